@@ -0,0 +1,281 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_byte.h"
+#include "rans64.h"
+#include "rans32.h"
+#include "rans_interleave.h"
+#include "rans_word_sse41.h"
+#include "rans_stats.h"
+#include "rans_corpus.h"
+
+// Sample program for rans32.h: compares it against rans_byte and rans64 on
+// book1 and on synthetic data across the entropy range, and checks that
+// its 8-way streams at scale_bits=12 are the same as the SSE 4.1 word
+// coder's.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+static bool check(uint8_t const* in_bytes, uint8_t const* dec_bytes, size_t size)
+{
+    if (memcmp(in_bytes, dec_bytes, size) == 0)
+        return true;
+
+    printf("ERROR: bad decoder!\n");
+    return false;
+}
+
+// ---- N-way interleaved encode/decode timings
+
+// Best-of-5 encode and decode (plain and fused tables) for one coder, plus
+// a checked decode of the same stream.
+template<int N, typename Coder>
+static bool time_coder(char const* name, uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, SymbolStats const& stats, uint32_t scale_bits)
+{
+    typedef typename Coder::Word Word;
+
+    typename Coder::EncSymbol esyms[256];
+    typename Coder::DecSymbol dsyms[256];
+    typename Coder::DecSlot* slots = new typename Coder::DecSlot[1 << scale_bits];
+    uint8_t* cum2sym = new uint8_t[1 << scale_bits];
+    for (int s=0; s < 256; s++) {
+        Coder::EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], scale_bits);
+        Coder::DecSymbolInit(&dsyms[s], stats.cum_freqs[s], stats.freqs[s]);
+        Coder::DecSlotsInitSymbol(slots, cum2sym, (uint8_t) s, stats.cum_freqs[s], stats.freqs[s]);
+    }
+
+    size_t out_max_words = (in_size * 2) / sizeof(Word) + 64;
+    Word* out_buf = new Word[out_max_words + 8]; // extra words at end (rans32 decoder reads past it)
+    Word* out_end = out_buf + out_max_words;
+    Word* rans_begin = out_end;
+
+    uint64_t enc_clocks = ~0ull, dec_clocks = ~0ull, slot_clocks = ~0ull;
+    bool ok = true;
+    for (int run=0; run < 5; run++) {
+        uint64_t start = __rdtsc();
+        rans_begin = RansInterleavedEncode<N, Coder>(out_end, in_bytes, in_size, esyms, scale_bits);
+        uint64_t clocks = __rdtsc() - start;
+        if (clocks < enc_clocks)
+            enc_clocks = clocks;
+
+        memset(dec_bytes, 0xcc, in_size);
+        start = __rdtsc();
+        RansInterleavedDecode<N, Coder>(dec_bytes, in_size, rans_begin, dsyms, cum2sym, scale_bits);
+        clocks = __rdtsc() - start;
+        if (clocks < dec_clocks)
+            dec_clocks = clocks;
+        ok = ok && check(in_bytes, dec_bytes, in_size);
+
+        memset(dec_bytes, 0xcc, in_size);
+        start = __rdtsc();
+        RansInterleavedDecodeSlots<N, Coder>(dec_bytes, in_size, rans_begin, slots, cum2sym, scale_bits);
+        clocks = __rdtsc() - start;
+        if (clocks < slot_clocks)
+            slot_clocks = clocks;
+        ok = ok && check(in_bytes, dec_bytes, in_size);
+    }
+
+    memset(dec_bytes, 0xcc, in_size);
+    if (RansInterleavedDecodeChecked<N, Coder>(dec_bytes, in_size, rans_begin, out_end, dsyms, cum2sym, scale_bits) != out_end)
+        ok = false;
+    ok = ok && check(in_bytes, dec_bytes, in_size);
+
+    printf("  %-10s %8d bytes  enc %5.2f  dec %5.2f  fused %5.2f clocks/symbol\n", name,
+        (int) ((out_end - rans_begin) * sizeof(Word)), 1.0 * enc_clocks / in_size, 1.0 * dec_clocks / in_size, 1.0 * slot_clocks / in_size);
+
+    delete[] out_buf;
+    delete[] slots;
+    delete[] cum2sym;
+    return ok;
+}
+
+static bool time_all(char const* name, uint8_t const* in_bytes, size_t in_size, uint32_t scale_bits)
+{
+    printf("\n%s: %d bytes, order-0 entropy %.3f bits/symbol, 4-way, scale_bits=%d\n", name, (int) in_size,
+        RansCorpusOrder0Entropy(in_bytes, in_size), (int) scale_bits);
+
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(1 << scale_bits);
+
+    uint8_t* dec_bytes = new uint8_t[in_size];
+    bool ok = true;
+    ok = time_coder<4, RansByteCoder>("rans_byte", in_bytes, in_size, dec_bytes, stats, scale_bits) && ok;
+    ok = time_coder<4, Rans64Coder>("rans64", in_bytes, in_size, dec_bytes, stats, scale_bits) && ok;
+    ok = time_coder<4, Rans32Coder>("rans32", in_bytes, in_size, dec_bytes, stats, scale_bits) && ok;
+    delete[] dec_bytes;
+    return ok;
+}
+
+// ---- Compatibility with the SSE 4.1 word coder
+
+// Encodes with 8-way rans32 and with the SIMD encoder (same layout as
+// main_simd.cpp), checks that both give the same stream, and decodes it
+// with the other side's decoder.
+static bool test_word_compat(uint8_t const* in_bytes, size_t in_size)
+{
+    printf("\nrans32 vs. SSE 4.1 word coder, 8-way, scale_bits=%d:\n", RANS_WORD_SCALE_BITS);
+
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(RANS_WORD_M);
+
+    RansWordTables tab;
+    RansWordEncSymbol word_esyms[256];
+    Rans32EncSymbol esyms[256];
+    Rans32DecSymbol dsyms[256];
+    uint8_t cum2sym[RANS_WORD_M];
+    for (int s=0; s < 256; s++) {
+        RansWordTablesInitSymbol(&tab, (uint8_t)s, stats.cum_freqs[s], stats.freqs[s]);
+        RansWordEncSymbolInit(&word_esyms[s], stats.cum_freqs[s], stats.freqs[s]);
+        Rans32EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], RANS_WORD_SCALE_BITS);
+        Rans32DecSymbolInit(&dsyms[s], stats.cum_freqs[s], stats.freqs[s]);
+        for (uint32_t i=stats.cum_freqs[s]; i < stats.cum_freqs[s+1]; i++)
+            cum2sym[i] = (uint8_t) s;
+    }
+
+    size_t out_max_words = in_size + 64;
+    uint16_t* out32 = new uint16_t[out_max_words + 8]; // extra words at end (decoders read past it)
+    uint16_t* out_simd = new uint16_t[out_max_words + 8];
+    uint8_t* dec_bytes = new uint8_t[in_size + 8];
+
+    // rans32
+    uint16_t* begin32 = RansInterleavedEncode<8, Rans32Coder>(out32 + out_max_words, in_bytes, in_size, esyms, RANS_WORD_SCALE_BITS);
+    size_t size32 = out32 + out_max_words - begin32;
+
+    // SIMD
+    RansSimdEnc enc0, enc1;
+    RansSimdEncInit(&enc0);
+    RansSimdEncInit(&enc1);
+
+    uint16_t* ptr = out_simd + out_max_words; // *end* of output buffer
+    for (size_t i=in_size; i > (in_size & ~7); i--) { // NB: working in reverse
+        RansSimdEnc* which = ((i - 1) & 4) != 0 ? &enc1 : &enc0;
+        int s = in_bytes[i - 1];
+        RansWordEncPut(&which->lane[(i - 1) & 3], &ptr, stats.cum_freqs[s], stats.freqs[s]);
+    }
+    for (size_t i=(in_size & ~7); i > 0; i -= 8) { // NB: working in reverse!
+        RansSimdEncPut(&enc1, &ptr, word_esyms, *(uint32_t *)(in_bytes + i - 4));
+        RansSimdEncPut(&enc0, &ptr, word_esyms, *(uint32_t *)(in_bytes + i - 8));
+    }
+    RansSimdEncFlush(&enc1, &ptr);
+    RansSimdEncFlush(&enc0, &ptr);
+    uint16_t* begin_simd = ptr;
+    size_t size_simd = out_simd + out_max_words - begin_simd;
+
+    bool ok = true;
+    printf("rans32: %d bytes, SIMD: %d bytes\n", (int) (size32 * 2), (int) (size_simd * 2));
+    if (size32 == size_simd && memcmp(begin32, begin_simd, size32 * 2) == 0)
+        printf("streams match!\n");
+    else {
+        printf("ERROR: streams differ!\n");
+        ok = false;
+    }
+
+    // SIMD decoder on the rans32 stream
+    memset(dec_bytes, 0xcc, in_size);
+    RansSimdDec dec0, dec1;
+    ptr = begin32;
+    RansSimdDecInit(&dec0, &ptr);
+    RansSimdDecInit(&dec1, &ptr);
+    for (size_t i=0; i < (in_size & ~7); i += 8) {
+        uint32_t s03 = RansSimdDecSym(&dec0, &tab);
+        uint32_t s47 = RansSimdDecSym(&dec1, &tab);
+        *(uint32_t *)(dec_bytes + i) = s03;
+        *(uint32_t *)(dec_bytes + i + 4) = s47;
+        RansSimdDecRenorm(&dec0, &ptr);
+        RansSimdDecRenorm(&dec1, &ptr);
+    }
+    for (size_t i=(in_size & ~7); i < in_size; i++) {
+        RansSimdDec* which = (i & 4) != 0 ? &dec1 : &dec0;
+        dec_bytes[i] = RansWordDecSym(&which->lane[i & 3], &tab);
+    }
+    ok = check(in_bytes, dec_bytes, in_size) && ok;
+
+    // rans32 decoder on the SIMD stream
+    memset(dec_bytes, 0xcc, in_size);
+    RansInterleavedDecode<8, Rans32Coder>(dec_bytes, in_size, begin_simd, dsyms, cum2sym, RANS_WORD_SCALE_BITS);
+    ok = check(in_bytes, dec_bytes, in_size) && ok;
+
+    // checked decode of a truncated stream has to fail
+    if (RansInterleavedDecodeChecked<8, Rans32Coder>(dec_bytes, in_size, begin32, begin32 + size32 - 1, dsyms, cum2sym, RANS_WORD_SCALE_BITS) != 0) {
+        printf("ERROR: truncated stream decoded!\n");
+        ok = false;
+    }
+
+    delete[] out32;
+    delete[] out_simd;
+    delete[] dec_bytes;
+    return ok;
+}
+
+int main()
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file("book1", &in_size);
+
+    bool ok = true;
+    ok = test_word_compat(in_bytes, in_size) && ok;
+    ok = time_all("book1", in_bytes, in_size, 12) && ok;
+    ok = time_all("book1", in_bytes, in_size, 14) && ok;
+    delete[] in_bytes;
+
+    // synthetic data across the entropy range; the middle is where the
+    // branchless renormalization should make the most difference.
+    static const double entropies[] = { 1.0, 2.0, 4.0, 6.0, 7.5 };
+
+    size_t size = 1 << 20;
+    uint8_t* data = new uint8_t[size];
+    for (size_t i=0; i < sizeof(entropies) / sizeof(*entropies); i++) {
+        double param = RansCorpusSolve(RANS_CORPUS_GEOMETRIC, entropies[i]);
+        RansCorpusGenerate(data, size, RANS_CORPUS_GEOMETRIC, param, 1234);
+
+        char name[64];
+        sprintf(name, "geometric:%g", param);
+        ok = time_all(name, data, size, 12) && ok;
+    }
+    delete[] data;
+
+    if (ok)
+        printf("\ndecode ok!\n");
+    else
+        printf("\nERROR: bad decoder!\n");
+    return 0;
+}
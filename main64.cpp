@@ -7,6 +7,9 @@
 #include <assert.h>
 
 #include "rans64.h"
+#include "rans_interleave.h"
+#include "rans_container.h"
+#include "rans_stats.h"
 
 // This is just the sample program. All the meat is in rans_byte.h.
 
@@ -44,88 +47,145 @@ static uint8_t* read_file(char const* filename, size_t* out_size)
     return buf;
 }
 
-// ---- Stats
+// ---- N-way interleaved rANS encode/decode via rans_interleave.h
 
-struct SymbolStats
+template<int N, typename Coder>
+static void test_interleaved(uint8_t const* in_bytes, size_t in_size, typename Coder::Word* out_end, uint8_t* dec_bytes,
+    typename Coder::EncSymbol const* esyms, typename Coder::DecSymbol const* dsyms, uint8_t const* cum2sym, uint32_t prob_bits)
 {
-    uint32_t freqs[256];
-    uint32_t cum_freqs[257];
+    typedef typename Coder::Word Word;
+    Word* rans_begin = out_end;
 
-    void count_freqs(uint8_t const* in, size_t nbytes);
-    void calc_cum_freqs();
-    void normalize_freqs(uint32_t target_total);
-};
+    memset(dec_bytes, 0xcc, in_size);
 
-void SymbolStats::count_freqs(uint8_t const* in, size_t nbytes)
-{
-    for (int i=0; i < 256; i++)
-        freqs[i] = 0;
+    printf("\n%d-way interleaved rANS encode:\n", N);
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t enc_start_time = __rdtsc();
 
-    for (size_t i=0; i < nbytes; i++)
-        freqs[in[i]]++;
-}
+        rans_begin = RansInterleavedEncode<N, Coder>(out_end, in_bytes, in_size, esyms, prob_bits);
 
-void SymbolStats::calc_cum_freqs()
-{
-    cum_freqs[0] = 0;
-    for (int i=0; i < 256; i++)
-        cum_freqs[i+1] = cum_freqs[i] + freqs[i];
+        uint64_t enc_clocks = __rdtsc() - enc_start_time;
+        double enc_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", enc_clocks, 1.0 * enc_clocks / in_size, 1.0 * in_size / (enc_time * 1048576.0));
+    }
+    printf("%d-way interleaved rANS: %d bytes\n", N, (int) ((out_end - rans_begin) * sizeof(Word)));
+
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t dec_start_time = __rdtsc();
+
+        RansInterleavedDecode<N, Coder>(dec_bytes, in_size, rans_begin, dsyms, cum2sym, prob_bits);
+
+        uint64_t dec_clocks = __rdtsc() - dec_start_time;
+        double dec_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", dec_clocks, 1.0 * dec_clocks / in_size, 1.0 * in_size / (dec_time * 1048576.0));
+    }
+
+    // check decode results
+    if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
 }
 
-void SymbolStats::normalize_freqs(uint32_t target_total)
+// ---- Fused decoder tables
+
+// Compares the regular decoder tables (cum2sym + DecSymbol) against fused
+// slots (see rans_byte.h) at the given scale_bits. The fused table is 4
+// bytes per slot, so this mostly pays off while it fits in L1.
+template<int N, typename Coder>
+static void test_slots(uint8_t const* in_bytes, size_t in_size, typename Coder::Word* out_end, uint8_t* dec_bytes, uint32_t scale_bits)
 {
-    assert(target_total >= 256);
-    
-    calc_cum_freqs();
-    uint32_t cur_total = cum_freqs[256];
-    
-    // resample distribution based on cumulative freqs
-    for (int i = 1; i <= 256; i++)
-        cum_freqs[i] = ((uint64_t)target_total * cum_freqs[i])/cur_total;
-
-    // if we nuked any non-0 frequency symbol to 0, we need to steal
-    // the range to make the frequency nonzero from elsewhere.
-    //
-    // this is not at all optimal, i'm just doing the first thing that comes to mind.
-    for (int i=0; i < 256; i++) {
-        if (freqs[i] && cum_freqs[i+1] == cum_freqs[i]) {
-            // symbol i was set to zero freq
-
-            // find best symbol to steal frequency from (try to steal from low-freq ones)
-            uint32_t best_freq = ~0u;
-            int best_steal = -1;
-            for (int j=0; j < 256; j++) {
-                uint32_t freq = cum_freqs[j+1] - cum_freqs[j];
-                if (freq > 1 && freq < best_freq) {
-                    best_freq = freq;
-                    best_steal = j;
-                }
-            }
-            assert(best_steal != -1);
-
-            // and steal from it!
-            if (best_steal < i) {
-                for (int j = best_steal + 1; j <= i; j++)
-                    cum_freqs[j]--;
-            } else {
-                assert(best_steal > i);
-                for (int j = i + 1; j <= best_steal; j++)
-                    cum_freqs[j]++;
-            }
+    typedef typename Coder::Word Word;
+
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(1 << scale_bits);
+
+    typename Coder::EncSymbol esyms[256];
+    typename Coder::DecSymbol dsyms[256];
+    typename Coder::DecSlot* slots = new typename Coder::DecSlot[1 << scale_bits];
+    uint8_t* cum2sym = new uint8_t[1 << scale_bits];
+    for (int s=0; s < 256; s++) {
+        Coder::EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], scale_bits);
+        Coder::DecSymbolInit(&dsyms[s], stats.cum_freqs[s], stats.freqs[s]);
+        Coder::DecSlotsInitSymbol(slots, cum2sym, (uint8_t) s, stats.cum_freqs[s], stats.freqs[s]);
+    }
+
+    Word* rans_begin = RansInterleavedEncode<N, Coder>(out_end, in_bytes, in_size, esyms, scale_bits);
+
+    printf("\n%d-way interleaved decode, scale_bits=%d:\n", N, (int) scale_bits);
+    bool ok = true;
+    for (int fused=0; fused < 2; fused++) {
+        uint64_t best_clocks = ~0ull;
+        memset(dec_bytes, 0xcc, in_size);
+        for (int run=0; run < 5; run++) {
+            uint64_t dec_start_time = __rdtsc();
+
+            if (fused)
+                RansInterleavedDecodeSlots<N, Coder>(dec_bytes, in_size, rans_begin, slots, cum2sym, scale_bits);
+            else
+                RansInterleavedDecode<N, Coder>(dec_bytes, in_size, rans_begin, dsyms, cum2sym, scale_bits);
+
+            uint64_t dec_clocks = __rdtsc() - dec_start_time;
+            if (dec_clocks < best_clocks)
+                best_clocks = dec_clocks;
         }
+        printf("%s: %.1f clocks/symbol (best of 5)\n", fused ? "fused slots     " : "cum2sym + dsyms ", 1.0 * best_clocks / in_size);
+        if (memcmp(in_bytes, dec_bytes, in_size) != 0)
+            ok = false;
     }
 
-    // calculate updated freqs and make sure we didn't screw anything up
-    assert(cum_freqs[0] == 0 && cum_freqs[256] == target_total);
-    for (int i=0; i < 256; i++) {
-        if (freqs[i] == 0)
-            assert(cum_freqs[i+1] == cum_freqs[i]);
-        else
-            assert(cum_freqs[i+1] > cum_freqs[i]);
+    if (ok)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+
+    delete[] slots;
+    delete[] cum2sym;
+}
 
-        // calc updated freq
-        freqs[i] = cum_freqs[i+1] - cum_freqs[i];
+// ---- Decoding from a self-contained container
+
+// Decodes a container written by main() using nothing but its bytes.
+static bool decode_container(uint8_t const* in, size_t in_size, uint8_t* out, size_t out_size)
+{
+    RansContainerHeader hdr;
+    uint8_t const* payload;
+    size_t payload_size;
+    if (RansContainerParse(in, in_size, &hdr, &payload, &payload_size) != RANS_CONTAINER_OK)
+        return false;
+    if (hdr.variant != RANS_VARIANT_64 || hdr.num_symbols != out_size)
+        return false;
+
+    // rebuild the decoder tables from the stored frequencies
+    uint32_t scale_bits = hdr.scale_bits;
+    uint32_t cum_freq = 0;
+    Rans64DecSymbol dsyms[256];
+    uint8_t* cum2sym = new uint8_t[1 << scale_bits];
+    for (int s=0; s < 256; s++) {
+        Rans64DecSymbolInit(&dsyms[s], cum_freq, hdr.freqs[s]);
+        for (uint32_t i=0; i < hdr.freqs[s]; i++)
+            cum2sym[cum_freq + i] = (uint8_t) s;
+        cum_freq += hdr.freqs[s];
     }
+
+    // payload comes straight from the caller's buffer, so decode it with
+    // the checked decoder.
+    uint32_t* ptr = (uint32_t*) payload;
+    uint32_t const* end = (uint32_t const*) (payload + payload_size);
+    bool ok;
+    switch (hdr.interleave) {
+    case 1: ok = RansInterleavedDecodeChecked<1, Rans64Coder>(out, out_size, ptr, end, dsyms, cum2sym, scale_bits) != 0; break;
+    case 2: ok = RansInterleavedDecodeChecked<2, Rans64Coder>(out, out_size, ptr, end, dsyms, cum2sym, scale_bits) != 0; break;
+    case 4: ok = RansInterleavedDecodeChecked<4, Rans64Coder>(out, out_size, ptr, end, dsyms, cum2sym, scale_bits) != 0; break;
+    case 8: ok = RansInterleavedDecodeChecked<8, Rans64Coder>(out, out_size, ptr, end, dsyms, cum2sym, scale_bits) != 0; break;
+    default: ok = false; break;
+    }
+
+    delete[] cum2sym;
+    return ok;
 }
 
 int main()
@@ -292,6 +352,44 @@ int main()
     else
         printf("ERROR: bad decoder!\n");
 
+    // ---- wider interleaving, using the generic driver
+
+    test_interleaved<1, Rans64Coder>(in_bytes, in_size, out_end, dec_bytes, esyms, dsyms, cum2sym, prob_bits);
+    test_interleaved<2, Rans64Coder>(in_bytes, in_size, out_end, dec_bytes, esyms, dsyms, cum2sym, prob_bits);
+    test_interleaved<4, Rans64Coder>(in_bytes, in_size, out_end, dec_bytes, esyms, dsyms, cum2sym, prob_bits);
+    test_interleaved<8, Rans64Coder>(in_bytes, in_size, out_end, dec_bytes, esyms, dsyms, cum2sym, prob_bits);
+    test_interleaved<16, Rans64Coder>(in_bytes, in_size, out_end, dec_bytes, esyms, dsyms, cum2sym, prob_bits);
+
+    // ---- fused decoder tables, small and large
+    test_slots<2, Rans64Coder>(in_bytes, in_size, out_end, dec_bytes, 12);
+    test_slots<2, Rans64Coder>(in_bytes, in_size, out_end, dec_bytes, prob_bits);
+
+    // ---- self-contained stream: container header + 4-way interleaved rANS.
+    // The decoder only gets to see the container bytes.
+
+    memset(dec_bytes, 0xcc, in_size);
+    {
+        RansContainerHeader hdr;
+        hdr.variant = RANS_VARIANT_64;
+        hdr.scale_bits = prob_bits;
+        hdr.interleave = 4;
+        hdr.num_symbols = in_size;
+        for (int s=0; s < 256; s++)
+            hdr.freqs[s] = stats.freqs[s];
+
+        // rANS output goes at the end of the buffer, so the header just goes in front of it.
+        uint32_t* payload = RansInterleavedEncode<4, Rans64Coder>(out_end, in_bytes, in_size, esyms, prob_bits);
+        uint8_t* container = (uint8_t*) payload - RansContainerHeaderSize(&hdr);
+        RansContainerWriteHeader(container, &hdr, (uint8_t*) out_end - (uint8_t*) payload);
+        size_t container_size = (uint8_t*) out_end - container;
+        printf("\ncontainer: %d bytes\n", (int) container_size);
+
+        if (decode_container(container, container_size, dec_bytes, in_size) && memcmp(in_bytes, dec_bytes, in_size) == 0)
+            printf("decode ok!\n");
+        else
+            printf("ERROR: bad decoder!\n");
+    }
+
     delete[] out_buf;
     delete[] dec_bytes;
     delete[] in_bytes;
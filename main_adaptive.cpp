@@ -0,0 +1,382 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_byte.h"
+#include "rans64.h"
+#include "rans_stats.h"
+#include "rans_interleave.h"
+#include "rans_adaptive.h"
+
+// Sample program for the adaptive model in rans_adaptive.h.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+static void print_clocks(uint64_t clocks, double time, size_t in_size)
+{
+    printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", clocks, 1.0 * clocks / in_size, 1.0 * in_size / (time * 1048576.0));
+}
+
+static void check(uint8_t const* in_bytes, uint8_t const* dec_bytes, size_t in_size)
+{
+    if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+}
+
+// Runs the adaptive model over the input, recording (start, freq) for
+// every symbol so the encoder can go backwards.
+static void model_symbols(uint32_t* syms, uint8_t const* in_bytes, size_t in_size, uint32_t scale_bits)
+{
+    RansAdaptiveModel model;
+    RansAdaptiveInit(&model, scale_bits);
+    for (size_t i=0; i < in_size; i++) {
+        uint32_t s = in_bytes[i];
+        syms[i] = model.cum[s] | (model.cum[s + 1] << 16);
+        RansAdaptiveUpdate(&model, s);
+    }
+}
+
+// Encodes and decodes with the adaptive model at "scale_bits" (rans_byte),
+// to check the ends of the supported range.
+static void test_scale(uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, uint8_t* out_buf, size_t out_max_size, uint32_t scale_bits)
+{
+    uint32_t* starts = new uint32_t[in_size];
+    uint32_t* freqs = new uint32_t[in_size];
+
+    RansAdaptiveModel model;
+    RansAdaptiveInit(&model, scale_bits);
+    for (size_t i=0; i < in_size; i++) {
+        uint32_t s = in_bytes[i];
+        starts[i] = model.cum[s];
+        freqs[i] = model.cum[s + 1] - model.cum[s];
+        RansAdaptiveUpdate(&model, s);
+    }
+
+    RansState rans;
+    RansEncInit(&rans);
+    uint8_t* ptr = out_buf + out_max_size; // *end* of output buffer
+    for (size_t i=in_size; i > 0; i--) // NB: working in reverse!
+        RansEncPut(&rans, &ptr, starts[i-1], freqs[i-1], scale_bits);
+    RansEncFlush(&rans, &ptr);
+    printf("scale_bits=%d: %d bytes\n", (int) scale_bits, (int) (out_buf + out_max_size - ptr));
+
+    RansAdaptiveInit(&model, scale_bits);
+    RansDecInit(&rans, &ptr);
+    memset(dec_bytes, 0xcc, in_size);
+    for (size_t i=0; i < in_size; i++) {
+        uint32_t s = RansAdaptiveFind(&model, RansDecGet(&rans, scale_bits));
+        dec_bytes[i] = (uint8_t) s;
+        RansDecAdvance(&rans, &ptr, model.cum[s], model.cum[s+1] - model.cum[s], scale_bits);
+        RansAdaptiveUpdate(&model, s);
+    }
+    check(in_bytes, dec_bytes, in_size);
+
+    delete[] starts;
+    delete[] freqs;
+}
+
+int main(int argc, char** argv)
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file(argc > 1 ? argv[1] : "book1", &in_size);
+
+    static const uint32_t static_bits = 14;
+    static const uint32_t adaptive_bits = 15;
+
+    size_t out_max_size = 32<<20; // 32MB
+    uint8_t* out_buf = new uint8_t[out_max_size];
+    uint8_t* dec_bytes = new uint8_t[in_size];
+    uint32_t* syms = new uint32_t[in_size];
+
+    // ---- static order-0 model for comparison, same as main.cpp
+
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(1 << static_bits);
+
+    uint8_t* cum2sym = new uint8_t[1 << static_bits];
+    RansEncSymbol esyms[256];
+    RansDecSymbol dsyms[256];
+    for (int s=0; s < 256; s++) {
+        for (uint32_t i=stats.cum_freqs[s]; i < stats.cum_freqs[s+1]; i++)
+            cum2sym[i] = (uint8_t) s;
+        RansEncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], static_bits);
+        RansDecSymbolInit(&dsyms[s], stats.cum_freqs[s], stats.freqs[s]);
+    }
+
+    uint8_t* rans_begin;
+    {
+        RansState rans;
+        RansEncInit(&rans);
+
+        uint8_t* ptr = out_buf + out_max_size; // *end* of output buffer
+        for (size_t i=in_size; i > 0; i--) // NB: working in reverse!
+            RansEncPutSymbol(&rans, &ptr, &esyms[in_bytes[i-1]]);
+        RansEncFlush(&rans, &ptr);
+        rans_begin = ptr;
+    }
+    printf("static rANS: %d bytes (plus tables)\n", (int) (out_buf + out_max_size - rans_begin));
+
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t dec_start_time = __rdtsc();
+
+        RansState rans;
+        uint8_t* ptr = rans_begin;
+        RansDecInit(&rans, &ptr);
+
+        for (size_t i=0; i < in_size; i++) {
+            uint32_t s = cum2sym[RansDecGet(&rans, static_bits)];
+            dec_bytes[i] = (uint8_t) s;
+            RansDecAdvanceSymbol(&rans, &ptr, &dsyms[s], static_bits);
+        }
+
+        print_clocks(__rdtsc() - dec_start_time, timer() - start_time, in_size);
+    }
+    check(in_bytes, dec_bytes, in_size);
+
+    // ---- adaptive model with rans_byte
+
+    printf("\nadaptive rANS encode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t enc_start_time = __rdtsc();
+
+        model_symbols(syms, in_bytes, in_size, adaptive_bits);
+
+        RansState rans;
+        RansEncInit(&rans);
+
+        uint8_t* ptr = out_buf + out_max_size; // *end* of output buffer
+        for (size_t i=in_size; i > 0; i--) { // NB: working in reverse!
+            uint32_t start = syms[i-1] & 0xffff;
+            uint32_t end = syms[i-1] >> 16;
+            RansEncPut(&rans, &ptr, start, end - start, adaptive_bits);
+        }
+        RansEncFlush(&rans, &ptr);
+        rans_begin = ptr;
+
+        print_clocks(__rdtsc() - enc_start_time, timer() - start_time, in_size);
+    }
+    printf("adaptive rANS: %d bytes\n", (int) (out_buf + out_max_size - rans_begin));
+
+    memset(dec_bytes, 0xcc, in_size);
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t dec_start_time = __rdtsc();
+
+        RansAdaptiveModel model;
+        RansAdaptiveInit(&model, adaptive_bits);
+
+        RansState rans;
+        uint8_t* ptr = rans_begin;
+        RansDecInit(&rans, &ptr);
+
+        for (size_t i=0; i < in_size; i++) {
+            uint32_t s = RansAdaptiveFind(&model, RansDecGet(&rans, adaptive_bits));
+            dec_bytes[i] = (uint8_t) s;
+            RansDecAdvance(&rans, &ptr, model.cum[s], model.cum[s+1] - model.cum[s], adaptive_bits);
+            RansAdaptiveUpdate(&model, s);
+        }
+
+        print_clocks(__rdtsc() - dec_start_time, timer() - start_time, in_size);
+    }
+    check(in_bytes, dec_bytes, in_size);
+
+    // ---- 2-way interleaved, static and adaptive. The adaptive coding table
+    // only changes on rebuilds, so the two states' searches are independent
+    // and can overlap just like the static table lookups.
+
+    printf("\n2-way interleaved static rANS:\n");
+    {
+        uint8_t* ptr = RansInterleavedEncode<2, RansByteCoder>(out_buf + out_max_size, in_bytes, in_size, esyms, static_bits);
+        memset(dec_bytes, 0xcc, in_size);
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t dec_start_time = __rdtsc();
+
+            RansInterleavedDecode<2, RansByteCoder>(dec_bytes, in_size, ptr, dsyms, cum2sym, static_bits);
+
+            print_clocks(__rdtsc() - dec_start_time, timer() - start_time, in_size);
+        }
+        check(in_bytes, dec_bytes, in_size);
+    }
+
+    printf("\n2-way interleaved adaptive rANS encode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t enc_start_time = __rdtsc();
+
+        model_symbols(syms, in_bytes, in_size, adaptive_bits);
+
+        RansState rans0, rans1;
+        RansEncInit(&rans0);
+        RansEncInit(&rans1);
+
+        uint8_t* ptr = out_buf + out_max_size; // *end* of output buffer
+
+        // odd number of bytes?
+        if (in_size & 1) {
+            uint32_t start = syms[in_size-1] & 0xffff;
+            uint32_t end = syms[in_size-1] >> 16;
+            RansEncPut(&rans0, &ptr, start, end - start, adaptive_bits);
+        }
+
+        for (size_t i=(in_size & ~1); i > 0; i -= 2) { // NB: working in reverse!
+            uint32_t start1 = syms[i-1] & 0xffff, end1 = syms[i-1] >> 16;
+            uint32_t start0 = syms[i-2] & 0xffff, end0 = syms[i-2] >> 16;
+            RansEncPut(&rans1, &ptr, start1, end1 - start1, adaptive_bits);
+            RansEncPut(&rans0, &ptr, start0, end0 - start0, adaptive_bits);
+        }
+        RansEncFlush(&rans1, &ptr);
+        RansEncFlush(&rans0, &ptr);
+        rans_begin = ptr;
+
+        print_clocks(__rdtsc() - enc_start_time, timer() - start_time, in_size);
+    }
+    printf("2-way interleaved adaptive rANS: %d bytes\n", (int) (out_buf + out_max_size - rans_begin));
+
+    memset(dec_bytes, 0xcc, in_size);
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t dec_start_time = __rdtsc();
+
+        RansAdaptiveModel model;
+        RansAdaptiveInit(&model, adaptive_bits);
+
+        RansState rans0, rans1;
+        uint8_t* ptr = rans_begin;
+        RansDecInit(&rans0, &ptr);
+        RansDecInit(&rans1, &ptr);
+
+        for (size_t i=0; i < (in_size & ~1); i += 2) {
+            uint32_t s0 = RansAdaptiveFind(&model, RansDecGet(&rans0, adaptive_bits));
+            uint32_t s1 = RansAdaptiveFind(&model, RansDecGet(&rans1, adaptive_bits));
+            dec_bytes[i+0] = (uint8_t) s0;
+            dec_bytes[i+1] = (uint8_t) s1;
+            RansDecAdvanceStep(&rans0, model.cum[s0], model.cum[s0+1] - model.cum[s0], adaptive_bits);
+            RansDecAdvanceStep(&rans1, model.cum[s1], model.cum[s1+1] - model.cum[s1], adaptive_bits);
+            RansDecRenorm(&rans0, &ptr);
+            RansDecRenorm(&rans1, &ptr);
+
+            // the table for s1 has to be the one before the update for s0;
+            // that's a given since only rebuilds change it, and a rebuild
+            // can't happen in the middle of a pair if the period is even.
+            RansAdaptiveUpdate(&model, s0);
+            RansAdaptiveUpdate(&model, s1);
+        }
+
+        // last byte, if number of bytes was odd
+        if (in_size & 1) {
+            uint32_t s0 = RansAdaptiveFind(&model, RansDecGet(&rans0, adaptive_bits));
+            dec_bytes[in_size - 1] = (uint8_t) s0;
+            RansDecAdvance(&rans0, &ptr, model.cum[s0], model.cum[s0+1] - model.cum[s0], adaptive_bits);
+        }
+
+        print_clocks(__rdtsc() - dec_start_time, timer() - start_time, in_size);
+    }
+    check(in_bytes, dec_bytes, in_size);
+
+    // ---- adaptive model with rans64
+
+    uint32_t* out_words = (uint32_t*) out_buf;
+    size_t out_max_words = out_max_size / sizeof(uint32_t);
+    uint32_t* rans64_begin;
+
+    printf("\nadaptive rANS64 encode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t enc_start_time = __rdtsc();
+
+        model_symbols(syms, in_bytes, in_size, adaptive_bits);
+
+        Rans64State rans;
+        Rans64EncInit(&rans);
+
+        uint32_t* ptr = out_words + out_max_words; // *end* of output buffer
+        for (size_t i=in_size; i > 0; i--) { // NB: working in reverse!
+            uint32_t start = syms[i-1] & 0xffff;
+            uint32_t end = syms[i-1] >> 16;
+            Rans64EncPut(&rans, &ptr, start, end - start, adaptive_bits);
+        }
+        Rans64EncFlush(&rans, &ptr);
+        rans64_begin = ptr;
+
+        print_clocks(__rdtsc() - enc_start_time, timer() - start_time, in_size);
+    }
+    printf("adaptive rANS64: %d bytes\n", (int) ((out_words + out_max_words - rans64_begin) * sizeof(uint32_t)));
+
+    memset(dec_bytes, 0xcc, in_size);
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t dec_start_time = __rdtsc();
+
+        RansAdaptiveModel model;
+        RansAdaptiveInit(&model, adaptive_bits);
+
+        Rans64State rans;
+        uint32_t* ptr = rans64_begin;
+        Rans64DecInit(&rans, &ptr);
+
+        for (size_t i=0; i < in_size; i++) {
+            uint32_t s = RansAdaptiveFind(&model, Rans64DecGet(&rans, adaptive_bits));
+            dec_bytes[i] = (uint8_t) s;
+            Rans64DecAdvance(&rans, &ptr, model.cum[s], model.cum[s+1] - model.cum[s], adaptive_bits);
+            RansAdaptiveUpdate(&model, s);
+        }
+
+        print_clocks(__rdtsc() - dec_start_time, timer() - start_time, in_size);
+    }
+    check(in_bytes, dec_bytes, in_size);
+
+    // ---- smallest and largest supported scale_bits
+
+    printf("\nadaptive rANS at the ends of the scale_bits range:\n");
+    test_scale(in_bytes, in_size, dec_bytes, out_buf, out_max_size, RANS_ADAPTIVE_GUIDE_BITS);
+    test_scale(in_bytes, in_size, dec_bytes, out_buf, out_max_size, 16);
+
+    delete[] syms;
+    delete[] cum2sym;
+    delete[] out_buf;
+    delete[] dec_bytes;
+    delete[] in_bytes;
+    return 0;
+}
@@ -7,6 +7,8 @@
 #include <assert.h>
 
 #include "rans_byte.h"
+#include "rans_container.h"
+#include "rans_stats.h"
 
 static void panic(const char *fmt, ...)
 {
@@ -44,14 +46,12 @@ static uint8_t* read_file(char const* filename, size_t* out_size)
 
 // ---- Stats
 
-struct SymbolStats
+// Order-0 stats from rans_stats.h plus the alias table.
+struct AliasStats : SymbolStats
 {
     static const int LOG2NSYMS = 8;
     static const int NSYMS = 1 << LOG2NSYMS;
 
-    uint32_t freqs[NSYMS];
-    uint32_t cum_freqs[NSYMS + 1];
-
     // alias table
     uint32_t divider[NSYMS];
     uint32_t slot_adjust[NSYMS*2];
@@ -61,90 +61,14 @@ struct SymbolStats
     // for encoder
     uint32_t* alias_remap;
 
-    SymbolStats() : alias_remap(0) {}
-    ~SymbolStats() { delete[] alias_remap; }
-
-    void count_freqs(uint8_t const* in, size_t nbytes);
-    void calc_cum_freqs();
-    void normalize_freqs(uint32_t target_total);
+    AliasStats() : alias_remap(0) {}
+    ~AliasStats() { delete[] alias_remap; }
 
     void make_alias_table();
 };
 
-void SymbolStats::count_freqs(uint8_t const* in, size_t nbytes)
-{
-    for (int i=0; i < NSYMS; i++)
-        freqs[i] = 0;
-
-    for (size_t i=0; i < nbytes; i++)
-        freqs[in[i]]++;
-}
-
-void SymbolStats::calc_cum_freqs()
-{
-    cum_freqs[0] = 0;
-    for (int i=0; i < NSYMS; i++)
-        cum_freqs[i+1] = cum_freqs[i] + freqs[i];
-}
-
-void SymbolStats::normalize_freqs(uint32_t target_total)
-{
-    assert(target_total >= NSYMS);
-    
-    calc_cum_freqs();
-    uint32_t cur_total = cum_freqs[NSYMS];
-    
-    // resample distribution based on cumulative freqs
-    for (int i = 1; i <= NSYMS; i++)
-        cum_freqs[i] = ((uint64_t)target_total * cum_freqs[i])/cur_total;
-
-    // if we nuked any non-0 frequency symbol to 0, we need to steal
-    // the range to make the frequency nonzero from elsewhere.
-    //
-    // this is not at all optimal, i'm just doing the first thing that comes to mind.
-    for (int i=0; i < NSYMS; i++) {
-        if (freqs[i] && cum_freqs[i+1] == cum_freqs[i]) {
-            // symbol i was set to zero freq
-
-            // find best symbol to steal frequency from (try to steal from low-freq ones)
-            uint32_t best_freq = ~0u;
-            int best_steal = -1;
-            for (int j=0; j < NSYMS; j++) {
-                uint32_t freq = cum_freqs[j+1] - cum_freqs[j];
-                if (freq > 1 && freq < best_freq) {
-                    best_freq = freq;
-                    best_steal = j;
-                }
-            }
-            assert(best_steal != -1);
-
-            // and steal from it!
-            if (best_steal < i) {
-                for (int j = best_steal + 1; j <= i; j++)
-                    cum_freqs[j]--;
-            } else {
-                assert(best_steal > i);
-                for (int j = i + 1; j <= best_steal; j++)
-                    cum_freqs[j]++;
-            }
-        }
-    }
-
-    // calculate updated freqs and make sure we didn't screw anything up
-    assert(cum_freqs[0] == 0 && cum_freqs[NSYMS] == target_total);
-    for (int i=0; i < NSYMS; i++) {
-        if (freqs[i] == 0)
-            assert(cum_freqs[i+1] == cum_freqs[i]);
-        else
-            assert(cum_freqs[i+1] > cum_freqs[i]);
-
-        // calc updated freq
-        freqs[i] = cum_freqs[i+1] - cum_freqs[i];
-    }
-}
-
 // Set up the alias table.
-void SymbolStats::make_alias_table()
+void AliasStats::make_alias_table()
 {
     // verify that our distribution sum divides the number of buckets
     uint32_t sum = cum_freqs[NSYMS];
@@ -238,7 +162,7 @@ void SymbolStats::make_alias_table()
 
 // ---- rANS encoding/decoding with alias table
 
-static inline void RansEncPutAlias(RansState* r, uint8_t** pptr, SymbolStats* const syms, int s, uint32_t scale_bits)
+static inline void RansEncPutAlias(RansState* r, uint8_t** pptr, AliasStats* const syms, int s, uint32_t scale_bits)
 {
     // renormalize
     uint32_t freq = syms->freqs[s];
@@ -249,14 +173,14 @@ static inline void RansEncPutAlias(RansState* r, uint8_t** pptr, SymbolStats* co
     *r = ((x / freq) << scale_bits) + syms->alias_remap[(x % freq) + syms->cum_freqs[s]];
 }
 
-static inline uint32_t RansDecGetAlias(RansState* r, SymbolStats* const syms, uint32_t scale_bits)
+static inline uint32_t RansDecGetAlias(RansState* r, AliasStats* const syms, uint32_t scale_bits)
 {
     RansState x = *r;
 
     // figure out symbol via alias table
     uint32_t mask = (1u << scale_bits) - 1; // constant for fixed scale_bits!
     uint32_t xm = x & mask;
-    uint32_t bucket_id = xm >> (scale_bits - SymbolStats::LOG2NSYMS);
+    uint32_t bucket_id = xm >> (scale_bits - AliasStats::LOG2NSYMS);
     uint32_t bucket2 = bucket_id * 2;
     if (xm < syms->divider[bucket_id]) 
         bucket2++;
@@ -266,6 +190,47 @@ static inline uint32_t RansDecGetAlias(RansState* r, SymbolStats* const syms, ui
     return syms->sym_id[bucket2];
 }
 
+// ---- Decoding from a self-contained container
+
+// Decodes a container written by main() using nothing but its bytes.
+static bool decode_container(uint8_t const* in, size_t in_size, uint8_t* out, size_t out_size)
+{
+    RansContainerHeader hdr;
+    uint8_t const* payload;
+    size_t payload_size;
+    if (RansContainerParse(in, in_size, &hdr, &payload, &payload_size) != RANS_CONTAINER_OK)
+        return false;
+    if (hdr.variant != RANS_VARIANT_ALIAS || hdr.interleave != 1 || hdr.num_symbols != out_size)
+        return false;
+    if (hdr.scale_bits < AliasStats::LOG2NSYMS)
+        return false;
+
+    // rebuild the alias tables from the stored frequencies
+    AliasStats stats;
+    for (int s=0; s < AliasStats::NSYMS; s++)
+        stats.freqs[s] = hdr.freqs[s];
+    stats.calc_cum_freqs();
+    stats.make_alias_table();
+
+    // checked decoding (see rans_byte.h): a renorm reads at most 2 bytes,
+    // so only the last few need to look at the end pointer.
+    RansState rans;
+    uint8_t* ptr = (uint8_t*) payload;
+    uint8_t const* end = payload + payload_size;
+    if (!RansDecInitChecked(&rans, &ptr, end))
+        return false;
+
+    for (size_t i=0; i < out_size; i++) {
+        out[i] = (uint8_t) RansDecGetAlias(&rans, &stats, hdr.scale_bits);
+        if (end - ptr >= 2)
+            RansDecRenorm(&rans, &ptr);
+        else if (!RansDecRenormChecked(&rans, &ptr, end))
+            return false;
+    }
+
+    return rans == RANS_BYTE_L;
+}
+
 // ----
 
 int main()
@@ -276,7 +241,7 @@ int main()
     static const uint32_t prob_bits = 16;
     static const uint32_t prob_scale = 1 << prob_bits;
 
-    SymbolStats stats;
+    AliasStats stats;
     stats.count_freqs(in_bytes, in_size);
     stats.normalize_freqs(prob_scale);
     stats.make_alias_table();
@@ -415,6 +380,42 @@ int main()
     else
         printf("ERROR: bad decoder!\n");
 
+    // ---- self-contained stream: container header + rANS with alias tables.
+    // The decoder only gets to see the container bytes.
+
+    memset(dec_bytes, 0xcc, in_size);
+    {
+        RansContainerHeader hdr;
+        hdr.variant = RANS_VARIANT_ALIAS;
+        hdr.scale_bits = prob_bits;
+        hdr.interleave = 1;
+        hdr.num_symbols = in_size;
+        for (int s=0; s < 256; s++)
+            hdr.freqs[s] = stats.freqs[s];
+
+        RansState rans;
+        RansEncInit(&rans);
+
+        uint8_t* end = out_buf + out_max_size;
+        uint8_t* ptr = end;
+        for (size_t i=in_size; i > 0; i--) { // NB: working in reverse!
+            int s = in_bytes[i-1];
+            RansEncPutAlias(&rans, &ptr, &stats, s, prob_bits);
+        }
+        RansEncFlush(&rans, &ptr);
+
+        // rANS output goes at the end of the buffer, so the header just goes in front of it.
+        uint8_t* container = ptr - RansContainerHeaderSize(&hdr);
+        RansContainerWriteHeader(container, &hdr, end - ptr);
+        size_t container_size = end - container;
+        printf("\ncontainer: %d bytes\n", (int) container_size);
+
+        if (decode_container(container, container_size, dec_bytes, in_size) && memcmp(in_bytes, dec_bytes, in_size) == 0)
+            printf("decode ok!\n");
+        else
+            printf("ERROR: bad decoder!\n");
+    }
+
     delete[] out_buf;
     delete[] dec_bytes;
     delete[] in_bytes;
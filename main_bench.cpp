@@ -0,0 +1,907 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "rans_byte.h"
+#include "rans64.h"
+#include "rans32.h"
+#include "rans_interleave.h"
+#include "rans_stats.h"
+#include "rans_alias.h"
+#include "rans_tans.h"
+#include "rans_word_sse41.h"
+#include "rans_dispatch.h"
+#include "rans_corpus.h"
+
+// Benchmark harness. Unlike the sample programs, which each time a couple
+// of hand-written loops on book1, this runs every coder variant over a
+// grid of interleave widths, scale_bits values, input files and sizes, and
+// reports robust statistics (median and best of several runs, after
+// warm-up) in a form that can be compared across machines and commits.
+//
+//   exam_bench [options] [files...]      (default file: book1, if no -g)
+//
+//   -r <runs>       timed runs per measurement (default 7)
+//   -w <runs>       untimed warm-up runs (default 1)
+//   -b <bits,...>   scale_bits values (default 11,12,14,16)
+//   -s <size,...>   input sizes; each file is cut to these (default: whole file)
+//   -m <substr>     only run coders whose name contains this
+//   -c <cpu>        pin to this CPU (default: whichever we start on; -1: don't)
+//   -f <format>     text, csv or json (default text)
+//   -o <file>       write results there instead of stdout
+//   -t <tag>        free-form label stored with the results (commit id, say)
+//   -g <spec,...>   add synthetic inputs (see rans_corpus.h):
+//                     <kind>:<param>  e.g. zipf:1.2, spike:0.999, uniform:16
+//                     <kind>@<bits>   the source with that entropy, e.g. geometric@2
+//                     sweep           geometric, zipf, spike and markov sources
+//                                     from 0.1 to 7.5 bits/symbol, plus
+//                                     spike:0.999 and uniform:256
+//   -n <size>       size of the synthetic inputs (default 1MB)
+//
+// Along with the compression ratio, results have the order-0 entropy of the
+// input (H0, what any order-0 coder is up against) and the overhead: bits
+// per symbol actually spent, minus H0. With more than one input, text
+// output ends with a summary per coder, sorted by entropy, for
+// throughput-vs-entropy curves. (For markov sources, "src H" is the
+// entropy rate, which is below what an order-0 coder can get.)
+//
+// Every coder is checked (decode must give back the input) before it's
+// timed; failures are reported and counted in the exit code.
+//
+// Cycle counts are rdtsc ticks, which on current CPUs run at a fixed
+// frequency that can differ from the actual core clock; the MiB/s figures
+// are wall-clock. Pinning keeps us on one core (and its caches); for
+// numbers that compare across runs, also turn off frequency scaling.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (size && fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+// ---- Coders
+
+// One coder configuration. The harness calls setup() once per input (not
+// timed), then encode() and decode() repeatedly. encode() writes the stream
+// backwards from "out_end" and keeps track of where it starts.
+struct BenchCoder {
+    std::string family;
+    char const* isa;        // instruction set the kernel needs ("" for baseline)
+    int ways;               // interleaved states
+    uint32_t scale_bits;
+    uint8_t* out_end;       // end of the output buffer (with padding behind it)
+
+    BenchCoder(char const* family, char const* isa, int ways, uint32_t scale_bits)
+        : family(family), isa(isa), ways(ways), scale_bits(scale_bits), out_end(0) {}
+    virtual ~BenchCoder() {}
+
+    // "stats" is normalized to 1 << scale_bits.
+    virtual void setup(SymbolStats const& stats) = 0;
+
+    // Returns the size of the encoded stream in bytes.
+    virtual size_t encode(uint8_t const* in, size_t in_size) = 0;
+    virtual void decode(uint8_t* out, size_t out_size) = 0;
+
+    std::string name() const
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s%s%s x%d @%d", family.c_str(), *isa ? "-" : "", isa, ways, (int) scale_bits);
+        return buf;
+    }
+};
+
+// rans_byte/rans64/rans32 through the interleave driver, with either the regular
+// or the fused decoder tables.
+template<int N, typename Coder>
+struct BenchInterleaved : BenchCoder {
+    typedef typename Coder::Word Word;
+
+    bool fused;
+    typename Coder::EncSymbol esyms[256];
+    typename Coder::DecSymbol dsyms[256];
+    std::vector<typename Coder::DecSlot> slots;
+    std::vector<uint8_t> cum2sym;
+    Word* begin;
+
+    BenchInterleaved(char const* family, uint32_t scale_bits, bool fused)
+        : BenchCoder(family, "", N, scale_bits), fused(fused), begin(0) {}
+
+    virtual void setup(SymbolStats const& stats)
+    {
+        cum2sym.resize(1u << scale_bits);
+        slots.resize(fused ? (1u << scale_bits) : 0);
+        for (int s=0; s < 256; s++) {
+            Coder::EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], scale_bits);
+            Coder::DecSymbolInit(&dsyms[s], stats.cum_freqs[s], stats.freqs[s]);
+            if (fused)
+                Coder::DecSlotsInitSymbol(&slots[0], &cum2sym[0], (uint8_t) s, stats.cum_freqs[s], stats.freqs[s]);
+            else {
+                for (uint32_t i=stats.cum_freqs[s]; i < stats.cum_freqs[s+1]; i++)
+                    cum2sym[i] = (uint8_t) s;
+            }
+        }
+    }
+
+    virtual size_t encode(uint8_t const* in, size_t in_size)
+    {
+        begin = RansInterleavedEncode<N, Coder>((Word*) out_end, in, in_size, esyms, scale_bits);
+        return (uint8_t*) out_end - (uint8_t*) begin;
+    }
+
+    virtual void decode(uint8_t* out, size_t out_size)
+    {
+        if (fused)
+            RansInterleavedDecodeSlots<N, Coder>(out, out_size, begin, &slots[0], &cum2sym[0], scale_bits);
+        else
+            RansInterleavedDecode<N, Coder>(out, out_size, begin, dsyms, &cum2sym[0], scale_bits);
+    }
+};
+
+// Alias tables (rans_alias.h), same stream layout as the interleave driver.
+struct BenchAliasByte {
+    typedef RansByteCoder Coder;
+    static inline void EncPut(RansState* r, uint8_t** pptr, RansAliasTable const* t, uint32_t s) { RansAliasEncPut(r, pptr, t, s); }
+    static inline uint32_t DecGet(RansState* r, RansAliasTable const* t) { return RansAliasDecGet(r, t); }
+};
+
+struct BenchAlias64 {
+    typedef Rans64Coder Coder;
+    static inline void EncPut(Rans64State* r, uint32_t** pptr, RansAliasTable const* t, uint32_t s) { Rans64AliasEncPut(r, pptr, t, s); }
+    static inline uint32_t DecGet(Rans64State* r, RansAliasTable const* t) { return Rans64AliasDecGet(r, t); }
+};
+
+template<int N, typename Alias>
+struct BenchAlias : BenchCoder {
+    typedef typename Alias::Coder Coder;
+    typedef typename Coder::State State;
+    typedef typename Coder::Word Word;
+
+    RansAliasTable table;
+    Word* begin;
+
+    BenchAlias(char const* family, uint32_t scale_bits)
+        : BenchCoder(family, "", N, scale_bits), begin(0) {}
+
+    virtual void setup(SymbolStats const& stats)
+    {
+        RansAliasInit(&table, stats.freqs, 256, scale_bits);
+    }
+
+    virtual size_t encode(uint8_t const* in, size_t in_size)
+    {
+        State rans[N];
+        for (int j=0; j < N; j++)
+            Coder::EncInit(&rans[j]);
+
+        Word* ptr = (Word*) out_end;
+        size_t full = in_size - (in_size % N);
+        for (size_t i=in_size; i > full; i--) // NB: working in reverse!
+            Alias::EncPut(&rans[i - 1 - full], &ptr, &table, in[i - 1]);
+        for (size_t i=full; i > 0; i -= N) {
+            for (int j=N-1; j >= 0; j--)
+                Alias::EncPut(&rans[j], &ptr, &table, in[i - N + j]);
+        }
+        for (int j=N-1; j >= 0; j--)
+            Coder::EncFlush(&rans[j], &ptr);
+
+        begin = ptr;
+        return (uint8_t*) out_end - (uint8_t*) begin;
+    }
+
+    virtual void decode(uint8_t* out, size_t out_size)
+    {
+        State rans[N];
+        Word* ptr = begin;
+        for (int j=0; j < N; j++)
+            Coder::DecInit(&rans[j], &ptr);
+
+        size_t full = out_size - (out_size % N);
+        for (size_t i=0; i < full; i += N) {
+            for (int j=0; j < N; j++)
+                out[i + j] = (uint8_t) Alias::DecGet(&rans[j], &table);
+            for (int j=0; j < N; j++)
+                Coder::DecRenorm(&rans[j], &ptr);
+        }
+        for (size_t i=full; i < out_size; i++) {
+            out[i] = (uint8_t) Alias::DecGet(&rans[i - full], &table);
+            Coder::DecRenorm(&rans[i - full], &ptr);
+        }
+    }
+};
+
+// Word-aligned coder, 16-way, through rans_dispatch.h (so every kernel the
+// CPU supports gets run, not just the best one). Always RANS_WORD_SCALE_BITS.
+struct BenchWord : BenchCoder {
+    RansDispatch const* kernels;
+    RansWordTables* tab;
+    RansWordEncSymbol esyms[256];
+    uint16_t* begin;
+
+    explicit BenchWord(RansDispatch const* kernels)
+        : BenchCoder("word", kernels->name, RANS_DISPATCH_WAYS, RANS_WORD_SCALE_BITS), kernels(kernels), tab(new RansWordTables), begin(0)
+    {
+        // names like "SSE 4.1" are fine for humans, but not in CSV columns
+        static char const* const isa_names[RANS_ISA_COUNT] = { "", "sse41", "avx2", "avx512" };
+        isa = isa_names[kernels->isa];
+    }
+    virtual ~BenchWord() { delete tab; }
+
+    virtual void setup(SymbolStats const& stats)
+    {
+        for (int s=0; s < 256; s++) {
+            RansWordTablesInitSymbol(tab, (uint8_t) s, stats.cum_freqs[s], stats.freqs[s]);
+            RansWordEncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s]);
+        }
+    }
+
+    virtual size_t encode(uint8_t const* in, size_t in_size)
+    {
+        begin = kernels->encode((uint16_t*) out_end, in, in_size, esyms);
+        return (uint8_t*) out_end - (uint8_t*) begin;
+    }
+
+    virtual void decode(uint8_t* out, size_t out_size)
+    {
+        kernels->decode(out, out_size, begin, tab);
+    }
+};
+
+// tANS (rans_tans.h), from the same normalized stats. table_log is
+// scale_bits, so only for RANS_TANS_MIN_TABLE_LOG..RANS_TANS_MAX_TABLE_LOG.
+template<int N>
+struct BenchTans : BenchCoder {
+    RansTansEncTable* enc;
+    RansTansDecEntry* dec;
+    uint8_t* begin;
+
+    explicit BenchTans(uint32_t scale_bits)
+        : BenchCoder("tans", "", N, scale_bits), enc(new RansTansEncTable), dec(new RansTansDecEntry[1u << scale_bits]), begin(0) {}
+    virtual ~BenchTans() { delete enc; delete[] dec; }
+
+    virtual void setup(SymbolStats const& stats)
+    {
+        RansTansEncTableInit(enc, stats.freqs, scale_bits);
+        RansTansDecTableInit(dec, stats.freqs, scale_bits);
+    }
+
+    virtual size_t encode(uint8_t const* in, size_t in_size)
+    {
+        begin = RansTansEncode<N>(out_end, in, in_size, enc);
+        return out_end - begin;
+    }
+
+    virtual void decode(uint8_t* out, size_t out_size)
+    {
+        RansTansDecode<N>(out, out_size, begin, dec, scale_bits);
+    }
+};
+
+template<int N>
+static void add_interleaved(std::vector<BenchCoder*>* coders, uint32_t scale_bits)
+{
+    coders->push_back(new BenchInterleaved<N, RansByteCoder>("rans_byte", scale_bits, false));
+    coders->push_back(new BenchInterleaved<N, RansByteCoder>("rans_byte_fused", scale_bits, true));
+    coders->push_back(new BenchInterleaved<N, Rans64Coder>("rans64", scale_bits, false));
+    coders->push_back(new BenchInterleaved<N, Rans64Coder>("rans64_fused", scale_bits, true));
+    coders->push_back(new BenchInterleaved<N, Rans32Coder>("rans32", scale_bits, false));
+    coders->push_back(new BenchInterleaved<N, Rans32Coder>("rans32_fused", scale_bits, true));
+    coders->push_back(new BenchAlias<N, BenchAliasByte>("alias_byte", scale_bits));
+    coders->push_back(new BenchAlias<N, BenchAlias64>("alias64", scale_bits));
+    if (scale_bits >= RANS_TANS_MIN_TABLE_LOG && scale_bits <= RANS_TANS_MAX_TABLE_LOG)
+        coders->push_back(new BenchTans<N>(scale_bits));
+}
+
+static void make_coders(std::vector<BenchCoder*>* coders, std::vector<uint32_t> const& scales)
+{
+    for (size_t k=0; k < scales.size(); k++) {
+        uint32_t scale_bits = scales[k];
+        add_interleaved<1>(coders, scale_bits);
+        add_interleaved<2>(coders, scale_bits);
+        add_interleaved<4>(coders, scale_bits);
+        add_interleaved<8>(coders, scale_bits);
+
+        if (scale_bits == RANS_WORD_SCALE_BITS) {
+            for (int isa=0; isa < RANS_ISA_COUNT; isa++) {
+                if (RansDispatch const* d = RansDispatchFor((RansIsa) isa))
+                    coders->push_back(new BenchWord(d));
+            }
+        }
+    }
+}
+
+// ---- Measurement
+
+struct BenchTiming {
+    double clk_med, clk_min;    // rdtsc ticks per symbol
+    double mibs_med, mibs_max;  // MiB/s
+};
+
+struct BenchInput {
+    std::string name;
+    uint8_t* data;
+    size_t size;
+    double source_entropy;  // bits/symbol for synthetic sources, else -1
+};
+
+struct BenchResult {
+    std::string file;
+    size_t size;
+    double entropy;         // order-0 entropy of the input, bits/symbol
+    double source_entropy;
+    std::string name;       // coder name, as printed
+    std::string family;
+    std::string isa;
+    int ways;
+    uint32_t scale_bits;
+    size_t comp_bytes;
+    bool ok;
+    BenchTiming enc, dec;
+};
+
+struct BenchOptions {
+    int runs;
+    int warmup;
+    std::vector<uint32_t> scales;
+    std::vector<size_t> sizes;
+    char const* filter;
+    int cpu;
+    char const* format;
+    char const* output;
+    char const* tag;
+    size_t gen_size;
+};
+
+// bits/symbol spent, and the overhead over the order-0 entropy
+static double bits_per_symbol(BenchResult const& r)
+{
+    return r.size ? 8.0 * r.comp_bytes / r.size : 0.0;
+}
+
+static double overhead(BenchResult const& r)
+{
+    return bits_per_symbol(r) - r.entropy;
+}
+
+static double median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n & 1) ? v[n/2] : 0.5 * (v[n/2 - 1] + v[n/2]);
+}
+
+static BenchTiming summarize(std::vector<double> const& clocks, std::vector<double> const& secs, size_t size)
+{
+    BenchTiming t;
+    t.clk_med = median(clocks) / size;
+    t.clk_min = *std::min_element(clocks.begin(), clocks.end()) / size;
+    t.mibs_med = size / (median(secs) * 1048576.0);
+    t.mibs_max = size / (*std::min_element(secs.begin(), secs.end()) * 1048576.0);
+    return t;
+}
+
+static void run_coder(BenchCoder* c, BenchOptions const& opts, uint8_t const* in, size_t in_size, uint8_t* dec, BenchResult* res)
+{
+    std::vector<double> clocks, secs;
+
+    SymbolStats stats;
+    stats.count_freqs(in, in_size);
+    stats.normalize_freqs(1u << c->scale_bits);
+    c->setup(stats);
+
+    // check first
+    res->comp_bytes = c->encode(in, in_size);
+    memset(dec, 0xcc, in_size);
+    c->decode(dec, in_size);
+    res->ok = memcmp(in, dec, in_size) == 0;
+    memset(&res->enc, 0, sizeof(res->enc));
+    memset(&res->dec, 0, sizeof(res->dec));
+    if (!res->ok || !in_size)
+        return;
+
+    // Small inputs get coded several times per run, so each run takes
+    // long enough to time.
+    size_t reps = (in_size < 65536) ? 65536 / in_size : 1;
+
+    for (int run=0; run < opts.warmup + opts.runs; run++) {
+        double start_time = timer();
+        uint64_t start_clocks = __rdtsc();
+
+        for (size_t rep=0; rep < reps; rep++)
+            c->encode(in, in_size);
+
+        uint64_t end_clocks = __rdtsc();
+        double end_time = timer();
+        if (run >= opts.warmup) {
+            clocks.push_back((double) (end_clocks - start_clocks));
+            secs.push_back(end_time - start_time);
+        }
+    }
+    res->enc = summarize(clocks, secs, in_size * reps);
+
+    clocks.clear();
+    secs.clear();
+    for (int run=0; run < opts.warmup + opts.runs; run++) {
+        double start_time = timer();
+        uint64_t start_clocks = __rdtsc();
+
+        for (size_t rep=0; rep < reps; rep++)
+            c->decode(dec, in_size);
+
+        uint64_t end_clocks = __rdtsc();
+        double end_time = timer();
+        if (run >= opts.warmup) {
+            clocks.push_back((double) (end_clocks - start_clocks));
+            secs.push_back(end_time - start_time);
+        }
+    }
+    res->dec = summarize(clocks, secs, in_size * reps);
+}
+
+// ---- Environment
+
+static bool pin_to_cpu(int cpu)
+{
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+static int current_cpu()
+{
+#if defined(_WIN32)
+    return (int) GetCurrentProcessorNumber();
+#elif defined(__linux__)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+static std::string cpu_brand()
+{
+    uint32_t regs[12];
+    RansCpuid(regs, 0x80000000u, 0);
+    if (regs[0] < 0x80000004u)
+        return "unknown";
+
+    char brand[49];
+    for (uint32_t i=0; i < 3; i++)
+        RansCpuid(regs + i*4, 0x80000002u + i, 0);
+    memcpy(brand, regs, 48);
+    brand[48] = 0;
+
+    // trim the padding some CPUs have
+    char const* p = brand;
+    while (*p == ' ')
+        p++;
+    std::string s = p;
+    while (!s.empty() && s[s.size() - 1] == ' ')
+        s.erase(s.size() - 1);
+    return s;
+}
+
+static std::string compiler_name()
+{
+    char buf[128];
+#if defined(__clang__)
+    snprintf(buf, sizeof(buf), "clang %s", __clang_version__);
+#elif defined(__GNUC__)
+    snprintf(buf, sizeof(buf), "gcc %s", __VERSION__);
+#elif defined(_MSC_VER)
+    snprintf(buf, sizeof(buf), "msvc %d", _MSC_VER);
+#else
+    snprintf(buf, sizeof(buf), "unknown");
+#endif
+    return buf;
+}
+
+// ---- Output
+
+static void print_text_header(FILE* f)
+{
+    fprintf(f, "%-14s %9s  %-28s %9s %6s %5s %6s  %17s %8s  %17s %8s\n", "file", "size", "coder", "bytes", "ratio",
+        "H0", "+bits", "enc clk/sym", "MiB/s", "dec clk/sym", "MiB/s");
+    fprintf(f, "%-14s %9s  %-28s %9s %6s %5s %6s  %8s %8s %8s  %8s %8s %8s\n", "", "", "", "", "", "", "",
+        "med", "min", "med", "med", "min", "med");
+}
+
+static void print_text(FILE* f, BenchResult const& r, std::string const& name)
+{
+    std::string file = r.file;
+    if (file.size() > 14)
+        file = "..." + file.substr(file.size() - 11);
+
+    if (!r.ok) {
+        fprintf(f, "%-14s %9d  %-28s ERROR: bad decode!\n", file.c_str(), (int) r.size, name.c_str());
+        return;
+    }
+    fprintf(f, "%-14s %9d  %-28s %9d %6.3f %5.2f %6.3f  %8.2f %8.2f %8.1f  %8.2f %8.2f %8.1f\n",
+        file.c_str(), (int) r.size, name.c_str(), (int) r.comp_bytes, r.size ? 1.0 * r.comp_bytes / r.size : 0.0,
+        r.entropy, overhead(r), r.enc.clk_med, r.enc.clk_min, r.enc.mibs_med, r.dec.clk_med, r.dec.clk_min, r.dec.mibs_med);
+}
+
+// Same results, grouped by coder and sorted by entropy.
+static bool by_coder_then_entropy(BenchResult const* a, BenchResult const* b)
+{
+    if (a->name != b->name)
+        return a->name < b->name;
+    return a->entropy < b->entropy;
+}
+
+static void print_curves(FILE* f, std::vector<BenchResult> const& results)
+{
+    std::vector<BenchResult const*> sorted;
+    for (size_t i=0; i < results.size(); i++) {
+        if (results[i].ok)
+            sorted.push_back(&results[i]);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), by_coder_then_entropy);
+
+    for (size_t i=0; i < sorted.size(); i++) {
+        BenchResult const& r = *sorted[i];
+        if (i == 0 || r.name != sorted[i-1]->name) {
+            fprintf(f, "\n%s:\n", r.name.c_str());
+            fprintf(f, "  %-14s %9s %6s %6s %8s %6s %7s  %8s %8s  %8s %8s\n", "input", "size", "src H", "H0", "bits/sym", "+bits", "+%",
+                "enc clk", "MiB/s", "dec clk", "MiB/s");
+        }
+
+        char src[16] = "-";
+        if (r.source_entropy >= 0.0)
+            snprintf(src, sizeof(src), "%6.3f", r.source_entropy);
+        fprintf(f, "  %-14s %9d %6s %6.3f %8.3f %6.3f %6.2f%%  %8.2f %8.1f  %8.2f %8.1f\n", r.file.c_str(), (int) r.size,
+            src, r.entropy, bits_per_symbol(r), overhead(r), r.entropy > 0.0 ? 100.0 * overhead(r) / r.entropy : 0.0,
+            r.enc.clk_med, r.enc.mibs_med, r.dec.clk_med, r.dec.mibs_med);
+    }
+}
+
+static void print_csv(FILE* f, BenchOptions const& opts, std::vector<BenchResult> const& results)
+{
+    fprintf(f, "tag,file,size,source_entropy,entropy,coder,isa,ways,scale_bits,bytes,ratio,bits_per_symbol,overhead,ok,"
+        "enc_clk_med,enc_clk_min,enc_mibs_med,enc_mibs_max,dec_clk_med,dec_clk_min,dec_mibs_med,dec_mibs_max\n");
+    for (size_t i=0; i < results.size(); i++) {
+        BenchResult const& r = results[i];
+        fprintf(f, "%s,%s,%d,%.5f,%.5f,%s,%s,%d,%d,%d,%.5f,%.5f,%.5f,%d,%.3f,%.3f,%.2f,%.2f,%.3f,%.3f,%.2f,%.2f\n",
+            opts.tag, r.file.c_str(), (int) r.size, r.source_entropy, r.entropy, r.family.c_str(), r.isa.c_str(), r.ways, (int) r.scale_bits,
+            (int) r.comp_bytes, r.size ? 1.0 * r.comp_bytes / r.size : 0.0, bits_per_symbol(r), overhead(r), r.ok ? 1 : 0,
+            r.enc.clk_med, r.enc.clk_min, r.enc.mibs_med, r.enc.mibs_max,
+            r.dec.clk_med, r.dec.clk_min, r.dec.mibs_med, r.dec.mibs_max);
+    }
+}
+
+static std::string json_string(std::string const& s)
+{
+    std::string out = "\"";
+    for (size_t i=0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char) c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else
+            out += c;
+    }
+    return out + "\"";
+}
+
+static void print_json(FILE* f, BenchOptions const& opts, std::vector<BenchResult> const& results)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"tag\": %s,\n", json_string(opts.tag).c_str());
+    fprintf(f, "  \"cpu\": %s,\n", json_string(cpu_brand()).c_str());
+    fprintf(f, "  \"compiler\": %s,\n", json_string(compiler_name()).c_str());
+    fprintf(f, "  \"pinned_cpu\": %d,\n", opts.cpu);
+    fprintf(f, "  \"runs\": %d,\n", opts.runs);
+    fprintf(f, "  \"warmup\": %d,\n", opts.warmup);
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i=0; i < results.size(); i++) {
+        BenchResult const& r = results[i];
+        fprintf(f, "    { \"file\": %s, \"size\": %d, \"source_entropy\": %.5f, \"entropy\": %.5f,"
+            " \"coder\": %s, \"isa\": %s, \"ways\": %d, \"scale_bits\": %d,\n",
+            json_string(r.file).c_str(), (int) r.size, r.source_entropy, r.entropy,
+            json_string(r.family).c_str(), json_string(r.isa).c_str(), r.ways, (int) r.scale_bits);
+        fprintf(f, "      \"bytes\": %d, \"ratio\": %.5f, \"bits_per_symbol\": %.5f, \"overhead\": %.5f, \"ok\": %s,\n",
+            (int) r.comp_bytes, r.size ? 1.0 * r.comp_bytes / r.size : 0.0, bits_per_symbol(r), overhead(r), r.ok ? "true" : "false");
+        fprintf(f, "      \"enc\": { \"clk_med\": %.3f, \"clk_min\": %.3f, \"mibs_med\": %.2f, \"mibs_max\": %.2f },\n",
+            r.enc.clk_med, r.enc.clk_min, r.enc.mibs_med, r.enc.mibs_max);
+        fprintf(f, "      \"dec\": { \"clk_med\": %.3f, \"clk_min\": %.3f, \"mibs_med\": %.2f, \"mibs_max\": %.2f } }%s\n",
+            r.dec.clk_med, r.dec.clk_min, r.dec.mibs_med, r.dec.mibs_max, (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+// ---- Driver
+
+static void parse_list(char const* arg, std::vector<size_t>* out)
+{
+    out->clear();
+    while (*arg) {
+        char* end;
+        out->push_back((size_t) strtoull(arg, &end, 0));
+        if (end == arg)
+            panic("bad list: %s", arg);
+        arg = (*end == ',') ? end + 1 : end;
+    }
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: exam_bench [-r runs] [-w warmup] [-b bits,...] [-s size,...] [-m filter]\n"
+        "                  [-c cpu] [-f text|csv|json] [-o file] [-t tag]\n"
+        "                  [-g spec,...] [-n size] [files...]\n");
+    exit(1);
+}
+
+static void add_synthetic(std::vector<BenchInput>* inputs, RansCorpusKind kind, double param, char const* name, size_t size)
+{
+    BenchInput in;
+    in.name = name;
+    in.size = size;
+    in.data = new uint8_t[size ? size : 1];
+    in.source_entropy = RansCorpusEntropy(kind, param);
+    RansCorpusGenerate(in.data, size, kind, param, 1);
+    inputs->push_back(in);
+}
+
+// Parses one -g spec (see the top of the file) and adds its inputs.
+static void add_synthetic_spec(std::vector<BenchInput>* inputs, std::string const& spec, size_t size)
+{
+    char name[64];
+    if (spec == "sweep") {
+        static const double entropies[] = { 0.1, 0.5, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 7.5 };
+        static const RansCorpusKind kinds[] = { RANS_CORPUS_GEOMETRIC, RANS_CORPUS_ZIPF, RANS_CORPUS_SPIKE, RANS_CORPUS_MARKOV };
+        for (size_t k=0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+            // markov sources can't go above the entropy of their base distribution
+            double max_entropy = RansCorpusEntropy(kinds[k], RansCorpusSolve(kinds[k], 8.0));
+            for (size_t e=0; e < sizeof(entropies) / sizeof(entropies[0]); e++) {
+                if (entropies[e] > max_entropy)
+                    continue;
+                snprintf(name, sizeof(name), "%s@%g", RansCorpusKindNames[kinds[k]], entropies[e]);
+                add_synthetic(inputs, kinds[k], RansCorpusSolve(kinds[k], entropies[e]), name, size);
+            }
+        }
+        add_synthetic(inputs, RANS_CORPUS_SPIKE, 0.999, "spike:0.999", size);
+        add_synthetic(inputs, RANS_CORPUS_UNIFORM, 256, "uniform:256", size);
+        return;
+    }
+
+    size_t sep = spec.find_first_of(":@");
+    int kind = 0;
+    while (kind < RANS_CORPUS_NUM_KINDS && spec.compare(0, sep, RansCorpusKindNames[kind]) != 0)
+        kind++;
+    if (sep == std::string::npos || kind == RANS_CORPUS_NUM_KINDS)
+        panic("bad corpus spec: %s", spec.c_str());
+
+    double value = atof(spec.c_str() + sep + 1);
+    double param = (spec[sep] == '@') ? RansCorpusSolve((RansCorpusKind) kind, value) : value;
+    add_synthetic(inputs, (RansCorpusKind) kind, param, spec.c_str(), size);
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions opts;
+    opts.runs = 7;
+    opts.warmup = 1;
+    opts.scales.push_back(11);
+    opts.scales.push_back(12);
+    opts.scales.push_back(14);
+    opts.scales.push_back(16);
+    opts.filter = "";
+    opts.cpu = current_cpu();
+    opts.format = "text";
+    opts.output = 0;
+    opts.tag = "";
+    opts.gen_size = 1 << 20;
+
+    std::vector<char const*> files;
+    std::vector<std::string> gen_specs;
+    for (int i=1; i < argc; i++) {
+        char const* a = argv[i];
+        if (a[0] != '-' || !a[1]) {
+            files.push_back(a);
+            continue;
+        }
+        if (a[2] || i + 1 >= argc)
+            usage();
+
+        char const* val = argv[++i];
+        std::vector<size_t> list;
+        switch (a[1]) {
+        case 'r': opts.runs = atoi(val); break;
+        case 'w': opts.warmup = atoi(val); break;
+        case 'b':
+            parse_list(val, &list);
+            opts.scales.assign(list.begin(), list.end());
+            break;
+        case 's': parse_list(val, &opts.sizes); break;
+        case 'm': opts.filter = val; break;
+        case 'c': opts.cpu = atoi(val); break;
+        case 'f': opts.format = val; break;
+        case 'o': opts.output = val; break;
+        case 't': opts.tag = val; break;
+        case 'n': opts.gen_size = (size_t) strtoull(val, 0, 0); break;
+        case 'g':
+            for (char const* p=val; *p; ) {
+                char const* e = strchr(p, ',');
+                size_t len = e ? (size_t) (e - p) : strlen(p);
+                gen_specs.push_back(std::string(p, len));
+                p += len + (e ? 1 : 0);
+            }
+            break;
+        default: usage();
+        }
+    }
+    if (files.empty() && gen_specs.empty())
+        files.push_back("book1");
+    if (opts.runs < 1)
+        opts.runs = 1;
+    for (size_t k=0; k < opts.scales.size(); k++) {
+        if (opts.scales[k] < 8 || opts.scales[k] > 16)
+            panic("scale_bits must be in [8,16] (rans_byte limit, and 256 symbols)");
+    }
+
+    bool text = strcmp(opts.format, "text") == 0;
+    if (!text && strcmp(opts.format, "csv") != 0 && strcmp(opts.format, "json") != 0)
+        usage();
+
+    FILE* out = stdout;
+    if (opts.output && !(out = fopen(opts.output, "w")))
+        panic("can't open %s", opts.output);
+    // progress goes to stdout for text output to the terminal, else stderr
+    FILE* progress = (text && out == stdout) ? stdout : stderr;
+
+    if (opts.cpu >= 0 && !pin_to_cpu(opts.cpu)) {
+        fprintf(stderr, "warning: couldn't pin to CPU %d\n", opts.cpu);
+        opts.cpu = -1;
+    }
+
+    fprintf(progress, "%s, %s\n", cpu_brand().c_str(), compiler_name().c_str());
+    fprintf(progress, "pinned to CPU %d, %d runs after %d warm-up\n\n", opts.cpu, opts.runs, opts.warmup);
+
+    std::vector<BenchCoder*> all, coders;
+    make_coders(&all, opts.scales);
+    for (size_t k=0; k < all.size(); k++) {
+        if (strstr(all[k]->name().c_str(), opts.filter))
+            coders.push_back(all[k]);
+        else
+            delete all[k];
+    }
+
+    std::vector<BenchInput> inputs;
+    for (size_t fi=0; fi < files.size(); fi++) {
+        BenchInput in;
+        in.name = files[fi];
+        in.data = read_file(files[fi], &in.size);
+        in.source_entropy = -1.0;
+        inputs.push_back(in);
+    }
+    for (size_t gi=0; gi < gen_specs.size(); gi++)
+        add_synthetic_spec(&inputs, gen_specs[gi], opts.gen_size);
+
+    std::vector<BenchResult> results;
+    int failures = 0;
+    print_text_header(progress);
+    if (text && out != stdout)
+        print_text_header(out);
+
+    for (size_t ii=0; ii < inputs.size(); ii++) {
+        BenchInput const& input = inputs[ii];
+
+        std::vector<size_t> sizes = opts.sizes;
+        if (sizes.empty())
+            sizes.push_back(input.size);
+
+        for (size_t si=0; si < sizes.size(); si++) {
+            size_t in_size = sizes[si] ? sizes[si] : input.size;
+            if (in_size > input.size) {
+                fprintf(stderr, "%s: skipping size %d (input is only %d bytes)\n", input.name.c_str(), (int) in_size, (int) input.size);
+                continue;
+            }
+            double entropy = RansCorpusOrder0Entropy(input.data, in_size);
+
+            // Worst case is about 2 bytes per symbol (rans_byte at a scale where a
+            // symbol can have freq 1), plus flushes. The word decoders read
+            // up to 32 bytes past the end of their stream.
+            size_t out_max = 2 * in_size + 1024;
+            uint32_t* out_buf = new uint32_t[out_max / 4 + 16];
+            uint8_t* dec_bytes = new uint8_t[in_size ? in_size : 1];
+
+            for (size_t k=0; k < coders.size(); k++) {
+                BenchCoder* c = coders[k];
+                c->out_end = (uint8_t*) (out_buf + out_max / 4);
+                memset(c->out_end, 0, 64);
+
+                BenchResult r;
+                r.file = input.name;
+                r.size = in_size;
+                r.entropy = entropy;
+                r.source_entropy = input.source_entropy;
+                r.name = c->name();
+                r.family = c->family;
+                r.isa = c->isa;
+                r.ways = c->ways;
+                r.scale_bits = c->scale_bits;
+                run_coder(c, opts, input.data, in_size, dec_bytes, &r);
+                failures += !r.ok;
+
+                print_text(progress, r, c->name());
+                if (text && out != stdout)
+                    print_text(out, r, c->name());
+                results.push_back(r);
+            }
+
+            delete[] out_buf;
+            delete[] dec_bytes;
+        }
+
+        delete[] input.data;
+    }
+
+    if (text && results.size() > coders.size()) {
+        FILE* f = (out == stdout) ? progress : out;
+        fprintf(f, "\n---- per coder, by entropy\n");
+        print_curves(f, results);
+    }
+
+    if (strcmp(opts.format, "csv") == 0)
+        print_csv(out, opts, results);
+    else if (strcmp(opts.format, "json") == 0)
+        print_json(out, opts, results);
+    if (out != stdout)
+        fclose(out);
+
+    for (size_t k=0; k < coders.size(); k++)
+        delete coders[k];
+
+    if (failures)
+        fprintf(stderr, "ERROR: %d coders failed to decode\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_block.h"
+
+// Sample program for the block-parallel compressor in rans_block.h.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+int main(int argc, char** argv)
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file(argc > 1 ? argv[1] : "book1", &in_size);
+
+    static const char* const coder_names[] = { "rans_byte", "rans64" };
+    static const int thread_counts[] = { 1, 2, 4, 0 };
+    static const int num_thread_counts = sizeof(thread_counts) / sizeof(thread_counts[0]);
+
+    uint8_t* dec_bytes = new uint8_t[in_size];
+
+    for (uint32_t coder=RANS_BLOCK_CODER_BYTE; coder <= RANS_BLOCK_CODER_64; coder++) {
+        for (int shared=0; shared < 2; shared++) {
+            for (uint32_t block_size=4 << 10; block_size <= (256 << 10); block_size <<= 2) {
+                RansBlockOptions opts;
+                RansBlockOptionsInit(&opts);
+                opts.coder = coder;
+                opts.shared_stats = shared != 0;
+                opts.block_size = block_size;
+
+                printf("\n%s, %dKB blocks, %s stats:\n", coder_names[coder], block_size >> 10, shared ? "shared" : "per-block");
+
+                size_t out_max = RansBlockCompressBound(in_size, &opts);
+                uint8_t* ref_buf = new uint8_t[out_max];
+                uint8_t* out_buf = new uint8_t[out_max];
+                size_t ref_size = 0;
+                bool all_ok = true;
+
+                for (int t=0; t < num_thread_counts; t++) {
+                    opts.num_threads = thread_counts[t];
+
+                    double start_time = timer();
+                    uint64_t enc_start_time = __rdtsc();
+
+                    size_t out_size = RansBlockCompress(out_buf, out_max, in_bytes, in_size, &opts);
+
+                    uint64_t enc_clocks = __rdtsc() - enc_start_time;
+                    double enc_time = timer() - start_time;
+
+                    memset(dec_bytes, 0xcc, in_size);
+                    start_time = timer();
+                    bool dec_ok = RansBlockDecompress(dec_bytes, in_size, out_buf, out_size, opts.num_threads);
+                    double dec_time = timer() - start_time;
+
+                    printf("threads=%d: %d bytes, enc %.1f clocks/symbol (%5.1fMiB/s), dec %5.1fMiB/s\n",
+                        thread_counts[t], (int) out_size, 1.0 * enc_clocks / in_size,
+                        1.0 * in_size / (enc_time * 1048576.0), 1.0 * in_size / (dec_time * 1048576.0));
+
+                    // output must not depend on the number of threads
+                    if (t == 0) {
+                        ref_size = out_size;
+                        memcpy(ref_buf, out_buf, out_size);
+                    } else if (out_size != ref_size || memcmp(ref_buf, out_buf, out_size) != 0) {
+                        printf("ERROR: output depends on thread count!\n");
+                        all_ok = false;
+                    }
+
+                    if (!out_size || !dec_ok || memcmp(in_bytes, dec_bytes, in_size) != 0) {
+                        printf("ERROR: bad decoder!\n");
+                        all_ok = false;
+                    }
+                }
+                if (all_ok)
+                    printf("decode ok!\n");
+
+                delete[] ref_buf;
+                delete[] out_buf;
+            }
+        }
+    }
+
+    delete[] dec_bytes;
+    delete[] in_bytes;
+    return 0;
+}
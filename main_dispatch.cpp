@@ -0,0 +1,154 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_word_sse41.h"
+#include "rans_stats.h"
+#include "rans_dispatch.h"
+
+// Sample program for rans_dispatch.h. This file is compiled without any
+// -m flags; the SIMD kernels come from the rans_dispatch_*.cpp files.
+// It picks the best kernels for this CPU, then runs every kernel the CPU
+// supports on the same stream.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+int main()
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file("book1", &in_size);
+
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(RANS_WORD_M);
+
+    static RansWordTables tab;
+    static RansWordEncSymbol esyms[256];
+    for (int s=0; s < 256; s++) {
+        RansWordTablesInitSymbol(&tab, (uint8_t)s, stats.cum_freqs[s], stats.freqs[s]);
+        RansWordEncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s]);
+    }
+
+    // The stream gets written backwards from out_end; the decoders may
+    // read a little past the end of it, so leave some room after.
+    static size_t out_max_words = 16<<20; // 32MB
+    static size_t out_padding = 32; // words
+    uint16_t* out_buf = new uint16_t[out_max_words];
+    uint16_t* out_end = out_buf + out_max_words - out_padding;
+    memset(out_end, 0, out_padding * sizeof(uint16_t));
+    uint8_t* dec_bytes = new uint8_t[in_size];
+
+    // reference stream, from the scalar kernel
+    uint16_t* rans_begin = RansDispatchEncodeScalar(out_end, in_bytes, in_size, esyms);
+    size_t ref_words = out_end - rans_begin;
+    uint16_t* ref_words_buf = new uint16_t[ref_words];
+    memcpy(ref_words_buf, rans_begin, ref_words * sizeof(uint16_t));
+    printf("16-way rANS: %d bytes\n", (int) (ref_words * sizeof(uint16_t)));
+
+    uint32_t features = RansCpuFeatures();
+    printf("CPU supports:");
+    for (int isa=0; isa < RANS_ISA_COUNT; isa++) {
+        if (features & (1u << isa))
+            printf(" %s", RansDispatchFor((RansIsa)isa)->name);
+    }
+    printf("\nbest: %s\n", RansDispatchBest()->name);
+
+    for (int isa=0; isa < RANS_ISA_COUNT; isa++) {
+        RansDispatch const* d = RansDispatchFor((RansIsa)isa);
+        if (!d)
+            continue;
+
+        printf("\n%s rANS encode:\n", d->name);
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t enc_start_time = __rdtsc();
+
+            rans_begin = d->encode(out_end, in_bytes, in_size, esyms);
+
+            uint64_t enc_clocks = __rdtsc() - enc_start_time;
+            double enc_time = timer() - start_time;
+            printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", enc_clocks, 1.0 * enc_clocks / in_size, 1.0 * in_size / (enc_time * 1048576.0));
+        }
+
+        // check encode results
+        if ((size_t) (out_end - rans_begin) == ref_words && memcmp(ref_words_buf, rans_begin, ref_words * sizeof(uint16_t)) == 0)
+            printf("encode ok!\n");
+        else
+            printf("ERROR: bad encoder!\n");
+
+        printf("%s rANS decode:\n", d->name);
+        memset(dec_bytes, 0xcc, in_size);
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t dec_start_time = __rdtsc();
+
+            d->decode(dec_bytes, in_size, rans_begin, &tab);
+
+            uint64_t dec_clocks = __rdtsc() - dec_start_time;
+            double dec_time = timer() - start_time;
+            printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMB/s)\n", dec_clocks, 1.0 * dec_clocks / in_size, 1.0 * in_size / (dec_time * 1048576.0));
+        }
+
+        // check decode results
+        if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+            printf("decode ok!\n");
+        else
+            printf("ERROR: bad decoder!\n");
+    }
+
+    // short inputs, through the default entry points; the scalar decoder
+    // has to agree.
+    bool ok = true;
+    for (size_t len=0; len < 40 && ok; len++) {
+        rans_begin = RansDispatchEncode(out_end, in_bytes, len, esyms);
+        memset(dec_bytes, 0xcc, len);
+        RansDispatchDecode(dec_bytes, len, rans_begin, &tab);
+        ok = memcmp(in_bytes, dec_bytes, len) == 0;
+        memset(dec_bytes, 0xcc, len);
+        RansDispatchDecodeScalar(dec_bytes, len, rans_begin, &tab);
+        ok = ok && memcmp(in_bytes, dec_bytes, len) == 0;
+    }
+    printf("\n%s\n", ok ? "short inputs ok!" : "ERROR: bad short inputs!");
+
+    delete[] out_buf;
+    delete[] dec_bytes;
+    delete[] ref_words_buf;
+    delete[] in_bytes;
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_hist.h"
+#include "rans_stats.h"
+#include "rans_corpus.h"
+
+// Sample program for rans_hist.h: times the plain counting loop against
+// the sub-histogram version and the threaded one, for bytes and 16-bit
+// symbols, on book1 and synthetic data from nearly constant to random
+// (skewed data is where the plain loop is slowest), and checks that all
+// of them give the same counts.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+// The plain loops, for reference.
+static void count_plain8(uint32_t* freqs, uint8_t const* in, size_t size)
+{
+    for (int s=0; s < 256; s++)
+        freqs[s] = 0;
+    for (size_t i=0; i < size; i++)
+        freqs[in[i]]++;
+}
+
+static void count_plain16(uint32_t* freqs, uint32_t nsyms, uint16_t const* in, size_t count)
+{
+    for (uint32_t s=0; s < nsyms; s++)
+        freqs[s] = 0;
+    for (size_t i=0; i < count; i++)
+        freqs[in[i]]++;
+}
+
+// (On machines with fewer cores than this, the threaded numbers are mostly
+// thread startup overhead.)
+static const int num_threads = 4;
+
+// Best-of-5 clocks/symbol for "func", which counts into "freqs"; checks
+// the result against "ref".
+template<typename Func>
+static double time_count(Func const& func, uint32_t* freqs, uint32_t const* ref, uint32_t nsyms, size_t count, bool* ok)
+{
+    uint64_t best_clocks = ~0ull;
+    for (int run=0; run < 5; run++) {
+        memset(freqs, 0xcc, nsyms * sizeof(uint32_t));
+        uint64_t start = __rdtsc();
+        func();
+        uint64_t clocks = __rdtsc() - start;
+        if (clocks < best_clocks)
+            best_clocks = clocks;
+        if (memcmp(freqs, ref, nsyms * sizeof(uint32_t)) != 0)
+            *ok = false;
+    }
+    return count ? 1.0 * best_clocks / count : 0.0;
+}
+
+static bool run8(char const* name, uint8_t const* in, size_t size)
+{
+    uint32_t ref[256], freqs[256];
+    bool ok = true;
+
+    double plain = time_count([&]() { count_plain8(ref, in, size); }, ref, ref, 256, size, &ok);
+    double hist = time_count([&]() { RansHistCount8(freqs, in, size); }, freqs, ref, 256, size, &ok);
+    double threaded = time_count([&]() { RansHistCount8Threaded(freqs, in, size, num_threads); }, freqs, ref, 256, size, &ok);
+
+    SymbolStats stats;
+    stats.count_freqs(in, size);
+    ok = ok && memcmp(stats.freqs, ref, sizeof(ref)) == 0;
+    stats.count_freqs_threaded(in, size, num_threads);
+    ok = ok && memcmp(stats.freqs, ref, sizeof(ref)) == 0;
+
+    printf("%-16s %9d bytes: plain %5.2f  hist %5.2f  %d threads %5.2f clocks/symbol\n", name, (int) size,
+        plain, hist, num_threads, threaded);
+    return ok;
+}
+
+static bool run16(char const* name, uint16_t const* in, size_t count, uint32_t nsyms)
+{
+    uint32_t* ref = new uint32_t[nsyms];
+    SymbolStats16 stats(nsyms);
+    uint32_t* freqs = &stats.freqs[0];
+    bool ok = true;
+
+    double plain = time_count([&]() { count_plain16(ref, nsyms, in, count); }, ref, ref, nsyms, count, &ok);
+    double hist = time_count([&]() { stats.count_freqs(in, count); }, freqs, ref, nsyms, count, &ok);
+    double threaded = time_count([&]() { stats.count_freqs_threaded(in, count, num_threads); }, freqs, ref, nsyms, count, &ok);
+
+    printf("%-16s %9d syms:  plain %5.2f  hist %5.2f  %d threads %5.2f clocks/symbol (nsyms=%d)\n", name, (int) count,
+        plain, hist, num_threads, threaded, (int) nsyms);
+    delete[] ref;
+    return ok;
+}
+
+int main()
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file("book1", &in_size);
+
+    bool ok = true;
+    printf("8-bit symbols:\n");
+    ok = run8("book1", in_bytes, in_size) && ok;
+    delete[] in_bytes;
+
+    // 8MB, so the threaded versions actually use threads
+    static const struct {
+        RansCorpusKind kind;
+        double param;
+    } sources[] = {
+        { RANS_CORPUS_SPIKE, 0.999 },
+        { RANS_CORPUS_SPIKE, 0.9 },
+        { RANS_CORPUS_MARKOV, 0.9 },
+        { RANS_CORPUS_GEOMETRIC, 0.5 },
+        { RANS_CORPUS_UNIFORM, 256 },
+    };
+
+    size_t size = 8 << 20;
+    uint8_t* data = new uint8_t[size];
+    uint16_t* syms = new uint16_t[size];
+    for (size_t i=0; i < sizeof(sources) / sizeof(*sources); i++) {
+        RansCorpusKind kind = sources[i].kind;
+        RansCorpusGenerate(data, size, kind, sources[i].param, 1234);
+
+        char name[64];
+        sprintf(name, "%s:%g", RansCorpusKindNames[kind], sources[i].param);
+        ok = run8(name, data, size) && ok;
+    }
+
+    // 16-bit symbols: two consecutive bytes of synthetic data, so the
+    // skew carries over. (At nsyms=65536, 4M symbols are too few per bin
+    // for threads to pay off, so the threaded version stays on one.)
+    printf("\n16-bit symbols:\n");
+    static const uint32_t alphabets[] = { 1024, 65536 };
+    for (size_t k=0; k < sizeof(alphabets) / sizeof(*alphabets); k++) {
+        uint32_t nsyms = alphabets[k];
+        for (size_t i=0; i < sizeof(sources) / sizeof(*sources); i++) {
+            RansCorpusKind kind = sources[i].kind;
+            RansCorpusGenerate(data, size, kind, sources[i].param, 1234);
+            for (size_t j=0; j < size / 2; j++)
+                syms[j] = (uint16_t) ((data[j*2] | (data[j*2 + 1] << 8)) % nsyms);
+
+            char name[64];
+            sprintf(name, "%s:%g", RansCorpusKindNames[kind], sources[i].param);
+            ok = run16(name, syms, size / 2, nsyms) && ok;
+        }
+    }
+
+    // odd sizes and alignments, to exercise the tails
+    RansCorpusGenerate(data, 256, RANS_CORPUS_ZIPF, 1.0, 5678);
+    for (size_t j=0; j < 256; j++)
+        syms[j] = (uint16_t) ((data[j] * 17) & 4095);
+    for (size_t offs=0; offs < 8; offs++) {
+        for (size_t n=0; n < 64; n++) {
+            uint32_t ref[4096], freqs[4096];
+            count_plain8(ref, data + offs, n);
+            RansHistCount8(freqs, data + offs, n);
+            ok = ok && memcmp(freqs, ref, 256 * sizeof(uint32_t)) == 0;
+
+            count_plain16(ref, 4096, syms + offs, n);
+            RansHistCount16(freqs, 4096, syms + offs, n);
+            ok = ok && memcmp(freqs, ref, 4096 * sizeof(uint32_t)) == 0;
+        }
+    }
+
+    if (ok)
+        printf("\ncounts ok!\n");
+    else
+        printf("\nERROR: bad counts!\n");
+
+    delete[] syms;
+    delete[] data;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#ifndef RANS_INSTRUMENT
+#define RANS_INSTRUMENT
+#endif
+
+#include "rans_byte.h"
+#include "rans64.h"
+#include "rans32.h"
+#include "rans_interleave.h"
+#include "rans_word_sse41.h"
+#include "rans_stats.h"
+#include "rans_corpus.h"
+#include "rans_instrument.h"
+
+// Sample program for rans_instrument.h: encodes and decodes book1 and a few
+// synthetic inputs with rans_byte, rans64, rans32 and the SSE 4.1 word coder, and
+// prints the renormalization statistics for each. Compare the low-entropy
+// inputs (nearly every symbol is free, renorms are rare) with the
+// high-entropy ones (a word every other symbol or so).
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+static void check(char const* what, uint8_t const* in_bytes, uint8_t const* dec_bytes, size_t size)
+{
+    if (memcmp(in_bytes, dec_bytes, size) == 0)
+        printf("%s: decode ok!\n", what);
+    else
+        printf("%s: ERROR: bad decoder!\n", what);
+}
+
+// N-way interleaved rans_byte, rans64 or rans32.
+template<int N, typename Coder>
+static void run_interleaved(uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, uint32_t scale_bits,
+    char const* name, RansCoderCounters const* counters)
+{
+    typedef typename Coder::Word Word;
+
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(1 << scale_bits);
+
+    typename Coder::EncSymbol esyms[256];
+    typename Coder::DecSymbol dsyms[256];
+    uint8_t* cum2sym = new uint8_t[1 << scale_bits];
+    for (int s=0; s < 256; s++) {
+        Coder::EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], scale_bits);
+        Coder::DecSymbolInit(&dsyms[s], stats.cum_freqs[s], stats.freqs[s]);
+        for (uint32_t i=stats.cum_freqs[s]; i < stats.cum_freqs[s+1]; i++)
+            cum2sym[i] = (uint8_t) s;
+    }
+
+    size_t out_max_words = (in_size * 2) / sizeof(Word) + 64;
+    Word* out_buf = new Word[out_max_words + 8]; // extra words at end (rans32 decoder reads past it)
+
+    RansCountersReset();
+    Word* rans_begin = RansInterleavedEncode<N, Coder>(out_buf + out_max_words, in_bytes, in_size, esyms, scale_bits);
+    RansInterleavedDecode<N, Coder>(dec_bytes, in_size, rans_begin, dsyms, cum2sym, scale_bits);
+
+    char label[64];
+    sprintf(label, "%s, %d-way, scale_bits=%u, %d bytes", name, N, scale_bits,
+        (int) ((out_buf + out_max_words - rans_begin) * sizeof(Word)));
+    RansCountersPrint(stdout, label, counters);
+    check(name, in_bytes, dec_bytes, in_size);
+
+    delete[] out_buf;
+    delete[] cum2sym;
+}
+
+// 8-way SSE 4.1 word coder (two 4-lane registers), same layout as
+// main_simd.cpp.
+static void run_simd(uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes)
+{
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(RANS_WORD_M);
+
+    RansWordTables tab;
+    RansWordEncSymbol esyms[256];
+    for (int s=0; s < 256; s++) {
+        RansWordTablesInitSymbol(&tab, (uint8_t)s, stats.cum_freqs[s], stats.freqs[s]);
+        RansWordEncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s]);
+    }
+
+    size_t out_max_words = in_size + 64;
+    uint16_t* out_buf = new uint16_t[out_max_words + 8]; // extra words at end (decoder reads past it)
+
+    RansCountersReset();
+
+    RansSimdEnc enc0, enc1;
+    RansSimdEncInit(&enc0);
+    RansSimdEncInit(&enc1);
+
+    uint16_t* ptr = out_buf + out_max_words; // *end* of output buffer
+    for (size_t i=in_size; i > (in_size & ~7); i--) { // NB: working in reverse
+        RansSimdEnc* which = ((i - 1) & 4) != 0 ? &enc1 : &enc0;
+        int s = in_bytes[i - 1];
+        RansWordEncPut(&which->lane[(i - 1) & 3], &ptr, stats.cum_freqs[s], stats.freqs[s]);
+    }
+    for (size_t i=(in_size & ~7); i > 0; i -= 8) { // NB: working in reverse!
+        RansSimdEncPut(&enc1, &ptr, esyms, *(uint32_t *)(in_bytes + i - 4));
+        RansSimdEncPut(&enc0, &ptr, esyms, *(uint32_t *)(in_bytes + i - 8));
+    }
+    RansSimdEncFlush(&enc1, &ptr);
+    RansSimdEncFlush(&enc0, &ptr);
+    uint16_t* rans_begin = ptr;
+
+    RansSimdDec dec0, dec1;
+    RansSimdDecInit(&dec0, &ptr);
+    RansSimdDecInit(&dec1, &ptr);
+    for (size_t i=0; i < (in_size & ~7); i += 8) {
+        uint32_t s03 = RansSimdDecSym(&dec0, &tab);
+        uint32_t s47 = RansSimdDecSym(&dec1, &tab);
+        *(uint32_t *)(dec_bytes + i) = s03;
+        *(uint32_t *)(dec_bytes + i + 4) = s47;
+        RansSimdDecRenorm(&dec0, &ptr);
+        RansSimdDecRenorm(&dec1, &ptr);
+    }
+    for (size_t i=(in_size & ~7); i < in_size; i++) {
+        RansSimdDec* which = (i & 4) != 0 ? &dec1 : &dec0;
+        dec_bytes[i] = RansWordDecSym(&which->lane[i & 3], &tab);
+    }
+
+    char label[64];
+    sprintf(label, "SSE 4.1 word, 8-way, scale_bits=%d, %d bytes", RANS_WORD_SCALE_BITS,
+        (int) ((out_buf + out_max_words - rans_begin) * sizeof(uint16_t)));
+    RansCountersPrint(stdout, label, &RansGetCounters()->word);
+    check("SSE 4.1 word", in_bytes, dec_bytes, in_size);
+
+    delete[] out_buf;
+}
+
+static void run_all(char const* name, uint8_t const* in_bytes, size_t in_size)
+{
+    printf("\n==== %s: %d bytes, order-0 entropy %.3f bits/symbol\n\n", name, (int) in_size,
+        RansCorpusOrder0Entropy(in_bytes, in_size));
+
+    uint8_t* dec_bytes = new uint8_t[in_size + 8];
+    run_interleaved<4, RansByteCoder>(in_bytes, in_size, dec_bytes, 14, "rans_byte", &RansGetCounters()->byte);
+    run_interleaved<4, Rans64Coder>(in_bytes, in_size, dec_bytes, 14, "rans64", &RansGetCounters()->rans64);
+    run_interleaved<4, Rans32Coder>(in_bytes, in_size, dec_bytes, 14, "rans32", &RansGetCounters()->rans32);
+    run_simd(in_bytes, in_size, dec_bytes);
+    delete[] dec_bytes;
+}
+
+int main()
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file("book1", &in_size);
+    run_all("book1", in_bytes, in_size);
+    delete[] in_bytes;
+
+    // synthetic data from nearly constant to nearly random
+    static const struct {
+        RansCorpusKind kind;
+        double entropy;
+    } sources[] = {
+        { RANS_CORPUS_SPIKE, 0.1 },
+        { RANS_CORPUS_ZIPF, 2.0 },
+        { RANS_CORPUS_GEOMETRIC, 6.0 },
+        { RANS_CORPUS_UNIFORM, 8.0 },
+    };
+
+    size_t size = 1 << 20;
+    uint8_t* data = new uint8_t[size];
+    for (size_t i=0; i < sizeof(sources) / sizeof(*sources); i++) {
+        RansCorpusKind kind = sources[i].kind;
+        double param = RansCorpusSolve(kind, sources[i].entropy);
+        RansCorpusGenerate(data, size, kind, param, 1234);
+
+        char name[64];
+        sprintf(name, "%s:%g", RansCorpusKindNames[kind], param);
+        run_all(name, data, size);
+    }
+    delete[] data;
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_byte.h"
+#include "rans64.h"
+#include "rans_interleave.h"
+#include "rans_stats.h"
+#include "rans_alias.h"
+
+// Sample program for large (16-bit) alphabets. The test data is book1
+// read as 16-bit little-endian words, so the alphabet is all 64K byte
+// pairs, a few thousand of which actually occur.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+static void check(uint16_t const* a, uint16_t const* b, size_t count)
+{
+    if (memcmp(a, b, count * sizeof(uint16_t)) == 0)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+}
+
+int main(int argc, char** argv)
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file(argc > 1 ? argv[1] : "book1", &in_size);
+
+    static const uint32_t nsyms = 1 << 16;
+    size_t count = in_size / 2;
+    uint16_t* in_syms = new uint16_t[count];
+    for (size_t i=0; i < count; i++)
+        in_syms[i] = (uint16_t) (in_bytes[i*2 + 0] | (in_bytes[i*2 + 1] << 8));
+
+    // rans64 gets more precision than rans_byte (which is limited to 16 bits).
+    static const uint32_t prob_bits = 20;
+    static const uint32_t prob_scale = 1 << prob_bits;
+
+    SymbolStats16 stats(nsyms);
+    stats.count_freqs(in_syms, count);
+    uint32_t nused = 0;
+    for (uint32_t s=0; s < nsyms; s++)
+        nused += stats.freqs[s] != 0;
+    stats.normalize_freqs(prob_scale);
+    printf("%d symbols, %d distinct\n", (int) count, (int) nused);
+
+    static size_t out_max_words = 8<<20; // 32MB
+    uint32_t* out_buf = new uint32_t[out_max_words];
+    uint32_t* out_end = out_buf + out_max_words;
+    uint16_t* dec_syms = new uint16_t[count];
+
+    // ---- cum2sym lookup, via the interleave driver. Needs a 16-bit entry per slot.
+    {
+        Rans64EncSymbol* esyms = new Rans64EncSymbol[nsyms];
+        Rans64DecSymbol* dsyms = new Rans64DecSymbol[nsyms];
+        uint16_t* cum2sym = new uint16_t[prob_scale];
+        for (uint32_t s=0; s < nsyms; s++) {
+            Rans64EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], prob_bits);
+            Rans64DecSymbolInit(&dsyms[s], stats.cum_freqs[s], stats.freqs[s]);
+            for (uint32_t i=stats.cum_freqs[s]; i < stats.cum_freqs[s+1]; i++)
+                cum2sym[i] = (uint16_t) s;
+        }
+
+        uint32_t* rans_begin = RansInterleavedEncode<2, Rans64Coder>(out_end, in_syms, count, esyms, prob_bits);
+        printf("\nrans64 + cum2sym, %dKB of decoder tables: %d bytes\n",
+            (int) ((prob_scale * sizeof(uint16_t) + nsyms * sizeof(Rans64DecSymbol)) >> 10),
+            (int) ((out_end - rans_begin) * sizeof(uint32_t)));
+
+        memset(dec_syms, 0xcc, count * sizeof(uint16_t));
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t dec_start_time = __rdtsc();
+
+            RansInterleavedDecode<2, Rans64Coder>(dec_syms, count, rans_begin, dsyms, cum2sym, prob_bits);
+
+            uint64_t dec_clocks = __rdtsc() - dec_start_time;
+            double dec_time = timer() - start_time;
+            printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMsyms/s)\n", dec_clocks, 1.0 * dec_clocks / count, 1.0 * count / (dec_time * 1000000.0));
+        }
+        check(in_syms, dec_syms, count);
+
+        delete[] esyms;
+        delete[] dsyms;
+        delete[] cum2sym;
+    }
+
+    // ---- alias tables, with rans64. Tables proportional to the number of used symbols.
+    {
+        RansAliasTable alias;
+        RansAliasInit(&alias, &stats.freqs[0], nsyms, prob_bits);
+
+        uint32_t* rans_begin = 0;
+        printf("\nrans64 + alias, %dKB of decoder tables:\n", (int) ((alias.buckets.size() * sizeof(RansAliasBucket)) >> 10));
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t enc_start_time = __rdtsc();
+
+            Rans64State rans0, rans1;
+            Rans64EncInit(&rans0);
+            Rans64EncInit(&rans1);
+
+            uint32_t* ptr = out_end;
+
+            // odd number of symbols?
+            if (count & 1)
+                Rans64AliasEncPut(&rans0, &ptr, &alias, in_syms[count - 1]);
+
+            for (size_t i=(count & ~1); i > 0; i -= 2) { // NB: working in reverse!
+                Rans64AliasEncPut(&rans1, &ptr, &alias, in_syms[i-1]);
+                Rans64AliasEncPut(&rans0, &ptr, &alias, in_syms[i-2]);
+            }
+            Rans64EncFlush(&rans1, &ptr);
+            Rans64EncFlush(&rans0, &ptr);
+            rans_begin = ptr;
+
+            uint64_t enc_clocks = __rdtsc() - enc_start_time;
+            double enc_time = timer() - start_time;
+            printf("enc: %" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMsyms/s)\n", enc_clocks, 1.0 * enc_clocks / count, 1.0 * count / (enc_time * 1000000.0));
+        }
+        printf("rans64 + alias: %d bytes\n", (int) ((out_end - rans_begin) * sizeof(uint32_t)));
+
+        memset(dec_syms, 0xcc, count * sizeof(uint16_t));
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t dec_start_time = __rdtsc();
+
+            Rans64State rans0, rans1;
+            uint32_t* ptr = rans_begin;
+            Rans64DecInit(&rans0, &ptr);
+            Rans64DecInit(&rans1, &ptr);
+
+            for (size_t i=0; i < (count & ~1); i += 2) {
+                dec_syms[i+0] = (uint16_t) Rans64AliasDecGet(&rans0, &alias);
+                dec_syms[i+1] = (uint16_t) Rans64AliasDecGet(&rans1, &alias);
+                Rans64DecRenorm(&rans0, &ptr);
+                Rans64DecRenorm(&rans1, &ptr);
+            }
+
+            // last symbol, if number of symbols was odd
+            if (count & 1) {
+                dec_syms[count - 1] = (uint16_t) Rans64AliasDecGet(&rans0, &alias);
+                Rans64DecRenorm(&rans0, &ptr);
+            }
+
+            uint64_t dec_clocks = __rdtsc() - dec_start_time;
+            double dec_time = timer() - start_time;
+            printf("dec: %" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMsyms/s)\n", dec_clocks, 1.0 * dec_clocks / count, 1.0 * count / (dec_time * 1000000.0));
+        }
+        check(in_syms, dec_syms, count);
+    }
+
+    // ---- alias tables, with rans_byte at 16 bits of precision.
+    {
+        static const uint32_t byte_prob_bits = 16;
+
+        SymbolStats16 stats16(nsyms);
+        stats16.count_freqs(in_syms, count);
+        stats16.normalize_freqs(1 << byte_prob_bits);
+
+        RansAliasTable alias;
+        RansAliasInit(&alias, &stats16.freqs[0], nsyms, byte_prob_bits);
+
+        uint8_t* byte_end = (uint8_t*) out_end;
+        RansState rans;
+        RansEncInit(&rans);
+        uint8_t* ptr = byte_end;
+        for (size_t i=count; i > 0; i--) // NB: working in reverse!
+            RansAliasEncPut(&rans, &ptr, &alias, in_syms[i-1]);
+        RansEncFlush(&rans, &ptr);
+        uint8_t* rans_begin = ptr;
+        printf("\nrans_byte + alias, %d bits: %d bytes\n", (int) byte_prob_bits, (int) (byte_end - rans_begin));
+
+        memset(dec_syms, 0xcc, count * sizeof(uint16_t));
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t dec_start_time = __rdtsc();
+
+            ptr = rans_begin;
+            RansDecInit(&rans, &ptr);
+            for (size_t i=0; i < count; i++) {
+                dec_syms[i] = (uint16_t) RansAliasDecGet(&rans, &alias);
+                RansDecRenorm(&rans, &ptr);
+            }
+
+            uint64_t dec_clocks = __rdtsc() - dec_start_time;
+            double dec_time = timer() - start_time;
+            printf("dec: %" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMsyms/s)\n", dec_clocks, 1.0 * dec_clocks / count, 1.0 * count / (dec_time * 1000000.0));
+        }
+        check(in_syms, dec_syms, count);
+    }
+
+    delete[] out_buf;
+    delete[] dec_syms;
+    delete[] in_syms;
+    delete[] in_bytes;
+    return 0;
+}
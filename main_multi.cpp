@@ -0,0 +1,258 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_interleave.h"
+#include "rans_multi.h"
+#include "rans_stats.h"
+#include "rans_corpus.h"
+
+// Sample program for rans_multi.h: compares regular fused decoding against
+// multi-symbol decoding on increasingly skewed data, at scale_bits=12.
+// Without a run symbol, checks that the token stream is the same as the
+// regular one.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+static const uint32_t scale_bits = 12;
+
+// Regular N-way fused decoding of the bytes. Returns the best-of-5 decode
+// time in clocks; the stream ends at "out_end" and is "*out_bytes" long.
+template<int N, typename Coder>
+static uint64_t run_plain(uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, typename Coder::Word* out_end,
+    SymbolStats const& stats, size_t* out_bytes, bool* ok)
+{
+    typedef typename Coder::Word Word;
+
+    typename Coder::EncSymbol esyms[256];
+    typename Coder::DecSlot slots[1 << scale_bits];
+    uint8_t cum2sym[1 << scale_bits];
+    for (int s=0; s < 256; s++) {
+        Coder::EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], scale_bits);
+        Coder::DecSlotsInitSymbol(slots, cum2sym, (uint8_t) s, stats.cum_freqs[s], stats.freqs[s]);
+    }
+
+    Word* rans_begin = RansInterleavedEncode<N, Coder>(out_end, in_bytes, in_size, esyms, scale_bits);
+    *out_bytes = (out_end - rans_begin) * sizeof(Word);
+
+    uint64_t best_clocks = ~0ull;
+    for (int run=0; run < 5; run++) {
+        memset(dec_bytes, 0xcc, in_size);
+        uint64_t start = __rdtsc();
+        RansInterleavedDecodeSlots<N, Coder>(dec_bytes, in_size, rans_begin, slots, cum2sym, scale_bits);
+        uint64_t clocks = __rdtsc() - start;
+        if (clocks < best_clocks)
+            best_clocks = clocks;
+        if (memcmp(in_bytes, dec_bytes, in_size) != 0)
+            *ok = false;
+    }
+
+    return best_clocks;
+}
+
+// The same through rans_multi.h.
+template<int N, typename Coder>
+static uint64_t run_multi(uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, typename Coder::Word* out_end,
+    SymbolStats const& stats, size_t* out_bytes, size_t* out_tokens, bool* ok)
+{
+    typedef typename Coder::Word Word;
+
+    int run_sym = RansMultiPickRunSym(stats.freqs);
+    uint16_t* tokens = new uint16_t[in_size];
+    size_t num_tokens = RansMultiTokenize(tokens, in_bytes, in_size, run_sym);
+
+    RansMultiStats mstats;
+    RansMultiCountTokens(&mstats, tokens, num_tokens);
+    RansMultiNormalize(&mstats, scale_bits);
+
+    typename Coder::EncSymbol esyms[RANS_MULTI_NUM_CODED];
+    RansMultiEntry* table = new RansMultiEntry[2 << scale_bits];
+    for (uint32_t t=0; t < RANS_MULTI_NUM_CODED; t++) {
+        Coder::EncSymbolInit(&esyms[t], mstats.cum_freqs[t], mstats.freqs[t], scale_bits);
+        RansMultiTableInitToken(table, t, run_sym, mstats.cum_freqs[t], mstats.freqs[t], scale_bits);
+    }
+
+    Word* rans_begin = RansInterleavedEncode<N, Coder>(out_end, tokens, num_tokens, esyms, scale_bits);
+    *out_bytes = (out_end - rans_begin) * sizeof(Word);
+    *out_tokens = num_tokens;
+
+    uint64_t best_clocks = ~0ull;
+    for (int run=0; run < 5; run++) {
+        memset(dec_bytes, 0xcc, in_size);
+        uint64_t start = __rdtsc();
+        RansMultiDecode<N, Coder>(dec_bytes, in_size, rans_begin, table, scale_bits);
+        uint64_t clocks = __rdtsc() - start;
+        if (clocks < best_clocks)
+            best_clocks = clocks;
+        if (memcmp(in_bytes, dec_bytes, in_size) != 0)
+            *ok = false;
+    }
+
+    delete[] table;
+    delete[] tokens;
+    return best_clocks;
+}
+
+template<int N, typename Coder>
+static bool run_coder(char const* coder_name, uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, SymbolStats const& stats)
+{
+    typedef typename Coder::Word Word;
+
+    size_t out_max_words = (in_size * 2) / sizeof(Word) + 64;
+    Word* out_buf = new Word[out_max_words + 8]; // extra words at end (rans32 decoder reads past it)
+    Word* out_end = out_buf + out_max_words;
+
+    Word* multi_buf = new Word[out_max_words + 8];
+    Word* multi_end = multi_buf + out_max_words;
+
+    bool ok = true;
+    size_t plain_bytes, multi_bytes, num_tokens;
+    uint64_t plain_clocks = run_plain<N, Coder>(in_bytes, in_size, dec_bytes, out_end, stats, &plain_bytes, &ok);
+    uint64_t multi_clocks = run_multi<N, Coder>(in_bytes, in_size, dec_bytes, multi_end, stats, &multi_bytes, &num_tokens, &ok);
+
+    // without a run symbol, the regular decoder is the fallback, so the
+    // streams had better be the same.
+    if (RansMultiPickRunSym(stats.freqs) == RANS_MULTI_NO_RUN_SYM) {
+        if (plain_bytes != multi_bytes || memcmp((uint8_t*) out_end - plain_bytes, (uint8_t*) multi_end - multi_bytes, plain_bytes) != 0) {
+            printf("ERROR: token stream differs from regular stream!\n");
+            ok = false;
+        }
+        multi_clocks = plain_clocks;
+    }
+
+    printf("  %-7s %d-way: plain %8d bytes %5.2f clk/sym   multi %8d bytes (%+.2f%%) %5.2f clk/sym, %.2f sym/token\n",
+        coder_name, N, (int) plain_bytes, 1.0 * plain_clocks / in_size,
+        (int) multi_bytes, 100.0 * ((double) multi_bytes / plain_bytes - 1.0), 1.0 * multi_clocks / in_size,
+        1.0 * in_size / (num_tokens ? num_tokens : 1));
+
+    delete[] out_buf;
+    delete[] multi_buf;
+    return ok;
+}
+
+static bool run_all(char const* name, uint8_t const* in_bytes, size_t in_size)
+{
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(1 << scale_bits);
+
+    int run_sym = RansMultiPickRunSym(stats.freqs);
+    printf("\n%s: %d bytes, order-0 entropy %.3f bits/symbol, ", name, (int) in_size,
+        RansCorpusOrder0Entropy(in_bytes, in_size));
+    if (run_sym != RANS_MULTI_NO_RUN_SYM)
+        printf("run symbol %d (p=%.3f)\n", run_sym, 1.0 * stats.freqs[run_sym] / (1 << scale_bits));
+    else
+        printf("no run symbol, regular decoder\n");
+
+    uint8_t* dec_bytes = new uint8_t[in_size];
+    bool ok = true;
+    ok = run_coder<1, Rans32Coder>("rans32", in_bytes, in_size, dec_bytes, stats) && ok;
+    ok = run_coder<4, Rans32Coder>("rans32", in_bytes, in_size, dec_bytes, stats) && ok;
+    ok = run_coder<4, Rans64Coder>("rans64", in_bytes, in_size, dec_bytes, stats) && ok;
+    ok = run_coder<4, RansByteCoder>("rans_byte", in_bytes, in_size, dec_bytes, stats) && ok;
+    delete[] dec_bytes;
+
+    if (ok)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+    return ok;
+}
+
+int main()
+{
+    // book1 has no dominant symbol, so this is the fallback
+    size_t in_size;
+    uint8_t* in_bytes = read_file("book1", &in_size);
+    run_all("book1", in_bytes, in_size);
+    delete[] in_bytes;
+
+    // skewed synthetic data: one dominant symbol, the rest spread out
+    // (spike), or a two-sided falloff like prediction residuals would have
+    // (geometric).
+    static const struct {
+        RansCorpusKind kind;
+        double param;
+    } sources[] = {
+        { RANS_CORPUS_SPIKE, 0.5 },
+        { RANS_CORPUS_SPIKE, 0.75 },
+        { RANS_CORPUS_SPIKE, 0.85 },
+        { RANS_CORPUS_SPIKE, 0.95 },
+        { RANS_CORPUS_GEOMETRIC, 0.3 },
+        { RANS_CORPUS_GEOMETRIC, 0.1 },
+    };
+
+    size_t size = 1 << 20;
+    uint8_t* data = new uint8_t[size];
+    for (size_t i=0; i < sizeof(sources) / sizeof(*sources); i++) {
+        RansCorpusKind kind = sources[i].kind;
+        RansCorpusGenerate(data, size, kind, sources[i].param, 1234);
+
+        char name[64];
+        sprintf(name, "%s:%g", RansCorpusKindNames[kind], sources[i].param);
+        run_all(name, data, size);
+    }
+
+    // odd sizes, to exercise the tails
+    for (size_t tail=0; tail < 12; tail++) {
+        size_t n = 1000 + tail;
+        RansCorpusGenerate(data, n, RANS_CORPUS_SPIKE, 0.9, 5678 + tail);
+        SymbolStats stats;
+        stats.count_freqs(data, n);
+        stats.normalize_freqs(1 << scale_bits);
+
+        uint8_t dec_bytes[1024];
+        uint8_t out8[4096];
+        uint16_t out16[2048 + 8];
+        uint32_t out32[1024];
+        size_t multi_bytes, num_tokens;
+        bool ok = true;
+        run_multi<4, Rans32Coder>(data, n, dec_bytes, out16 + 2048, stats, &multi_bytes, &num_tokens, &ok);
+        run_multi<3, Rans64Coder>(data, n, dec_bytes, out32 + 1024, stats, &multi_bytes, &num_tokens, &ok);
+        run_multi<5, RansByteCoder>(data, n, dec_bytes, out8 + 4096, stats, &multi_bytes, &num_tokens, &ok);
+        if (!ok) {
+            printf("\nsize %d: ERROR: bad decoder!\n", (int) n);
+            return 1;
+        }
+    }
+    printf("\nsmall sizes: decode ok!\n");
+
+    delete[] data;
+    return 0;
+}
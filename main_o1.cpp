@@ -0,0 +1,96 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_order1.h"
+
+// Sample program for the order-1 coder in rans_order1.h.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+int main(int argc, char** argv)
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file(argc > 1 ? argv[1] : "book1", &in_size);
+
+    size_t out_max = RansO1CompressBound(in_size);
+    uint8_t* out_buf = new uint8_t[out_max];
+    uint8_t* dec_bytes = new uint8_t[in_size];
+    size_t out_size = 0;
+
+    // try order-1 encode
+    printf("order-1 rANS encode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t enc_start_time = __rdtsc();
+
+        out_size = RansO1Compress(out_buf, out_max, in_bytes, in_size);
+
+        uint64_t enc_clocks = __rdtsc() - enc_start_time;
+        double enc_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", enc_clocks, 1.0 * enc_clocks / in_size, 1.0 * in_size / (enc_time * 1048576.0));
+    }
+    printf("order-1 rANS: %d bytes (tables: %d bytes)\n", (int) out_size, (int) RansGet32(out_buf + 16));
+
+    // try order-1 decode
+    bool ok = true;
+    for (int run=0; run < 5; run++) {
+        memset(dec_bytes, 0xcc, in_size);
+
+        double start_time = timer();
+        uint64_t dec_start_time = __rdtsc();
+
+        ok = RansO1Decompress(dec_bytes, in_size, out_buf, out_size) && ok;
+
+        uint64_t dec_clocks = __rdtsc() - dec_start_time;
+        double dec_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", dec_clocks, 1.0 * dec_clocks / in_size, 1.0 * in_size / (dec_time * 1048576.0));
+    }
+
+    // check decode results
+    if (ok && memcmp(in_bytes, dec_bytes, in_size) == 0)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+
+    delete[] out_buf;
+    delete[] dec_bytes;
+    delete[] in_bytes;
+    return 0;
+}
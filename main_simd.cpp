@@ -7,6 +7,17 @@
 #include <assert.h>
 
 #include "rans_word_sse41.h"
+#include "rans_container.h"
+#include "rans_table.h"
+#include "rans_stats.h"
+#include "rans_word_alias.h"
+#ifdef __AVX2__
+#include "rans_word_avx2.h"
+#endif
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VL__)
+#define HAVE_AVX512
+#include "rans_word_avx512.h"
+#endif
 
 // This is just the sample program. All the meat is in rans_byte.h.
 
@@ -44,88 +55,56 @@ static uint8_t* read_file(char const* filename, size_t* out_size)
     return buf;
 }
 
-// ---- Stats
+// ---- Decoding from a self-contained container
 
-struct SymbolStats
+// Decodes a container written by main() using nothing but its bytes.
+static bool decode_container(uint8_t const* in, size_t in_size, uint8_t* out, size_t out_size)
 {
-    uint32_t freqs[256];
-    uint32_t cum_freqs[257];
-
-    void count_freqs(uint8_t const* in, size_t nbytes);
-    void calc_cum_freqs();
-    void normalize_freqs(uint32_t target_total);
-};
-
-void SymbolStats::count_freqs(uint8_t const* in, size_t nbytes)
-{
-    for (int i=0; i < 256; i++)
-        freqs[i] = 0;
-
-    for (size_t i=0; i < nbytes; i++)
-        freqs[in[i]]++;
-}
-
-void SymbolStats::calc_cum_freqs()
-{
-    cum_freqs[0] = 0;
-    for (int i=0; i < 256; i++)
-        cum_freqs[i+1] = cum_freqs[i] + freqs[i];
-}
-
-void SymbolStats::normalize_freqs(uint32_t target_total)
-{
-    assert(target_total >= 256);
-    
-    calc_cum_freqs();
-    uint32_t cur_total = cum_freqs[256];
-    
-    // resample distribution based on cumulative freqs
-    for (int i = 1; i <= 256; i++)
-        cum_freqs[i] = ((uint64_t)target_total * cum_freqs[i])/cur_total;
-
-    // if we nuked any non-0 frequency symbol to 0, we need to steal
-    // the range to make the frequency nonzero from elsewhere.
-    //
-    // this is not at all optimal, i'm just doing the first thing that comes to mind.
-    for (int i=0; i < 256; i++) {
-        if (freqs[i] && cum_freqs[i+1] == cum_freqs[i]) {
-            // symbol i was set to zero freq
-
-            // find best symbol to steal frequency from (try to steal from low-freq ones)
-            uint32_t best_freq = ~0u;
-            int best_steal = -1;
-            for (int j=0; j < 256; j++) {
-                uint32_t freq = cum_freqs[j+1] - cum_freqs[j];
-                if (freq > 1 && freq < best_freq) {
-                    best_freq = freq;
-                    best_steal = j;
-                }
-            }
-            assert(best_steal != -1);
-
-            // and steal from it!
-            if (best_steal < i) {
-                for (int j = best_steal + 1; j <= i; j++)
-                    cum_freqs[j]--;
-            } else {
-                assert(best_steal > i);
-                for (int j = i + 1; j <= best_steal; j++)
-                    cum_freqs[j]++;
-            }
-        }
+    RansContainerHeader hdr;
+    uint8_t const* payload;
+    size_t payload_size;
+    if (RansContainerParse(in, in_size, &hdr, &payload, &payload_size) != RANS_CONTAINER_OK)
+        return false;
+    if (hdr.variant != RANS_VARIANT_WORD_SIMD || hdr.scale_bits != RANS_WORD_SCALE_BITS || hdr.interleave != 8 || hdr.num_symbols != out_size)
+        return false;
+
+    // rebuild the decoder tables from the stored frequencies
+    static RansWordTables tab;
+    uint32_t cum_freq = 0;
+    for (int s=0; s < 256; s++) {
+        RansWordTablesInitSymbol(&tab, (uint8_t)s, cum_freq, hdr.freqs[s]);
+        cum_freq += hdr.freqs[s];
     }
 
-    // calculate updated freqs and make sure we didn't screw anything up
-    assert(cum_freqs[0] == 0 && cum_freqs[256] == target_total);
-    for (int i=0; i < 256; i++) {
-        if (freqs[i] == 0)
-            assert(cum_freqs[i+1] == cum_freqs[i]);
-        else
-            assert(cum_freqs[i+1] > cum_freqs[i]);
+    // The payload comes straight from the caller, without padding, so this
+    // uses the checked decoder: the regular SIMD renorm while there are
+    // enough words left for any input, checked renorms for the rest.
+    RansSimdDec rans0, rans1;
+    uint16_t* ptr = (uint16_t*) payload;
+    uint16_t const* end = ptr + payload_size / 2;
+    if (!RansSimdDecInitChecked(&rans0, &ptr, end) || !RansSimdDecInitChecked(&rans1, &ptr, end))
+        return false;
+
+    for (size_t i=0; i < (out_size & ~7); i += 8) {
+        uint32_t s03 = RansSimdDecSym(&rans0, &tab);
+        uint32_t s47 = RansSimdDecSym(&rans1, &tab);
+        *(uint32_t *)(out + i) = s03;
+        *(uint32_t *)(out + i + 4) = s47;
+        if (end - ptr >= 8) {
+            RansSimdDecRenorm(&rans0, &ptr);
+            RansSimdDecRenorm(&rans1, &ptr);
+        } else if (!RansSimdDecRenormChecked(&rans0, &ptr, end) || !RansSimdDecRenormChecked(&rans1, &ptr, end))
+            return false;
+    }
 
-        // calc updated freq
-        freqs[i] = cum_freqs[i+1] - cum_freqs[i];
+    for (size_t i=(out_size & ~7); i < out_size; i++) {
+        RansSimdDec* which = (i & 4) != 0 ? &rans1 : &rans0;
+        out[i] = RansWordDecSym(&which->lane[i & 3], &tab);
+        if (!RansWordDecRenormChecked(&which->lane[i & 3], &ptr, end))
+            return false;
     }
+
+    return RansSimdDecIsFinal(&rans0) && RansSimdDecIsFinal(&rans1);
 }
 
 int main()
@@ -142,6 +121,11 @@ int main()
     for (int s=0; s < 256; s++)
         RansWordTablesInitSymbol(&tab, (uint8_t)s, stats.cum_freqs[s], stats.freqs[s]);
 
+    // init SIMD encoder symbols
+    RansWordEncSymbol esyms[256];
+    for (int s=0; s < 256; s++)
+        RansWordEncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s]);
+
     size_t out_max_size = in_size + (in_size >> 3) + 128;
     uint8_t* out_buf = new uint8_t[out_max_size + 16]; // extra bytes at end
     uint8_t* dec_bytes = new uint8_t[in_size];
@@ -305,6 +289,49 @@ int main()
     }
     printf("SIMD rANS: %d bytes\n", (int) (out_buf + out_max_size - (uint8_t*)rans_begin));
 
+    // keep the reference stream around so we can compare against it
+    size_t ref_size = out_buf + out_max_size - (uint8_t*)rans_begin;
+    uint8_t* ref_bytes = new uint8_t[ref_size];
+    memcpy(ref_bytes, rans_begin, ref_size);
+
+    // try SIMD rANS encode
+    printf("\nSIMD rANS encode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t enc_start_time = __rdtsc();
+
+        RansSimdEnc rans0, rans1;
+        RansSimdEncInit(&rans0);
+        RansSimdEncInit(&rans1);
+
+        uint16_t* ptr = (uint16_t *)(out_buf + out_max_size); // *end* of output buffer
+
+        // last few bytes
+        for (size_t i=in_size; i > (in_size & ~7); i--) { // NB: working in reverse
+            RansSimdEnc* which = ((i - 1) & 4) != 0 ? &rans1 : &rans0;
+            int s = in_bytes[i - 1];
+            RansWordEncPut(&which->lane[(i - 1) & 3], &ptr, stats.cum_freqs[s], stats.freqs[s]);
+        }
+
+        for (size_t i=(in_size & ~7); i > 0; i -= 8) { // NB: working in reverse!
+            RansSimdEncPut(&rans1, &ptr, esyms, *(uint32_t *)(in_bytes + i - 4));
+            RansSimdEncPut(&rans0, &ptr, esyms, *(uint32_t *)(in_bytes + i - 8));
+        }
+        RansSimdEncFlush(&rans1, &ptr);
+        RansSimdEncFlush(&rans0, &ptr);
+        rans_begin = ptr;
+
+        uint64_t enc_clocks = __rdtsc() - enc_start_time;
+        double enc_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", enc_clocks, 1.0 * enc_clocks / in_size, 1.0 * in_size / (enc_time * 1048576.0));
+    }
+
+    // check encode results
+    if (out_buf + out_max_size - (uint8_t*)rans_begin == (ptrdiff_t)ref_size && memcmp(ref_bytes, rans_begin, ref_size) == 0)
+        printf("encode ok!\n");
+    else
+        printf("ERROR: bad encoder!\n");
+
     // try SIMD rANS decode
     for (int run=0; run < 5; run++) {
         double start_time = timer();
@@ -342,6 +369,392 @@ int main()
     else
         printf("ERROR: bad decoder!\n");
 
+#ifdef __AVX2__
+    // ---- AVX2 decode of the same 8-way interleaved stream.
+
+    memset(dec_bytes, 0xcc, in_size);
+
+    printf("\nAVX2 rANS encode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t enc_start_time = __rdtsc();
+
+        RansAvx2Enc rans;
+        RansAvx2EncInit(&rans);
+
+        uint16_t* ptr = (uint16_t *)(out_buf + out_max_size); // *end* of output buffer
+
+        // last few bytes
+        for (size_t i=in_size; i > (in_size & ~7); i--) { // NB: working in reverse
+            int s = in_bytes[i - 1];
+            RansWordEncPut(&rans.lane[(i - 1) & 7], &ptr, stats.cum_freqs[s], stats.freqs[s]);
+        }
+
+        for (size_t i=(in_size & ~7); i > 0; i -= 8) // NB: working in reverse!
+            RansAvx2EncPut(&rans, &ptr, esyms, *(uint64_t *)(in_bytes + i - 8));
+        RansAvx2EncFlush(&rans, &ptr);
+        rans_begin = ptr;
+
+        uint64_t enc_clocks = __rdtsc() - enc_start_time;
+        double enc_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", enc_clocks, 1.0 * enc_clocks / in_size, 1.0 * in_size / (enc_time * 1048576.0));
+    }
+
+    // check encode results
+    if (out_buf + out_max_size - (uint8_t*)rans_begin == (ptrdiff_t)ref_size && memcmp(ref_bytes, rans_begin, ref_size) == 0)
+        printf("encode ok!\n");
+    else
+        printf("ERROR: bad encoder!\n");
+
+    printf("\nAVX2 rANS decode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t dec_start_time = __rdtsc();
+
+        RansAvx2Dec rans;
+        uint16_t* ptr = rans_begin;
+        RansAvx2DecInit(&rans, &ptr);
+
+        for (size_t i=0; i < (in_size & ~7); i += 8) {
+            uint64_t s07 = RansAvx2DecSym(&rans, &tab);
+            *(uint64_t *)(dec_bytes + i) = s07;
+            RansAvx2DecRenorm(&rans, &ptr);
+        }
+
+        // last few bytes
+        for (size_t i=(in_size & ~7); i < in_size; i++) {
+            uint8_t s = RansWordDecSym(&rans.lane[i & 7], &tab);
+            dec_bytes[i] = s;
+        }
+
+        uint64_t dec_clocks = __rdtsc() - dec_start_time;
+        double dec_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMB/s)\n", dec_clocks, 1.0 * dec_clocks / in_size, 1.0 * in_size / (dec_time * 1048576.0));
+    }
+
+    // check decode results
+    if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+
+    // checked decode, from an exactly-sized copy of the stream (no padding)
+    {
+        size_t num_words = (uint16_t*) (out_buf + out_max_size) - rans_begin;
+        uint16_t* exact = new uint16_t[num_words];
+        memcpy(exact, rans_begin, num_words * sizeof(uint16_t));
+        uint16_t const* end = exact + num_words;
+        memset(dec_bytes, 0xcc, in_size);
+
+        RansAvx2Dec rans;
+        uint16_t* ptr = exact;
+        bool ok = RansAvx2DecInitChecked(&rans, &ptr, end);
+
+        for (size_t i=0; ok && i < (in_size & ~7); i += 8) {
+            uint64_t s07 = RansAvx2DecSym(&rans, &tab);
+            *(uint64_t *)(dec_bytes + i) = s07;
+            if (end - ptr >= 8)
+                RansAvx2DecRenorm(&rans, &ptr);
+            else
+                ok = RansAvx2DecRenormChecked(&rans, &ptr, end);
+        }
+        for (size_t i=(in_size & ~7); ok && i < in_size; i++) {
+            dec_bytes[i] = RansWordDecSym(&rans.lane[i & 7], &tab);
+            ok = RansWordDecRenormChecked(&rans.lane[i & 7], &ptr, end);
+        }
+
+        if (ok && RansAvx2DecIsFinal(&rans) && memcmp(in_bytes, dec_bytes, in_size) == 0)
+            printf("checked decode ok!\n");
+        else
+            printf("ERROR: bad checked decoder!\n");
+        delete[] exact;
+    }
+#endif
+
+#ifdef HAVE_AVX512
+    // ---- 16-way interleaved rANS encode/decode.
+
+    memset(dec_bytes, 0xcc, in_size);
+
+    // reference 16-way stream, using the scalar encoder
+    // this is written for clarity not speed.
+    {
+        RansWordEnc rans[16];
+        for (int i=0; i < 16; i++)
+            rans[i] = RansWordEncInit();
+
+        uint16_t* ptr = (uint16_t *)(out_buf + out_max_size); // *end* of output buffer
+        for (size_t i=in_size; i > 0; i--) { // NB: working in reverse
+            int s = in_bytes[i - 1];
+            RansWordEncPut(&rans[(i - 1) & 15], &ptr, stats.cum_freqs[s], stats.freqs[s]);
+        }
+        for (int i=16; i > 0; i--)
+            RansWordEncFlush(&rans[i - 1], &ptr);
+        rans_begin = ptr;
+    }
+    printf("\n16-way SIMD rANS: %d bytes\n", (int) (out_buf + out_max_size - (uint8_t*)rans_begin));
+
+    delete[] ref_bytes;
+    ref_size = out_buf + out_max_size - (uint8_t*)rans_begin;
+    ref_bytes = new uint8_t[ref_size];
+    memcpy(ref_bytes, rans_begin, ref_size);
+
+    printf("AVX-512 rANS encode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t enc_start_time = __rdtsc();
+
+        RansAvx512Enc rans;
+        RansAvx512EncInit(&rans);
+
+        uint16_t* ptr = (uint16_t *)(out_buf + out_max_size); // *end* of output buffer
+
+        // last few bytes
+        for (size_t i=in_size; i > (in_size & ~15); i--) { // NB: working in reverse
+            int s = in_bytes[i - 1];
+            RansWordEncPut(&rans.lane[(i - 1) & 15], &ptr, stats.cum_freqs[s], stats.freqs[s]);
+        }
+
+        for (size_t i=(in_size & ~15); i > 0; i -= 16) // NB: working in reverse!
+            RansAvx512EncPut(&rans, &ptr, esyms, _mm_loadu_si128((const __m128i*)(in_bytes + i - 16)));
+        RansAvx512EncFlush(&rans, &ptr);
+        rans_begin = ptr;
+
+        uint64_t enc_clocks = __rdtsc() - enc_start_time;
+        double enc_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMiB/s)\n", enc_clocks, 1.0 * enc_clocks / in_size, 1.0 * in_size / (enc_time * 1048576.0));
+    }
+
+    // check encode results
+    if (out_buf + out_max_size - (uint8_t*)rans_begin == (ptrdiff_t)ref_size && memcmp(ref_bytes, rans_begin, ref_size) == 0)
+        printf("encode ok!\n");
+    else
+        printf("ERROR: bad encoder!\n");
+
+    printf("\nAVX-512 rANS decode:\n");
+    for (int run=0; run < 5; run++) {
+        double start_time = timer();
+        uint64_t dec_start_time = __rdtsc();
+
+        RansAvx512Dec rans;
+        uint16_t* ptr = rans_begin;
+        RansAvx512DecInit(&rans, &ptr);
+
+        for (size_t i=0; i < (in_size & ~15); i += 16) {
+            __m128i s015 = RansAvx512DecSym(&rans, &tab);
+            _mm_storeu_si128((__m128i *)(dec_bytes + i), s015);
+            RansAvx512DecRenorm(&rans, &ptr);
+        }
+
+        // last few bytes
+        for (size_t i=(in_size & ~15); i < in_size; i++) {
+            uint8_t s = RansWordDecSym(&rans.lane[i & 15], &tab);
+            dec_bytes[i] = s;
+        }
+
+        uint64_t dec_clocks = __rdtsc() - dec_start_time;
+        double dec_time = timer() - start_time;
+        printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMB/s)\n", dec_clocks, 1.0 * dec_clocks / in_size, 1.0 * in_size / (dec_time * 1048576.0));
+    }
+
+    // check decode results
+    if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+
+    // checked decode, from an exactly-sized copy of the stream (no padding)
+    {
+        size_t num_words = (uint16_t*) (out_buf + out_max_size) - rans_begin;
+        uint16_t* exact = new uint16_t[num_words];
+        memcpy(exact, rans_begin, num_words * sizeof(uint16_t));
+        uint16_t const* end = exact + num_words;
+        memset(dec_bytes, 0xcc, in_size);
+
+        RansAvx512Dec rans;
+        uint16_t* ptr = exact;
+        bool ok = RansAvx512DecInitChecked(&rans, &ptr, end);
+
+        for (size_t i=0; ok && i < (in_size & ~15); i += 16) {
+            __m128i s015 = RansAvx512DecSym(&rans, &tab);
+            _mm_storeu_si128((__m128i *)(dec_bytes + i), s015);
+            if (end - ptr >= 16)
+                RansAvx512DecRenorm(&rans, &ptr);
+            else
+                ok = RansAvx512DecRenormChecked(&rans, &ptr, end);
+        }
+        for (size_t i=(in_size & ~15); ok && i < in_size; i++) {
+            dec_bytes[i] = RansWordDecSym(&rans.lane[i & 15], &tab);
+            ok = RansWordDecRenormChecked(&rans.lane[i & 15], &ptr, end);
+        }
+
+        if (ok && RansAvx512DecIsFinal(&rans) && memcmp(in_bytes, dec_bytes, in_size) == 0)
+            printf("checked decode ok!\n");
+        else
+            printf("ERROR: bad checked decoder!\n");
+        delete[] exact;
+    }
+#endif
+
+    // ---- SIMD alias decoding: same 8-way stream layout, but with more
+    // precise probabilities than the fully unrolled tables can do. (Up to
+    // 16 bits works, but with L=1<<16, the state gets close to M at that
+    // point, which costs a bit; on book1, 14 bits is the sweet spot.)
+
+    memset(dec_bytes, 0xcc, in_size);
+    {
+        static const uint32_t alias_prob_bits = 14;
+
+        SymbolStats stats16;
+        stats16.count_freqs(in_bytes, in_size);
+        stats16.normalize_freqs(1 << alias_prob_bits);
+
+        RansAliasTable alias;
+        RansAliasInit(&alias, stats16.freqs, 256, alias_prob_bits);
+        static RansWordAliasTables alias_tab;
+        RansWordAliasTablesInit(&alias_tab, &alias);
+
+        RansWordEnc rans[8];
+        for (int i=0; i < 8; i++)
+            rans[i] = RansWordEncInit();
+
+        uint16_t* end = (uint16_t *)(out_buf + out_max_size);
+        uint16_t* ptr = end;
+        for (size_t i=in_size; i > 0; i--) // NB: working in reverse
+            RansWordAliasEncPut(&rans[(i - 1) & 7], &ptr, &alias, in_bytes[i - 1]);
+        for (int i=8; i > 0; i--)
+            RansWordEncFlush(&rans[i - 1], &ptr);
+        rans_begin = ptr;
+        printf("\nSIMD alias rANS, %d bits: %d bytes (%d bytes of decoder tables)\n", (int) alias_prob_bits,
+            (int) ((uint8_t*) end - (uint8_t*) rans_begin), (int) sizeof(alias_tab.buckets[0]) * (int) alias.buckets.size());
+
+        printf("SSE 4.1 alias decode:\n");
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t dec_start_time = __rdtsc();
+
+            RansSimdDec rans0, rans1;
+            ptr = rans_begin;
+            RansSimdDecInit(&rans0, &ptr);
+            RansSimdDecInit(&rans1, &ptr);
+
+            for (size_t i=0; i < (in_size & ~7); i += 8) {
+                uint32_t s03 = RansSimdAliasDecSym(&rans0, &alias_tab);
+                uint32_t s47 = RansSimdAliasDecSym(&rans1, &alias_tab);
+                *(uint32_t *)(dec_bytes + i) = s03;
+                *(uint32_t *)(dec_bytes + i + 4) = s47;
+                RansSimdDecRenorm(&rans0, &ptr);
+                RansSimdDecRenorm(&rans1, &ptr);
+            }
+
+            // last few bytes
+            for (size_t i=(in_size & ~7); i < in_size; i++) {
+                RansSimdDec* which = (i & 4) != 0 ? &rans1 : &rans0;
+                dec_bytes[i] = RansWordAliasDecSym(&which->lane[i & 3], &alias_tab);
+            }
+
+            uint64_t dec_clocks = __rdtsc() - dec_start_time;
+            double dec_time = timer() - start_time;
+            printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMB/s)\n", dec_clocks, 1.0 * dec_clocks / in_size, 1.0 * in_size / (dec_time * 1048576.0));
+        }
+
+        if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+            printf("decode ok!\n");
+        else
+            printf("ERROR: bad decoder!\n");
+
+#ifdef __AVX2__
+        memset(dec_bytes, 0xcc, in_size);
+
+        printf("AVX2 alias decode:\n");
+        for (int run=0; run < 5; run++) {
+            double start_time = timer();
+            uint64_t dec_start_time = __rdtsc();
+
+            RansAvx2Dec rans;
+            ptr = rans_begin;
+            RansAvx2DecInit(&rans, &ptr);
+
+            for (size_t i=0; i < (in_size & ~7); i += 8) {
+                uint64_t s07 = RansAvx2AliasDecSym(&rans, &alias_tab);
+                *(uint64_t *)(dec_bytes + i) = s07;
+                RansAvx2DecRenorm(&rans, &ptr);
+            }
+
+            // last few bytes
+            for (size_t i=(in_size & ~7); i < in_size; i++)
+                dec_bytes[i] = RansWordAliasDecSym(&rans.lane[i & 7], &alias_tab);
+
+            uint64_t dec_clocks = __rdtsc() - dec_start_time;
+            double dec_time = timer() - start_time;
+            printf("%" PRIu64 " clocks, %.1f clocks/symbol (%5.1fMB/s)\n", dec_clocks, 1.0 * dec_clocks / in_size, 1.0 * in_size / (dec_time * 1048576.0));
+        }
+
+        if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+            printf("decode ok!\n");
+        else
+            printf("ERROR: bad decoder!\n");
+#endif
+    }
+
+    // ---- compact frequency table: encode the table, then set up the
+    // decoder tables straight from the encoded form.
+    {
+        uint8_t table[RANS_TABLE_MAX_SIZE];
+        size_t table_size = RansTableWrite(table, stats.freqs, RANS_WORD_SCALE_BITS);
+        printf("\ncompact table: %d bytes (raw: 512 bytes)\n", (int) table_size);
+
+        static RansWordTables tab2;
+        if (RansTableReadWordTables(&tab2, table, table_size) == table_size && memcmp(&tab, &tab2, sizeof(tab)) == 0)
+            printf("table ok!\n");
+        else
+            printf("ERROR: bad table!\n");
+    }
+
+    // ---- self-contained stream: container header + 8-way interleaved SIMD rANS.
+    // The decoder only gets to see the container bytes.
+
+    memset(dec_bytes, 0xcc, in_size);
+    {
+        RansContainerHeader hdr;
+        hdr.variant = RANS_VARIANT_WORD_SIMD;
+        hdr.scale_bits = RANS_WORD_SCALE_BITS;
+        hdr.interleave = 8;
+        hdr.num_symbols = in_size;
+        for (int s=0; s < 256; s++)
+            hdr.freqs[s] = stats.freqs[s];
+
+        RansSimdEnc rans0, rans1;
+        RansSimdEncInit(&rans0);
+        RansSimdEncInit(&rans1);
+
+        uint16_t* end = (uint16_t *)(out_buf + out_max_size);
+        uint16_t* ptr = end;
+        for (size_t i=in_size; i > (in_size & ~7); i--) { // NB: working in reverse
+            RansSimdEnc* which = ((i - 1) & 4) != 0 ? &rans1 : &rans0;
+            int s = in_bytes[i - 1];
+            RansWordEncPut(&which->lane[(i - 1) & 3], &ptr, stats.cum_freqs[s], stats.freqs[s]);
+        }
+        for (size_t i=(in_size & ~7); i > 0; i -= 8) {
+            RansSimdEncPut(&rans1, &ptr, esyms, *(uint32_t *)(in_bytes + i - 4));
+            RansSimdEncPut(&rans0, &ptr, esyms, *(uint32_t *)(in_bytes + i - 8));
+        }
+        RansSimdEncFlush(&rans1, &ptr);
+        RansSimdEncFlush(&rans0, &ptr);
+
+        // rANS output goes at the end of the buffer, so the header just goes in front of it.
+        uint8_t* container = (uint8_t*) ptr - RansContainerHeaderSize(&hdr);
+        RansContainerWriteHeader(container, &hdr, (uint8_t*) end - (uint8_t*) ptr);
+        size_t container_size = (uint8_t*) end - container;
+        printf("\ncontainer: %d bytes\n", (int) container_size);
+
+        if (decode_container(container, container_size, dec_bytes, in_size) && memcmp(in_bytes, dec_bytes, in_size) == 0)
+            printf("decode ok!\n");
+        else
+            printf("ERROR: bad decoder!\n");
+    }
+
+    delete[] ref_bytes;
     delete[] out_buf;
     delete[] dec_bytes;
     delete[] in_bytes;
@@ -0,0 +1,279 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_byte.h"
+#include "rans64.h"
+#include "rans_interleave.h"
+#include "rans_word_sse41.h"
+#include "rans_static.h"
+
+// Sample program for rans_static.h: a fixed model (book1's order-0
+// statistics at scale_bits=12), with all coder tables built at compile
+// time. Checks that the compile-time coders produce the same streams as
+// rans_byte.h and rans64.h with runtime tables, and compares their speed.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+// ---- The built-in model
+
+static const uint32_t prob_bits = 12;
+
+// book1, normalized to 1 << 12.
+static constexpr uint32_t book1_freqs[256] = {
+       1,   0,   0,   0,   0,   0,   0,   0,   0,   0,  88,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,   0,   0,
+     667,   4,  13,   0,   0,   0,   1,  34,   1,   1,   1,   4,  55,  21,  38,   0,
+       1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   4,   3,   1,   3,   4,
+       0,   5,   8,   3,   1,   2,   2,   3,   5,  15,   1,   1,   2,   3,   3,   5,
+       4,   1,   1,   5,  10,   1,   1,   4,   1,   2,   0,   0,   0,   0,   0,   0,
+       0, 254,  48,  67, 141, 385,  65,  65, 199, 196,   3,  27, 123,  75, 217, 238,
+      50,   3, 175, 195, 266,  85,  29,  75,   5,  64,   1,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+typedef RansStaticByte<prob_bits> StaticByte;
+typedef RansStatic64<prob_bits> Static64;
+typedef RansStaticCoder<uint32_t, uint16_t, 1u << 15, prob_bits> Static16; // 16-bit words
+
+static_assert(RansStaticFreqsValid<StaticByte>(book1_freqs), "bad model");
+
+static constexpr RansStaticTables<StaticByte, 256> byte_tables = RansStaticTablesMake<StaticByte>(book1_freqs);
+static constexpr RansStaticTables<Static64, 256> rans64_tables = RansStaticTablesMake<Static64>(book1_freqs);
+static constexpr RansStaticTables<Static16, 256> word16_tables = RansStaticTablesMake<Static16>(book1_freqs);
+static constexpr RansWordTables word_tables = RansWordTablesMake(book1_freqs);
+
+// ---- Runtime tables for the same model, for comparison
+
+template<typename Coder>
+struct RuntimeTables {
+    typename Coder::EncSymbol esyms[256];
+    typename Coder::DecSymbol dsyms[256];
+    uint8_t cum2sym[1 << prob_bits];
+
+    void init()
+    {
+        uint32_t start = 0;
+        for (int s=0; s < 256; s++) {
+            Coder::EncSymbolInit(&esyms[s], start, book1_freqs[s], prob_bits);
+            Coder::DecSymbolInit(&dsyms[s], start, book1_freqs[s]);
+            for (uint32_t i=0; i < book1_freqs[s]; i++)
+                cum2sym[start + i] = (uint8_t) s;
+            start += book1_freqs[s];
+        }
+    }
+};
+
+// ---- Tests
+
+// Best-of-5 clocks for encoding and decoding with N-way interleaving.
+// Returns the start of the encoded stream.
+template<int N, typename Coder>
+static typename Coder::Word* time_coder(char const* name, uint8_t const* in_bytes, size_t in_size, typename Coder::Word* out_end,
+    uint8_t* dec_bytes, typename Coder::EncSymbol const* esyms, typename Coder::DecSymbol const* dsyms, uint8_t const* cum2sym)
+{
+    typename Coder::Word* rans_begin = out_end;
+    uint64_t enc_best = ~0ull, dec_best = ~0ull;
+
+    memset(dec_bytes, 0xcc, in_size);
+    for (int run=0; run < 5; run++) {
+        uint64_t start = __rdtsc();
+        rans_begin = RansInterleavedEncode<N, Coder>(out_end, in_bytes, in_size, esyms, prob_bits);
+        uint64_t clocks = __rdtsc() - start;
+        enc_best = clocks < enc_best ? clocks : enc_best;
+    }
+    for (int run=0; run < 5; run++) {
+        uint64_t start = __rdtsc();
+        RansInterleavedDecode<N, Coder>(dec_bytes, in_size, rans_begin, dsyms, cum2sym, prob_bits);
+        uint64_t clocks = __rdtsc() - start;
+        dec_best = clocks < dec_best ? clocks : dec_best;
+    }
+
+    printf("%-24s %d bytes, encode %.1f clocks/symbol, decode %.1f clocks/symbol\n", name,
+        (int) ((out_end - rans_begin) * sizeof(*rans_begin)), 1.0 * enc_best / in_size, 1.0 * dec_best / in_size);
+    if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+
+    return rans_begin;
+}
+
+// Runs the runtime coder "Ref" against its compile-time counterpart "Static"
+// (with "tables"), and checks that they produce the same stream.
+template<int N, typename Ref, typename Static>
+static void compare(char const* name, uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes,
+    RansStaticTables<Static, 256> const* tables)
+{
+    typedef typename Ref::Word Word;
+    size_t out_words = in_size / sizeof(Word) + 64;
+    Word* ref_buf = new Word[out_words];
+    Word* static_buf = new Word[out_words];
+
+    printf("\n%s, %d-way:\n", name, N);
+
+    RuntimeTables<Ref>* ref = new RuntimeTables<Ref>;
+    uint64_t start = __rdtsc();
+    ref->init();
+    uint64_t setup_clocks = __rdtsc() - start;
+    printf("runtime table setup: %" PRIu64 " clocks\n", setup_clocks);
+
+    Word* ref_begin = time_coder<N, Ref>("runtime tables:", in_bytes, in_size, ref_buf + out_words, dec_bytes,
+        ref->esyms, ref->dsyms, ref->cum2sym);
+    Word* static_begin = time_coder<N, Static>("compile-time:", in_bytes, in_size, static_buf + out_words, dec_bytes,
+        tables->esyms, tables->dsyms, tables->cum2sym);
+
+    size_t ref_size = ref_buf + out_words - ref_begin;
+    if (static_buf + out_words - static_begin == (ptrdiff_t) ref_size && memcmp(ref_begin, static_begin, ref_size * sizeof(Word)) == 0)
+        printf("encode ok!\n");
+    else
+        printf("ERROR: streams differ!\n");
+
+    delete ref;
+    delete[] ref_buf;
+    delete[] static_buf;
+}
+
+// The SSE 4.1 word coder with the compile-time tables (8-way, like
+// main_simd.cpp; the last few symbols go through the scalar encoder).
+static void test_word(uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes)
+{
+    printf("\nSSE 4.1 word coder, 8-way:\n");
+
+    RansWordTables* ref = new RansWordTables;
+    uint32_t start = 0;
+    for (int s=0; s < 256; s++) {
+        RansWordTablesInitSymbol(ref, (uint8_t) s, start, book1_freqs[s]);
+        start += book1_freqs[s];
+    }
+    if (memcmp(ref, &word_tables, sizeof(*ref)) == 0)
+        printf("tables ok!\n");
+    else
+        printf("ERROR: tables differ!\n");
+    delete ref;
+
+    // constexpr encoder symbols
+    static constexpr struct WordEncSymbols {
+        RansWordEncSymbol syms[256];
+        constexpr WordEncSymbols() : syms()
+        {
+            uint32_t start = 0;
+            for (int s=0; s < 256; s++) {
+                syms[s] = RansWordEncSymbolMake(start, book1_freqs[s]);
+                start += book1_freqs[s];
+            }
+        }
+    } esyms;
+
+    size_t out_words = in_size + 64;
+    uint16_t* out_buf = new uint16_t[out_words + 8]; // decoder reads a bit past the end
+    uint16_t* ptr = out_buf + out_words;
+
+    RansSimdEnc enc0, enc1;
+    RansSimdEncInit(&enc0);
+    RansSimdEncInit(&enc1);
+    for (size_t i=in_size; i > (in_size & ~7); i--) { // NB: working in reverse
+        RansSimdEnc* which = ((i - 1) & 4) != 0 ? &enc1 : &enc0;
+        RansWordEncSymbol const* s = &esyms.syms[in_bytes[i - 1]];
+        RansWordEncPut(&which->lane[(i - 1) & 3], &ptr, s->start, s->freq);
+    }
+    for (size_t i=(in_size & ~7); i > 0; i -= 8) { // NB: working in reverse!
+        RansSimdEncPut(&enc1, &ptr, esyms.syms, *(uint32_t *)(in_bytes + i - 4));
+        RansSimdEncPut(&enc0, &ptr, esyms.syms, *(uint32_t *)(in_bytes + i - 8));
+    }
+    RansSimdEncFlush(&enc1, &ptr);
+    RansSimdEncFlush(&enc0, &ptr);
+    printf("%d bytes\n", (int) ((out_buf + out_words - ptr) * sizeof(uint16_t)));
+
+    RansSimdDec dec0, dec1;
+    RansSimdDecInit(&dec0, &ptr);
+    RansSimdDecInit(&dec1, &ptr);
+    for (size_t i=0; i < (in_size & ~7); i += 8) {
+        uint32_t s03 = RansSimdDecSym(&dec0, &word_tables);
+        uint32_t s47 = RansSimdDecSym(&dec1, &word_tables);
+        *(uint32_t *)(dec_bytes + i) = s03;
+        *(uint32_t *)(dec_bytes + i + 4) = s47;
+        RansSimdDecRenorm(&dec0, &ptr);
+        RansSimdDecRenorm(&dec1, &ptr);
+    }
+    for (size_t i=(in_size & ~7); i < in_size; i++) {
+        RansSimdDec* which = (i & 4) != 0 ? &dec1 : &dec0;
+        dec_bytes[i] = RansWordDecSym(&which->lane[i & 3], &word_tables);
+    }
+
+    if (memcmp(in_bytes, dec_bytes, in_size) == 0)
+        printf("decode ok!\n");
+    else
+        printf("ERROR: bad decoder!\n");
+
+    delete[] out_buf;
+}
+
+int main()
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file("book1", &in_size);
+    uint8_t* dec_bytes = new uint8_t[in_size + 8];
+
+    compare<1, RansByteCoder, StaticByte>("rans_byte", in_bytes, in_size, dec_bytes, &byte_tables);
+    compare<4, RansByteCoder, StaticByte>("rans_byte", in_bytes, in_size, dec_bytes, &byte_tables);
+    compare<1, Rans64Coder, Static64>("rans64", in_bytes, in_size, dec_bytes, &rans64_tables);
+    compare<4, Rans64Coder, Static64>("rans64", in_bytes, in_size, dec_bytes, &rans64_tables);
+
+    // no runtime equivalent for this one
+    printf("\n32-bit state, 16-bit words, 4-way:\n");
+    size_t out_words = in_size / 2 + 64;
+    uint16_t* out_buf = new uint16_t[out_words];
+    time_coder<4, Static16>("compile-time:", in_bytes, in_size, out_buf + out_words, dec_bytes,
+        word16_tables.esyms, word16_tables.dsyms, word16_tables.cum2sym);
+    delete[] out_buf;
+
+    test_word(in_bytes, in_size, dec_bytes);
+
+    delete[] dec_bytes;
+    delete[] in_bytes;
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_stream.h"
+
+// Sample program for the streaming compressor in rans_stream.h.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+// Compressed output just gets appended to a vector here; a real program
+// would write it to a file or socket.
+static bool append_sink(void* user, uint8_t const* data, size_t size)
+{
+    std::vector<uint8_t>* out = (std::vector<uint8_t>*) user;
+    out->insert(out->end(), data, data + size);
+    return true;
+}
+
+// Decoded output gets compared against the original as it comes in.
+struct CompareSink {
+    uint8_t const* expected;
+    size_t size;
+    size_t pos;
+};
+
+static bool compare_sink(void* user, uint8_t const* data, size_t size)
+{
+    CompareSink* cmp = (CompareSink*) user;
+    if (size > cmp->size - cmp->pos || memcmp(cmp->expected + cmp->pos, data, size) != 0)
+        return false;
+    cmp->pos += size;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file(argc > 1 ? argv[1] : "book1", &in_size);
+
+    static const char* const coder_names[] = { "rans_byte", "rans64" };
+    static const size_t chunk_size = 1500; // pretend the data trickles in
+
+    std::vector<uint8_t> out;
+    out.reserve(in_size);
+
+    for (uint32_t coder=RANS_BLOCK_CODER_BYTE; coder <= RANS_BLOCK_CODER_64; coder++) {
+        for (size_t limit=16 << 10; limit <= (1 << 20); limit <<= 2) {
+            RansStreamOptions opts;
+            RansStreamOptionsInit(&opts);
+            opts.coder = coder;
+            opts.memory_limit = limit;
+
+            printf("\n%s, %dKB memory limit:\n", coder_names[coder], (int) (limit >> 10));
+
+            double start_time = timer();
+            uint64_t enc_start_time = __rdtsc();
+
+            out.clear();
+            RansStreamEncoder enc;
+            if (!RansStreamEncoderInit(&enc, &opts, append_sink, &out))
+                panic("encoder init failed\n");
+            for (size_t pos=0; pos < in_size; pos += chunk_size) {
+                size_t n = (in_size - pos < chunk_size) ? in_size - pos : chunk_size;
+                RansStreamEncoderPush(&enc, in_bytes + pos, n);
+            }
+            bool enc_ok = RansStreamEncoderFinish(&enc);
+
+            uint64_t enc_clocks = __rdtsc() - enc_start_time;
+            double enc_time = timer() - start_time;
+
+            CompareSink cmp;
+            cmp.expected = in_bytes;
+            cmp.size = in_size;
+            cmp.pos = 0;
+
+            start_time = timer();
+            bool dec_ok = RansStreamDecompress(out.data(), out.size(), enc.block_size, compare_sink, &cmp) && cmp.pos == in_size;
+            double dec_time = timer() - start_time;
+
+            printf("%dKB blocks, %d bytes of buffers: %d bytes, enc %.1f clocks/symbol (%5.1fMiB/s), dec %5.1fMiB/s\n",
+                (int) (enc.block_size >> 10), (int) RansStreamEncoderMemory(&enc), (int) out.size(),
+                1.0 * enc_clocks / in_size, 1.0 * in_size / (enc_time * 1048576.0), 1.0 * in_size / (dec_time * 1048576.0));
+
+            // push decoder, with the compressed data arriving in pieces
+            static const size_t dec_chunk_sizes[] = { 1, 1500, 65536 };
+            for (size_t c=0; c < sizeof(dec_chunk_sizes) / sizeof(dec_chunk_sizes[0]); c++) {
+                size_t dec_chunk = dec_chunk_sizes[c];
+                cmp.pos = 0;
+
+                start_time = timer();
+                RansStreamDecoder dec;
+                RansStreamDecoderInit(&dec, enc.block_size, compare_sink, &cmp);
+                int result = RANS_STREAM_NEED_INPUT;
+                for (size_t pos=0; pos < out.size() && result == RANS_STREAM_NEED_INPUT; pos += dec_chunk) {
+                    size_t n = (out.size() - pos < dec_chunk) ? out.size() - pos : dec_chunk;
+                    result = RansStreamDecoderPush(&dec, out.data() + pos, n);
+                }
+                dec_time = timer() - start_time;
+
+                printf("push decode, %5d-byte pieces: %5.1fMiB/s\n", (int) dec_chunk, 1.0 * in_size / (dec_time * 1048576.0));
+                if (result != RANS_STREAM_END || cmp.pos != in_size)
+                    dec_ok = false;
+            }
+
+            if (enc_ok && RansStreamEncoderMemory(&enc) <= limit && dec_ok)
+                printf("decode ok!\n");
+            else
+                printf("ERROR: bad decoder!\n");
+        }
+    }
+
+    // A frame header claiming a huge frame must be rejected up front, not
+    // make the decoder allocate 4GB.
+    {
+        RansStreamOptions opts;
+        RansStreamOptionsInit(&opts);
+        out.clear();
+        RansStreamEncoder enc;
+        if (!RansStreamEncoderInit(&enc, &opts, append_sink, &out) || !RansStreamEncoderFinish(&enc))
+            panic("encoder init failed\n");
+
+        uint8_t bad[RANS_STREAM_HEADER_SIZE + RANS_STREAM_FRAME_HEADER_SIZE + 4] = { 0 };
+        memcpy(bad, out.data(), RANS_STREAM_HEADER_SIZE);
+        RansPut32(bad + RANS_STREAM_HEADER_SIZE + 0, 0xffffffffu);
+        RansPut32(bad + RANS_STREAM_HEADER_SIZE + 4, 4);
+
+        CompareSink cmp;
+        cmp.expected = in_bytes;
+        cmp.size = in_size;
+        cmp.pos = 0;
+        if (!RansStreamDecompress(bad, sizeof(bad), enc.block_size, compare_sink, &cmp))
+            printf("\noversized frame rejected: ok!\n");
+        else
+            printf("\nERROR: oversized frame accepted!\n");
+    }
+
+    delete[] in_bytes;
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rans_byte.h"
+#include "rans32.h"
+#include "rans_interleave.h"
+#include "rans_tans.h"
+#include "rans_stats.h"
+#include "rans_corpus.h"
+
+// Sample program for rans_tans.h: tANS against rANS (fused decoding) with
+// the same normalized frequencies, on book1 and on small-alphabet
+// synthetic data, at scale_bits 11 and 12.
+
+static void panic(const char *fmt, ...)
+{
+    va_list arg;
+
+    va_start(arg, fmt);
+    fputs("Error: ", stderr);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    fputs("\n", stderr);
+
+    exit(1);
+}
+
+static uint8_t* read_file(char const* filename, size_t* out_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        panic("file not found: %s\n", filename);
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* buf = new uint8_t[size];
+    if (fread(buf, size, 1, f) != 1)
+        panic("read failed\n");
+
+    fclose(f);
+    if (out_size)
+        *out_size = size;
+
+    return buf;
+}
+
+static bool check(uint8_t const* in_bytes, uint8_t const* dec_bytes, size_t size)
+{
+    if (memcmp(in_bytes, dec_bytes, size) == 0)
+        return true;
+
+    printf("ERROR: bad decoder!\n");
+    return false;
+}
+
+// Best-of-5 encode and fused decode for one rANS coder.
+template<int N, typename Coder>
+static bool time_rans(char const* name, uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, SymbolStats const& stats, uint32_t scale_bits)
+{
+    typedef typename Coder::Word Word;
+
+    typename Coder::EncSymbol esyms[256];
+    typename Coder::DecSlot* slots = new typename Coder::DecSlot[1 << scale_bits];
+    uint8_t* cum2sym = new uint8_t[1 << scale_bits];
+    for (int s=0; s < 256; s++) {
+        Coder::EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], scale_bits);
+        Coder::DecSlotsInitSymbol(slots, cum2sym, (uint8_t) s, stats.cum_freqs[s], stats.freqs[s]);
+    }
+
+    size_t out_max_words = (in_size * 2) / sizeof(Word) + 64;
+    Word* out_buf = new Word[out_max_words + 8]; // extra words at end (rans32 decoder reads past it)
+    Word* out_end = out_buf + out_max_words;
+    Word* rans_begin = out_end;
+
+    uint64_t enc_clocks = ~0ull, dec_clocks = ~0ull;
+    bool ok = true;
+    for (int run=0; run < 5; run++) {
+        uint64_t start = __rdtsc();
+        rans_begin = RansInterleavedEncode<N, Coder>(out_end, in_bytes, in_size, esyms, scale_bits);
+        uint64_t clocks = __rdtsc() - start;
+        if (clocks < enc_clocks)
+            enc_clocks = clocks;
+
+        memset(dec_bytes, 0xcc, in_size);
+        start = __rdtsc();
+        RansInterleavedDecodeSlots<N, Coder>(dec_bytes, in_size, rans_begin, slots, cum2sym, scale_bits);
+        clocks = __rdtsc() - start;
+        if (clocks < dec_clocks)
+            dec_clocks = clocks;
+        ok = ok && check(in_bytes, dec_bytes, in_size);
+    }
+
+    printf("  %-9s %d-way: %8d bytes  enc %5.2f  dec %5.2f clocks/symbol\n", name, N,
+        (int) ((out_end - rans_begin) * sizeof(Word)), 1.0 * enc_clocks / in_size, 1.0 * dec_clocks / in_size);
+
+    delete[] out_buf;
+    delete[] slots;
+    delete[] cum2sym;
+    return ok;
+}
+
+// Encodes with N-way tANS into a buffer ending at "out_end" (with room for
+// the decoder to read past it), decodes and checks. Returns the stream
+// size in bytes, or 0 if the decode failed.
+template<int N>
+static size_t code_tans(uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, uint8_t* out_end,
+    RansTansEncTable const* enc, RansTansDecEntry const* dec, uint64_t* enc_clocks, uint64_t* dec_clocks)
+{
+    uint64_t start = __rdtsc();
+    uint8_t* begin = RansTansEncode<N>(out_end, in_bytes, in_size, enc);
+    *enc_clocks = __rdtsc() - start;
+
+    memset(dec_bytes, 0xcc, in_size);
+    start = __rdtsc();
+    uint8_t const* end = RansTansDecode<N>(dec_bytes, in_size, begin, dec, enc->table_log);
+    *dec_clocks = __rdtsc() - start;
+
+    if (end != out_end || memcmp(in_bytes, dec_bytes, in_size) != 0)
+        return 0;
+    return out_end - begin;
+}
+
+// Best-of-5 for N-way tANS.
+template<int N>
+static bool time_tans(uint8_t const* in_bytes, size_t in_size, uint8_t* dec_bytes, RansTansEncTable const* enc, RansTansDecEntry const* dec)
+{
+    size_t out_max = in_size * 2 + 64;
+    uint8_t* out_buf = new uint8_t[out_max + 16]; // decoder reads up to 16 bytes past the end
+
+    uint64_t enc_clocks = ~0ull, dec_clocks = ~0ull;
+    size_t out_bytes = 0;
+    bool ok = true;
+    for (int run=0; run < 5; run++) {
+        uint64_t enc_run, dec_run;
+        out_bytes = code_tans<N>(in_bytes, in_size, dec_bytes, out_buf + out_max, enc, dec, &enc_run, &dec_run);
+        if (!out_bytes) {
+            printf("ERROR: bad decoder!\n");
+            ok = false;
+        }
+        if (enc_run < enc_clocks)
+            enc_clocks = enc_run;
+        if (dec_run < dec_clocks)
+            dec_clocks = dec_run;
+    }
+
+    printf("  %-9s %d-way: %8d bytes  enc %5.2f  dec %5.2f clocks/symbol\n", "tans", N,
+        (int) out_bytes, 1.0 * enc_clocks / in_size, 1.0 * dec_clocks / in_size);
+
+    delete[] out_buf;
+    return ok;
+}
+
+static bool time_all(char const* name, uint8_t const* in_bytes, size_t in_size, uint32_t scale_bits)
+{
+    printf("\n%s: %d bytes, order-0 entropy %.3f bits/symbol, scale_bits=%d\n", name, (int) in_size,
+        RansCorpusOrder0Entropy(in_bytes, in_size), (int) scale_bits);
+
+    SymbolStats stats;
+    stats.count_freqs(in_bytes, in_size);
+    stats.normalize_freqs(1 << scale_bits);
+
+    RansTansEncTable* enc = new RansTansEncTable;
+    RansTansDecEntry* dec = new RansTansDecEntry[1 << scale_bits];
+    RansTansEncTableInit(enc, stats.freqs, scale_bits);
+    RansTansDecTableInit(dec, stats.freqs, scale_bits);
+
+    uint8_t* dec_bytes = new uint8_t[in_size];
+    bool ok = true;
+    ok = time_rans<4, RansByteCoder>("rans_byte", in_bytes, in_size, dec_bytes, stats, scale_bits) && ok;
+    ok = time_rans<4, Rans32Coder>("rans32", in_bytes, in_size, dec_bytes, stats, scale_bits) && ok;
+    ok = time_tans<1>(in_bytes, in_size, dec_bytes, enc, dec) && ok;
+    ok = time_tans<2>(in_bytes, in_size, dec_bytes, enc, dec) && ok;
+    ok = time_tans<4>(in_bytes, in_size, dec_bytes, enc, dec) && ok;
+
+    if (ok)
+        printf("decode ok!\n");
+
+    delete[] dec_bytes;
+    delete[] dec;
+    delete enc;
+    return ok;
+}
+
+int main()
+{
+    size_t in_size;
+    uint8_t* in_bytes = read_file("book1", &in_size);
+
+    bool ok = true;
+    ok = time_all("book1", in_bytes, in_size, 11) && ok;
+    ok = time_all("book1", in_bytes, in_size, 12) && ok;
+    delete[] in_bytes;
+
+    // small alphabets, where tANS is usually used
+    static const struct {
+        RansCorpusKind kind;
+        double param;
+    } sources[] = {
+        { RANS_CORPUS_UNIFORM, 16 },
+        { RANS_CORPUS_GEOMETRIC, 0.5 },
+        { RANS_CORPUS_GEOMETRIC, 0.1 },
+    };
+
+    size_t size = 1 << 20;
+    uint8_t* data = new uint8_t[size];
+    for (size_t i=0; i < sizeof(sources) / sizeof(*sources); i++) {
+        RansCorpusKind kind = sources[i].kind;
+        RansCorpusGenerate(data, size, kind, sources[i].param, 1234);
+
+        char name[64];
+        sprintf(name, "%s:%g", RansCorpusKindNames[kind], sources[i].param);
+        ok = time_all(name, data, size, 11) && ok;
+        ok = time_all(name, data, size, 12) && ok;
+    }
+
+    // odd sizes (including empty), to exercise the tails, and the extremes
+    // of table_log (SymbolStats::normalize_freqs wants at least 256, so
+    // normalize directly; 16 symbols fit at any table_log)
+    static const uint32_t table_logs[] = { RANS_TANS_MIN_TABLE_LOG, 11, RANS_TANS_MAX_TABLE_LOG };
+    RansTansEncTable* enc = new RansTansEncTable;
+    RansTansDecEntry* dec = new RansTansDecEntry[1 << RANS_TANS_MAX_TABLE_LOG];
+    for (size_t k=0; k < sizeof(table_logs) / sizeof(*table_logs); k++) {
+        uint32_t table_log = table_logs[k];
+        for (size_t n=0; n < 40; n++) {
+            RansCorpusGenerate(data, n + 1, RANS_CORPUS_UNIFORM, 16, 5678 + n);
+            SymbolStats stats;
+            stats.count_freqs(data, n + 1);
+            RansNormalizeFreqs(stats.freqs, 256, 1 << table_log);
+            RansTansEncTableInit(enc, stats.freqs, table_log);
+            RansTansDecTableInit(dec, stats.freqs, table_log);
+
+            uint8_t dec_bytes[64];
+            uint8_t out_buf[256];
+            uint64_t enc_clocks, dec_clocks;
+            bool tail_ok = code_tans<1>(data, n, dec_bytes, out_buf + 128, enc, dec, &enc_clocks, &dec_clocks) != 0;
+            tail_ok = code_tans<3>(data, n, dec_bytes, out_buf + 128, enc, dec, &enc_clocks, &dec_clocks) != 0 && tail_ok;
+            tail_ok = code_tans<8>(data, n, dec_bytes, out_buf + 128, enc, dec, &enc_clocks, &dec_clocks) != 0 && tail_ok;
+            if (!tail_ok) {
+                printf("\nsize %d, table_log %d: ERROR: bad decoder!\n", (int) n, (int) table_log);
+                ok = false;
+            }
+        }
+    }
+    if (ok)
+        printf("\nsmall sizes: decode ok!\n");
+
+    delete[] dec;
+    delete enc;
+    delete[] data;
+    return ok ? 0 : 1;
+}
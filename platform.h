@@ -29,7 +29,7 @@
 
 #define PRIu64 "llu"
 
-double timer()
+static inline double timer()
 {
     LARGE_INTEGER ctr, freq;
     QueryPerformanceCounter(&ctr);
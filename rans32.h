@@ -0,0 +1,314 @@
+// 32-bit rANS encoder/decoder with 16-bit renormalization - public domain
+//
+// This is a scalar version of the coder in rans_word_sse41.h: 32-bit
+// states with L=1<<16 and 16-bit words. Since L >= M and the words are at
+// least as wide as scale_bits, renormalization moves exactly zero or one
+// word per symbol, on both sides, and never needs to loop. That makes it
+// possible to write both renormalizations without branches: the encoder
+// always stores the low 16 bits and only advances the pointer if it
+// needed to; the decoder always loads the next word and only keeps it
+// (and advances) if it needed it. The selects are written as masks;
+// written as ?:, GCC turns them into branches at least some of the time.
+//
+// rans_byte.h renormalizes with a loop around a data-dependent branch,
+// which mispredicts a lot on data in the middle of the entropy range (2-6
+// bits/symbol, say), where a symbol may or may not need a renorm with
+// no easy pattern. Here, the cost is the same either way.
+//
+// The encoder uses reciprocals like rans_byte.h (Rans32EncPutSymbol), but
+// since the states use all 32 bits, there's no exact 32-bit reciprocal;
+// we use the same estimate-and-fix-up as RansSimdEncPut instead, also
+// without branches.
+//
+// Up to scale_bits=16. At scale_bits=12 (RANS_WORD_SCALE_BITS), the
+// streams are the same as the word coder's: 8-way interleaving via
+// rans_interleave.h gives exactly what main_simd.cpp writes, and can be
+// decoded with the SIMD decoders (and vice versa). The one exception is a
+// symbol with freq=M (the only symbol in the alphabet), which this coder
+// handles without renormalizing every symbol; either stream decodes fine
+// with either decoder.
+//
+// NOTE: the decoder reads one word ahead, so Rans32DecRenorm (and
+// Rans32DecAdvance) can read one 16-bit word past the end of the stream.
+// Pad the buffer, or use the checked functions near the end.
+
+#ifndef RANS32_HEADER
+#define RANS32_HEADER
+
+#include <stdint.h>
+
+#include "rans_instrument.h"
+
+#ifdef assert
+#define Rans32Assert assert
+#else
+#define Rans32Assert(x)
+#endif
+
+#define RANS32_L (1u << 16)  // lower bound of our normalization interval
+
+// State for a rANS encoder. Yep, that's all there is to it.
+typedef uint32_t Rans32State;
+
+// Initialize a rANS encoder.
+static inline void Rans32EncInit(Rans32State* r)
+{
+    *r = RANS32_L;
+}
+
+// Upper bound (inclusive) of the pre-normalization interval for a symbol,
+// i.e. x_max - 1. x_max itself is 2^32 for freq = M, which wraps to 0 in 32
+// bits, but then so does the product below, and subtracting 1 gives the
+// right answer.
+static inline uint32_t Rans32XLim(uint32_t freq, uint32_t scale_bits)
+{
+    return ((RANS32_L >> scale_bits) << 16) * freq - 1;
+}
+
+// Renormalize the encoder: emits a word if x > x_lim. Internal function.
+static inline uint32_t Rans32EncRenorm(uint32_t x, uint16_t** pptr, uint32_t x_lim)
+{
+    // Always store; if we didn't need to, the pointer doesn't move, and
+    // the word gets overwritten later (at the latest, by Rans32EncFlush).
+    uint16_t* ptr = *pptr;
+    uint32_t renorm = x > x_lim;
+    ptr[-1] = (uint16_t) x;
+    *pptr = ptr - renorm;
+    uint32_t mask = 0u - renorm;
+    return (x & ~mask) | ((x >> 16) & mask); // = renorm ? x >> 16 : x
+}
+
+// Encodes a single symbol with range start "start" and frequency "freq".
+// All frequencies are assumed to sum to "1 << scale_bits", and the
+// resulting words get written to ptr (which is updated).
+//
+// NOTE: With rANS, you need to encode symbols in *reverse order*, i.e. from
+// beginning to end! Likewise, the output stream is written *backwards*:
+// ptr starts pointing at the end of the output buffer and keeps decrementing.
+static inline void Rans32EncPut(Rans32State* r, uint16_t** pptr, uint32_t start, uint32_t freq, uint32_t scale_bits)
+{
+    Rans32Assert(freq != 0);
+
+    // renormalize
+    RANS_COUNT(uint16_t* start_ptr = *pptr);
+    uint32_t x = Rans32EncRenorm(*r, pptr, Rans32XLim(freq, scale_bits));
+    RANS_COUNT(RansCountEnc(&RansGetCounters()->rans32, RansCountCost(freq, scale_bits), start_ptr - *pptr));
+
+    // x = C(s,x)
+    *r = ((x / freq) << scale_bits) + (x % freq) + start;
+}
+
+// Flushes the rANS encoder.
+static inline void Rans32EncFlush(Rans32State* r, uint16_t** pptr)
+{
+    uint32_t x = *r;
+    uint16_t* ptr = *pptr;
+
+    ptr -= 2;
+    ptr[0] = (uint16_t) (x >> 0);
+    ptr[1] = (uint16_t) (x >> 16);
+
+    *pptr = ptr;
+}
+
+// Initializes a rANS decoder.
+// Unlike the encoder, the decoder works forwards as you'd expect.
+static inline void Rans32DecInit(Rans32State* r, uint16_t** pptr)
+{
+    uint32_t x;
+    uint16_t* ptr = *pptr;
+
+    x  = ptr[0] << 0;
+    x |= ptr[1] << 16;
+    ptr += 2;
+
+    *pptr = ptr;
+    *r = x;
+}
+
+// Returns the current cumulative frequency (map it to a symbol yourself!)
+static inline uint32_t Rans32DecGet(Rans32State* r, uint32_t scale_bits)
+{
+    return *r & ((1u << scale_bits) - 1);
+}
+
+// Renormalize.
+static inline void Rans32DecRenorm(Rans32State* r, uint16_t** pptr)
+{
+    // Always load the next word (this is the read past the end mentioned
+    // above); keep it only if the state is below L.
+    uint32_t x = *r;
+    uint16_t* ptr = *pptr;
+    uint32_t renorm = x < RANS32_L;
+    uint32_t x_in = (x << 16) | *ptr;
+    uint32_t mask = 0u - renorm;
+    *r = (x & ~mask) | (x_in & mask); // = renorm ? x_in : x
+    *pptr = ptr + renorm;
+    RANS_COUNT(RansCountDec(&RansGetCounters()->rans32, renorm));
+}
+
+// Advances in the bit stream by "popping" a single symbol with range start
+// "start" and frequency "freq". All frequencies are assumed to sum to "1 << scale_bits".
+// No renormalization or output happens.
+static inline void Rans32DecAdvanceStep(Rans32State* r, uint32_t start, uint32_t freq, uint32_t scale_bits)
+{
+    uint32_t mask = (1u << scale_bits) - 1;
+
+    // s, x = D(x)
+    uint32_t x = *r;
+    *r = freq * (x >> scale_bits) + (x & mask) - start;
+}
+
+// Advances in the bit stream by "popping" a single symbol with range start
+// "start" and frequency "freq". All frequencies are assumed to sum to "1 << scale_bits",
+// and the resulting words get read from ptr (which is updated).
+static inline void Rans32DecAdvance(Rans32State* r, uint16_t** pptr, uint32_t start, uint32_t freq, uint32_t scale_bits)
+{
+    Rans32DecAdvanceStep(r, start, freq, scale_bits);
+    Rans32DecRenorm(r, pptr);
+}
+
+// --------------------------------------------------------------------------
+
+// That's all you need for a full encoder; below here are some utility
+// functions with extra convenience or optimizations.
+
+// Encoder symbol description. Same idea as in rans_byte.h, but with the
+// fix-up step (see Rans32EncPutSymbol), this needs freq as well.
+typedef struct {
+    uint32_t x_lim;     // (Inclusive) upper bound of pre-normalization interval
+    uint32_t rcp_freq;  // Fixed-point reciprocal frequency
+    uint32_t freq;      // Symbol frequency
+    uint32_t bias;      // Bias (= start)
+    uint32_t cmpl_freq; // Complement of frequency: (1 << scale_bits) - freq
+} Rans32EncSymbol;
+
+// Decoder symbols are straightforward.
+typedef struct {
+    uint32_t start;     // Start of range.
+    uint32_t freq;      // Symbol frequency.
+} Rans32DecSymbol;
+
+// Initializes an encoder symbol to start "start" and frequency "freq"
+static inline void Rans32EncSymbolInit(Rans32EncSymbol* s, uint32_t start, uint32_t freq, uint32_t scale_bits)
+{
+    Rans32Assert(scale_bits <= 16);
+    Rans32Assert(start <= (1u << scale_bits));
+    Rans32Assert(freq <= (1u << scale_bits) - start);
+
+    // As in rans_byte.h, the encoder computes
+    //   x_new = x + bias + q*cmpl_freq
+    // with q = x / freq. Our x can use all 32 bits, so we use
+    // rcp_freq = floor((2^32-1)/freq), which gives an estimate
+    // q' = mul_hi(x, rcp_freq) with
+    //   x/freq - x/2^32 - 1 < q' <= x/freq
+    // i.e. q' is either q or q-1, and it's q-1 exactly when the remainder
+    // x - q'*freq is >= freq. That covers freq=1 as well (q' = x-1 for
+    // x >= 1, which always gets fixed up), so no special case needed.
+    // (freq=0 symbols can't be encoded.)
+    s->x_lim = Rans32XLim(freq, scale_bits);
+    s->rcp_freq = freq ? 0xffffffffu / freq : 0;
+    s->freq = freq;
+    s->bias = start;
+    s->cmpl_freq = (1u << scale_bits) - freq;
+}
+
+// Initialize a decoder symbol to start "start" and frequency "freq"
+static inline void Rans32DecSymbolInit(Rans32DecSymbol* s, uint32_t start, uint32_t freq)
+{
+    Rans32Assert(start <= (1 << 16));
+    Rans32Assert(freq <= (1 << 16) - start);
+    s->start = start;
+    s->freq = freq;
+}
+
+// Encodes a given symbol. This is faster than straight Rans32EncPut since we
+// can do multiplications instead of a divide.
+static inline void Rans32EncPutSymbol(Rans32State* r, uint16_t** pptr, Rans32EncSymbol const* sym)
+{
+    Rans32Assert(sym->freq != 0); // can't encode symbol with freq=0
+
+    // renormalize
+    RANS_COUNT(uint16_t* start_ptr = *pptr);
+    uint32_t x = Rans32EncRenorm(*r, pptr, sym->x_lim);
+    RANS_COUNT(RansCountEnc(&RansGetCounters()->rans32, RansCountCost(sym->freq, RansCountLog2(sym->freq + sym->cmpl_freq)), start_ptr - *pptr));
+
+    // x = C(s,x)
+    uint32_t q = (uint32_t) (((uint64_t)x * sym->rcp_freq) >> 32);
+    q += (x - q * sym->freq) >= sym->freq; // fix up if q was one too small
+    *r = x + sym->bias + q * sym->cmpl_freq;
+}
+
+// Equivalent to Rans32DecAdvance that takes a symbol.
+static inline void Rans32DecAdvanceSymbol(Rans32State* r, uint16_t** pptr, Rans32DecSymbol const* sym, uint32_t scale_bits)
+{
+    Rans32DecAdvance(r, pptr, sym->start, sym->freq, scale_bits);
+}
+
+// Equivalent to Rans32DecAdvanceStep that takes a symbol.
+static inline void Rans32DecAdvanceSymbolStep(Rans32State* r, Rans32DecSymbol const* sym, uint32_t scale_bits)
+{
+    Rans32DecAdvanceStep(r, sym->start, sym->freq, scale_bits);
+}
+
+// --------------------------------------------------------------------------
+
+// Fused decoder table (one lookup per symbol); see the notes in rans_byte.h.
+typedef uint32_t Rans32DecSlot;
+
+// Initializes the slots (and cum2sym entries) for a symbol with range start
+// "start" and frequency "freq".
+static inline void Rans32DecSlotsInitSymbol(Rans32DecSlot* slots, uint8_t* cum2sym, uint8_t sym, uint32_t start, uint32_t freq)
+{
+    Rans32Assert(start <= (1 << 16));
+    Rans32Assert(freq <= (1 << 16) - start);
+    for (uint32_t i=0; i < freq; i++) {
+        slots[start + i] = (freq - 1) | (i << 16);
+        cum2sym[start + i] = sym;
+    }
+}
+
+// Equivalent to Rans32DecAdvanceStep, using the slot for the current state
+// (i.e. slots[Rans32DecGet(r, scale_bits)]).
+static inline void Rans32DecAdvanceSlotStep(Rans32State* r, Rans32DecSlot slot, uint32_t scale_bits)
+{
+    // s, x = D(x)
+    uint32_t q = *r >> scale_bits;
+    *r = (slot & 0xffff) * q + (q + (slot >> 16));
+}
+
+// --------------------------------------------------------------------------
+
+// Checked decoding, for untrusted input; see the notes in rans_byte.h.
+// Here, the valid state range is [L, 2^32), renorm never reads more than
+// one word, and the final state is RANS32_L. These only read words they
+// actually use, so they never touch "end".
+
+// Like Rans32DecInit. Fails if there aren't 2 words left or the state is
+// out of range.
+static inline int Rans32DecInitChecked(Rans32State* r, uint16_t** pptr, uint16_t const* end)
+{
+    if (end - *pptr < 2)
+        return 0;
+
+    Rans32DecInit(r, pptr);
+    return *r >= RANS32_L;
+}
+
+// Like Rans32DecRenorm. Fails if it would have to read past "end".
+static inline int Rans32DecRenormChecked(Rans32State* r, uint16_t** pptr, uint16_t const* end)
+{
+    uint32_t x = *r;
+    if (x < RANS32_L) {
+        if (*pptr == end)
+            return 0;
+        x = (x << 16) | **pptr;
+        *pptr += 1;
+    }
+    RANS_COUNT(RansCountDec(&RansGetCounters()->rans32, x != *r));
+
+    *r = x;
+    return 1;
+}
+
+#endif // RANS32_HEADER
@@ -15,6 +15,8 @@
 
 #include <stdint.h>
 
+#include "rans_instrument.h"
+
 #ifdef assert
 #define Rans64Assert assert
 #else
@@ -81,12 +83,14 @@ static inline void Rans64EncPut(Rans64State* r, uint32_t** pptr, uint32_t start,
     // renormalize (never needs to loop)
     uint64_t x = *r;
     uint64_t x_max = ((RANS64_L >> scale_bits) << 32) * freq; // this turns into a shift.
+    RANS_COUNT(uint32_t* start_ptr = *pptr);
     if (x >= x_max) {
         *pptr -= 1;
         **pptr = (uint32_t) x;
         x >>= 32;
         Rans64Assert(x < x_max);
     }
+    RANS_COUNT(RansCountEnc(&RansGetCounters()->rans64, RansCountCost(freq, scale_bits), start_ptr - *pptr));
 
     // x = C(s,x)
     *r = ((x / freq) << scale_bits) + (x % freq) + start;
@@ -132,6 +136,7 @@ static inline void Rans64DecAdvance(Rans64State* r, uint32_t** pptr, uint32_t st
     x = freq * (x >> scale_bits) + (x & mask) - start;
 
     // renormalize
+    RANS_COUNT(RansCountDec(&RansGetCounters()->rans64, x < RANS64_L));
     if (x < RANS64_L) {
         x = (x << 32) | **pptr;
         *pptr += 1;
@@ -266,11 +271,13 @@ static inline void Rans64EncPutSymbol(Rans64State* r, uint32_t** pptr, Rans64Enc
     // renormalize
     uint64_t x = *r;
     uint64_t x_max = ((RANS64_L >> scale_bits) << 32) * sym->freq; // turns into a shift
+    RANS_COUNT(uint32_t* start_ptr = *pptr);
     if (x >= x_max) {
         *pptr -= 1;
         **pptr = (uint32_t) x;
         x >>= 32;
     }
+    RANS_COUNT(RansCountEnc(&RansGetCounters()->rans64, RansCountCost(sym->freq, scale_bits), start_ptr - *pptr));
 
     // x = C(s,x)
     uint64_t q = Rans64MulHi(x, sym->rcp_freq) >> sym->rcp_shift;
@@ -306,6 +313,7 @@ static inline void Rans64DecRenorm(Rans64State* r, uint32_t** pptr)
 {
     // renormalize
     uint64_t x = *r;
+    RANS_COUNT(RansCountDec(&RansGetCounters()->rans64, x < RANS64_L));
     if (x < RANS64_L) {
         x = (x << 32) | **pptr;
         *pptr += 1;
@@ -315,4 +323,64 @@ static inline void Rans64DecRenorm(Rans64State* r, uint32_t** pptr)
     *r = x;
 }
 
+// --------------------------------------------------------------------------
+
+// Fused decoder table (one lookup per symbol); see the notes in rans_byte.h.
+// Same slot layout, so this is limited to scale_bits <= 16.
+typedef uint32_t Rans64DecSlot;
+
+// Initializes the slots (and cum2sym entries) for a symbol with range start
+// "start" and frequency "freq".
+static inline void Rans64DecSlotsInitSymbol(Rans64DecSlot* slots, uint8_t* cum2sym, uint8_t sym, uint32_t start, uint32_t freq)
+{
+    Rans64Assert(start <= (1 << 16));
+    Rans64Assert(freq <= (1 << 16) - start);
+    for (uint32_t i=0; i < freq; i++) {
+        slots[start + i] = (freq - 1) | (i << 16);
+        cum2sym[start + i] = sym;
+    }
+}
+
+// Equivalent to Rans64DecAdvanceStep, using the slot for the current state
+// (i.e. slots[Rans64DecGet(r, scale_bits)]).
+static inline void Rans64DecAdvanceSlotStep(Rans64State* r, Rans64DecSlot slot, uint32_t scale_bits)
+{
+    // s, x = D(x)
+    uint64_t q = *r >> scale_bits;
+    *r = (slot & 0xffff) * q + (q + (slot >> 16));
+}
+
+// --------------------------------------------------------------------------
+
+// Checked decoding, for untrusted input; see the notes in rans_byte.h.
+// Here, the valid state range is [L, L<<32), renorm never reads more than
+// one word, and the final state is RANS64_L.
+
+// Like Rans64DecInit. Fails if there aren't 2 words left or the state is
+// out of range.
+static inline int Rans64DecInitChecked(Rans64State* r, uint32_t** pptr, uint32_t const* end)
+{
+    if (end - *pptr < 2)
+        return 0;
+
+    Rans64DecInit(r, pptr);
+    return *r >= RANS64_L && *r < (RANS64_L << 32);
+}
+
+// Like Rans64DecRenorm. Fails if it would have to read past "end".
+static inline int Rans64DecRenormChecked(Rans64State* r, uint32_t** pptr, uint32_t const* end)
+{
+    uint64_t x = *r;
+    if (x < RANS64_L) {
+        if (*pptr == end)
+            return 0;
+        x = (x << 32) | **pptr;
+        *pptr += 1;
+    }
+    RANS_COUNT(RansCountDec(&RansGetCounters()->rans64, x != *r));
+
+    *r = x;
+    return 1;
+}
+
 #endif // RANS64_HEADER
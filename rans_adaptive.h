@@ -0,0 +1,199 @@
+// Adaptive order-0 model for rANS - public domain
+//
+// The other coders all use a static distribution, which has to be counted
+// in a separate pass and sent along with the data. This is an adaptive
+// model instead: it starts out uniform and learns the distribution as it
+// goes, so it works in one pass and can follow data whose statistics
+// change over time.
+//
+// It's just a model; coding is done with the regular RansEncPut /
+// RansDecAdvance functions from rans_byte.h or rans64.h (or any other rANS
+// coder taking start/freq pairs). Usage looks like this:
+//
+//   decoder:
+//     s = RansAdaptiveFind(&m, RansDecGet(&r, scale_bits));
+//     RansDecAdvance(&r, &ptr, m.cum[s], m.cum[s+1] - m.cum[s], scale_bits);
+//     RansAdaptiveUpdate(&m, s);
+//
+// The encoder has to see the model in the same state the decoder does, but
+// rANS encodes in reverse. So the encoder first runs through the data
+// forwards, recording the (start, freq) it gets from the model for every
+// symbol, then encodes those in reverse. See main_adaptive.cpp.
+//
+// Updates just bump a count. The coding table (cumulative frequencies
+// summing to 1 << scale_bits) is rebuilt from the counts every "period"
+// symbols, so per symbol, that's a few cycles amortized; the period starts
+// short so the model adapts quickly at the start and doubles up to
+// RANS_ADAPTIVE_MAX_PERIOD. Counts are halved when their total gets large,
+// so older statistics are gradually forgotten.
+//
+// Instead of a full slot->symbol table (which would be expensive to rebuild
+// that often), the decoder finds symbols by searching the cumulative
+// frequencies with SSE2. A small guide table, indexed by the top bits of
+// the slot, gives the first symbol that can possibly match; one compare
+// against the next 16 cumulative frequencies then almost always finds the
+// symbol. (Only runs of more than 16 rare symbols need a second round.)
+// Most slots fall in guide buckets covered by a single symbol, though, and
+// the guide marks those, so the search only runs near symbol boundaries.
+
+#ifndef RANS_ADAPTIVE_HEADER
+#define RANS_ADAPTIVE_HEADER
+
+#include <stdint.h>
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define RANS_ADAPTIVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define RANS_ADAPTIVE_INC 32            // count increment per symbol
+#define RANS_ADAPTIVE_LIMIT (1 << 16)   // halve counts when total exceeds this
+#define RANS_ADAPTIVE_MAX_PERIOD 1024   // max symbols between table rebuilds
+#define RANS_ADAPTIVE_GUIDE_BITS 10     // log2(size of the guide table)
+#define RANS_ADAPTIVE_GUIDE_ONLY 0x100  // guide flag: bucket is a single symbol
+
+typedef struct {
+    // coding table: cum[s] is the start of symbol s, cum[256] = 1 << scale_bits.
+    uint32_t cum[257];
+
+    // search[i] = (cum[i+1] - 1) ^ 0x8000: the last slot of symbol i, so it
+    // fits in 16 bits even at scale_bits=16, biased so signed compares work
+    // for the full 16-bit range. Padded so reading 16 entries from any
+    // i < 256 works.
+    int16_t search[256 + 16];
+
+    // guide[j] = symbol containing slot j << guide_shift, plus
+    // RANS_ADAPTIVE_GUIDE_ONLY if that symbol covers the whole bucket
+    uint16_t guide[1 << RANS_ADAPTIVE_GUIDE_BITS];
+    uint32_t guide_shift;
+
+    uint32_t counts[256];   // adaptive counts
+    uint32_t total;         // sum of counts
+    uint32_t scale_bits;
+    uint32_t period;        // current rebuild period
+    uint32_t until_rebuild; // symbols left until the next rebuild
+} RansAdaptiveModel;
+
+// --------------------------------------------------------------------------
+
+static inline uint32_t RansAdaptiveCtz32(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (uint32_t) index;
+#else
+    return (uint32_t) __builtin_ctz(x);
+#endif
+}
+
+// Rebuilds the coding table from the counts.
+static inline void RansAdaptiveRebuild(RansAdaptiveModel* m)
+{
+    // forget old stats
+    if (m->total > RANS_ADAPTIVE_LIMIT) {
+        m->total = 0;
+        for (int s=0; s < 256; s++) {
+            m->counts[s] = (m->counts[s] + 1) >> 1;
+            m->total += m->counts[s];
+        }
+    }
+
+    // Every symbol gets at least 1; the rest of the range is split
+    // proportional to the counts (rounding down), and whatever's left
+    // after that goes to the most probable symbol.
+    uint32_t range = (1u << m->scale_bits) - 256;
+    uint64_t mul = ((uint64_t) range << 32) / m->total;
+    uint32_t sum = 0, best = 0;
+    uint32_t freqs[256];
+    for (int s=0; s < 256; s++) {
+        freqs[s] = 1 + (uint32_t) ((m->counts[s] * mul) >> 32);
+        sum += freqs[s];
+        if (m->counts[s] > m->counts[best])
+            best = s;
+    }
+    freqs[best] += (1u << m->scale_bits) - sum;
+
+    uint32_t cum = 0;
+    for (int s=0; s < 256; s++) {
+        m->cum[s] = cum;
+        cum += freqs[s];
+        m->search[s] = (int16_t) ((cum - 1) ^ 0x8000);
+    }
+    m->cum[256] = cum;
+
+    uint32_t s = 0;
+    uint32_t bucket_size = 1u << m->guide_shift;
+    for (uint32_t j=0; j < (1u << RANS_ADAPTIVE_GUIDE_BITS); j++) {
+        uint32_t slot = j << m->guide_shift;
+        while (m->cum[s + 1] <= slot)
+            s++;
+        m->guide[j] = (uint16_t) (s | (m->cum[s + 1] >= slot + bucket_size ? RANS_ADAPTIVE_GUIDE_ONLY : 0));
+    }
+
+    if (m->period < RANS_ADAPTIVE_MAX_PERIOD)
+        m->period *= 2;
+    m->until_rebuild = m->period;
+}
+
+// Initializes a model to the uniform distribution. scale_bits has to be
+// between RANS_ADAPTIVE_GUIDE_BITS and 16.
+static inline void RansAdaptiveInit(RansAdaptiveModel* m, uint32_t scale_bits)
+{
+    assert(scale_bits >= RANS_ADAPTIVE_GUIDE_BITS && scale_bits <= 16);
+
+    m->scale_bits = scale_bits;
+    m->guide_shift = scale_bits - RANS_ADAPTIVE_GUIDE_BITS;
+    m->total = 256;
+    for (int s=0; s < 256; s++)
+        m->counts[s] = 1;
+    for (int i=256; i < 256 + 16; i++)
+        m->search[i] = 0x7fff;
+
+    m->period = 8;
+    RansAdaptiveRebuild(m);
+}
+
+// Updates the model after coding symbol "s".
+static inline void RansAdaptiveUpdate(RansAdaptiveModel* m, uint32_t s)
+{
+    m->counts[s] += RANS_ADAPTIVE_INC;
+    m->total += RANS_ADAPTIVE_INC;
+    if (--m->until_rebuild == 0)
+        RansAdaptiveRebuild(m);
+}
+
+// Returns the symbol "slot" (as returned by RansDecGet) falls into, i.e.
+// the s with cum[s] <= slot < cum[s+1].
+static inline uint32_t RansAdaptiveFind(RansAdaptiveModel const* m, uint32_t slot)
+{
+    uint32_t s = m->guide[slot >> m->guide_shift];
+    if (s & RANS_ADAPTIVE_GUIDE_ONLY)
+        return s & 0xff;
+
+#ifdef RANS_ADAPTIVE_SSE2
+    // The entries are increasing, so the lanes where slot > cum[s+1+i] - 1
+    // (symbols that end before the slot) are a prefix, and the first lane
+    // after them is the symbol we want.
+    __m128i x = _mm_set1_epi16((short) (slot ^ 0x8000));
+    for (;;) {
+        __m128i before0 = _mm_cmpgt_epi16(x, _mm_loadu_si128((__m128i const*) &m->search[s + 0]));
+        __m128i before1 = _mm_cmpgt_epi16(x, _mm_loadu_si128((__m128i const*) &m->search[s + 8]));
+        uint32_t mask = _mm_movemask_epi8(_mm_packs_epi16(before0, before1)) ^ 0xffff;
+        if (mask)
+            return s + RansAdaptiveCtz32(mask);
+        s += 16;
+    }
+#else
+    while (m->cum[s + 1] <= slot)
+        s++;
+    return s;
+#endif
+}
+
+#endif // RANS_ADAPTIVE_HEADER
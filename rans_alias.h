@@ -0,0 +1,290 @@
+// Alias-method symbol tables for large alphabets - public domain
+//
+// This is the alias table from main_alias.cpp, generalized to alphabets of
+// up to 64K (16-bit) symbols. The point of the alias method is that the
+// decoder finds the symbol in O(1) with a table whose size is proportional
+// to the number of symbols, not to M = 1 << scale_bits - which is exactly
+// what you want for large alphabets, where a cum2sym table would have to
+// be big (M entries of 16 bits each) to give every symbol a fair shot.
+//
+// Quick recap of how it works: the slots [0, M) are split into
+// nbuckets equal-sized buckets (nbuckets = smallest power of 2 >= the number
+// of symbols actually used). Vose's algorithm arranges things so each
+// bucket holds slots of at most two symbols: the bucket's "own" symbol
+// below a divider, and an alias above it. Every symbol still has exactly
+// freq slots in total, but they're scattered over several buckets, so the
+// encoder needs to map "x % freq" to the actual slot. main_alias.cpp does
+// that with a table of M entries; here, it's a binary search over the
+// (few) pieces a symbol got split into, so the encoder tables are
+// proportional to the alphabet size as well.
+//
+// Decoding is the usual rANS step with a twist: "start" isn't a per-symbol
+// constant, but we can still write the decoder as
+//
+//   x_new = freq * (x >> scale_bits) + bias
+//
+// where bias = (x & mask) - adjust < freq comes from the bucket.
+//
+// Functions are provided for rans_byte.h (scale_bits <= 16) and rans64.h
+// (scale_bits <= 31). See main_large.cpp for an example.
+//
+// Needs to be compiled as C++.
+
+#ifndef RANS_ALIAS_HEADER
+#define RANS_ALIAS_HEADER
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+
+#include "rans_byte.h"
+#include "rans64.h"
+
+// One bucket, laid out so a decode touches only this (24-byte) struct.
+// [0] is the bucket's own symbol, [1] the alias.
+struct RansAliasBucket {
+    uint32_t divider;   // slots below this (absolute) go to [0], others to [1]
+    uint16_t sym[2];    // symbol ids
+    uint32_t freq[2];   // symbol frequencies
+    uint32_t adjust[2]; // bias = slot - adjust
+};
+
+// Piece of a symbol's range: slots [base, base+len) of the symbol (counting
+// from 0) live at [slot, slot+len). len is implied by the next piece.
+struct RansAliasPiece {
+    uint32_t base;
+    uint32_t slot;
+};
+
+struct RansAliasTable {
+    uint32_t scale_bits;
+    uint32_t bucket_shift;  // scale_bits - log2(nbuckets)
+
+    // decoder
+    std::vector<RansAliasBucket> buckets;
+
+    // encoder: pieces[first[s] .. first[s+1]) belong to symbol s, sorted by base.
+    std::vector<uint32_t> freqs;
+    std::vector<uint32_t> first;
+    std::vector<RansAliasPiece> pieces;
+};
+
+// Builds the alias table for "nsyms" normalized frequencies summing to
+// 1 << scale_bits. Need nbuckets <= 1 << scale_bits, so scale_bits has to
+// be at least log2 of the number of used symbols (rounded up).
+static inline void RansAliasInit(RansAliasTable* t, uint32_t const* freqs, uint32_t nsyms, uint32_t scale_bits)
+{
+    assert(nsyms >= 1 && nsyms <= 65536);
+
+    // only the used symbols get a bucket
+    std::vector<uint32_t> used;
+    uint32_t sum = 0;
+    for (uint32_t s=0; s < nsyms; s++) {
+        if (freqs[s]) {
+            used.push_back(s);
+            sum += freqs[s];
+        }
+    }
+    assert(sum == (1u << scale_bits));
+    (void)sum;
+
+    uint32_t log2_buckets = 0;
+    while ((1u << log2_buckets) < used.size())
+        log2_buckets++;
+    assert(log2_buckets <= scale_bits);
+
+    uint32_t nbuckets = 1u << log2_buckets;
+    uint32_t tgt_sum = 1u << (scale_bits - log2_buckets); // target size in every bucket
+
+    t->scale_bits = scale_bits;
+    t->bucket_shift = scale_bits - log2_buckets;
+    t->buckets.resize(nbuckets);
+    t->freqs.assign(freqs, freqs + nsyms);
+
+    // bucket i's own symbol is used[i]; the padding ones have freq 0 and
+    // end up entirely aliased.
+    uint32_t nused = (uint32_t) used.size();
+    used.resize(nbuckets, 0);
+    std::vector<uint32_t> bucket_freq(nbuckets), remaining(nbuckets), alias(nbuckets), divider(nbuckets);
+    for (uint32_t i=0; i < nbuckets; i++) {
+        bucket_freq[i] = (i < nused) ? freqs[used[i]] : 0;
+        remaining[i] = bucket_freq[i];
+        divider[i] = tgt_sum;
+        alias[i] = i;
+    }
+
+    // Vose's algorithm, same as in main_alias.cpp:
+    // a "small" symbol is one with less than tgt_sum slots left to distribute
+    // a "large" symbol is one with >=tgt_sum slots.
+    uint32_t cur_large = 0;
+    uint32_t cur_small = 0;
+    while (cur_large < nbuckets && remaining[cur_large] < tgt_sum)
+        cur_large++;
+    while (cur_small < nbuckets && remaining[cur_small] >= tgt_sum)
+        cur_small++;
+
+    // cur_small is definitely a small bucket
+    // next_small *might* be.
+    uint32_t next_small = cur_small + 1;
+
+    // top up small buckets from large buckets until we're done
+    // this might turn the large bucket we stole from into a small bucket itself.
+    while (cur_large < nbuckets && cur_small < nbuckets) {
+        // this bucket is split between cur_small and cur_large
+        alias[cur_small] = cur_large;
+        divider[cur_small] = remaining[cur_small];
+
+        // take the amount we took out of cur_large's bucket
+        remaining[cur_large] -= tgt_sum - divider[cur_small];
+
+        // if the large bucket is still large *or* we haven't processed it yet...
+        if (remaining[cur_large] >= tgt_sum || next_small <= cur_large) {
+            // find the next small bucket to process
+            cur_small = next_small;
+            while (cur_small < nbuckets && remaining[cur_small] >= tgt_sum)
+                cur_small++;
+            next_small = cur_small + 1;
+        } else // the large bucket we just made small is behind us, need to back-track
+            cur_small = cur_large;
+
+        // if cur_large isn't large anymore, forward to a bucket that is
+        while (cur_large < nbuckets && remaining[cur_large] < tgt_sum)
+            cur_large++;
+    }
+
+    // Count the pieces per symbol first, so they can be stored grouped by
+    // symbol. Buckets are processed in order and each symbol's slots get
+    // handed out in order, so within a symbol, the pieces come out sorted.
+    t->first.assign(nsyms + 1, 0);
+    for (uint32_t i=0; i < nbuckets; i++) {
+        if (divider[i])
+            t->first[used[i] + 1]++;
+        if (divider[i] < tgt_sum)
+            t->first[used[alias[i]] + 1]++;
+    }
+    for (uint32_t s=0; s < nsyms; s++)
+        t->first[s + 1] += t->first[s];
+    t->pieces.resize(t->first[nsyms]);
+
+    std::vector<uint32_t> assigned(nbuckets, 0), fill(t->first.begin(), t->first.end() - 1);
+    for (uint32_t i=0; i < nbuckets; i++) {
+        uint32_t j = alias[i];
+        uint32_t sym0_height = divider[i];
+        uint32_t sym1_height = tgt_sum - divider[i];
+        uint32_t base0 = assigned[i];
+        uint32_t base1 = assigned[j];
+        uint32_t slot0 = i*tgt_sum;
+
+        RansAliasBucket* b = &t->buckets[i];
+        b->divider = slot0 + sym0_height;
+        b->sym[0] = (uint16_t) used[i];
+        b->sym[1] = (uint16_t) used[j];
+        b->freq[0] = bucket_freq[i];
+        b->freq[1] = bucket_freq[j];
+        b->adjust[0] = slot0 - base0;
+        b->adjust[1] = slot0 - (base1 - sym0_height);
+
+        if (sym0_height) {
+            RansAliasPiece* p = &t->pieces[fill[used[i]]++];
+            p->base = base0;
+            p->slot = slot0;
+        }
+        if (sym1_height) {
+            RansAliasPiece* p = &t->pieces[fill[used[j]]++];
+            p->base = base1;
+            p->slot = slot0 + sym0_height;
+        }
+
+        assigned[i] += sym0_height;
+        assigned[j] += sym1_height;
+    }
+
+    // check that each symbol got the number of slots it needed
+    for (uint32_t i=0; i < nbuckets; i++)
+        assert(assigned[i] == bucket_freq[i]);
+}
+
+// Returns the slot for the "r"th slot (0 <= r < freq) of symbol "s".
+static inline uint32_t RansAliasSlot(RansAliasTable const* t, uint32_t s, uint32_t r)
+{
+    // binary search for the last piece with base <= r. Most symbols only
+    // have one or two pieces.
+    RansAliasPiece const* p = &t->pieces[t->first[s]];
+    uint32_t n = t->first[s + 1] - t->first[s];
+    while (n > 1) {
+        uint32_t half = n >> 1;
+        if (p[half].base <= r)
+            p += half;
+        n -= half;
+    }
+    return p->slot + (r - p->base);
+}
+
+// Looks up the slot "xm" (= x & mask) in the decoder table; returns the
+// symbol and the freq and bias for the decoder step.
+static inline uint32_t RansAliasLookup(RansAliasTable const* t, uint32_t xm, uint32_t* freq, uint32_t* bias)
+{
+    RansAliasBucket const* b = &t->buckets[xm >> t->bucket_shift];
+    uint32_t k = xm >= b->divider;
+    *freq = b->freq[k];
+    *bias = xm - b->adjust[k];
+    return b->sym[k];
+}
+
+// --------------------------------------------------------------------------
+
+// rans_byte.h: encodes symbol "s". Needs scale_bits <= 16.
+static inline void RansAliasEncPut(RansState* r, uint8_t** pptr, RansAliasTable const* t, uint32_t s)
+{
+    // renormalize
+    uint32_t freq = t->freqs[s];
+    RansState x = RansEncRenorm(*r, pptr, freq, t->scale_bits);
+
+    // x = C(s,x)
+    *r = ((x / freq) << t->scale_bits) + RansAliasSlot(t, s, x % freq);
+}
+
+// rans_byte.h: decodes a symbol; renormalize afterwards with RansDecRenorm.
+static inline uint32_t RansAliasDecGet(RansState* r, RansAliasTable const* t)
+{
+    uint32_t x = *r;
+    uint32_t freq, bias;
+    uint32_t s = RansAliasLookup(t, x & ((1u << t->scale_bits) - 1), &freq, &bias);
+
+    // s, x = D(x)
+    *r = freq * (x >> t->scale_bits) + bias;
+    return s;
+}
+
+// rans64.h: encodes symbol "s".
+static inline void Rans64AliasEncPut(Rans64State* r, uint32_t** pptr, RansAliasTable const* t, uint32_t s)
+{
+    uint32_t freq = t->freqs[s];
+
+    // renormalize (never needs to loop)
+    uint64_t x = *r;
+    uint64_t x_max = ((RANS64_L >> t->scale_bits) << 32) * freq; // this turns into a shift.
+    if (x >= x_max) {
+        *pptr -= 1;
+        **pptr = (uint32_t) x;
+        x >>= 32;
+        Rans64Assert(x < x_max);
+    }
+
+    // x = C(s,x)
+    *r = ((x / freq) << t->scale_bits) + RansAliasSlot(t, s, (uint32_t) (x % freq));
+}
+
+// rans64.h: decodes a symbol; renormalize afterwards with Rans64DecRenorm.
+static inline uint32_t Rans64AliasDecGet(Rans64State* r, RansAliasTable const* t)
+{
+    uint64_t x = *r;
+    uint32_t freq, bias;
+    uint32_t s = RansAliasLookup(t, (uint32_t) x & ((1u << t->scale_bits) - 1), &freq, &bias);
+
+    // s, x = D(x)
+    *r = freq * (x >> t->scale_bits) + bias;
+    return s;
+}
+
+#endif // RANS_ALIAS_HEADER
@@ -0,0 +1,386 @@
+// Block-parallel rANS compressor - public domain
+//
+// Splits the input into fixed-size blocks that are coded independently
+// (with rans_byte.h or rans64.h, via rans_interleave.h), so both
+// compression and decompression can be spread across multiple threads.
+// The compressed output only depends on the input and the options, never
+// on the number of threads used.
+//
+// Format (all values little-endian):
+//
+//   header      24 bytes, see RansBlockCompress
+//   [table]     frequency table (if RANS_BLOCK_SHARED_STATS)
+//   index       num_blocks x u32 compressed block sizes
+//   blocks      each: [frequency table (if not shared)] + rANS stream
+//
+// Frequency tables are stored in the compact format from rans_table.h.
+// Tables and rANS streams are each padded to a multiple of 4 bytes.
+//
+// Blocks are block_size bytes each, except for the last one, which has
+// whatever is left. Each block's rANS stream is RANS_BLOCK_INTERLEAVE-way
+// interleaved as described in rans_interleave.h.
+//
+// Needs to be compiled as C++11 or later (uses std::thread).
+
+#ifndef RANS_BLOCK_HEADER
+#define RANS_BLOCK_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "rans_container.h"
+#include "rans_interleave.h"
+#include "rans_stats.h"
+#include "rans_table.h"
+
+#define RANS_BLOCK_MAGIC 0x4b4c4252u // "RBLK"
+#define RANS_BLOCK_HEADER_SIZE 24
+#define RANS_BLOCK_INTERLEAVE 4
+
+// Coders
+#define RANS_BLOCK_CODER_BYTE 0     // rans_byte.h
+#define RANS_BLOCK_CODER_64 1       // rans64.h
+
+// Flags
+#define RANS_BLOCK_SHARED_STATS 1   // one frequency table for all blocks
+
+struct RansBlockOptions {
+    uint32_t block_size;    // Bytes per block.
+    uint32_t scale_bits;    // Probability resolution; 8 to 15.
+    uint32_t coder;         // RANS_BLOCK_CODER_*
+    bool shared_stats;      // Use one frequency table for the whole input?
+    int num_threads;        // Worker threads; 0 = one per core.
+};
+
+// Initializes options to the defaults.
+static inline void RansBlockOptionsInit(RansBlockOptions* opts)
+{
+    opts->block_size = 1 << 20;
+    opts->scale_bits = 14;
+    opts->coder = RANS_BLOCK_CODER_BYTE;
+    opts->shared_stats = false;
+    opts->num_threads = 0;
+}
+
+// --------------------------------------------------------------------------
+
+// Internal helpers.
+
+// Runs func(item, thread_index) for every item in [0,count) on up to
+// num_threads threads (including the calling thread).
+template<typename Func>
+static void RansBlockParallelFor(int num_threads, uint32_t count, Func const& func)
+{
+    if (num_threads <= 0)
+        num_threads = (int) std::thread::hardware_concurrency();
+    if ((uint32_t) num_threads > count)
+        num_threads = (int) count;
+    if (num_threads <= 1) {
+        for (uint32_t i=0; i < count; i++)
+            func(i, 0);
+        return;
+    }
+
+    std::atomic<uint32_t> next(0);
+    auto worker = [&](int thread_index) {
+        uint32_t i;
+        while ((i = next.fetch_add(1)) < count)
+            func(i, thread_index);
+    };
+
+    std::vector<std::thread> threads;
+    for (int t=1; t < num_threads; t++)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (size_t t=0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+// Appends the frequency table for "stats" to "dst", padded to a multiple
+// of 4 bytes.
+static inline void RansBlockWriteFreqs(std::vector<uint8_t>* dst, SymbolStats const& stats, uint32_t scale_bits)
+{
+    size_t pos = dst->size();
+    dst->resize(pos + RANS_TABLE_MAX_SIZE);
+    size_t len = RansTableWrite(dst->data() + pos, stats.freqs, scale_bits);
+    dst->resize(pos + ((len + 3) & ~(size_t)3));
+    for (size_t i=pos + len; i < dst->size(); i++)
+        (*dst)[i] = 0;
+}
+
+// Reads a frequency table into "stats". Returns the padded table size, or
+// 0 if the table is invalid.
+static inline size_t RansBlockReadFreqs(SymbolStats* stats, uint8_t const* p, size_t size, uint32_t scale_bits)
+{
+    size_t len = RansTableRead(stats->freqs, p, size, scale_bits);
+    stats->calc_cum_freqs();
+    len = (len + 3) & ~(size_t)3;
+    return len <= size ? len : 0;
+}
+
+// Appends the encoded stream for one block to "dst", padded to a multiple
+// of 4 bytes. Returns the unpadded size. "scratch" is grown as needed.
+template<typename Coder>
+static size_t RansBlockEncodeStream(std::vector<uint8_t>* dst, uint8_t const* in, size_t in_size, SymbolStats const& stats, uint32_t scale_bits,
+    std::vector<typename Coder::Word>* scratch)
+{
+    typedef typename Coder::Word Word;
+
+    typename Coder::EncSymbol esyms[256];
+    for (int s=0; s < 256; s++)
+        Coder::EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], scale_bits);
+
+    // every symbol costs at most scale_bits <= 16 bits, plus the final states
+    size_t max_words = (in_size * 2 + RANS_BLOCK_INTERLEAVE * 8) / sizeof(Word) + 1;
+    if (scratch->size() < max_words)
+        scratch->resize(max_words);
+
+    Word* end = scratch->data() + scratch->size();
+    Word* begin = RansInterleavedEncode<RANS_BLOCK_INTERLEAVE, Coder>(end, in, in_size, esyms, scale_bits);
+    size_t nbytes = (end - begin) * sizeof(Word);
+
+    size_t pos = dst->size();
+    dst->resize(pos + ((nbytes + 3) & ~(size_t)3), 0);
+    memcpy(dst->data() + pos, begin, nbytes);
+    return nbytes;
+}
+
+// Decodes one block from "in" ("in_size" bytes). With "shared" == 0, the
+// block starts with its own frequency table, which is read straight into
+// the decoder tables. Returns false if the block is invalid; never reads
+// past the end of the block.
+template<typename Coder>
+static bool RansBlockDecodeStream(uint8_t* out, size_t out_size, uint8_t const* in, size_t in_size, SymbolStats const* shared, uint32_t scale_bits,
+    std::vector<uint8_t>* cum2sym)
+{
+    typename Coder::DecSymbol dsyms[256];
+    cum2sym->resize(1u << scale_bits);
+    uint8_t* c2s = cum2sym->data();
+    auto init_sym = [&dsyms, c2s](int s, uint32_t start, uint32_t freq) {
+        Coder::DecSymbolInit(&dsyms[s], start, freq);
+        memset(c2s + start, s, freq);
+    };
+
+    if (shared) {
+        for (int s=0; s < 256; s++)
+            init_sym(s, shared->cum_freqs[s], shared->freqs[s]);
+    } else {
+        size_t len = RansTableDecode(in, in_size, scale_bits, init_sym);
+        len = (len + 3) & ~(size_t)3;
+        if (!len || len > in_size)
+            return false;
+        in += len;
+        in_size -= len;
+    }
+
+    // NOTE: the streams are 4-byte aligned relative to the start of the
+    // compressed data, so rans64 wants that to be 4-byte aligned too.
+    typedef typename Coder::Word Word;
+    Word* ptr = (Word*) in;
+    Word const* end = ptr + in_size / sizeof(Word);
+    return RansInterleavedDecodeChecked<RANS_BLOCK_INTERLEAVE, Coder>(out, out_size, ptr, end, dsyms, c2s, scale_bits) != 0;
+}
+
+// --------------------------------------------------------------------------
+
+// Returns an upper bound for the compressed size of "in_size" bytes.
+static inline size_t RansBlockCompressBound(size_t in_size, RansBlockOptions const* opts)
+{
+    size_t num_blocks = (in_size + opts->block_size - 1) / opts->block_size;
+    size_t per_block = 4 + RANS_TABLE_MAX_SIZE + RANS_BLOCK_INTERLEAVE * 8 + 4;
+    return RANS_BLOCK_HEADER_SIZE + RANS_TABLE_MAX_SIZE + in_size * 2 + num_blocks * per_block;
+}
+
+// Compresses "in" into "out" (with room for "out_max" bytes).
+// Returns the compressed size, or 0 if the options are invalid or the
+// output doesn't fit.
+static inline size_t RansBlockCompress(uint8_t* out, size_t out_max, uint8_t const* in, size_t in_size, RansBlockOptions const* opts)
+{
+    uint32_t block_size = opts->block_size;
+    uint32_t scale_bits = opts->scale_bits;
+    if (block_size == 0 || scale_bits < 8 || scale_bits > 15 || opts->coder > RANS_BLOCK_CODER_64)
+        return 0;
+
+    uint64_t num_blocks64 = (in_size + block_size - 1) / block_size;
+    if (num_blocks64 > 0xffffffffu)
+        return 0;
+    uint32_t num_blocks = (uint32_t) num_blocks64;
+    bool shared_stats = opts->shared_stats && num_blocks != 0;
+
+    // pass 1: count symbols in every block
+    std::vector<SymbolStats> stats(num_blocks);
+    RansBlockParallelFor(opts->num_threads, num_blocks, [&](uint32_t b, int) {
+        size_t offs = (size_t) b * block_size;
+        size_t len = (in_size - offs < block_size) ? in_size - offs : block_size;
+        stats[b].count_freqs(in + offs, len);
+        if (!shared_stats)
+            stats[b].normalize_freqs(1u << scale_bits);
+    });
+
+    SymbolStats shared;
+    if (shared_stats) {
+        // The block counts can add up to more than 32 bits on big inputs,
+        // so sum them in 64 bits and scale down until they fit (rounding
+        // up, so every used symbol stays used).
+        uint64_t totals[256];
+        uint64_t total = 0;
+        for (int s=0; s < 256; s++) {
+            totals[s] = 0;
+            for (uint32_t b=0; b < num_blocks; b++)
+                totals[s] += stats[b].freqs[s];
+            total += totals[s];
+        }
+
+        uint32_t shift = 0;
+        while ((total >> shift) > 0x7fffffffu)
+            shift++;
+        uint64_t round = (1ull << shift) - 1;
+        for (int s=0; s < 256; s++)
+            shared.freqs[s] = (uint32_t) ((totals[s] + round) >> shift);
+        shared.normalize_freqs(1u << scale_bits);
+    }
+
+    // pass 2: encode every block into its own buffer
+    int num_threads = opts->num_threads > 0 ? opts->num_threads : (int) std::thread::hardware_concurrency();
+    if (num_threads < 1)
+        num_threads = 1;
+    std::vector<std::vector<uint8_t> > blocks(num_blocks);
+    std::vector<std::vector<uint8_t> > byte_scratch(num_threads);
+    std::vector<std::vector<uint32_t> > word_scratch(num_threads);
+
+    RansBlockParallelFor(num_threads, num_blocks, [&](uint32_t b, int t) {
+        size_t offs = (size_t) b * block_size;
+        size_t len = (in_size - offs < block_size) ? in_size - offs : block_size;
+        SymbolStats const& st = shared_stats ? shared : stats[b];
+        std::vector<uint8_t>* dst = &blocks[b];
+
+        if (!shared_stats)
+            RansBlockWriteFreqs(dst, st, scale_bits);
+        if (opts->coder == RANS_BLOCK_CODER_BYTE)
+            RansBlockEncodeStream<RansByteCoder>(dst, in + offs, len, st, scale_bits, &byte_scratch[t]);
+        else
+            RansBlockEncodeStream<Rans64Coder>(dst, in + offs, len, st, scale_bits, &word_scratch[t]);
+    });
+
+    // lay out the output
+    std::vector<uint8_t> shared_table;
+    if (shared_stats)
+        RansBlockWriteFreqs(&shared_table, shared, scale_bits);
+
+    size_t header_size = RANS_BLOCK_HEADER_SIZE + shared_table.size() + (size_t) num_blocks * 4;
+    std::vector<size_t> offsets(num_blocks + 1);
+    offsets[0] = header_size;
+    for (uint32_t b=0; b < num_blocks; b++)
+        offsets[b + 1] = offsets[b] + blocks[b].size();
+    if (offsets[num_blocks] > out_max)
+        return 0;
+
+    RansPut32(out + 0, RANS_BLOCK_MAGIC);
+    out[4] = (uint8_t) opts->coder;
+    out[5] = (uint8_t) scale_bits;
+    out[6] = shared_stats ? RANS_BLOCK_SHARED_STATS : 0;
+    out[7] = RANS_BLOCK_INTERLEAVE;
+    RansPut32(out + 8, block_size);
+    RansPut32(out + 12, num_blocks);
+    RansPut64(out + 16, in_size);
+
+    uint8_t* p = out + RANS_BLOCK_HEADER_SIZE;
+    if (!shared_table.empty()) // data() can be null otherwise
+        memcpy(p, shared_table.data(), shared_table.size());
+    p += shared_table.size();
+    for (uint32_t b=0; b < num_blocks; b++)
+        RansPut32(p + b*4, (uint32_t) blocks[b].size());
+
+    RansBlockParallelFor(num_threads, num_blocks, [&](uint32_t b, int) {
+        memcpy(out + offsets[b], blocks[b].data(), blocks[b].size());
+    });
+
+    return offsets[num_blocks];
+}
+
+// Returns the decompressed size of a compressed buffer, or false if it
+// doesn't look like one.
+static inline bool RansBlockGetSize(uint8_t const* in, size_t in_size, uint64_t* out_size)
+{
+    if (in_size < RANS_BLOCK_HEADER_SIZE || RansGet32(in) != RANS_BLOCK_MAGIC)
+        return false;
+
+    *out_size = RansGet64(in + 16);
+    return true;
+}
+
+// Decompresses "in" into "out", which needs to be exactly the size
+// returned by RansBlockGetSize. Returns false on invalid input (truncated
+// or corrupt); never reads past the end of "in".
+static inline bool RansBlockDecompress(uint8_t* out, size_t out_size, uint8_t const* in, size_t in_size, int num_threads)
+{
+    uint64_t orig_size;
+    if (!RansBlockGetSize(in, in_size, &orig_size) || orig_size != out_size)
+        return false;
+
+    uint32_t coder = in[4];
+    uint32_t scale_bits = in[5];
+    uint32_t flags = in[6];
+    uint32_t block_size = RansGet32(in + 8);
+    uint32_t num_blocks = RansGet32(in + 12);
+    bool shared_stats = (flags & RANS_BLOCK_SHARED_STATS) != 0;
+
+    if (coder > RANS_BLOCK_CODER_64 || scale_bits < 8 || scale_bits > 15 || in[7] != RANS_BLOCK_INTERLEAVE || block_size == 0)
+        return false;
+    if (num_blocks != (out_size + block_size - 1) / block_size)
+        return false;
+
+    SymbolStats shared;
+    size_t table_size = 0;
+    if (shared_stats) {
+        table_size = RansBlockReadFreqs(&shared, in + RANS_BLOCK_HEADER_SIZE, in_size - RANS_BLOCK_HEADER_SIZE, scale_bits);
+        if (!table_size)
+            return false;
+    }
+
+    size_t header_size = RANS_BLOCK_HEADER_SIZE + table_size + (size_t) num_blocks * 4;
+    if (header_size > in_size)
+        return false;
+
+    // find where the blocks are
+    uint8_t const* index = in + header_size - (size_t) num_blocks * 4;
+    std::vector<size_t> offsets(num_blocks + 1);
+    offsets[0] = header_size;
+    for (uint32_t b=0; b < num_blocks; b++) {
+        size_t len = RansGet32(index + b*4);
+        if ((len & 3) != 0 || len > in_size - offsets[b])
+            return false;
+        offsets[b + 1] = offsets[b] + len;
+    }
+
+    if (num_threads <= 0)
+        num_threads = (int) std::thread::hardware_concurrency();
+    if (num_threads < 1)
+        num_threads = 1;
+    std::vector<std::vector<uint8_t> > cum2sym(num_threads);
+    std::atomic<bool> ok(true);
+
+    RansBlockParallelFor(num_threads, num_blocks, [&](uint32_t b, int t) {
+        size_t offs = (size_t) b * block_size;
+        size_t len = (out_size - offs < block_size) ? out_size - offs : block_size;
+        uint8_t const* src = in + offsets[b];
+        size_t src_size = offsets[b + 1] - offsets[b];
+        SymbolStats const* st = shared_stats ? &shared : 0;
+
+        bool block_ok;
+        if (coder == RANS_BLOCK_CODER_BYTE)
+            block_ok = RansBlockDecodeStream<RansByteCoder>(out + offs, len, src, src_size, st, scale_bits, &cum2sym[t]);
+        else
+            block_ok = RansBlockDecodeStream<Rans64Coder>(out + offs, len, src, src_size, st, scale_bits, &cum2sym[t]);
+        if (!block_ok)
+            ok = false;
+    });
+
+    return ok;
+}
+
+#endif // RANS_BLOCK_HEADER
@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 
+#include "rans_instrument.h"
+
 #ifdef assert
 #define RansAssert assert
 #else
@@ -62,6 +64,7 @@ static inline void RansEncInit(RansState* r)
 static inline RansState RansEncRenorm(RansState x, uint8_t** pptr, uint32_t freq, uint32_t scale_bits)
 {
     uint32_t x_max = ((RANS_BYTE_L >> scale_bits) << 8) * freq; // this turns into a shift.
+    RANS_COUNT(uint8_t* start_ptr = *pptr);
     if (x >= x_max) {
         uint8_t* ptr = *pptr;
         do {
@@ -70,6 +73,7 @@ static inline RansState RansEncRenorm(RansState x, uint8_t** pptr, uint32_t freq
         } while (x >= x_max);
         *pptr = ptr;
     }
+    RANS_COUNT(RansCountEnc(&RansGetCounters()->byte, RansCountCost(freq, scale_bits), start_ptr - *pptr));
     return x;
 }
 
@@ -139,11 +143,13 @@ static inline void RansDecAdvance(RansState* r, uint8_t** pptr, uint32_t start,
     x = freq * (x >> scale_bits) + (x & mask) - start;
 
     // renormalize
+    RANS_COUNT(uint8_t* start_ptr = *pptr);
     if (x < RANS_BYTE_L) {
         uint8_t* ptr = *pptr;
         do x = (x << 8) | *ptr++; while (x < RANS_BYTE_L);
         *pptr = ptr;
     }
+    RANS_COUNT(RansCountDec(&RansGetCounters()->byte, *pptr - start_ptr));
 
     *r = x;
 }
@@ -262,6 +268,7 @@ static inline void RansEncPutSymbol(RansState* r, uint8_t** pptr, RansEncSymbol
     // renormalize
     uint32_t x = *r;
     uint32_t x_max = sym->x_max;
+    RANS_COUNT(uint8_t* start_ptr = *pptr);
     if (x >= x_max) {
         uint8_t* ptr = *pptr;
         do {
@@ -270,6 +277,8 @@ static inline void RansEncPutSymbol(RansState* r, uint8_t** pptr, RansEncSymbol
         } while (x >= x_max);
         *pptr = ptr;
     }
+    // x_max = freq << (31 - scale_bits)
+    RANS_COUNT(RansCountEnc(&RansGetCounters()->byte, 31 - RansCountLog2(x_max), start_ptr - *pptr));
 
     // x = C(s,x)
     // NOTE: written this way so we get a 32-bit "multiply high" when
@@ -308,13 +317,106 @@ static inline void RansDecRenorm(RansState* r, uint8_t** pptr)
 {
     // renormalize
     uint32_t x = *r;
+    RANS_COUNT(uint8_t* start_ptr = *pptr);
     if (x < RANS_BYTE_L) {
         uint8_t* ptr = *pptr;
         do x = (x << 8) | *ptr++; while (x < RANS_BYTE_L);
         *pptr = ptr;
     }
+    RANS_COUNT(RansCountDec(&RansGetCounters()->byte, *pptr - start_ptr));
+
+    *r = x;
+}
+
+// --------------------------------------------------------------------------
+
+// Fused decoder table: one entry per slot (cumulative frequency) holding
+// everything the decoder step needs, so the decoder does a single table
+// lookup per symbol instead of cum2sym followed by a dependent load from
+// the RansDecSymbol array. The symbol itself comes from a separate cum2sym
+// table; that load is off the critical path (the next state doesn't depend
+// on it).
+//
+// Since slot = start + (x & mask), the decoder step
+//   x_new = freq * (x >> scale_bits) + (x & mask) - start
+// is just freq * (x >> scale_bits) + bias with bias = slot - start < freq.
+// Storing freq-1 instead of freq makes everything fit into 16 bits even for
+// freq = 1 << 16, which works out because
+//   freq * q + bias = (freq - 1) * q + (q + bias)
+// and q + bias can be computed while the multiply is in flight.
+//
+// A table for scale_bits is 4 << scale_bits bytes (plus 1 << scale_bits
+// for cum2sym), so this is a win when that stays L1-resident (scale_bits
+// around 12); for larger tables, the extra cache misses tend to eat the
+// gains, and cum2sym + RansDecSymbol (1 byte per slot + 1KB) is faster.
+typedef uint32_t RansDecSlot;
+
+// Initializes the slots (and cum2sym entries) for a symbol with range start
+// "start" and frequency "freq".
+static inline void RansDecSlotsInitSymbol(RansDecSlot* slots, uint8_t* cum2sym, uint8_t sym, uint32_t start, uint32_t freq)
+{
+    RansAssert(start <= (1 << 16));
+    RansAssert(freq <= (1 << 16) - start);
+    for (uint32_t i=0; i < freq; i++) {
+        slots[start + i] = (freq - 1) | (i << 16);
+        cum2sym[start + i] = sym;
+    }
+}
+
+// Equivalent to RansDecAdvanceStep, using the slot for the current state
+// (i.e. slots[RansDecGet(r, scale_bits)]).
+static inline void RansDecAdvanceSlotStep(RansState* r, RansDecSlot slot, uint32_t scale_bits)
+{
+    // s, x = D(x)
+    uint32_t q = *r >> scale_bits;
+    *r = (slot & 0xffff) * q + (q + (slot >> 16));
+}
+
+// --------------------------------------------------------------------------
+
+// Checked decoding, for untrusted input. These take an "end" pointer
+// (exclusive) and never read at or past it; they return 0 if the stream is
+// truncated or plainly corrupt, 1 otherwise.
+//
+// Decoding never increases the state (freq <= 1 << scale_bits), so as long
+// as the initial state is in the valid range [L, L<<8), it stays there, and
+// with scale_bits <= 16 a renorm never reads more than 2 bytes - even for
+// corrupt data, provided the symbol tables are consistent. So a decoder
+// can use the regular unchecked functions whenever there are at least
+// 2 bytes per symbol left, and only switch to RansDecRenormChecked near
+// the end. Also, once everything's decoded, the state is back to
+// RANS_BYTE_L (the encoder's initial state) exactly; that's a cheap check
+// for corrupt data.
+
+// Like RansDecInit. Fails if there aren't 4 bytes left or the state is out
+// of range.
+static inline int RansDecInitChecked(RansState* r, uint8_t** pptr, uint8_t const* end)
+{
+    if (end - *pptr < 4)
+        return 0;
+
+    RansDecInit(r, pptr);
+    return *r >= RANS_BYTE_L && *r < (RANS_BYTE_L << 8);
+}
+
+// Like RansDecRenorm. Fails if it would have to read past "end".
+static inline int RansDecRenormChecked(RansState* r, uint8_t** pptr, uint8_t const* end)
+{
+    uint32_t x = *r;
+    RANS_COUNT(uint8_t* start_ptr = *pptr);
+    if (x < RANS_BYTE_L) {
+        uint8_t* ptr = *pptr;
+        do {
+            if (ptr == end)
+                return 0;
+            x = (x << 8) | *ptr++;
+        } while (x < RANS_BYTE_L);
+        *pptr = ptr;
+    }
+    RANS_COUNT(RansCountDec(&RansGetCounters()->byte, *pptr - start_ptr));
 
     *r = x;
+    return 1;
 }
 
 #endif // RANS_BYTE_HEADER
\ No newline at end of file
@@ -0,0 +1,188 @@
+// Self-describing container for rANS streams - public domain
+//
+// The coders themselves don't store anything but the raw rANS data; the
+// decoder needs to know the exact model the encoder used. This header
+// defines a small container that stores everything needed to set up a
+// decoder for one of the sample coders in front of the actual rANS data.
+//
+// Layout (all values little-endian):
+//
+//    0  u32      magic ("rANS")
+//    4  u8       version (1)
+//    5  u8       variant (RANS_VARIANT_*)
+//    6  u8       scale_bits
+//    7  u8       interleave (number of interleaved states)
+//    8  u64      number of symbols coded (original length)
+//   16  u64      payload size in bytes
+//   24  u8[32]   bitmap of symbols with non-zero frequency
+//   56  u16[n]   (freq - 1) for each of the n symbols in the bitmap
+//        ...     zero padding to a multiple of 8 bytes
+//       payload  the rANS data, in the same form the encoder produced it
+//
+// Since the header size is a multiple of 8, the payload has the same
+// alignment as the container itself, so decoders can read it in place.
+// Because rANS writes its output backwards, the usual way to produce a
+// container is to encode first and then write the header right in front
+// of the encoded data (see main.cpp).
+
+#ifndef RANS_CONTAINER_HEADER
+#define RANS_CONTAINER_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RANS_CONTAINER_MAGIC 0x534e4172u // "rANS"
+#define RANS_CONTAINER_VERSION 1
+
+// Coder variants
+#define RANS_VARIANT_BYTE 0         // rans_byte.h
+#define RANS_VARIANT_64 1           // rans64.h
+#define RANS_VARIANT_WORD_SIMD 2    // rans_word_sse41.h
+#define RANS_VARIANT_ALIAS 3        // rans_byte.h with alias tables (main_alias.cpp)
+
+// Return codes for RansContainerParse
+#define RANS_CONTAINER_OK 0
+#define RANS_CONTAINER_ERR_TRUNCATED -1 // input too short
+#define RANS_CONTAINER_ERR_MAGIC -2     // not a container (or unknown version)
+#define RANS_CONTAINER_ERR_HEADER -3    // invalid header fields or frequency table
+
+typedef struct {
+    uint32_t variant;       // RANS_VARIANT_*
+    uint32_t scale_bits;    // Frequencies sum to 1 << scale_bits (at most 16)
+    uint32_t interleave;    // Number of interleaved states
+    uint64_t num_symbols;   // Number of symbols coded
+    uint32_t freqs[256];    // Normalized symbol frequencies
+} RansContainerHeader;
+
+// --------------------------------------------------------------------------
+
+// Little-endian helpers.
+
+static inline void RansPut16(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t) (v >> 0);
+    p[1] = (uint8_t) (v >> 8);
+}
+
+static inline void RansPut32(uint8_t* p, uint32_t v)
+{
+    RansPut16(p + 0, v & 0xffff);
+    RansPut16(p + 2, v >> 16);
+}
+
+static inline void RansPut64(uint8_t* p, uint64_t v)
+{
+    RansPut32(p + 0, (uint32_t) v);
+    RansPut32(p + 4, (uint32_t) (v >> 32));
+}
+
+static inline uint32_t RansGet16(uint8_t const* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t RansGet32(uint8_t const* p)
+{
+    return RansGet16(p) | (RansGet16(p + 2) << 16);
+}
+
+static inline uint64_t RansGet64(uint8_t const* p)
+{
+    return RansGet32(p) | ((uint64_t) RansGet32(p + 4) << 32);
+}
+
+// --------------------------------------------------------------------------
+
+// Returns the size of the header (everything before the payload) for "hdr".
+static inline size_t RansContainerHeaderSize(RansContainerHeader const* hdr)
+{
+    size_t nsyms = 0;
+    for (int s=0; s < 256; s++)
+        nsyms += (hdr->freqs[s] != 0);
+
+    return (56 + nsyms*2 + 7) & ~(size_t)7;
+}
+
+// Writes the header for "hdr" followed by a payload of "payload_size"
+// bytes to "out", which needs RansContainerHeaderSize(hdr) bytes. The
+// payload itself is not written. Returns the header size.
+static inline size_t RansContainerWriteHeader(uint8_t* out, RansContainerHeader const* hdr, uint64_t payload_size)
+{
+    size_t size = RansContainerHeaderSize(hdr);
+    uint8_t* p = out + 56;
+
+    RansPut32(out + 0, RANS_CONTAINER_MAGIC);
+    out[4] = RANS_CONTAINER_VERSION;
+    out[5] = (uint8_t) hdr->variant;
+    out[6] = (uint8_t) hdr->scale_bits;
+    out[7] = (uint8_t) hdr->interleave;
+    RansPut64(out + 8, hdr->num_symbols);
+    RansPut64(out + 16, payload_size);
+
+    for (int i=0; i < 32; i++)
+        out[24 + i] = 0;
+    for (int s=0; s < 256; s++) {
+        if (hdr->freqs[s]) {
+            out[24 + (s >> 3)] |= (uint8_t) (1 << (s & 7));
+            RansPut16(p, hdr->freqs[s] - 1);
+            p += 2;
+        }
+    }
+
+    while (p < out + size)
+        *p++ = 0;
+
+    return size;
+}
+
+// Parses a container at "in" (with "in_size" bytes available). On success,
+// fills out "hdr", points "*payload" at the rANS data (inside "in", no
+// copies are made) and returns RANS_CONTAINER_OK; otherwise, returns one
+// of the RANS_CONTAINER_ERR_* codes.
+static inline int RansContainerParse(uint8_t const* in, size_t in_size, RansContainerHeader* hdr, uint8_t const** payload, size_t* payload_size)
+{
+    if (in_size < 56)
+        return RANS_CONTAINER_ERR_TRUNCATED;
+    if (RansGet32(in) != RANS_CONTAINER_MAGIC || in[4] != RANS_CONTAINER_VERSION)
+        return RANS_CONTAINER_ERR_MAGIC;
+
+    hdr->variant = in[5];
+    hdr->scale_bits = in[6];
+    hdr->interleave = in[7];
+    hdr->num_symbols = RansGet64(in + 8);
+    uint64_t size = RansGet64(in + 16);
+
+    if (hdr->variant > RANS_VARIANT_ALIAS || hdr->scale_bits > 16 || hdr->interleave == 0)
+        return RANS_CONTAINER_ERR_HEADER;
+
+    // frequency table
+    size_t nsyms = 0;
+    for (int s=0; s < 256; s++)
+        nsyms += (in[24 + (s >> 3)] >> (s & 7)) & 1;
+
+    size_t header_size = (56 + nsyms*2 + 7) & ~(size_t)7;
+    if (in_size < header_size)
+        return RANS_CONTAINER_ERR_TRUNCATED;
+
+    uint8_t const* p = in + 56;
+    uint32_t total = 0;
+    for (int s=0; s < 256; s++) {
+        hdr->freqs[s] = 0;
+        if ((in[24 + (s >> 3)] >> (s & 7)) & 1) {
+            hdr->freqs[s] = RansGet16(p) + 1;
+            total += hdr->freqs[s];
+            p += 2;
+        }
+    }
+    if (total != (1u << hdr->scale_bits))
+        return RANS_CONTAINER_ERR_HEADER;
+
+    if (size > in_size - header_size)
+        return RANS_CONTAINER_ERR_TRUNCATED;
+
+    *payload = in + header_size;
+    *payload_size = (size_t) size;
+    return RANS_CONTAINER_OK;
+}
+
+#endif // RANS_CONTAINER_HEADER
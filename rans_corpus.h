@@ -0,0 +1,215 @@
+// Synthetic test data for the rANS coders - public domain
+//
+// book1 is English text at about 4.5 bits/symbol (order 0), which is a
+// single point on the curve. rANS throughput depends a lot on the entropy
+// of the data: the number of renormalizations (and hence words moved and
+// branches taken) per symbol tracks the number of bits per symbol. This
+// generates byte-symbol data with known statistics, so the coders can be
+// measured from nearly constant to nearly random input:
+//
+//   uniform     k equally likely symbols                   H = log2(k)
+//   geometric   p_i ~ r^i                                  (0 < r < 1)
+//   zipf        p_i ~ 1 / (i+1)^s                          (s > 0)
+//   spike       one symbol with probability p, the other
+//               255 equally likely (p=0.999 is "nearly constant")
+//   markov      order-1 source: repeat the previous symbol with
+//               probability "stay", else draw from zipf(1). The
+//               order-0 statistics are those of zipf(1); the
+//               entropy rate is lower, by how much depends on "stay".
+//
+// Each source has one parameter. RansCorpusSolve finds the parameter that
+// gives a target entropy (the entropy rate, for markov), so sweeps over
+// entropy can use any of the shapes.
+//
+// Data is generated with a fixed-seed PRNG, so it's the same everywhere.
+//
+// Needs to be compiled as C++.
+
+#ifndef RANS_CORPUS_HEADER
+#define RANS_CORPUS_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+enum RansCorpusKind {
+    RANS_CORPUS_UNIFORM,
+    RANS_CORPUS_GEOMETRIC,
+    RANS_CORPUS_ZIPF,
+    RANS_CORPUS_SPIKE,
+    RANS_CORPUS_MARKOV,
+
+    RANS_CORPUS_NUM_KINDS
+};
+
+static char const* const RansCorpusKindNames[RANS_CORPUS_NUM_KINDS] = {
+    "uniform", "geometric", "zipf", "spike", "markov"
+};
+
+// Markov sources draw from this when they don't repeat.
+#define RANS_CORPUS_MARKOV_BASE_ZIPF 1.0
+
+// Symbol probabilities of the order-0 distribution for "kind" with
+// parameter "param" (for markov, the distribution it draws new symbols
+// from, which is also its marginal distribution).
+static inline void RansCorpusProbs(double probs[256], RansCorpusKind kind, double param)
+{
+    double sum = 0.0;
+    for (int i=0; i < 256; i++) {
+        double p;
+        switch (kind) {
+        case RANS_CORPUS_UNIFORM:   p = (i < (int) param) ? 1.0 : 0.0; break;
+        case RANS_CORPUS_GEOMETRIC: p = pow(param, i); break;
+        case RANS_CORPUS_ZIPF:      p = pow(i + 1.0, -param); break;
+        case RANS_CORPUS_SPIKE:     p = (i == 0) ? param : (1.0 - param) / 255.0; break;
+        default:                    p = pow(i + 1.0, -RANS_CORPUS_MARKOV_BASE_ZIPF); break;
+        }
+        probs[i] = p;
+        sum += p;
+    }
+    for (int i=0; i < 256; i++)
+        probs[i] /= sum;
+}
+
+// Shannon entropy of a distribution, in bits/symbol.
+static inline double RansCorpusEntropyOf(double const* probs, int n)
+{
+    double h = 0.0;
+    for (int i=0; i < n; i++) {
+        if (probs[i] > 0.0)
+            h -= probs[i] * log2(probs[i]);
+    }
+    return h;
+}
+
+// Entropy (rate) of the source, in bits/symbol.
+static inline double RansCorpusEntropy(RansCorpusKind kind, double param)
+{
+    double probs[256];
+    RansCorpusProbs(probs, kind, param);
+    if (kind != RANS_CORPUS_MARKOV)
+        return RansCorpusEntropyOf(probs, 256);
+
+    // The marginal distribution of a markov source is the base
+    // distribution, so the rate is the average entropy of its rows:
+    // symbol j follows symbol i with probability (1-stay)*p_j, plus stay
+    // if j == i.
+    double stay = param, rate = 0.0;
+    for (int i=0; i < 256; i++) {
+        double row = 0.0;
+        for (int j=0; j < 256; j++) {
+            double q = (1.0 - stay) * probs[j] + (i == j ? stay : 0.0);
+            if (q > 0.0)
+                row -= q * log2(q);
+        }
+        rate += probs[i] * row;
+    }
+    return rate;
+}
+
+// Returns the parameter for "kind" that gets closest to "entropy" bits per
+// symbol. For uniform, that's the nearest power-of-2-ish integer k; the
+// others are continuous and solved by bisection. Targets outside what a
+// kind can reach get clamped to the nearest end of its range.
+static inline double RansCorpusSolve(RansCorpusKind kind, double entropy)
+{
+    if (kind == RANS_CORPUS_UNIFORM) {
+        double k = floor(pow(2.0, entropy) + 0.5);
+        return k < 1.0 ? 1.0 : (k > 256.0 ? 256.0 : k);
+    }
+
+    // Parameter ranges; entropy increases from lo to hi.
+    double lo, hi;
+    switch (kind) {
+    case RANS_CORPUS_GEOMETRIC: lo = 1e-6; hi = 1.0 - 1e-9; break;
+    case RANS_CORPUS_ZIPF:      lo = 64.0; hi = 0.0; break;
+    case RANS_CORPUS_SPIKE:     lo = 1.0 - 1e-9; hi = 1.0 / 256.0; break;
+    default:                    lo = 1.0 - 1e-9; hi = 0.0; break;
+    }
+
+    for (int iter=0; iter < 100; iter++) {
+        double mid = 0.5 * (lo + hi);
+        if (RansCorpusEntropy(kind, mid) < entropy)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+// ---- Generation
+
+// splitmix64; small, fast and good enough for this.
+static inline uint64_t RansCorpusRandom(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Uniform double in [0,1).
+static inline double RansCorpusUniform(uint64_t* state)
+{
+    return (RansCorpusRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Fills "out" with "size" symbols from the given source. Same seed, same
+// data.
+static inline void RansCorpusGenerate(uint8_t* out, size_t size, RansCorpusKind kind, double param, uint64_t seed)
+{
+    double probs[256], cdf[256];
+    RansCorpusProbs(probs, kind, param);
+
+    double sum = 0.0;
+    for (int i=0; i < 256; i++) {
+        sum += probs[i];
+        cdf[i] = sum;
+    }
+    cdf[255] = 2.0; // make sure the search always terminates
+
+    uint64_t state = seed;
+    double stay = (kind == RANS_CORPUS_MARKOV) ? param : 0.0;
+    uint8_t prev = 0;
+    for (size_t i=0; i < size; i++) {
+        if (stay > 0.0 && i > 0 && RansCorpusUniform(&state) < stay) {
+            out[i] = prev;
+            continue;
+        }
+
+        // binary search for the first cdf entry > u
+        double u = RansCorpusUniform(&state);
+        int lo = 0, hi = 255;
+        while (lo < hi) {
+            int mid = (lo + hi) >> 1;
+            if (cdf[mid] > u)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        out[i] = prev = (uint8_t) lo;
+    }
+}
+
+// Empirical order-0 entropy of some data, in bits/symbol. This is the best
+// an order-0 coder (everything in this repository but rans_order1.h) can
+// do on it, not counting the cost of sending the table.
+static inline double RansCorpusOrder0Entropy(uint8_t const* data, size_t size)
+{
+    if (!size)
+        return 0.0;
+
+    size_t counts[256];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i=0; i < size; i++)
+        counts[data[i]]++;
+
+    double probs[256];
+    for (int i=0; i < 256; i++)
+        probs[i] = (double) counts[i] / (double) size;
+    return RansCorpusEntropyOf(probs, 256);
+}
+
+#endif // RANS_CORPUS_HEADER
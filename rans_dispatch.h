@@ -0,0 +1,227 @@
+// Runtime CPU dispatch for the word-aligned rANS coder - public domain
+//
+// The SIMD coders in rans_word_sse41.h, rans_word_avx2.h and
+// rans_word_avx512.h each need to be compiled with the matching -m flags,
+// and the resulting program then only runs on CPUs that have them. This
+// file puts them behind one set of entry points that check the CPU once
+// (via cpuid) and pick the best kernel it supports.
+//
+// All kernels read and write the same stream: the 16-way interleaved
+// word stream from main_simd.cpp (symbol i goes into stream i & 15). That
+// is the native width of the AVX-512 coder; the AVX2 kernel runs it with
+// two 8-lane registers, the SSE 4.1 kernel with four 4-lane registers,
+// and the scalar kernel with 16 separate states. Either way the words
+// get consumed in the same order, so anything written by one kernel can
+// be read by any of the others.
+//
+// The scalar kernel lives in this file. The SIMD kernels are in
+// rans_dispatch_sse41.cpp, rans_dispatch_avx2.cpp and
+// rans_dispatch_avx512.cpp, which need to be compiled with -msse4.1,
+// -mavx2 and -mavx512f -mavx512bw -mavx512vl respectively (and linked in);
+// everything else is compiled for the baseline target. See
+// main_dispatch.cpp and "exam_dispatch" in the Makefile.
+//
+// Unlike rans_byte.h, this file needs to be compiled as C++.
+
+#ifndef RANS_DISPATCH_HEADER
+#define RANS_DISPATCH_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include "rans_word_sse41.h"
+
+// Number of interleaved streams in the dispatch stream format.
+#define RANS_DISPATCH_WAYS 16
+
+enum RansIsa {
+    RANS_ISA_SCALAR,
+    RANS_ISA_SSE41,
+    RANS_ISA_AVX2,
+    RANS_ISA_AVX512,    // F, BW and VL
+
+    RANS_ISA_COUNT
+};
+
+// Encodes "in_size" bytes into a 16-way interleaved stream that ends right
+// before "out_end" (the encoder writes backwards); returns the start.
+typedef uint16_t* RansDispatchEncodeFunc(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms);
+
+// Decodes "out_size" bytes from the stream starting at "ptr". Like the
+// SIMD decoders themselves, this may read up to 32 bytes past the end of
+// the stream, so leave some padding there.
+typedef void RansDispatchDecodeFunc(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab);
+
+struct RansDispatch {
+    RansIsa isa;
+    char const* name;
+    RansDispatchEncodeFunc* encode;
+    RansDispatchDecodeFunc* decode;
+};
+
+// SIMD kernels, each in its own translation unit.
+uint16_t* RansDispatchEncodeSse41(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms);
+void RansDispatchDecodeSse41(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab);
+uint16_t* RansDispatchEncodeAvx2(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms);
+void RansDispatchDecodeAvx2(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab);
+uint16_t* RansDispatchEncodeAvx512(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms);
+void RansDispatchDecodeAvx512(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab);
+
+// --------------------------------------------------------------------------
+
+// Scalar kernels. These are the reference for the stream format.
+static inline uint16_t* RansDispatchEncodeScalar(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms)
+{
+    RansWordEnc rans[RANS_DISPATCH_WAYS];
+    for (int j=0; j < RANS_DISPATCH_WAYS; j++)
+        rans[j] = RansWordEncInit();
+
+    uint16_t* ptr = out_end;
+    for (size_t i=in_size; i > 0; i--) { // NB: working in reverse
+        RansWordEncSymbol const* s = &esyms[in[i - 1]];
+        RansWordEncPut(&rans[(i - 1) & (RANS_DISPATCH_WAYS - 1)], &ptr, s->start, s->freq);
+    }
+    for (int j=RANS_DISPATCH_WAYS; j > 0; j--)
+        RansWordEncFlush(&rans[j - 1], &ptr);
+
+    return ptr;
+}
+
+static inline void RansDispatchDecodeScalar(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab)
+{
+    RansWordDec rans[RANS_DISPATCH_WAYS];
+    for (int j=0; j < RANS_DISPATCH_WAYS; j++)
+        RansWordDecInit(&rans[j], &ptr);
+
+    size_t body = out_size & ~(size_t)(RANS_DISPATCH_WAYS - 1);
+    for (size_t i=0; i < body; i += RANS_DISPATCH_WAYS) {
+        for (int j=0; j < RANS_DISPATCH_WAYS; j++)
+            out[i + j] = RansWordDecSym(&rans[j], tab);
+        for (int j=0; j < RANS_DISPATCH_WAYS; j++)
+            RansWordDecRenorm(&rans[j], &ptr);
+    }
+
+    // last few bytes (no renormalization needed; these were the first
+    // symbols the encoder saw in their lanes)
+    for (size_t i=body; i < out_size; i++)
+        out[i] = RansWordDecSym(&rans[i & (RANS_DISPATCH_WAYS - 1)], tab);
+}
+
+// --------------------------------------------------------------------------
+
+static inline void RansCpuid(uint32_t regs[4], uint32_t leaf, uint32_t subleaf)
+{
+#if defined(_MSC_VER)
+    __cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Returns the OS-enabled register state (XCR0); only call this when
+// cpuid says OSXSAVE is set.
+static inline uint64_t RansXgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+// Returns a mask with bit (1 << isa) set for every RansIsa the CPU (and
+// OS) supports.
+static inline uint32_t RansCpuDetect()
+{
+    uint32_t mask = 1u << RANS_ISA_SCALAR;
+    uint32_t regs[4];
+
+    RansCpuid(regs, 0, 0);
+    uint32_t max_leaf = regs[0];
+    if (max_leaf < 1)
+        return mask;
+
+    RansCpuid(regs, 1, 0);
+    uint32_t ecx1 = regs[2];
+    if (ecx1 & (1u << 19)) // SSE4.1
+        mask |= 1u << RANS_ISA_SSE41;
+
+    // AVX and up also need the OS to save the wider registers on context
+    // switches: XMM|YMM state for AVX2, plus opmask and ZMM for AVX-512.
+    if (max_leaf < 7 || !(ecx1 & (1u << 27))) // OSXSAVE
+        return mask;
+
+    uint64_t xcr0 = RansXgetbv();
+    RansCpuid(regs, 7, 0);
+    uint32_t ebx7 = regs[1];
+
+    bool avx = (ecx1 & (1u << 28)) != 0 && (xcr0 & 0x06) == 0x06;
+    if (avx && (ebx7 & (1u << 5))) // AVX2
+        mask |= 1u << RANS_ISA_AVX2;
+
+    uint32_t avx512_bits = (1u << 16) | (1u << 30) | (1u << 31); // F, BW, VL
+    if (avx && (xcr0 & 0xe6) == 0xe6 && (ebx7 & avx512_bits) == avx512_bits)
+        mask |= 1u << RANS_ISA_AVX512;
+
+    return mask;
+}
+
+// Returns the (cached) result of RansCpuDetect.
+static inline uint32_t RansCpuFeatures()
+{
+    static uint32_t const features = RansCpuDetect();
+    return features;
+}
+
+// Returns the kernels for "isa", or NULL if this CPU doesn't support it.
+static inline RansDispatch const* RansDispatchFor(RansIsa isa)
+{
+    static RansDispatch const kernels[RANS_ISA_COUNT] = {
+        { RANS_ISA_SCALAR, "scalar",  RansDispatchEncodeScalar, RansDispatchDecodeScalar },
+        { RANS_ISA_SSE41,  "SSE 4.1", RansDispatchEncodeSse41,  RansDispatchDecodeSse41 },
+        { RANS_ISA_AVX2,   "AVX2",    RansDispatchEncodeAvx2,   RansDispatchDecodeAvx2 },
+        { RANS_ISA_AVX512, "AVX-512", RansDispatchEncodeAvx512, RansDispatchDecodeAvx512 },
+    };
+
+    if ((unsigned)isa >= RANS_ISA_COUNT || !(RansCpuFeatures() & (1u << isa)))
+        return NULL;
+    return &kernels[isa];
+}
+
+// Returns the best kernels this CPU supports.
+static inline RansDispatch const* RansDispatchPick()
+{
+    for (int isa=RANS_ISA_COUNT - 1; isa > RANS_ISA_SCALAR; isa--) {
+        if (RansDispatch const* d = RansDispatchFor((RansIsa)isa))
+            return d;
+    }
+    return RansDispatchFor(RANS_ISA_SCALAR);
+}
+
+// Same, but the choice is made on the first call and cached.
+static inline RansDispatch const* RansDispatchBest()
+{
+    static RansDispatch const* const best = RansDispatchPick();
+    return best;
+}
+
+// Convenience wrappers: encode/decode with the best available kernels.
+static inline uint16_t* RansDispatchEncode(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms)
+{
+    return RansDispatchBest()->encode(out_end, in, in_size, esyms);
+}
+
+static inline void RansDispatchDecode(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab)
+{
+    RansDispatchBest()->decode(out, out_size, ptr, tab);
+}
+
+#endif // RANS_DISPATCH_HEADER
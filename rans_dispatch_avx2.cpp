@@ -0,0 +1,54 @@
+// AVX2 kernels for rans_dispatch.h - public domain
+//
+// Compile this file with -mavx2. Same caveat as rans_dispatch_sse41.cpp:
+// no C++ library templates in here.
+
+#include "platform.h"
+#include "rans_word_avx2.h"
+#include "rans_dispatch.h"
+
+// The 16 streams live in two 8-lane registers; stream i is in
+// rans[i >> 3].lane[i & 7].
+uint16_t* RansDispatchEncodeAvx2(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms)
+{
+    RansAvx2Enc rans[2];
+    RansAvx2EncInit(&rans[0]);
+    RansAvx2EncInit(&rans[1]);
+
+    uint16_t* ptr = out_end;
+
+    // last few bytes
+    for (size_t i=in_size; i > (in_size & ~15); i--) { // NB: working in reverse
+        RansWordEncSymbol const* s = &esyms[in[i - 1]];
+        RansWordEncPut(&rans[((i - 1) >> 3) & 1].lane[(i - 1) & 7], &ptr, s->start, s->freq);
+    }
+
+    for (size_t i=(in_size & ~15); i > 0; i -= 16) { // NB: working in reverse!
+        RansAvx2EncPut(&rans[1], &ptr, esyms, *(uint64_t const *)(in + i - 8));
+        RansAvx2EncPut(&rans[0], &ptr, esyms, *(uint64_t const *)(in + i - 16));
+    }
+    RansAvx2EncFlush(&rans[1], &ptr);
+    RansAvx2EncFlush(&rans[0], &ptr);
+
+    return ptr;
+}
+
+void RansDispatchDecodeAvx2(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab)
+{
+    RansAvx2Dec rans[2];
+    RansAvx2DecInit(&rans[0], &ptr);
+    RansAvx2DecInit(&rans[1], &ptr);
+
+    for (size_t i=0; i < (out_size & ~15); i += 16) {
+        uint64_t s07 = RansAvx2DecSym(&rans[0], tab);
+        uint64_t s8f = RansAvx2DecSym(&rans[1], tab);
+        *(uint64_t *)(out + i + 0) = s07;
+        *(uint64_t *)(out + i + 8) = s8f;
+        RansAvx2DecRenorm(&rans[0], &ptr);
+        RansAvx2DecRenorm(&rans[1], &ptr);
+    }
+
+    // last few bytes
+    for (size_t i=(out_size & ~15); i < out_size; i++)
+        out[i] = RansWordDecSym(&rans[(i >> 3) & 1].lane[i & 7], tab);
+}
@@ -0,0 +1,45 @@
+// AVX-512 kernels for rans_dispatch.h - public domain
+//
+// Compile this file with -mavx512f -mavx512bw -mavx512vl. Same caveat as
+// rans_dispatch_sse41.cpp: no C++ library templates in here.
+
+#include "platform.h"
+#include "rans_word_avx512.h"
+#include "rans_dispatch.h"
+
+// The dispatch stream format is the native format of this coder.
+uint16_t* RansDispatchEncodeAvx512(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms)
+{
+    RansAvx512Enc rans;
+    RansAvx512EncInit(&rans);
+
+    uint16_t* ptr = out_end;
+
+    // last few bytes
+    for (size_t i=in_size; i > (in_size & ~15); i--) { // NB: working in reverse
+        RansWordEncSymbol const* s = &esyms[in[i - 1]];
+        RansWordEncPut(&rans.lane[(i - 1) & 15], &ptr, s->start, s->freq);
+    }
+
+    for (size_t i=(in_size & ~15); i > 0; i -= 16) // NB: working in reverse!
+        RansAvx512EncPut(&rans, &ptr, esyms, _mm_loadu_si128((const __m128i*)(in + i - 16)));
+    RansAvx512EncFlush(&rans, &ptr);
+
+    return ptr;
+}
+
+void RansDispatchDecodeAvx512(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab)
+{
+    RansAvx512Dec rans;
+    RansAvx512DecInit(&rans, &ptr);
+
+    for (size_t i=0; i < (out_size & ~15); i += 16) {
+        __m128i s015 = RansAvx512DecSym(&rans, tab);
+        _mm_storeu_si128((__m128i *)(out + i), s015);
+        RansAvx512DecRenorm(&rans, &ptr);
+    }
+
+    // last few bytes
+    for (size_t i=(out_size & ~15); i < out_size; i++)
+        out[i] = RansWordDecSym(&rans.lane[i & 15], tab);
+}
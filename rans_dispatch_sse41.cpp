@@ -0,0 +1,64 @@
+// SSE 4.1 kernels for rans_dispatch.h - public domain
+//
+// Compile this file with -msse4.1 (and nothing else in the program needs
+// it). Keep it free of C++ library templates: anything with external
+// linkage instantiated here would be compiled for SSE 4.1 too, and the
+// linker is free to pick that copy for the rest of the program.
+
+#include "platform.h"
+#include "rans_word_sse41.h"
+#include "rans_dispatch.h"
+
+// The 16 streams live in four 4-lane registers; stream i is in
+// rans[i >> 2].lane[i & 3].
+uint16_t* RansDispatchEncodeSse41(uint16_t* out_end, uint8_t const* in, size_t in_size, RansWordEncSymbol const* esyms)
+{
+    RansSimdEnc rans[4];
+    for (int j=0; j < 4; j++)
+        RansSimdEncInit(&rans[j]);
+
+    uint16_t* ptr = out_end;
+
+    // last few bytes
+    for (size_t i=in_size; i > (in_size & ~15); i--) { // NB: working in reverse
+        RansWordEncSymbol const* s = &esyms[in[i - 1]];
+        RansWordEncPut(&rans[((i - 1) >> 2) & 3].lane[(i - 1) & 3], &ptr, s->start, s->freq);
+    }
+
+    for (size_t i=(in_size & ~15); i > 0; i -= 16) { // NB: working in reverse!
+        RansSimdEncPut(&rans[3], &ptr, esyms, *(uint32_t const *)(in + i - 4));
+        RansSimdEncPut(&rans[2], &ptr, esyms, *(uint32_t const *)(in + i - 8));
+        RansSimdEncPut(&rans[1], &ptr, esyms, *(uint32_t const *)(in + i - 12));
+        RansSimdEncPut(&rans[0], &ptr, esyms, *(uint32_t const *)(in + i - 16));
+    }
+    for (int j=4; j > 0; j--)
+        RansSimdEncFlush(&rans[j - 1], &ptr);
+
+    return ptr;
+}
+
+void RansDispatchDecodeSse41(uint8_t* out, size_t out_size, uint16_t* ptr, RansWordTables const* tab)
+{
+    RansSimdDec rans[4];
+    for (int j=0; j < 4; j++)
+        RansSimdDecInit(&rans[j], &ptr);
+
+    for (size_t i=0; i < (out_size & ~15); i += 16) {
+        uint32_t s03 = RansSimdDecSym(&rans[0], tab);
+        uint32_t s47 = RansSimdDecSym(&rans[1], tab);
+        uint32_t s8b = RansSimdDecSym(&rans[2], tab);
+        uint32_t scf = RansSimdDecSym(&rans[3], tab);
+        *(uint32_t *)(out + i + 0) = s03;
+        *(uint32_t *)(out + i + 4) = s47;
+        *(uint32_t *)(out + i + 8) = s8b;
+        *(uint32_t *)(out + i + 12) = scf;
+        RansSimdDecRenorm(&rans[0], &ptr);
+        RansSimdDecRenorm(&rans[1], &ptr);
+        RansSimdDecRenorm(&rans[2], &ptr);
+        RansSimdDecRenorm(&rans[3], &ptr);
+    }
+
+    // last few bytes
+    for (size_t i=(out_size & ~15); i < out_size; i++)
+        out[i] = RansWordDecSym(&rans[(i >> 2) & 3].lane[i & 3], tab);
+}
@@ -0,0 +1,218 @@
+// Fast symbol histograms - public domain
+//
+// Counting symbols is a full pass over the input before any encoding can
+// start, and the obvious loop
+//
+//   for (i=0; i < n; i++) freqs[in[i]]++;
+//
+// is slower than it looks: each increment is a load, add and store to
+// memory, and when the same symbol comes up again shortly after (runs, or
+// just a skewed distribution), the next increment has to wait for the
+// previous store to forward to its load. On highly skewed data, that's a
+// chain of dependent store-forwarding round trips, several cycles a
+// symbol, when the loads and adds themselves would go at well over one
+// symbol per cycle.
+//
+// The fix is the usual one: several sub-histograms, with consecutive
+// symbols going to different ones, so that repeats hit different
+// addresses and the increments can overlap; they get summed at the end.
+// Input is read with 8-byte loads (16 bytes per iteration), and the
+// symbols are pulled out with shifts, which is cheaper than a load per
+// symbol. (Which byte of a word goes to which sub-histogram doesn't
+// matter, so this doesn't care about endianness.) 16-bit symbols are
+// loaded one at a time; a 16-bit load is no more expensive than pulling
+// the symbol out of a wider one, and measured a bit faster.
+//
+// There's no vector gather/scatter in here. A histogram increment is a
+// read-modify-write to a data-dependent address, and doing that with
+// AVX-512 scatters (plus conflict detection for duplicate lanes, which
+// are common exactly on the skewed data where this matters) doesn't beat
+// the scalar sub-histograms.
+//
+// For large inputs, the Threaded versions split the input into one
+// contiguous range per thread, count each range separately, and add up
+// the results (which are exactly the same as the single-threaded ones).
+// The ranges need to be big enough to be worth starting a thread for,
+// and for big alphabets that's mostly about nsyms, not the input size:
+// every thread zeroes and merges its own 4*nsyms sub-histogram entries,
+// and the partial counts get summed serially at the end, so with few
+// symbols per bin the threads just add work (at nsyms=65536, 1M symbols
+// per thread was about twice as slow as one thread). Threads get at
+// least RANS_HIST_MIN_THREAD_BYTES of input and
+// RANS_HIST_MIN_THREAD_SYMS_PER_BIN*nsyms symbols each; smaller inputs
+// are counted on the calling thread.
+//
+// SymbolStats::count_freqs and SymbolStats16::count_freqs (rans_stats.h)
+// use these, and have _threaded variants.
+//
+// Counts are 32-bit, so inputs are limited to 2^32-1 symbols per call.
+//
+// Needs to be compiled as C++11 or later (uses std::thread).
+
+#ifndef RANS_HIST_HEADER
+#define RANS_HIST_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#ifdef assert
+#define RansHistAssert assert
+#else
+#define RansHistAssert(x)
+#endif
+
+// Number of sub-histograms. 4 is enough to hide the store forwarding
+// latency; more just makes the merge (and cache footprint) bigger.
+#define RANS_HIST_WAYS                      4
+
+// Threaded counting uses at most one thread per this many bytes of input,
+// and per this many symbols per histogram bin (see above).
+#define RANS_HIST_MIN_THREAD_BYTES          (1u << 20)
+#define RANS_HIST_MIN_THREAD_SYMS_PER_BIN   64
+
+// Counts the bytes in "in" into freqs[0..255] (overwriting them).
+static inline void RansHistCount8(uint32_t* freqs, uint8_t const* in, size_t size)
+{
+    RansHistAssert(size <= 0xffffffffu);
+    uint32_t c[RANS_HIST_WAYS][256];
+    memset(c, 0, sizeof(c));
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint64_t a, b;
+        memcpy(&a, in + i + 0, 8);
+        memcpy(&b, in + i + 8, 8);
+
+        c[0][(uint8_t) (a >>  0)]++;
+        c[1][(uint8_t) (a >>  8)]++;
+        c[2][(uint8_t) (a >> 16)]++;
+        c[3][(uint8_t) (a >> 24)]++;
+        c[0][(uint8_t) (a >> 32)]++;
+        c[1][(uint8_t) (a >> 40)]++;
+        c[2][(uint8_t) (a >> 48)]++;
+        c[3][(uint8_t) (a >> 56)]++;
+
+        c[0][(uint8_t) (b >>  0)]++;
+        c[1][(uint8_t) (b >>  8)]++;
+        c[2][(uint8_t) (b >> 16)]++;
+        c[3][(uint8_t) (b >> 24)]++;
+        c[0][(uint8_t) (b >> 32)]++;
+        c[1][(uint8_t) (b >> 40)]++;
+        c[2][(uint8_t) (b >> 48)]++;
+        c[3][(uint8_t) (b >> 56)]++;
+    }
+    for (; i < size; i++)
+        c[0][in[i]]++;
+
+    for (int s=0; s < 256; s++)
+        freqs[s] = c[0][s] + c[1][s] + c[2][s] + c[3][s];
+}
+
+// Counts 16-bit symbols (all < nsyms) into freqs[0..nsyms-1] (overwriting
+// them). For big alphabets, the sub-histograms get big too (4 x 256k at
+// nsyms=65536), which costs a bit on near-random data, but that's still
+// much better than the dependency chains on skewed data.
+static inline void RansHistCount16(uint32_t* freqs, uint32_t nsyms, uint16_t const* in, size_t count)
+{
+    RansHistAssert(count <= 0xffffffffu);
+    std::vector<uint32_t> tmp((size_t) nsyms * (RANS_HIST_WAYS - 1), 0);
+    uint32_t* c0 = freqs;
+    uint32_t* c1 = &tmp[0];
+    uint32_t* c2 = &tmp[nsyms];
+    uint32_t* c3 = &tmp[(size_t) nsyms * 2];
+    memset(c0, 0, nsyms * sizeof(uint32_t));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (int j=0; j < 8; j++)
+            RansHistAssert(in[i + j] < nsyms);
+
+        c0[in[i + 0]]++;
+        c1[in[i + 1]]++;
+        c2[in[i + 2]]++;
+        c3[in[i + 3]]++;
+        c0[in[i + 4]]++;
+        c1[in[i + 5]]++;
+        c2[in[i + 6]]++;
+        c3[in[i + 7]]++;
+    }
+    for (; i < count; i++) {
+        RansHistAssert(in[i] < nsyms);
+        c0[in[i]]++;
+    }
+
+    for (uint32_t s=0; s < nsyms; s++)
+        c0[s] += c1[s] + c2[s] + c3[s];
+}
+
+// Internal helpers.
+
+static inline void RansHistCountRange(uint32_t* freqs, uint32_t /*nsyms*/, uint8_t const* in, size_t count)
+{
+    RansHistCount8(freqs, in, count);
+}
+
+static inline void RansHistCountRange(uint32_t* freqs, uint32_t nsyms, uint16_t const* in, size_t count)
+{
+    RansHistCount16(freqs, nsyms, in, count);
+}
+
+// Splits "in" into one range per thread (on up to num_threads threads,
+// including the calling one; <= 0 means one per hardware thread), counts
+// each, and sums the counts into freqs[0..nsyms-1].
+template<typename Sym>
+static void RansHistCountThreaded(uint32_t* freqs, uint32_t nsyms, Sym const* in, size_t count, int num_threads)
+{
+    RansHistAssert(count <= 0xffffffffu); // the merged counts are 32-bit too
+    if (num_threads <= 0)
+        num_threads = (int) std::thread::hardware_concurrency();
+    size_t max_threads = count * sizeof(Sym) / RANS_HIST_MIN_THREAD_BYTES;
+    size_t max_threads_bins = count / ((size_t) nsyms * RANS_HIST_MIN_THREAD_SYMS_PER_BIN);
+    if (max_threads > max_threads_bins)
+        max_threads = max_threads_bins;
+    if ((size_t) num_threads > max_threads)
+        num_threads = (int) max_threads;
+    if (num_threads <= 1) {
+        RansHistCountRange(freqs, nsyms, in, count);
+        return;
+    }
+
+    // thread 0 (the calling thread) counts straight into freqs
+    std::vector<uint32_t> partial((size_t) nsyms * (num_threads - 1));
+    size_t range = count / num_threads;
+    auto worker = [&](int t) {
+        size_t start = (size_t) t * range;
+        size_t len = (t == num_threads - 1) ? count - start : range;
+        uint32_t* dst = t ? &partial[(size_t) nsyms * (t - 1)] : freqs;
+        RansHistCountRange(dst, nsyms, in + start, len);
+    };
+
+    std::vector<std::thread> threads;
+    for (int t=1; t < num_threads; t++)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (size_t t=0; t < threads.size(); t++)
+        threads[t].join();
+
+    for (int t=1; t < num_threads; t++) {
+        uint32_t const* src = &partial[(size_t) nsyms * (t - 1)];
+        for (uint32_t s=0; s < nsyms; s++)
+            freqs[s] += src[s];
+    }
+}
+
+// Threaded versions of RansHistCount8/RansHistCount16.
+static inline void RansHistCount8Threaded(uint32_t* freqs, uint8_t const* in, size_t size, int num_threads)
+{
+    RansHistCountThreaded(freqs, 256, in, size, num_threads);
+}
+
+static inline void RansHistCount16Threaded(uint32_t* freqs, uint32_t nsyms, uint16_t const* in, size_t count, int num_threads)
+{
+    RansHistCountThreaded(freqs, nsyms, in, count, num_threads);
+}
+
+#endif // RANS_HIST_HEADER
@@ -0,0 +1,208 @@
+// Optional instrumentation counters for the rANS coders - public domain
+//
+// Timings say *that* one stream decodes slower than another, not why. For
+// rANS, the "why" is nearly always in the renormalization: how often it
+// triggers, how many bytes or words each one moves (and hence how often the
+// renorm loops go around or the SIMD shuffles pick which lanes), and, behind
+// all that, the mix of symbol probabilities in the data.
+//
+// rans_byte.h, rans64.h, rans32.h and rans_word_sse41.h count those events when
+// RANS_INSTRUMENT is defined (before including them, or on the command
+// line). Otherwise the hooks expand to nothing and the coders compile to
+// exactly the same code as without this file.
+//
+// Counters are per thread and cumulative; reset them, run whatever you
+// want to look at, then read them (or print them) afterwards:
+//
+//   RansCountersReset();
+//   ... encode/decode ...
+//   RansCountersPrint(stdout, "rans_byte", &RansGetCounters()->byte);
+//
+// The encoder counts every symbol it puts, along with its cost. The
+// decoder side counts renormalization steps, which is one per symbol for
+// all decoders here except the last few symbols in each stream (those
+// don't need one). See "main_instrument.cpp" for an example.
+//
+// The counters make the coders a good deal slower, so don't time with them.
+//
+// Needs to be compiled as C++.
+
+#ifndef RANS_INSTRUMENT_HEADER
+#define RANS_INSTRUMENT_HEADER
+
+#ifdef RANS_INSTRUMENT
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+// Counting hook: the statement only exists in instrumented builds.
+#define RANS_COUNT(stmt) stmt
+
+#define RANS_COUNT_MAX_WORDS    4   // renorm histograms go 0, 1, ..., 4 or more
+#define RANS_COUNT_MAX_COST     31  // cost histogram goes 0, 1, ..., 31 bits
+#define RANS_COUNT_SIMD_LANES   4   // lanes per SIMD renorm (SSE 4.1 coder)
+
+struct RansCoderCounters {
+    // Encoder
+    uint64_t enc_symbols;                                // symbols encoded
+    uint64_t enc_words;                                  // bytes/words written by renorm
+    uint64_t enc_renorm[RANS_COUNT_MAX_WORDS + 1];       // symbols by number of bytes/words written
+    uint64_t enc_cost[RANS_COUNT_MAX_COST + 1];          // symbols by cost, see below
+
+    // Decoder
+    uint64_t dec_symbols;                                // renorm steps
+    uint64_t dec_words;                                  // bytes/words read by renorm
+    uint64_t dec_renorm[RANS_COUNT_MAX_WORDS + 1];       // steps by number of bytes/words read
+
+    // SIMD renorm steps by number of lanes that moved a word (this is the
+    // distribution of numbits[mask] in RansSimdEncPut/RansSimdDecRenorm).
+    uint64_t simd_enc_lanes[RANS_COUNT_SIMD_LANES + 1];
+    uint64_t simd_dec_lanes[RANS_COUNT_SIMD_LANES + 1];
+};
+
+// Bucket b of enc_cost counts the symbols with scale_bits - floor(log2(freq))
+// == b, i.e. symbols that cost more than b-1 and at most b bits. That's
+// the symbol frequency mix as the coder sees it: the bits per symbol, and
+// hence the renorm rate, follow directly from it.
+
+struct RansCounters {
+    RansCoderCounters byte;     // rans_byte.h
+    RansCoderCounters rans64;   // rans64.h
+    RansCoderCounters rans32;   // rans32.h
+    RansCoderCounters word;     // rans_word_sse41.h (scalar and SIMD)
+};
+
+// The counters for the current thread. NOTE: not static (unlike everything
+// else in these headers), so that all translation units share one copy.
+inline RansCounters* RansGetCounters()
+{
+    static thread_local RansCounters counters;
+    return &counters;
+}
+
+// Clears all counters for the current thread.
+static inline void RansCountersReset()
+{
+    memset(RansGetCounters(), 0, sizeof(RansCounters));
+}
+
+static inline uint32_t RansCountLog2(uint64_t x)
+{
+    uint32_t n = 0;
+    while (x >>= 1)
+        n++;
+    return n;
+}
+
+static inline void RansCountBump(uint64_t* hist, size_t value, size_t max_value)
+{
+    hist[value < max_value ? value : max_value]++;
+}
+
+// Encoder put of a symbol with the given cost bucket that wrote "words"
+// bytes/words.
+static inline void RansCountEnc(RansCoderCounters* c, uint32_t cost, size_t words)
+{
+    c->enc_symbols++;
+    c->enc_words += words;
+    RansCountBump(c->enc_renorm, words, RANS_COUNT_MAX_WORDS);
+    RansCountBump(c->enc_cost, cost, RANS_COUNT_MAX_COST);
+}
+
+// Just the cost part of that (for SIMD encoders, see RansCountSimdEnc).
+static inline void RansCountEncCost(RansCoderCounters* c, uint32_t cost)
+{
+    RansCountBump(c->enc_cost, cost, RANS_COUNT_MAX_COST);
+}
+
+// Cost bucket for a symbol with frequency "freq" at "scale_bits".
+static inline uint32_t RansCountCost(uint32_t freq, uint32_t scale_bits)
+{
+    return scale_bits - RansCountLog2(freq);
+}
+
+// Decoder renorm step that read "words" bytes/words.
+static inline void RansCountDec(RansCoderCounters* c, size_t words)
+{
+    c->dec_symbols++;
+    c->dec_words += words;
+    RansCountBump(c->dec_renorm, words, RANS_COUNT_MAX_WORDS);
+}
+
+// SIMD renorm steps: 4 lanes, "lanes" of which moved one word each. The
+// encoder counts the costs separately, per lane.
+static inline void RansCountSimdEnc(RansCoderCounters* c, uint32_t lanes)
+{
+    c->enc_symbols += RANS_COUNT_SIMD_LANES;
+    c->enc_words += lanes;
+    c->enc_renorm[0] += RANS_COUNT_SIMD_LANES - lanes;
+    c->enc_renorm[1] += lanes;
+    c->simd_enc_lanes[lanes]++;
+}
+
+static inline void RansCountSimdDec(RansCoderCounters* c, uint32_t lanes)
+{
+    c->dec_symbols += RANS_COUNT_SIMD_LANES;
+    c->dec_words += lanes;
+    c->dec_renorm[0] += RANS_COUNT_SIMD_LANES - lanes;
+    c->dec_renorm[1] += lanes;
+    c->simd_dec_lanes[lanes]++;
+}
+
+static inline void RansCountersPrintHist(FILE* f, char const* label, uint64_t const* hist, int count)
+{
+    uint64_t total = 0;
+    for (int i=0; i < count; i++)
+        total += hist[i];
+    if (!total)
+        return;
+
+    fprintf(f, "  %-17s", label);
+    for (int i=0; i < count; i++)
+        fprintf(f, " %5.1f%%", 100.0 * hist[i] / total);
+    fputs("\n", f);
+}
+
+// Prints a summary of one coder's counters.
+static inline void RansCountersPrint(FILE* f, char const* name, RansCoderCounters const* c)
+{
+    fprintf(f, "%s:\n", name);
+    if (c->enc_symbols) {
+        uint64_t n = c->enc_symbols;
+        fprintf(f, "  encode: %" PRIu64 " symbols, %" PRIu64 " words, %.3f words/symbol, %.1f%% renormalize\n",
+            n, c->enc_words, 1.0 * c->enc_words / n, 100.0 * (n - c->enc_renorm[0]) / n);
+        RansCountersPrintHist(f, "words 0..4+:", c->enc_renorm, RANS_COUNT_MAX_WORDS + 1);
+        RansCountersPrintHist(f, "SIMD lanes 0..4:", c->simd_enc_lanes, RANS_COUNT_SIMD_LANES + 1);
+
+        // cost histogram, only the range that's actually used
+        int lo = 0, hi = RANS_COUNT_MAX_COST;
+        while (lo < hi && !c->enc_cost[lo])
+            lo++;
+        while (hi > lo && !c->enc_cost[hi])
+            hi--;
+        double bits = 0.0;
+        for (int i=0; i <= RANS_COUNT_MAX_COST; i++)
+            bits += (double) i * c->enc_cost[i];
+        fprintf(f, "  cost in bits, rounded up (avg <= %.2f):\n", bits / n);
+        for (int i=lo; i <= hi; i++)
+            fprintf(f, "    %2d: %5.1f%%\n", i, 100.0 * c->enc_cost[i] / n);
+    }
+    if (c->dec_symbols) {
+        uint64_t n = c->dec_symbols;
+        fprintf(f, "  decode: %" PRIu64 " steps, %" PRIu64 " words, %.3f words/step, %.1f%% renormalize\n",
+            n, c->dec_words, 1.0 * c->dec_words / n, 100.0 * (n - c->dec_renorm[0]) / n);
+        RansCountersPrintHist(f, "words 0..4+:", c->dec_renorm, RANS_COUNT_MAX_WORDS + 1);
+        RansCountersPrintHist(f, "SIMD lanes 0..4:", c->simd_dec_lanes, RANS_COUNT_SIMD_LANES + 1);
+    }
+}
+
+#else
+
+#define RANS_COUNT(stmt)
+
+#endif // RANS_INSTRUMENT
+
+#endif // RANS_INSTRUMENT_HEADER
@@ -0,0 +1,319 @@
+// Generic N-way interleaved rANS encode/decode - public domain
+//
+// This wraps the interleaving pattern used in main.cpp/main64.cpp (which
+// is hard-coded for two states there) into a template that works for any
+// number of states and any of rans_byte.h / rans64.h / rans32.h.
+//
+// Stream layout: symbol i is coded by state (i % N). If the number of
+// symbols isn't a multiple of N, the last (n % N) symbols are coded by
+// states 0, 1, ..., in that order. For N=2, this is exactly the stream
+// produced by the interleaved loops in main.cpp and main64.cpp.
+//
+// Symbols can be bytes or 16-bit values (any unsigned integer type "Sym",
+// deduced from the in/out and cum2sym pointers): the symbol tables just
+// need one entry per symbol in the alphabet. See main_large.cpp.
+//
+// Needs to be compiled as C++.
+
+#ifndef RANS_INTERLEAVE_HEADER
+#define RANS_INTERLEAVE_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rans_byte.h"
+#include "rans64.h"
+#include "rans32.h"
+
+// --------------------------------------------------------------------------
+
+// Coder families. These just forward to the functions in the respective
+// headers, so the driver below can be written once.
+
+struct RansByteCoder {
+    typedef RansState State;
+    typedef uint8_t Word;
+    typedef RansEncSymbol EncSymbol;
+    typedef RansDecSymbol DecSymbol;
+
+    static inline void EncSymbolInit(EncSymbol* s, uint32_t start, uint32_t freq, uint32_t scale_bits) { RansEncSymbolInit(s, start, freq, scale_bits); }
+    static inline void DecSymbolInit(DecSymbol* s, uint32_t start, uint32_t freq) { RansDecSymbolInit(s, start, freq); }
+
+    static inline void EncInit(State* r) { RansEncInit(r); }
+    static inline void EncPutSymbol(State* r, Word** pptr, EncSymbol const* sym, uint32_t /*scale_bits*/) { RansEncPutSymbol(r, pptr, sym); }
+    static inline void EncFlush(State* r, Word** pptr) { RansEncFlush(r, pptr); }
+
+    static inline void DecInit(State* r, Word** pptr) { RansDecInit(r, pptr); }
+    static inline uint32_t DecGet(State* r, uint32_t scale_bits) { return RansDecGet(r, scale_bits); }
+    static inline void DecAdvanceSymbolStep(State* r, DecSymbol const* sym, uint32_t scale_bits) { RansDecAdvanceSymbolStep(r, sym, scale_bits); }
+    static inline void DecRenorm(State* r, Word** pptr) { RansDecRenorm(r, pptr); }
+
+    // fused decoder table (see rans_byte.h)
+    typedef RansDecSlot DecSlot;
+    static inline void DecSlotsInitSymbol(DecSlot* slots, uint8_t* cum2sym, uint8_t sym, uint32_t start, uint32_t freq) { RansDecSlotsInitSymbol(slots, cum2sym, sym, start, freq); }
+    static inline void DecAdvanceSlotStep(State* r, DecSlot slot, uint32_t scale_bits) { RansDecAdvanceSlotStep(r, slot, scale_bits); }
+
+    // checked decoding (see rans_byte.h)
+    enum { MaxRenormWords = 2 }; // per symbol, for any input
+    static inline bool DecInitChecked(State* r, Word** pptr, Word const* end) { return RansDecInitChecked(r, pptr, end); }
+    static inline bool DecRenormChecked(State* r, Word** pptr, Word const* end) { return RansDecRenormChecked(r, pptr, end); }
+    static inline bool DecIsFinal(State const* r) { return *r == RANS_BYTE_L; }
+};
+
+struct Rans64Coder {
+    typedef Rans64State State;
+    typedef uint32_t Word;
+    typedef Rans64EncSymbol EncSymbol;
+    typedef Rans64DecSymbol DecSymbol;
+
+    static inline void EncSymbolInit(EncSymbol* s, uint32_t start, uint32_t freq, uint32_t scale_bits) { Rans64EncSymbolInit(s, start, freq, scale_bits); }
+    static inline void DecSymbolInit(DecSymbol* s, uint32_t start, uint32_t freq) { Rans64DecSymbolInit(s, start, freq); }
+
+    static inline void EncInit(State* r) { Rans64EncInit(r); }
+    static inline void EncPutSymbol(State* r, Word** pptr, EncSymbol const* sym, uint32_t scale_bits) { Rans64EncPutSymbol(r, pptr, sym, scale_bits); }
+    static inline void EncFlush(State* r, Word** pptr) { Rans64EncFlush(r, pptr); }
+
+    static inline void DecInit(State* r, Word** pptr) { Rans64DecInit(r, pptr); }
+    static inline uint32_t DecGet(State* r, uint32_t scale_bits) { return Rans64DecGet(r, scale_bits); }
+    static inline void DecAdvanceSymbolStep(State* r, DecSymbol const* sym, uint32_t scale_bits) { Rans64DecAdvanceSymbolStep(r, sym, scale_bits); }
+    static inline void DecRenorm(State* r, Word** pptr) { Rans64DecRenorm(r, pptr); }
+
+    // fused decoder table (see rans64.h)
+    typedef Rans64DecSlot DecSlot;
+    static inline void DecSlotsInitSymbol(DecSlot* slots, uint8_t* cum2sym, uint8_t sym, uint32_t start, uint32_t freq) { Rans64DecSlotsInitSymbol(slots, cum2sym, sym, start, freq); }
+    static inline void DecAdvanceSlotStep(State* r, DecSlot slot, uint32_t scale_bits) { Rans64DecAdvanceSlotStep(r, slot, scale_bits); }
+
+    // checked decoding (see rans64.h)
+    enum { MaxRenormWords = 1 }; // per symbol, for any input
+    static inline bool DecInitChecked(State* r, Word** pptr, Word const* end) { return Rans64DecInitChecked(r, pptr, end); }
+    static inline bool DecRenormChecked(State* r, Word** pptr, Word const* end) { return Rans64DecRenormChecked(r, pptr, end); }
+    static inline bool DecIsFinal(State const* r) { return *r == RANS64_L; }
+};
+
+struct Rans32Coder {
+    typedef Rans32State State;
+    typedef uint16_t Word;
+    typedef Rans32EncSymbol EncSymbol;
+    typedef Rans32DecSymbol DecSymbol;
+
+    static inline void EncSymbolInit(EncSymbol* s, uint32_t start, uint32_t freq, uint32_t scale_bits) { Rans32EncSymbolInit(s, start, freq, scale_bits); }
+    static inline void DecSymbolInit(DecSymbol* s, uint32_t start, uint32_t freq) { Rans32DecSymbolInit(s, start, freq); }
+
+    static inline void EncInit(State* r) { Rans32EncInit(r); }
+    static inline void EncPutSymbol(State* r, Word** pptr, EncSymbol const* sym, uint32_t /*scale_bits*/) { Rans32EncPutSymbol(r, pptr, sym); }
+    static inline void EncFlush(State* r, Word** pptr) { Rans32EncFlush(r, pptr); }
+
+    static inline void DecInit(State* r, Word** pptr) { Rans32DecInit(r, pptr); }
+    static inline uint32_t DecGet(State* r, uint32_t scale_bits) { return Rans32DecGet(r, scale_bits); }
+    static inline void DecAdvanceSymbolStep(State* r, DecSymbol const* sym, uint32_t scale_bits) { Rans32DecAdvanceSymbolStep(r, sym, scale_bits); }
+    static inline void DecRenorm(State* r, Word** pptr) { Rans32DecRenorm(r, pptr); } // NOTE: reads one word ahead
+
+    // fused decoder table (see rans32.h)
+    typedef Rans32DecSlot DecSlot;
+    static inline void DecSlotsInitSymbol(DecSlot* slots, uint8_t* cum2sym, uint8_t sym, uint32_t start, uint32_t freq) { Rans32DecSlotsInitSymbol(slots, cum2sym, sym, start, freq); }
+    static inline void DecAdvanceSlotStep(State* r, DecSlot slot, uint32_t scale_bits) { Rans32DecAdvanceSlotStep(r, slot, scale_bits); }
+
+    // checked decoding (see rans32.h)
+    enum { MaxRenormWords = 1 }; // per symbol, for any input
+    static inline bool DecInitChecked(State* r, Word** pptr, Word const* end) { return Rans32DecInitChecked(r, pptr, end); }
+    static inline bool DecRenormChecked(State* r, Word** pptr, Word const* end) { return Rans32DecRenormChecked(r, pptr, end); }
+    static inline bool DecIsFinal(State const* r) { return *r == RANS32_L; }
+};
+
+// --------------------------------------------------------------------------
+
+// Encodes "in_size" symbols from "in" using N interleaved states.
+// Like the underlying coders, this writes backwards from "out_end"
+// (exclusive); returns the start of the encoded data.
+template<int N, typename Coder, typename Sym>
+static inline typename Coder::Word* RansInterleavedEncode(typename Coder::Word* out_end, Sym const* in, size_t in_size,
+    typename Coder::EncSymbol const* esyms, uint32_t scale_bits)
+{
+    typedef typename Coder::State State;
+    typedef typename Coder::Word Word;
+
+    State rans[N];
+    for (int j=0; j < N; j++)
+        Coder::EncInit(&rans[j]);
+
+    Word* ptr = out_end;
+    size_t full = in_size - (in_size % N);
+
+    // last few symbols go to states 0..(in_size % N)-1
+    for (size_t i=in_size; i > full; i--) { // NB: working in reverse!
+        int s = in[i - 1];
+        Coder::EncPutSymbol(&rans[i - 1 - full], &ptr, &esyms[s], scale_bits);
+    }
+
+    for (size_t i=full; i > 0; i -= N) { // NB: working in reverse!
+        Sym const* group = in + i - N;
+        for (int j=N-1; j >= 0; j--)
+            Coder::EncPutSymbol(&rans[j], &ptr, &esyms[group[j]], scale_bits);
+    }
+
+    for (int j=N-1; j >= 0; j--)
+        Coder::EncFlush(&rans[j], &ptr);
+
+    return ptr;
+}
+
+// Decodes "out_size" symbols into "out" from a stream produced by
+// RansInterleavedEncode with the same N. "cum2sym" maps a cumulative
+// frequency (RansDecGet result) to its symbol. Returns the read pointer
+// after the last word consumed.
+//
+// All N states first do their table lookup and "step", and only then
+// renormalize; that way, the N dependency chains can run in parallel.
+template<int N, typename Coder, typename Sym>
+static inline typename Coder::Word* RansInterleavedDecode(Sym* out, size_t out_size, typename Coder::Word* ptr,
+    typename Coder::DecSymbol const* dsyms, Sym const* cum2sym, uint32_t scale_bits)
+{
+    typedef typename Coder::State State;
+
+    State rans[N];
+    for (int j=0; j < N; j++)
+        Coder::DecInit(&rans[j], &ptr);
+
+    size_t full = out_size - (out_size % N);
+    for (size_t i=0; i < full; i += N) {
+        Sym s[N];
+        for (int j=0; j < N; j++) {
+            s[j] = cum2sym[Coder::DecGet(&rans[j], scale_bits)];
+            out[i + j] = s[j];
+        }
+        for (int j=0; j < N; j++)
+            Coder::DecAdvanceSymbolStep(&rans[j], &dsyms[s[j]], scale_bits);
+        for (int j=0; j < N; j++)
+            Coder::DecRenorm(&rans[j], &ptr);
+    }
+
+    // last few symbols, from states 0..(out_size % N)-1
+    for (size_t i=full; i < out_size; i++) {
+        State* r = &rans[i - full];
+        Sym s = cum2sym[Coder::DecGet(r, scale_bits)];
+        out[i] = s;
+        Coder::DecAdvanceSymbolStep(r, &dsyms[s], scale_bits);
+        Coder::DecRenorm(r, &ptr);
+    }
+
+    return ptr;
+}
+
+// Same as RansInterleavedDecode, but with a fused decoder table (set up
+// with Coder::DecSlotsInitSymbol): one dependent load per symbol instead of
+// two. The cum2sym lookup still happens, but nothing waits on it.
+template<int N, typename Coder, typename Sym>
+static inline typename Coder::Word* RansInterleavedDecodeSlots(Sym* out, size_t out_size, typename Coder::Word* ptr,
+    typename Coder::DecSlot const* slots, Sym const* cum2sym, uint32_t scale_bits)
+{
+    typedef typename Coder::State State;
+
+    State rans[N];
+    for (int j=0; j < N; j++)
+        Coder::DecInit(&rans[j], &ptr);
+
+    size_t full = out_size - (out_size % N);
+    for (size_t i=0; i < full; i += N) {
+        for (int j=0; j < N; j++) {
+            uint32_t slot = Coder::DecGet(&rans[j], scale_bits);
+            out[i + j] = cum2sym[slot];
+            Coder::DecAdvanceSlotStep(&rans[j], slots[slot], scale_bits);
+        }
+        for (int j=0; j < N; j++)
+            Coder::DecRenorm(&rans[j], &ptr);
+    }
+
+    // last few symbols, from states 0..(out_size % N)-1
+    for (size_t i=full; i < out_size; i++) {
+        State* r = &rans[i - full];
+        uint32_t slot = Coder::DecGet(r, scale_bits);
+        out[i] = cum2sym[slot];
+        Coder::DecAdvanceSlotStep(r, slots[slot], scale_bits);
+        Coder::DecRenorm(r, &ptr);
+    }
+
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+// Checked decoding, for untrusted input that can't be padded (straight out
+// of a mmap'd file or network buffer, say). Never reads at or past "end".
+
+// Decodes symbols [begin, end_sym) of an "out_size"-symbol stream into
+// "out", continuing from states "rans" (set up with Coder::DecInitChecked).
+// "begin" has to be a multiple of N (or past the last full group). Groups
+// run unchecked while there's enough input left for any data, and only the
+// last few renorms are checked. Returns false if the input runs out.
+template<int N, typename Coder, typename Sym>
+static inline bool RansInterleavedDecodeSymbolsChecked(typename Coder::State* rans, Sym* out, size_t out_size, size_t begin, size_t end_sym,
+    typename Coder::Word** pptr, typename Coder::Word const* end, typename Coder::DecSymbol const* dsyms, Sym const* cum2sym, uint32_t scale_bits)
+{
+    typedef typename Coder::State State;
+    typedef typename Coder::Word Word;
+
+    Word* ptr = *pptr;
+    size_t full = out_size - (out_size % N);
+    size_t group_end = end_sym < full ? end_sym : full;
+    size_t i = begin;
+
+    while (i < group_end) {
+        // fast path: as many groups as the input is guaranteed to cover
+        size_t safe = (size_t) (end - ptr) / (N * Coder::MaxRenormWords);
+        if (safe == 0)
+            break;
+        size_t stop = (group_end - i) / N < safe ? group_end : i + safe * N;
+
+        for (; i < stop; i += N) {
+            Sym s[N];
+            for (int j=0; j < N; j++) {
+                s[j] = cum2sym[Coder::DecGet(&rans[j], scale_bits)];
+                out[i + j] = s[j];
+            }
+            for (int j=0; j < N; j++)
+                Coder::DecAdvanceSymbolStep(&rans[j], &dsyms[s[j]], scale_bits);
+            for (int j=0; j < N; j++)
+                Coder::DecRenorm(&rans[j], &ptr);
+        }
+    }
+
+    // checked tail
+    for (; i < end_sym; i++) {
+        State* r = (i < full) ? &rans[i % N] : &rans[i - full];
+        Sym s = cum2sym[Coder::DecGet(r, scale_bits)];
+        out[i] = s;
+        Coder::DecAdvanceSymbolStep(r, &dsyms[s], scale_bits);
+        if (!Coder::DecRenormChecked(r, &ptr, end))
+            return false;
+    }
+
+    *pptr = ptr;
+    return true;
+}
+
+// Checked version of RansInterleavedDecode: decodes "out_size" symbols from
+// the stream in [ptr, end). Returns the read pointer after the last word
+// consumed, or 0 if the stream is truncated or corrupt.
+template<int N, typename Coder, typename Sym>
+static inline typename Coder::Word* RansInterleavedDecodeChecked(Sym* out, size_t out_size, typename Coder::Word* ptr, typename Coder::Word const* end,
+    typename Coder::DecSymbol const* dsyms, Sym const* cum2sym, uint32_t scale_bits)
+{
+    typedef typename Coder::State State;
+
+    State rans[N];
+    for (int j=0; j < N; j++)
+        if (!Coder::DecInitChecked(&rans[j], &ptr, end))
+            return 0;
+
+    if (!RansInterleavedDecodeSymbolsChecked<N, Coder>(rans, out, out_size, 0, out_size, &ptr, end, dsyms, cum2sym, scale_bits))
+        return 0;
+
+    // every state has to end up where the encoder started
+    for (int j=0; j < N; j++)
+        if (!Coder::DecIsFinal(&rans[j]))
+            return 0;
+
+    return ptr;
+}
+
+#endif // RANS_INTERLEAVE_HEADER
@@ -0,0 +1,274 @@
+// Multi-symbol rANS decoding for skewed distributions - public domain
+//
+// With one dominant symbol (say a residual of 0 with p=0.9), a decoder
+// spends nearly all its time doing one full table lookup and state update
+// for symbols that cost a fraction of a bit each. It would be nice to get
+// several of them out of one lookup.
+//
+// With Huffman or tANS, that's a matter of building a bigger table, since
+// the table index determines the rest of the decoding steps. With rANS it
+// isn't: after decoding a symbol, the next slot depends on the state's
+// high bits (x' = freq * (x >> scale_bits) + bias), not just on the
+// current slot. So instead, this moves the runs into the alphabet: the
+// encoder replaces runs of 2..RANS_MULTI_MAX_RUN copies of the dominant
+// symbol ("run symbol") with extra tokens, and codes the tokens with any
+// of the coders in rans_interleave.h. Every slot of the decoder table then
+// knows its symbol and how many copies of it to emit, and decoding a token
+// (a run, or a single symbol, which is the fallback for everything else)
+// is one lookup, one store and one fused state update (see rans_byte.h).
+//
+// Tokens 0-255 are the symbols themselves; token 256+k-2 is a run of k
+// copies of the run symbol (k=2..RANS_MULTI_MAX_RUN). Runs are split
+// greedily, longest first, so a run shorter than RANS_MULTI_MAX_RUN (that
+// includes the run symbol by itself) is always followed by some other
+// symbol. An order-0 model over the tokens doesn't know that, and loses a
+// lot (30% at p=0.9) on it. So there are two contexts, with a frequency
+// table each: context 1 is "right after a short run", and context 0 is
+// everything else. That gets us back to the order-0 entropy of the
+// symbols. The tokenizer puts the context into the tokens it returns
+// (coded token = context * RANS_MULTI_NUM_TOKENS + token), so encoding
+// is plain rans_interleave.h with 2*RANS_MULTI_NUM_TOKENS encoder symbols:
+//
+//   int run_sym = RansMultiPickRunSym(stats.freqs);   // (order-0 byte stats)
+//   size_t num_tokens = RansMultiTokenize(tokens, in, in_size, run_sym);
+//
+//   RansMultiStats mstats;
+//   RansMultiCountTokens(&mstats, tokens, num_tokens);
+//   RansMultiNormalize(&mstats, scale_bits);
+//   ... Coder::EncSymbolInit + RansMultiTableInitToken for every coded token ...
+//
+//   ptr = RansInterleavedEncode<N, Coder>(out_end, tokens, num_tokens, esyms, scale_bits);
+//   RansMultiDecode<N, Coder>(out, in_size, ptr, table, scale_bits);
+//
+// The decoder needs to know the number of symbols (not tokens) and the run
+// symbol, which the caller stores along with the frequencies.
+//
+// The decoder table has two entries per slot, one per context, 8 bytes
+// each (64k at scale_bits=12). Which one to use depends on the previous
+// token, which was decoded by a different state; to keep that from
+// serializing the interleaved states on the table loads, the decoder loads
+// both entries (they're next to each other) and then picks one, so the
+// chain from one token to the next is just a few ALU ops.
+//
+// Decoding a token costs a few cycles more than a regular fused decode
+// step, so this only pays off when tokens average well over one symbol:
+// RansMultiPickRunSym wants the run symbol to have p >= 3/4. Below that,
+// it returns RANS_MULTI_NO_RUN_SYM, and the tokens are just the symbols,
+// all in context 0. The frequencies then come out the same as with
+// SymbolStats::normalize_freqs, and the stream is exactly what
+// RansInterleavedEncode writes for the bytes, so decode it with the
+// regular decoders (RansInterleavedDecodeSlots), which are faster. That's
+// the fallback to single-symbol decoding; the decoder only needs to know
+// whether there's a run symbol.
+//
+// Needs to be compiled as C++.
+
+#ifndef RANS_MULTI_HEADER
+#define RANS_MULTI_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "rans_interleave.h"
+#include "rans_stats.h"
+
+#ifdef assert
+#define RansMultiAssert assert
+#else
+#define RansMultiAssert(x)
+#endif
+
+#define RANS_MULTI_MAX_RUN      4   // longest run per token (one 32-bit store)
+#define RANS_MULTI_NUM_TOKENS   (256 + RANS_MULTI_MAX_RUN - 1)
+#define RANS_MULTI_NUM_CODED    (2 * RANS_MULTI_NUM_TOKENS) // tokens in both contexts
+#define RANS_MULTI_NO_RUN_SYM   -1  // no run symbol, tokens are just the symbols
+
+// Decoder table entry; the entry for slot "slot" in context "ctx" is
+// table[slot*2 + ctx]. Bits:
+//    0-31  fused decoder slot: (freq - 1) | (bias << 16)
+//   32-39  symbol
+//   40-47  number of copies of the symbol to emit (1 for regular symbols)
+//      63  set if the next token is in context 1
+typedef uint64_t RansMultiEntry;
+
+// Token frequencies for both contexts; indexed by coded token.
+struct RansMultiStats {
+    uint32_t freqs[RANS_MULTI_NUM_CODED];
+    uint32_t cum_freqs[RANS_MULTI_NUM_CODED];   // start within its context
+};
+
+// Number of symbols a token stands for.
+static inline uint32_t RansMultiTokenLen(uint32_t token)
+{
+    return token < 256 ? 1 : token - 256 + 2;
+}
+
+// Picks the run symbol from order-0 symbol counts: the most frequent
+// symbol, if it's at least 3/4 of the total, else RANS_MULTI_NO_RUN_SYM.
+static inline int RansMultiPickRunSym(uint32_t const* freqs)
+{
+    uint64_t total = 0;
+    int best = 0;
+    for (int s=0; s < 256; s++) {
+        total += freqs[s];
+        if (freqs[s] > freqs[best])
+            best = s;
+    }
+
+    return (total && 4ull * freqs[best] >= 3 * total) ? best : RANS_MULTI_NO_RUN_SYM;
+}
+
+// Turns "in_size" bytes into coded tokens, replacing runs of "run_sym" (or
+// RANS_MULTI_NO_RUN_SYM). "tokens" needs room for "in_size" entries.
+// Returns the number of tokens.
+static inline size_t RansMultiTokenize(uint16_t* tokens, uint8_t const* in, size_t in_size, int run_sym)
+{
+    size_t num_tokens = 0;
+    uint32_t ctx = 0;
+    size_t i = 0;
+    while (i < in_size) {
+        uint8_t s = in[i];
+        if (s != run_sym) {
+            tokens[num_tokens++] = (uint16_t) (ctx * RANS_MULTI_NUM_TOKENS + s);
+            ctx = 0;
+            i++;
+            continue;
+        }
+
+        RansMultiAssert(ctx == 0);
+        size_t len = 1;
+        while (len < RANS_MULTI_MAX_RUN && i + len < in_size && in[i + len] == s)
+            len++;
+        tokens[num_tokens++] = (uint16_t) (len == 1 ? s : 256 + len - 2);
+        ctx = len < RANS_MULTI_MAX_RUN;
+        i += len;
+    }
+
+    return num_tokens;
+}
+
+// Counts coded tokens.
+static inline void RansMultiCountTokens(RansMultiStats* stats, uint16_t const* tokens, size_t num_tokens)
+{
+    for (int i=0; i < RANS_MULTI_NUM_CODED; i++)
+        stats->freqs[i] = 0;
+
+    for (size_t i=0; i < num_tokens; i++) {
+        RansMultiAssert(tokens[i] < RANS_MULTI_NUM_CODED);
+        stats->freqs[tokens[i]]++;
+    }
+}
+
+// Normalizes the counts for both contexts to 1 << scale_bits, and sets up
+// the cumulative frequencies.
+static inline void RansMultiNormalize(RansMultiStats* stats, uint32_t scale_bits)
+{
+    for (int ctx=0; ctx < 2; ctx++) {
+        uint32_t* freqs = stats->freqs + ctx * RANS_MULTI_NUM_TOKENS;
+        uint32_t* cum_freqs = stats->cum_freqs + ctx * RANS_MULTI_NUM_TOKENS;
+        RansNormalizeFreqs(freqs, RANS_MULTI_NUM_TOKENS, 1u << scale_bits);
+
+        uint32_t cum = 0;
+        for (int i=0; i < RANS_MULTI_NUM_TOKENS; i++) {
+            cum_freqs[i] = cum;
+            cum += freqs[i];
+        }
+    }
+}
+
+// Initializes the table entries for coded token "coded" with range start
+// "start" and frequency "freq". "table" has 2 << scale_bits entries.
+// Unused entries (where the token frequencies of a context don't add up to
+// 1 << scale_bits because it's empty) are never looked at.
+static inline void RansMultiTableInitToken(RansMultiEntry* table, uint32_t coded, int run_sym, uint32_t start, uint32_t freq, uint32_t scale_bits)
+{
+    RansMultiAssert(coded < RANS_MULTI_NUM_CODED);
+    RansMultiAssert(scale_bits <= 16);
+    RansMultiAssert(start <= (1u << scale_bits));
+    RansMultiAssert(freq <= (1u << scale_bits) - start);
+
+    uint32_t ctx = coded / RANS_MULTI_NUM_TOKENS;
+    uint32_t token = coded % RANS_MULTI_NUM_TOKENS;
+    RansMultiAssert(token < 256 || run_sym != RANS_MULTI_NO_RUN_SYM || freq == 0);
+
+    uint32_t len = RansMultiTokenLen(token);
+    uint32_t sym = token < 256 ? token : (uint32_t) run_sym;
+    uint64_t next = ((int) sym == run_sym && len < RANS_MULTI_MAX_RUN) ? 1 : 0;
+    uint64_t bits = ((uint64_t) sym << 32) | ((uint64_t) len << 40) | (next << 63);
+    for (uint32_t i=0; i < freq; i++)
+        table[(start + i)*2 + ctx] = bits | (freq - 1) | (i << 16);
+}
+
+// Picks the entry for slot "slot" for a token in context 1 if "ctx_mask"
+// is all ones, or context 0 if it's zero. Both loads are independent of
+// the context.
+static inline RansMultiEntry RansMultiLookup(RansMultiEntry const* table, uint32_t slot, uint64_t ctx_mask)
+{
+    RansMultiEntry e0 = table[slot*2 + 0];
+    RansMultiEntry e1 = table[slot*2 + 1];
+    return e0 ^ ((e0 ^ e1) & ctx_mask);
+}
+
+// Context mask for the token after "e".
+static inline uint64_t RansMultiNextMask(RansMultiEntry e)
+{
+    return (uint64_t) ((int64_t) e >> 63);
+}
+
+// Emits the symbols for "e". Writes 4 bytes no matter what, so there needs
+// to be room for that.
+static inline uint8_t* RansMultiEmit(uint8_t* out, RansMultiEntry e)
+{
+    uint32_t v = ((uint32_t) (e >> 32) & 0xff) * 0x01010101u;
+    memcpy(out, &v, 4);
+    return out + ((e >> 40) & 0xff);
+}
+
+// Decodes "out_size" symbols into "out" from a token stream produced by
+// RansInterleavedEncode with the same N. Returns the read pointer after
+// the last word consumed.
+//
+// Same structure as RansInterleavedDecodeSlots. Tokens go to states
+// round-robin like symbols do there; since we don't know how many tokens
+// there are, we go token by token once the output gets close to the end.
+template<int N, typename Coder>
+static inline typename Coder::Word* RansMultiDecode(uint8_t* out, size_t out_size, typename Coder::Word* ptr,
+    RansMultiEntry const* table, uint32_t scale_bits)
+{
+    typedef typename Coder::State State;
+
+    State rans[N];
+    for (int j=0; j < N; j++)
+        Coder::DecInit(&rans[j], &ptr);
+
+    uint8_t* out_end = out + out_size;
+    uint64_t ctx_mask = 0;
+    while (out_end - out >= N * RANS_MULTI_MAX_RUN) {
+        for (int j=0; j < N; j++) {
+            RansMultiEntry e = RansMultiLookup(table, Coder::DecGet(&rans[j], scale_bits), ctx_mask);
+            out = RansMultiEmit(out, e);
+            ctx_mask = RansMultiNextMask(e);
+            Coder::DecAdvanceSlotStep(&rans[j], (uint32_t) e, scale_bits);
+        }
+        for (int j=0; j < N; j++)
+            Coder::DecRenorm(&rans[j], &ptr);
+    }
+
+    // last few tokens, from states 0, 1, ... (wrapping around)
+    for (int j=0; out < out_end; j = (j + 1) % N) {
+        RansMultiEntry e = RansMultiLookup(table, Coder::DecGet(&rans[j], scale_bits), ctx_mask);
+        uint8_t sym = (uint8_t) (e >> 32);
+        uint32_t len = (uint32_t) (e >> 40) & 0xff;
+        RansMultiAssert(len <= (size_t) (out_end - out));
+        for (uint32_t k=0; k < len && out < out_end; k++)
+            *out++ = sym;
+        ctx_mask = RansMultiNextMask(e);
+        Coder::DecAdvanceSlotStep(&rans[j], (uint32_t) e, scale_bits);
+        Coder::DecRenorm(&rans[j], &ptr);
+    }
+
+    return ptr;
+}
+
+#endif // RANS_MULTI_HEADER
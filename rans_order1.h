@@ -0,0 +1,312 @@
+// Static order-1 rANS coder - public domain
+//
+// Uses a separate frequency table for every context (the previous byte),
+// on top of rans_byte.h. For text, this does a lot better than a single
+// order-0 model (book1: ~435k order-0, ~350k order-1).
+//
+// Tables use 12-bit probabilities. On the decoder side, each context gets
+// a 4096-entry slot->symbol byte map plus 256 packed (freq, start) words,
+// 5KB in total and contiguous, so a decode step touches two nearby cache
+// lines. (One 32-bit word per slot with everything packed in is one lookup
+// fewer, but 16KB per context; with ~100 contexts in use that falls out
+// of L2 and ends up slower.) Only contexts that actually occur get tables.
+//
+// To hide the latency of those lookups, the input is split into
+// RANS_O1_INTERLEAVE equally sized segments that are coded by separate,
+// interleaved rANS states. Each segment starts in context 0, so the
+// decoder never has to wait for a symbol from another state to know which
+// table to use. (Any leftover bytes go to the last segment.)
+//
+// Format (all values little-endian):
+//
+//    0  u32      magic ("rO1\0")
+//    4  u8       scale_bits (RANS_O1_SCALE_BITS)
+//    5  u8[3]    reserved, 0
+//    8  u64      uncompressed size
+//   16  u32      size of the tables in bytes
+//   20  u8[32]   bitmap of contexts that have a table
+//   52  ...      one compact table (rans_table.h) per context, in order
+//       ...      rANS data
+
+#ifndef RANS_ORDER1_HEADER
+#define RANS_ORDER1_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+#include "rans_byte.h"
+#include "rans_container.h"
+#include "rans_stats.h"
+#include "rans_table.h"
+
+#define RANS_O1_MAGIC 0x00314f72u // "rO1\0"
+#define RANS_O1_SCALE_BITS 12
+#define RANS_O1_INTERLEAVE 4
+#define RANS_O1_HEADER_SIZE 52
+
+// Normalized order-1 model.
+typedef struct {
+    uint32_t freqs[256][256];   // [context][symbol]
+    bool used[256];             // does the context occur?
+} RansO1Stats;
+
+// --------------------------------------------------------------------------
+
+// Internal helpers.
+
+// Returns the length of the first RANS_O1_INTERLEAVE-1 segments; the last
+// one gets the rest.
+static inline size_t RansO1SegmentSize(size_t size)
+{
+    return size / RANS_O1_INTERLEAVE;
+}
+
+// Decoder tables for one context.
+typedef struct {
+    uint8_t cum2sym[1 << RANS_O1_SCALE_BITS];   // slot -> symbol
+    uint32_t syms[256];                         // freq | (start << 16)
+} RansO1DecTable;
+
+// Decodes one symbol using the table for the current context. Doesn't
+// renormalize.
+static inline uint32_t RansO1DecSym(RansState* r, RansO1DecTable const* tab)
+{
+    uint32_t x = *r;
+    uint32_t slot = x & ((1u << RANS_O1_SCALE_BITS) - 1);
+    uint32_t s = tab->cum2sym[slot];
+    uint32_t info = tab->syms[s];
+    *r = (info & 0xffff) * (x >> RANS_O1_SCALE_BITS) + slot - (info >> 16);
+    return s;
+}
+
+// --------------------------------------------------------------------------
+
+// Gathers order-1 statistics for "in" (taking the segment starts into
+// account) and normalizes them.
+static inline void RansO1BuildStats(RansO1Stats* stats, uint8_t const* in, size_t in_size)
+{
+    memset(stats->freqs, 0, sizeof(stats->freqs));
+    memset(stats->used, 0, sizeof(stats->used));
+
+    size_t seg = RansO1SegmentSize(in_size);
+    for (int k=0; k < RANS_O1_INTERLEAVE; k++) {
+        size_t begin = k * seg;
+        size_t end = (k == RANS_O1_INTERLEAVE - 1) ? in_size : begin + seg;
+        uint32_t ctx = 0;
+        for (size_t i=begin; i < end; i++) {
+            stats->freqs[ctx][in[i]]++;
+            stats->used[ctx] = true;
+            ctx = in[i];
+        }
+    }
+
+    for (int c=0; c < 256; c++)
+        if (stats->used[c])
+            RansNormalizeFreqs(stats->freqs[c], 256, 1u << RANS_O1_SCALE_BITS);
+}
+
+// Returns an upper bound for the compressed size of "in_size" bytes.
+static inline size_t RansO1CompressBound(size_t in_size)
+{
+    return RANS_O1_HEADER_SIZE + 256 * RANS_TABLE_MAX_SIZE + in_size * 2 + RANS_O1_INTERLEAVE * 4;
+}
+
+// Compresses "in" to "out" (with room for "out_max" bytes, see
+// RansO1CompressBound). Returns the compressed size, or 0 if it doesn't fit.
+static inline size_t RansO1Compress(uint8_t* out, size_t out_max, uint8_t const* in, size_t in_size)
+{
+    if (out_max < RansO1CompressBound(in_size))
+        return 0;
+
+    std::vector<RansO1Stats> stats_buf(1);
+    RansO1Stats* stats = &stats_buf[0];
+    RansO1BuildStats(stats, in, in_size);
+
+    // header and tables
+    RansPut32(out + 0, RANS_O1_MAGIC);
+    out[4] = RANS_O1_SCALE_BITS;
+    out[5] = out[6] = out[7] = 0;
+    RansPut64(out + 8, in_size);
+
+    uint8_t* p = out + RANS_O1_HEADER_SIZE;
+    for (int c=0; c < 256; c++) {
+        if (c % 8 == 0)
+            out[20 + c/8] = 0;
+        if (stats->used[c]) {
+            out[20 + c/8] |= (uint8_t) (1 << (c % 8));
+            p += RansTableWrite(p, stats->freqs[c], RANS_O1_SCALE_BITS);
+        }
+    }
+    RansPut32(out + 16, (uint32_t) (p - (out + RANS_O1_HEADER_SIZE)));
+
+    // encoder symbols, for the contexts that are used
+    std::vector<RansEncSymbol> esyms;
+    RansEncSymbol const* ctx_syms[256];
+    uint32_t nctx = 0;
+    for (int c=0; c < 256; c++)
+        nctx += stats->used[c];
+    esyms.resize((size_t) nctx * 256);
+
+    uint32_t slot = 0;
+    for (int c=0; c < 256; c++) {
+        ctx_syms[c] = 0;
+        if (!stats->used[c])
+            continue;
+
+        RansEncSymbol* syms = &esyms[(size_t) slot++ * 256];
+        uint32_t cum = 0;
+        for (int s=0; s < 256; s++) {
+            RansEncSymbolInit(&syms[s], cum, stats->freqs[c][s], RANS_O1_SCALE_BITS);
+            cum += stats->freqs[c][s];
+        }
+        ctx_syms[c] = syms;
+    }
+
+    // encode (in reverse, as usual)
+    size_t seg = RansO1SegmentSize(in_size);
+    uint8_t const* seg_in[RANS_O1_INTERLEAVE];
+    RansState rans[RANS_O1_INTERLEAVE];
+    for (int k=0; k < RANS_O1_INTERLEAVE; k++) {
+        seg_in[k] = in + k * seg;
+        RansEncInit(&rans[k]);
+    }
+
+    // the context for position i of a segment is seg_in[k][i-1], or 0 for i=0
+    uint8_t* end = out + out_max;
+    uint8_t* ptr = end;
+    uint8_t const* last = seg_in[RANS_O1_INTERLEAVE - 1];
+    for (size_t i=in_size - (RANS_O1_INTERLEAVE - 1) * seg; i > seg; i--) {
+        uint32_t ctx = (i > 1) ? last[i - 2] : 0;
+        RansEncPutSymbol(&rans[RANS_O1_INTERLEAVE - 1], &ptr, &ctx_syms[ctx][last[i - 1]]);
+    }
+
+    for (size_t i=seg; i > 0; i--) {
+        for (int k=RANS_O1_INTERLEAVE - 1; k >= 0; k--) {
+            uint32_t ctx = (i > 1) ? seg_in[k][i - 2] : 0;
+            RansEncPutSymbol(&rans[k], &ptr, &ctx_syms[ctx][seg_in[k][i - 1]]);
+        }
+    }
+
+    for (int k=RANS_O1_INTERLEAVE - 1; k >= 0; k--)
+        RansEncFlush(&rans[k], &ptr);
+
+    // move the rANS data down to right after the tables
+    size_t rans_size = end - ptr;
+    memmove(p, ptr, rans_size);
+    return (p - out) + rans_size;
+}
+
+// Returns the decompressed size of a compressed buffer, or false if it
+// doesn't look like one.
+static inline bool RansO1GetSize(uint8_t const* in, size_t in_size, uint64_t* out_size)
+{
+    if (in_size < RANS_O1_HEADER_SIZE || RansGet32(in) != RANS_O1_MAGIC)
+        return false;
+
+    *out_size = RansGet64(in + 8);
+    return true;
+}
+
+// Decompresses "in" into "out", which needs to be exactly the size
+// returned by RansO1GetSize. Returns false on invalid input (truncated or
+// corrupt); never reads past the end of "in".
+static inline bool RansO1Decompress(uint8_t* out, size_t out_size, uint8_t const* in, size_t in_size)
+{
+    uint64_t orig_size;
+    if (!RansO1GetSize(in, in_size, &orig_size) || orig_size != out_size || in[4] != RANS_O1_SCALE_BITS)
+        return false;
+
+    size_t tables_size = RansGet32(in + 16);
+    if (tables_size > in_size - RANS_O1_HEADER_SIZE)
+        return false;
+
+    // read the tables straight into the decoder tables
+    uint32_t nctx = 0;
+    for (int c=0; c < 256; c++)
+        nctx += (in[20 + c/8] >> (c % 8)) & 1;
+
+    // contexts without a table never come up in a valid stream; they get
+    // a dummy table (symbol 0 with probability 1) so a bad one doesn't
+    // crash the decoder. It needs to be a proper table, since the checked
+    // decoding below relies on that.
+    std::vector<RansO1DecTable> tables(nctx + 1);
+    RansO1DecTable* dummy = &tables[nctx];
+    memset(dummy, 0, sizeof(RansO1DecTable));
+    dummy->syms[0] = 1u << RANS_O1_SCALE_BITS;
+    RansO1DecTable const* ctx_tabs[256];
+    uint8_t const* p = in + RANS_O1_HEADER_SIZE;
+    uint8_t const* tables_end = p + tables_size;
+    uint32_t next = 0;
+
+    for (int c=0; c < 256; c++) {
+        ctx_tabs[c] = dummy;
+        if (!((in[20 + c/8] >> (c % 8)) & 1))
+            continue;
+
+        RansO1DecTable* tab = &tables[next++];
+        memset(tab->syms, 0, sizeof(tab->syms));
+        size_t len = RansTableDecode(p, tables_end - p, RANS_O1_SCALE_BITS, [tab](int s, uint32_t start, uint32_t freq) {
+            memset(tab->cum2sym + start, s, freq);
+            tab->syms[s] = freq | (start << 16);
+        });
+        if (!len)
+            return false;
+
+        ctx_tabs[c] = tab;
+        p += len;
+    }
+    if (p != tables_end)
+        return false;
+
+    // decode. The rANS data is checked as described in rans_byte.h: the
+    // main loop only runs unchecked renorms while there are at least 2
+    // bytes per state left.
+    size_t seg = RansO1SegmentSize(out_size);
+    uint8_t* seg_out[RANS_O1_INTERLEAVE];
+    RansState rans[RANS_O1_INTERLEAVE];
+    uint32_t ctx[RANS_O1_INTERLEAVE];
+    uint8_t* ptr = (uint8_t*) tables_end;
+    uint8_t const* end = in + in_size;
+
+    for (int k=0; k < RANS_O1_INTERLEAVE; k++) {
+        seg_out[k] = out + k * seg;
+        if (!RansDecInitChecked(&rans[k], &ptr, end))
+            return false;
+        ctx[k] = 0;
+    }
+
+    for (size_t i=0; i < seg; i++) {
+        for (int k=0; k < RANS_O1_INTERLEAVE; k++) {
+            uint32_t s = RansO1DecSym(&rans[k], ctx_tabs[ctx[k]]);
+            seg_out[k][i] = (uint8_t) s;
+            ctx[k] = s;
+        }
+        if (end - ptr >= 2 * RANS_O1_INTERLEAVE) {
+            for (int k=0; k < RANS_O1_INTERLEAVE; k++)
+                RansDecRenorm(&rans[k], &ptr);
+        } else {
+            for (int k=0; k < RANS_O1_INTERLEAVE; k++)
+                if (!RansDecRenormChecked(&rans[k], &ptr, end))
+                    return false;
+        }
+    }
+
+    // leftovers in the last segment
+    RansState* r = &rans[RANS_O1_INTERLEAVE - 1];
+    uint32_t c = ctx[RANS_O1_INTERLEAVE - 1];
+    for (size_t i=RANS_O1_INTERLEAVE * seg; i < out_size; i++) {
+        c = RansO1DecSym(r, ctx_tabs[c]);
+        out[i] = (uint8_t) c;
+        if (!RansDecRenormChecked(r, &ptr, end))
+            return false;
+    }
+
+    for (int k=0; k < RANS_O1_INTERLEAVE; k++)
+        if (rans[k] != RANS_BYTE_L)
+            return false;
+    return true;
+}
+
+#endif // RANS_ORDER1_HEADER
@@ -0,0 +1,317 @@
+// rANS coders with compile-time parameters, and static tables - public domain
+//
+// The functions in rans_byte.h and rans64.h take scale_bits as a runtime
+// argument. That's fine when they get inlined into a loop with a constant
+// scale_bits, but it means that e.g. the "x_max" computation only turns
+// into a shift, and the decoder's mask into an immediate, if the compiler
+// manages to propagate the constant all the way through. Here, the scale
+// (and everything else that shapes the coder) is a template parameter:
+//
+//   RansStaticCoder<State, Word, L, ScaleBits>
+//
+// is a rANS coder with state type "State" (uint32_t or uint64_t), emitting
+// words of type "Word" (uint8_t, uint16_t or uint32_t), normalization
+// interval [L, L << (8*sizeof(Word))) and M = 1 << ScaleBits. It has the
+// same interface as the coder families in rans_interleave.h, so it plugs
+// right into RansInterleavedEncode/RansInterleavedDecode and friends (the
+// scale_bits they pass is ignored, apart from an assert). Renorm loops
+// that can never go around more than once don't loop, and all masks and
+// shifts are immediates.
+//
+// RansStaticByte<ScaleBits> and RansStatic64<ScaleBits> produce exactly the
+// same streams as rans_byte.h and rans64.h. Other combinations are fine as
+// long as L is a multiple of M and the states stay below half the range of
+// State (so the encoder's reciprocal trick works, see rans_byte.h); for
+// example, RansStaticCoder<uint32_t, uint16_t, 1u << 15, 15> is a 32-bit
+// coder that renormalizes in 16-bit words.
+//
+// The encoder and decoder symbols (and the tables for a whole
+// distribution, RansStaticTables) can be built with constexpr functions,
+// so fixed models known at build time can be baked into the binary: no
+// table setup at startup, and the tables live in read-only data. See
+// "main_static.cpp". The constexpr counterparts for rans_word_sse41.h are
+// in that file (RansWordEncSymbolMake, RansWordTablesMake).
+//
+// Needs to be compiled as C++14 or later.
+
+#ifndef RANS_STATIC_HEADER
+#define RANS_STATIC_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rans_byte.h"
+#include "rans64.h"
+
+#ifdef assert
+#define RansStaticAssert assert
+#else
+#define RansStaticAssert(x)
+#endif
+
+// High half of the full product.
+static inline uint32_t RansStaticMulHi(uint32_t a, uint32_t b) { return (uint32_t) (((uint64_t)a * b) >> 32); }
+static inline uint64_t RansStaticMulHi(uint64_t a, uint64_t b) { return Rans64MulHi(a, b); }
+
+template<typename StateT, typename WordT, StateT LowerBound, uint32_t ScaleBits>
+struct RansStaticCoder {
+    typedef StateT State;
+    typedef WordT Word;
+
+    static constexpr uint32_t kScaleBits = ScaleBits;
+    static constexpr uint32_t M = 1u << ScaleBits;
+    static constexpr uint32_t kStateBits = 8 * sizeof(State);
+    static constexpr uint32_t kWordBits = 8 * sizeof(Word);
+    static constexpr State L = LowerBound;
+
+    static_assert(kStateBits == 32 || kStateBits == 64, "State must be uint32_t or uint64_t");
+    static_assert(kWordBits < kStateBits, "Word must be smaller than State");
+    static_assert(ScaleBits >= 1 && ScaleBits <= 31, "ScaleBits out of range");
+    static_assert(L >= M && L % M == 0, "L must be a multiple of M");
+    static_assert((L >> (kStateBits - 1 - kWordBits)) <= 1, "L << word_bits must fit in state_bits-1 bits");
+
+    // Decoder symbols are straightforward.
+    struct DecSymbol {
+        uint32_t start;     // Start of range.
+        uint32_t freq;      // Symbol frequency.
+    };
+
+    // Encoder symbol, see RansEncSymbolInit in rans_byte.h. x_max is
+    // computed from freq (that's a shift), so it's not stored here.
+    struct EncSymbol {
+        State rcp_freq;     // Fixed-point reciprocal frequency
+        uint32_t freq;      // Symbol frequency
+        uint32_t bias;      // Bias
+        uint32_t cmpl_freq; // Complement of frequency: M - freq
+        uint32_t rcp_shift; // Reciprocal shift
+    };
+
+    // Most decoder renorms that can be needed per symbol, for any input.
+    enum { MaxRenormWords = (ScaleBits + kWordBits - 1) / kWordBits };
+
+    static constexpr DecSymbol MakeDecSymbol(uint32_t start, uint32_t freq)
+    {
+        return DecSymbol { start, freq };
+    }
+
+    // Same math as RansEncSymbolInit / Rans64EncSymbolInit (see there),
+    // with a reciprocal that has as many bits as the state.
+    static constexpr EncSymbol MakeEncSymbol(uint32_t start, uint32_t freq)
+    {
+        EncSymbol s = {};
+        s.freq = freq;
+        s.cmpl_freq = M - freq;
+        if (freq < 2) {
+            // q = x - 1, so bias = start + M - 1 (see rans_byte.h)
+            s.rcp_freq = (State) ~(State)0;
+            s.rcp_shift = 0;
+            s.bias = start + M - 1;
+        } else {
+            // Alverson, "Integer Division using reciprocals"
+            // shift=ceil(log2(freq))
+            uint32_t shift = 0;
+            while (freq > (1u << shift))
+                shift++;
+
+            // rcp = ceil(2^(shift + state_bits - 1) / freq), as a long
+            // divide in two halves (like rans64.h does it).
+            const uint32_t half = kStateBits / 2;
+            uint64_t x1 = 1ull << (shift + half - 1);
+            uint64_t t1 = x1 / freq;
+            uint64_t x0 = (freq - 1) + ((x1 % freq) << half);
+            uint64_t t0 = x0 / freq;
+
+            s.rcp_freq = (State) (t0 + (t1 << half));
+            s.rcp_shift = shift - 1;
+            s.bias = start;
+        }
+        return s;
+    }
+
+    static inline void EncSymbolInit(EncSymbol* s, uint32_t start, uint32_t freq, uint32_t scale_bits)
+    {
+        RansStaticAssert(scale_bits == ScaleBits);
+        *s = MakeEncSymbol(start, freq);
+    }
+
+    static inline void DecSymbolInit(DecSymbol* s, uint32_t start, uint32_t freq)
+    {
+        *s = MakeDecSymbol(start, freq);
+    }
+
+    static inline void EncInit(State* r)
+    {
+        *r = L;
+    }
+
+    // Encodes a single symbol (see RansEncPutSymbol).
+    static inline void EncPutSymbol(State* r, Word** pptr, EncSymbol const* sym, uint32_t /*scale_bits*/ = ScaleBits)
+    {
+        RansStaticAssert(sym->freq != 0); // can't encode symbol with freq=0
+
+        // renormalize; this can only take more than one word if
+        // ScaleBits > kWordBits.
+        State x = *r;
+        State x_max = ((L >> ScaleBits) << kWordBits) * sym->freq; // a shift
+        if (x >= x_max) {
+            Word* ptr = *pptr;
+            do {
+                *--ptr = (Word) x;
+                x >>= kWordBits;
+            } while (MaxRenormWords > 1 && x >= x_max);
+            *pptr = ptr;
+        }
+
+        // x = C(s,x)
+        State q = RansStaticMulHi(x, sym->rcp_freq) >> sym->rcp_shift;
+        *r = x + sym->bias + q * sym->cmpl_freq;
+    }
+
+    // Flushes the encoder: the state goes out as a whole number of words,
+    // least significant first.
+    static inline void EncFlush(State* r, Word** pptr)
+    {
+        State x = *r;
+        *pptr -= kStateBits / kWordBits;
+        for (uint32_t i=0; i < kStateBits / kWordBits; i++)
+            (*pptr)[i] = (Word) (x >> (i * kWordBits));
+    }
+
+    static inline void DecInit(State* r, Word** pptr)
+    {
+        State x = 0;
+        for (uint32_t i=0; i < kStateBits / kWordBits; i++)
+            x |= (State) (*pptr)[i] << (i * kWordBits);
+        *pptr += kStateBits / kWordBits;
+        *r = x;
+    }
+
+    static inline uint32_t DecGet(State* r, uint32_t /*scale_bits*/ = ScaleBits)
+    {
+        return (uint32_t) (*r & (M - 1));
+    }
+
+    static inline void DecAdvanceSymbolStep(State* r, DecSymbol const* sym, uint32_t /*scale_bits*/ = ScaleBits)
+    {
+        State x = *r;
+        *r = sym->freq * (x >> ScaleBits) + (x & (M - 1)) - sym->start;
+    }
+
+    static inline void DecRenorm(State* r, Word** pptr)
+    {
+        State x = *r;
+        if (x < L) {
+            Word* ptr = *pptr;
+            do x = (x << kWordBits) | *ptr++; while (MaxRenormWords > 1 && x < L);
+            *pptr = ptr;
+        }
+        *r = x;
+    }
+
+    // Equivalent to DecAdvanceSymbolStep followed by DecRenorm.
+    static inline void DecAdvanceSymbol(State* r, Word** pptr, DecSymbol const* sym)
+    {
+        DecAdvanceSymbolStep(r, sym);
+        DecRenorm(r, pptr);
+    }
+
+    // Fused decoder table (see rans_byte.h); needs ScaleBits <= 16.
+    typedef uint32_t DecSlot;
+
+    static constexpr DecSlot MakeDecSlot(uint32_t freq, uint32_t index)
+    {
+        return (freq - 1) | (index << 16);
+    }
+
+    static inline void DecSlotsInitSymbol(DecSlot* slots, uint8_t* cum2sym, uint8_t sym, uint32_t start, uint32_t freq)
+    {
+        static_assert(ScaleBits <= 16, "fused slots need ScaleBits <= 16");
+        for (uint32_t i=0; i < freq; i++) {
+            slots[start + i] = MakeDecSlot(freq, i);
+            cum2sym[start + i] = sym;
+        }
+    }
+
+    static inline void DecAdvanceSlotStep(State* r, DecSlot slot, uint32_t /*scale_bits*/ = ScaleBits)
+    {
+        State q = *r >> ScaleBits;
+        *r = (slot & 0xffff) * q + (q + (slot >> 16));
+    }
+
+    // Checked decoding (see rans_byte.h).
+    static inline bool DecInitChecked(State* r, Word** pptr, Word const* end)
+    {
+        if ((size_t) (end - *pptr) < kStateBits / kWordBits)
+            return false;
+
+        DecInit(r, pptr);
+        return *r >= L && (*r >> kWordBits) < L;
+    }
+
+    static inline bool DecRenormChecked(State* r, Word** pptr, Word const* end)
+    {
+        State x = *r;
+        if (x < L) {
+            Word* ptr = *pptr;
+            do {
+                if (ptr == end)
+                    return false;
+                x = (x << kWordBits) | *ptr++;
+            } while (MaxRenormWords > 1 && x < L);
+            *pptr = ptr;
+        }
+        *r = x;
+        return true;
+    }
+
+    static inline bool DecIsFinal(State const* r) { return *r == L; }
+};
+
+// Stream-compatible with rans_byte.h and rans64.h, respectively.
+template<uint32_t ScaleBits> using RansStaticByte = RansStaticCoder<uint32_t, uint8_t, RANS_BYTE_L, ScaleBits>;
+template<uint32_t ScaleBits> using RansStatic64 = RansStaticCoder<uint64_t, uint32_t, RANS64_L, ScaleBits>;
+
+// --------------------------------------------------------------------------
+
+// All tables for a static distribution over NumSyms symbols: encoder and
+// decoder symbols and cum2sym, ready for RansInterleavedEncode/Decode.
+template<typename Coder, int NumSyms>
+struct RansStaticTables {
+    typename Coder::EncSymbol esyms[NumSyms];
+    typename Coder::DecSymbol dsyms[NumSyms];
+    uint8_t cum2sym[Coder::M];
+};
+
+// Returns whether "freqs" is a valid normalized distribution for Coder
+// (sums to M); use with static_assert.
+template<typename Coder, int NumSyms>
+constexpr bool RansStaticFreqsValid(uint32_t const (&freqs)[NumSyms])
+{
+    uint64_t sum = 0;
+    for (int s=0; s < NumSyms; s++)
+        sum += freqs[s];
+    return NumSyms <= 256 && sum == Coder::M;
+}
+
+// Builds the tables for the normalized frequencies "freqs" (which must sum
+// to M; see RansStaticFreqsValid). Meant to be evaluated at compile time:
+//
+//   static constexpr uint32_t freqs[256] = { ... };
+//   static constexpr RansStaticTables<RansStaticByte<12>, 256> tables =
+//       RansStaticTablesMake<RansStaticByte<12>>(freqs);
+template<typename Coder, int NumSyms>
+constexpr RansStaticTables<Coder, NumSyms> RansStaticTablesMake(uint32_t const (&freqs)[NumSyms])
+{
+    RansStaticTables<Coder, NumSyms> t = {};
+    uint32_t start = 0;
+    for (int s=0; s < NumSyms; s++) {
+        t.esyms[s] = Coder::MakeEncSymbol(start, freqs[s]);
+        t.dsyms[s] = Coder::MakeDecSymbol(start, freqs[s]);
+        for (uint32_t i=0; i < freqs[s]; i++)
+            t.cum2sym[start + i] = (uint8_t) s;
+        start += freqs[s];
+    }
+    return t;
+}
+
+#endif // RANS_STATIC_HEADER
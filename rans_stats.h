@@ -0,0 +1,252 @@
+// Symbol statistics shared by the rANS coders - public domain
+//
+// This is the order-0 frequency counting/normalization used by the
+// example programs. RansNormalizeFreqs works on alphabets of any size;
+// SymbolStats16 is the version for 16-bit symbols. Counting goes through
+// rans_hist.h; the _threaded versions split big inputs across threads
+// (num_threads <= 0 means one per hardware thread).
+
+#ifndef RANS_STATS_HEADER
+#define RANS_STATS_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "rans_hist.h"
+
+struct SymbolStats
+{
+    uint32_t freqs[256];
+    uint32_t cum_freqs[257];
+
+    void count_freqs(uint8_t const* in, size_t nbytes);
+    void count_freqs_threaded(uint8_t const* in, size_t nbytes, int num_threads);
+    void calc_cum_freqs();
+    void normalize_freqs(uint32_t target_total);
+};
+
+inline void SymbolStats::count_freqs(uint8_t const* in, size_t nbytes)
+{
+    RansHistCount8(freqs, in, nbytes);
+}
+
+inline void SymbolStats::count_freqs_threaded(uint8_t const* in, size_t nbytes, int num_threads)
+{
+    RansHistCount8Threaded(freqs, in, nbytes, num_threads);
+}
+
+inline void SymbolStats::calc_cum_freqs()
+{
+    cum_freqs[0] = 0;
+    for (int i=0; i < 256; i++)
+        cum_freqs[i+1] = cum_freqs[i] + freqs[i];
+}
+
+// Normalizes "nsyms" symbol counts in "freqs" so they sum to exactly
+// "target_total" while keeping every nonzero count nonzero, minimizing
+// the coding cost
+//
+//   sum_i count_i * -log2(freq_i / target_total)
+//
+// (equivalently, the KL divergence from the empirical distribution).
+//
+// The cost is a sum of convex functions of the individual freqs, so a
+// solution is optimal exactly when no single +1/-1 exchange between two
+// symbols improves it. We start from the rounded-down scaled counts
+// (clamped to at least 1), get to the target sum taking the cheapest
+// steps first, then do whatever profitable exchanges are left (usually
+// none). All told, O(n log n) in the number of used symbols.
+struct RansNormalizeEntry {
+    double key;     // gain for +1, or -loss for -1 (so max-heaps work for both)
+    uint32_t idx;   // index into the used symbol list
+    uint32_t freq;  // freq when this entry was made; stale if it changed since
+
+    bool operator<(RansNormalizeEntry const& b) const { return key < b.key; }
+    bool operator>(RansNormalizeEntry const& b) const { return key > b.key; }
+};
+
+static inline void RansNormalizeFreqs(uint32_t* freqs, uint32_t nsyms, uint32_t target_total)
+{
+    typedef RansNormalizeEntry Entry;
+
+    // work on the used symbols only
+    std::vector<uint32_t> syms, counts;
+    syms.reserve(nsyms < 256 ? nsyms : 256);
+    counts.reserve(nsyms < 256 ? nsyms : 256);
+    uint64_t cur_total = 0;
+    for (uint32_t i=0; i < nsyms; i++) {
+        if (freqs[i]) {
+            syms.push_back(i);
+            counts.push_back(freqs[i]);
+            cur_total += freqs[i];
+        }
+    }
+    uint32_t n = (uint32_t) syms.size();
+    if (!n)
+        return;
+    assert(target_total >= n);
+
+    // initial guess
+    std::vector<uint32_t> q(n);
+    uint64_t sum = 0;
+    for (uint32_t k=0; k < n; k++) {
+        uint64_t scaled = (uint64_t)target_total * counts[k] / cur_total;
+        q[k] = scaled ? (uint32_t)scaled : 1;
+        sum += q[k];
+    }
+
+    // cost reduction for q[k]+1, cost increase for q[k]-1
+    auto gain = [&](uint32_t k) { return counts[k] * log2((q[k] + 1.0) / q[k]); };
+    auto loss = [&](uint32_t k) { return q[k] > 1 ? counts[k] * log2(q[k] / (q[k] - 1.0)) : HUGE_VAL; };
+    auto inc_entry = [&](uint32_t k) { Entry e = { gain(k), k, q[k] }; return e; };
+    auto dec_entry = [&](uint32_t k) { Entry e = { -loss(k), k, q[k] }; return e; };
+
+    std::vector<Entry> inc(n), dec(n);
+    for (uint32_t k=0; k < n; k++)
+        inc[k] = inc_entry(k);
+
+    if (sum < target_total) {
+        // Rounding down loses less than one slot per symbol, so this is
+        // one step each for the symbols that gain the most.
+        uint32_t steps = (uint32_t) (target_total - sum);
+        assert(steps < n);
+        std::nth_element(inc.begin(), inc.begin() + (steps - 1), inc.end(), std::greater<Entry>());
+        for (uint32_t j=0; j < steps; j++) {
+            uint32_t k = inc[j].idx;
+            q[k]++;
+            inc[j] = inc_entry(k);
+        }
+    } else if (sum > target_total) {
+        // Clamping to 1 put us over; there's no bound on how many slots
+        // an individual symbol might have to give up, so use a heap.
+        for (uint32_t k=0; k < n; k++)
+            dec[k] = dec_entry(k);
+        std::make_heap(dec.begin(), dec.end());
+        for (; sum > target_total; sum--) {
+            std::pop_heap(dec.begin(), dec.end());
+            uint32_t k = dec.back().idx;
+            q[k]--;
+            dec.back() = dec_entry(k);
+            std::push_heap(dec.begin(), dec.end());
+        }
+        for (uint32_t j=0; j < n; j++)
+            inc[j] = inc_entry(inc[j].idx);
+    }
+
+    // Exchange pass: move a slot from the symbol that misses it least to
+    // the one that wants it most, for as long as that's a win. Changed
+    // symbols get new heap entries; old ones are skipped when they come up.
+    //
+    // Usually there's nothing to do, so check for that first.
+    double max_gain = 0.0, min_loss = HUGE_VAL;
+    for (uint32_t k=0; k < n; k++) {
+        dec[k] = dec_entry(k);
+        max_gain = inc[k].key > max_gain ? inc[k].key : max_gain;
+        min_loss = -dec[k].key < min_loss ? -dec[k].key : min_loss;
+    }
+    if (max_gain <= min_loss * (1.0 + 1e-12)) {
+        for (uint32_t k=0; k < n; k++)
+            freqs[syms[k]] = q[k];
+        return;
+    }
+
+    std::make_heap(inc.begin(), inc.end());
+    std::make_heap(dec.begin(), dec.end());
+
+    auto top = [&](std::vector<Entry>& heap) -> Entry const& {
+        while (heap.front().freq != q[heap.front().idx]) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+        }
+        return heap.front();
+    };
+    auto push = [&](std::vector<Entry>& heap, Entry const& e) {
+        heap.push_back(e);
+        std::push_heap(heap.begin(), heap.end());
+    };
+
+    for (;;) {
+        // (for a single symbol, the gain from +1 is always less than the
+        // loss from -1, so this also stops if both are the same symbol.)
+        Entry const& up = top(inc);
+        Entry const& down = top(dec);
+        if (up.key <= -down.key * (1.0 + 1e-12))
+            break;
+
+        uint32_t i = up.idx, j = down.idx;
+        q[i]++;
+        q[j]--;
+        push(inc, inc_entry(i));
+        push(inc, inc_entry(j));
+        push(dec, dec_entry(i));
+        push(dec, dec_entry(j));
+    }
+
+    for (uint32_t k=0; k < n; k++)
+        freqs[syms[k]] = q[k];
+}
+
+inline void SymbolStats::normalize_freqs(uint32_t target_total)
+{
+    assert(target_total >= 256);
+
+    RansNormalizeFreqs(freqs, 256, target_total);
+    calc_cum_freqs();
+    assert(cum_freqs[256] == target_total);
+}
+
+// --------------------------------------------------------------------------
+
+// Same thing for larger alphabets (16-bit symbols, up to 64K of them). The
+// alphabet size is set at runtime; target_total needs to be at least the
+// number of symbols that actually occur, not the alphabet size.
+struct SymbolStats16
+{
+    uint32_t nsyms;
+    std::vector<uint32_t> freqs;
+    std::vector<uint32_t> cum_freqs;
+
+    explicit SymbolStats16(uint32_t nsyms);
+
+    void count_freqs(uint16_t const* in, size_t count);
+    void count_freqs_threaded(uint16_t const* in, size_t count, int num_threads);
+    void calc_cum_freqs();
+    void normalize_freqs(uint32_t target_total);
+};
+
+inline SymbolStats16::SymbolStats16(uint32_t nsyms)
+    : nsyms(nsyms), freqs(nsyms), cum_freqs(nsyms + 1)
+{
+    assert(nsyms >= 1 && nsyms <= 65536);
+}
+
+inline void SymbolStats16::count_freqs(uint16_t const* in, size_t count)
+{
+    RansHistCount16(&freqs[0], nsyms, in, count);
+}
+
+inline void SymbolStats16::count_freqs_threaded(uint16_t const* in, size_t count, int num_threads)
+{
+    RansHistCount16Threaded(&freqs[0], nsyms, in, count, num_threads);
+}
+
+inline void SymbolStats16::calc_cum_freqs()
+{
+    cum_freqs[0] = 0;
+    for (uint32_t i=0; i < nsyms; i++)
+        cum_freqs[i+1] = cum_freqs[i] + freqs[i];
+}
+
+inline void SymbolStats16::normalize_freqs(uint32_t target_total)
+{
+    RansNormalizeFreqs(&freqs[0], nsyms, target_total);
+    calc_cum_freqs();
+    assert(cum_freqs[nsyms] == target_total);
+}
+
+#endif // RANS_STATS_HEADER
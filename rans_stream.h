@@ -0,0 +1,582 @@
+// Streaming rANS compressor with bounded memory - public domain
+//
+// rANS encodes in reverse, so the sample programs keep all of the input
+// and output in memory and write backwards from the end of a big buffer.
+// That doesn't work for data that never ends (logs, sockets, ...). This
+// wrapper takes input in pieces of any size, collects it into blocks, and
+// encodes every full block (backwards, as usual) into a frame buffer.
+// Finished frames are handed to a sink callback in forward order, so the
+// only memory needed is one input block plus one frame buffer, both
+// allocated up front from a user-specified limit.
+//
+// Each frame is coded independently, with its own frequency table (the
+// same per-block coding rans_block.h does), so the decoder can also go
+// frame by frame without ever seeing the whole stream.
+//
+// Format (all values little-endian):
+//
+//   header      8 bytes:
+//                 0  u32  magic ("RSTR")
+//                 4  u8   coder (RANS_BLOCK_CODER_*)
+//                 5  u8   scale_bits
+//                 6  u8   interleave (RANS_BLOCK_INTERLEAVE)
+//                 7  u8   reserved, 0
+//   frames      each:
+//                 0  u32  number of bytes in the frame (1 to block size)
+//                 4  u32  payload size, a multiple of 4
+//                 8  ...  payload: frequency table (rans_table.h) and
+//                         rANS stream, each padded to a multiple of 4
+//   end         a frame header with both sizes 0
+//
+// Needs to be compiled as C++.
+
+#ifndef RANS_STREAM_HEADER
+#define RANS_STREAM_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+#include "rans_block.h"
+
+#define RANS_STREAM_MAGIC 0x52545352u // "RSTR"
+#define RANS_STREAM_HEADER_SIZE 8
+#define RANS_STREAM_FRAME_HEADER_SIZE 8
+#define RANS_STREAM_MIN_BLOCK 1024
+
+// Sink for compressed (or decompressed) data. Gets called with the output
+// in order; returns false to abort.
+typedef bool RansStreamSink(void* user, uint8_t const* data, size_t size);
+
+struct RansStreamOptions {
+    size_t memory_limit;    // Max bytes of buffer memory for the encoder.
+    uint32_t scale_bits;    // Probability resolution; 8 to 15.
+    uint32_t coder;         // RANS_BLOCK_CODER_*
+};
+
+// Initializes options to the defaults.
+static inline void RansStreamOptionsInit(RansStreamOptions* opts)
+{
+    opts->memory_limit = 1 << 20;
+    opts->scale_bits = 14;
+    opts->coder = RANS_BLOCK_CODER_BYTE;
+}
+
+typedef struct {
+    uint32_t block_size;            // bytes per frame (derived from the memory limit)
+    uint32_t scale_bits;
+    uint32_t coder;
+    RansStreamSink* sink;
+    void* user;
+
+    std::vector<uint8_t> in;        // current block, block_size bytes
+    size_t in_used;
+    std::vector<uint32_t> frame;    // frame buffer (uint32_t for rans64 alignment)
+
+    uint64_t total_in;              // bytes pushed so far
+    uint64_t total_out;             // bytes sent to the sink so far
+    bool failed;                    // sink said no or bad options; all calls fail from then on
+} RansStreamEncoder;
+
+// --------------------------------------------------------------------------
+
+// Internal helpers.
+
+// Max size of an encoded frame (including the frame header) for a block
+// of "block_size" bytes; same bound as for rans_block.h streams.
+static inline size_t RansStreamFrameBound(size_t block_size)
+{
+    size_t stream_max = (block_size * 2 + RANS_BLOCK_INTERLEAVE * 8) / 4 * 4 + 4;
+    return RANS_STREAM_FRAME_HEADER_SIZE + RANS_TABLE_MAX_SIZE + stream_max;
+}
+
+// Encodes the current block into the frame buffer. Returns the frame size.
+template<typename Coder>
+static inline size_t RansStreamEncodeFrame(RansStreamEncoder* enc)
+{
+    typedef typename Coder::Word Word;
+
+    uint8_t const* in = enc->in.data();
+    size_t in_size = enc->in_used;
+    uint8_t* frame = (uint8_t*) enc->frame.data();
+    size_t frame_size = enc->frame.size() * sizeof(uint32_t);
+
+    SymbolStats stats;
+    stats.count_freqs(in, in_size);
+    stats.normalize_freqs(1u << enc->scale_bits);
+
+    // table goes in front...
+    uint8_t* p = frame + RANS_STREAM_FRAME_HEADER_SIZE;
+    size_t table_len = RansTableWrite(p, stats.freqs, enc->scale_bits);
+    while (table_len & 3)
+        p[table_len++] = 0;
+    p += table_len;
+
+    // ...and the rANS data gets written backwards from the end of the
+    // buffer, then moved down to right after the table.
+    typename Coder::EncSymbol esyms[256];
+    for (int s=0; s < 256; s++)
+        Coder::EncSymbolInit(&esyms[s], stats.cum_freqs[s], stats.freqs[s], enc->scale_bits);
+
+    Word* end = (Word*) (frame + frame_size);
+    Word* begin = RansInterleavedEncode<RANS_BLOCK_INTERLEAVE, Coder>(end, in, in_size, esyms, enc->scale_bits);
+    size_t nbytes = (end - begin) * sizeof(Word);
+    memmove(p, begin, nbytes);
+    while (nbytes & 3)
+        p[nbytes++] = 0;
+    p += nbytes;
+
+    RansPut32(frame + 0, (uint32_t) in_size);
+    RansPut32(frame + 4, (uint32_t) (p - frame - RANS_STREAM_FRAME_HEADER_SIZE));
+    return p - frame;
+}
+
+static inline bool RansStreamEmit(RansStreamEncoder* enc, uint8_t const* data, size_t size)
+{
+    if (enc->failed || !enc->sink(enc->user, data, size)) {
+        enc->failed = true;
+        return false;
+    }
+    enc->total_out += size;
+    return true;
+}
+
+static inline bool RansStreamFlushBlock(RansStreamEncoder* enc)
+{
+    if (!enc->in_used)
+        return !enc->failed;
+
+    size_t size;
+    if (enc->coder == RANS_BLOCK_CODER_BYTE)
+        size = RansStreamEncodeFrame<RansByteCoder>(enc);
+    else
+        size = RansStreamEncodeFrame<Rans64Coder>(enc);
+    enc->in_used = 0;
+    return RansStreamEmit(enc, (uint8_t const*) enc->frame.data(), size);
+}
+
+// --------------------------------------------------------------------------
+
+// Returns the block size the encoder will use for a given memory limit,
+// or 0 if the limit is too small (less than about 4KB).
+static inline uint32_t RansStreamBlockSize(size_t memory_limit)
+{
+    // memory = block_size (input) + RansStreamFrameBound(block_size),
+    // which is about 3*block_size; keep it a multiple of 1KB.
+    size_t fixed = RansStreamFrameBound(0) + 4;
+    if (memory_limit < fixed + 3 * RANS_STREAM_MIN_BLOCK)
+        return 0;
+
+    size_t block_size = (memory_limit - fixed) / 3;
+    if (block_size > (1u << 30))
+        block_size = 1u << 30;
+    return (uint32_t) (block_size & ~(size_t) (RANS_STREAM_MIN_BLOCK - 1));
+}
+
+// Returns the buffer memory used by an encoder, in bytes.
+static inline size_t RansStreamEncoderMemory(RansStreamEncoder const* enc)
+{
+    return enc->in.size() + enc->frame.size() * sizeof(uint32_t);
+}
+
+// Sets up an encoder and writes the stream header to the sink. All
+// memory is allocated here. Returns false if the options are invalid or
+// the sink fails.
+static inline bool RansStreamEncoderInit(RansStreamEncoder* enc, RansStreamOptions const* opts, RansStreamSink* sink, void* user)
+{
+    enc->block_size = RansStreamBlockSize(opts->memory_limit);
+    enc->scale_bits = opts->scale_bits;
+    enc->coder = opts->coder;
+    enc->sink = sink;
+    enc->user = user;
+    enc->in_used = 0;
+    enc->total_in = 0;
+    enc->total_out = 0;
+    enc->failed = false;
+
+    if (!enc->block_size || opts->scale_bits < 8 || opts->scale_bits > 15 || opts->coder > RANS_BLOCK_CODER_64) {
+        enc->failed = true;
+        return false;
+    }
+
+    enc->in.resize(enc->block_size);
+    enc->frame.resize(RansStreamFrameBound(enc->block_size) / 4 + 1);
+
+    uint8_t header[RANS_STREAM_HEADER_SIZE];
+    RansPut32(header + 0, RANS_STREAM_MAGIC);
+    header[4] = (uint8_t) enc->coder;
+    header[5] = (uint8_t) enc->scale_bits;
+    header[6] = RANS_BLOCK_INTERLEAVE;
+    header[7] = 0;
+    return RansStreamEmit(enc, header, sizeof(header));
+}
+
+// Adds "size" bytes of input. Every time a block fills up, it gets
+// encoded and sent to the sink. Returns false if the sink failed (now or
+// earlier).
+static inline bool RansStreamEncoderPush(RansStreamEncoder* enc, uint8_t const* data, size_t size)
+{
+    while (size) {
+        size_t room = enc->block_size - enc->in_used;
+        size_t n = size < room ? size : room;
+        memcpy(enc->in.data() + enc->in_used, data, n);
+        enc->in_used += n;
+        enc->total_in += n;
+        data += n;
+        size -= n;
+
+        if (enc->in_used == enc->block_size && !RansStreamFlushBlock(enc))
+            return false;
+    }
+    return !enc->failed;
+}
+
+// Encodes whatever input is left and writes the end marker. Returns false
+// if the sink failed.
+static inline bool RansStreamEncoderFinish(RansStreamEncoder* enc)
+{
+    if (!RansStreamFlushBlock(enc))
+        return false;
+
+    uint8_t end[RANS_STREAM_FRAME_HEADER_SIZE] = { 0 };
+    return RansStreamEmit(enc, end, sizeof(end));
+}
+
+// --------------------------------------------------------------------------
+
+// Push decoder. Feed it compressed data in pieces of any size (as it comes
+// off a socket, say); every call decodes as much as the data so far
+// allows and sends it to the sink, then returns so the caller can go get
+// more. All decoder state lives in the struct, so it can be driven from
+// an event loop or a coroutine that awaits the next read in between.
+//
+// Within a frame, symbols get decoded as soon as enough bytes are in: a
+// rans_byte symbol never needs more than 2 bytes of input (4 for rans64;
+// see the notes on checked decoding in rans_byte.h), so a group of
+// RANS_BLOCK_INTERLEAVE symbols is safe to decode once that many bytes
+// are buffered. The decoder never reads past the data it's been given,
+// and reports truncated or corrupt frames as errors.
+
+// Decoder states
+#define RANS_STREAM_DEC_HEADER 0
+#define RANS_STREAM_DEC_FRAME 1
+#define RANS_STREAM_DEC_TABLE 2
+#define RANS_STREAM_DEC_STATES 3
+#define RANS_STREAM_DEC_SYMBOLS 4
+#define RANS_STREAM_DEC_PADDING 5
+#define RANS_STREAM_DEC_END 6
+#define RANS_STREAM_DEC_ERROR 7
+
+// Return values for RansStreamDecoderPush
+#define RANS_STREAM_NEED_INPUT 0    // all good so far, waiting for more data
+#define RANS_STREAM_END 1           // saw the end marker, all done
+#define RANS_STREAM_ERROR -1        // invalid stream or sink failed
+
+typedef struct {
+    uint32_t phase;                 // RANS_STREAM_DEC_*
+    uint32_t coder;
+    uint32_t scale_bits;
+    uint32_t max_frame;             // largest frame (decoded bytes) we accept
+    RansStreamSink* sink;
+    void* user;
+
+    std::vector<uint8_t> in;        // buffered input
+    size_t in_pos;                  // first byte not consumed yet
+
+    // current frame
+    uint32_t raw_size;              // decoded size
+    uint32_t raw_done;              // symbols decoded so far
+    size_t payload_left;            // payload bytes not consumed yet
+    uint64_t state[RANS_BLOCK_INTERLEAVE];
+    union {
+        RansDecSymbol byte[256];
+        Rans64DecSymbol w64[256];
+    } dsyms;
+    std::vector<uint8_t> cum2sym;
+    std::vector<uint8_t> out;       // decoded frame
+} RansStreamDecoder;
+
+// Sets up the rANS states for the current frame from "p" (with at least
+// "avail" bytes). Returns the number of bytes consumed, or 0 if the
+// states are invalid.
+template<typename Coder>
+static size_t RansStreamInitStates(RansStreamDecoder* dec, uint8_t const* p, size_t avail)
+{
+    typedef typename Coder::Word Word;
+
+    Word* start = (Word*) p;
+    Word* ptr = start;
+    Word const* end = start + avail / sizeof(Word);
+    for (int j=0; j < RANS_BLOCK_INTERLEAVE; j++) {
+        typename Coder::State x;
+        if (!Coder::DecInitChecked(&x, &ptr, end))
+            return 0;
+        dec->state[j] = x;
+    }
+    return (ptr - start) * sizeof(Word);
+}
+
+// Decodes as many symbols of the current frame as the buffered input
+// allows. Returns false if the frame turns out to be corrupt.
+template<typename Coder>
+static bool RansStreamDecodeSymbols(RansStreamDecoder* dec, typename Coder::DecSymbol const* dsyms)
+{
+    typedef typename Coder::Word Word;
+    static const size_t max_sym_bytes = Coder::MaxRenormWords * sizeof(Word);
+    enum { N = RANS_BLOCK_INTERLEAVE };
+
+    size_t avail = dec->in.size() - dec->in_pos;
+    size_t left = dec->raw_size - dec->raw_done;
+    size_t count;
+    if (avail >= dec->payload_left) { // have the rest of the frame
+        avail = dec->payload_left;
+        count = left;
+    } else {
+        count = avail / max_sym_bytes;
+        count -= count % N;
+        if (count > left)
+            count = left;
+    }
+    if (!count)
+        return true;
+
+    typename Coder::State rans[N];
+    for (int j=0; j < N; j++)
+        rans[j] = (typename Coder::State) dec->state[j];
+
+    Word* start = (Word*) (dec->in.data() + dec->in_pos);
+    Word* ptr = start;
+    Word const* end = start + avail / sizeof(Word);
+    size_t first = dec->raw_done;
+    if (!RansInterleavedDecodeSymbolsChecked<N, Coder>(rans, dec->out.data(), dec->raw_size, first, first + count, &ptr, end,
+            dsyms, dec->cum2sym.data(), dec->scale_bits))
+        return false;
+
+    // after the last symbol, all states have to be back where the encoder started
+    bool done = true;
+    for (int j=0; j < N; j++) {
+        dec->state[j] = rans[j];
+        done = done && Coder::DecIsFinal(&rans[j]);
+    }
+    if (first + count == dec->raw_size && !done)
+        return false;
+
+    size_t used = (ptr - start) * sizeof(Word);
+    dec->in_pos += used;
+    dec->payload_left -= used;
+    dec->raw_done = (uint32_t) (first + count);
+    return dec->sink(dec->user, dec->out.data() + first, count);
+}
+
+// Runs the decoder as far as the buffered input goes.
+static inline int RansStreamDecoderRun(RansStreamDecoder* dec)
+{
+    static const uint32_t N = RANS_BLOCK_INTERLEAVE;
+
+    for (;;) {
+        uint8_t const* p = dec->in.data() + dec->in_pos;
+        size_t avail = dec->in.size() - dec->in_pos;
+
+        switch (dec->phase) {
+        case RANS_STREAM_DEC_HEADER:
+            if (avail < RANS_STREAM_HEADER_SIZE)
+                return RANS_STREAM_NEED_INPUT;
+            dec->coder = p[4];
+            dec->scale_bits = p[5];
+            if (RansGet32(p) != RANS_STREAM_MAGIC || dec->coder > RANS_BLOCK_CODER_64 || dec->scale_bits < 8 || dec->scale_bits > 15 || p[6] != N)
+                return RANS_STREAM_ERROR;
+            dec->cum2sym.resize(1u << dec->scale_bits);
+            dec->in_pos += RANS_STREAM_HEADER_SIZE;
+            dec->phase = RANS_STREAM_DEC_FRAME;
+            break;
+
+        case RANS_STREAM_DEC_FRAME:
+            if (avail < RANS_STREAM_FRAME_HEADER_SIZE)
+                return RANS_STREAM_NEED_INPUT;
+            dec->raw_size = RansGet32(p + 0);
+            dec->payload_left = RansGet32(p + 4);
+            dec->raw_done = 0;
+            dec->in_pos += RANS_STREAM_FRAME_HEADER_SIZE;
+            if (!dec->raw_size) {
+                if (dec->payload_left || avail != RANS_STREAM_FRAME_HEADER_SIZE)
+                    return RANS_STREAM_ERROR;
+                dec->phase = RANS_STREAM_DEC_END;
+                return RANS_STREAM_END;
+            }
+            if (dec->raw_size > dec->max_frame || (dec->payload_left & 3) != 0)
+                return RANS_STREAM_ERROR;
+            if (dec->out.size() < dec->raw_size)
+                dec->out.resize(dec->raw_size);
+            dec->phase = RANS_STREAM_DEC_TABLE;
+            break;
+
+        case RANS_STREAM_DEC_TABLE: {
+            // Real tables are ~100 bytes, so don't wait for the worst case;
+            // try to parse whatever is buffered. Failing to parse a prefix
+            // just means we need more input; tables are at most
+            // RANS_TABLE_MAX_SIZE bytes, so once we have that much (or the
+            // whole payload), it either parses or is bad.
+            size_t limit = dec->payload_left < RANS_TABLE_MAX_SIZE ? dec->payload_left : RANS_TABLE_MAX_SIZE;
+            size_t have = avail < limit ? avail : limit;
+
+            uint8_t* c2s = dec->cum2sym.data();
+            size_t len;
+            if (dec->coder == RANS_BLOCK_CODER_BYTE)
+                len = RansTableReadDec(dec->dsyms.byte, c2s, p, have, dec->scale_bits);
+            else
+                len = RansTableReadDec64(dec->dsyms.w64, c2s, p, have, dec->scale_bits);
+            if (!len)
+                return (have < limit) ? RANS_STREAM_NEED_INPUT : RANS_STREAM_ERROR;
+            len = (len + 3) & ~(size_t)3;
+            if (len > dec->payload_left)
+                return RANS_STREAM_ERROR;
+            if (len > avail) // table is there, but not all of its padding
+                return RANS_STREAM_NEED_INPUT;
+            dec->in_pos += len;
+            dec->payload_left -= len;
+            dec->phase = RANS_STREAM_DEC_STATES;
+            break;
+        }
+
+        case RANS_STREAM_DEC_STATES: {
+            size_t need = N * ((dec->coder == RANS_BLOCK_CODER_BYTE) ? 4 : 8);
+            if (need > dec->payload_left)
+                return RANS_STREAM_ERROR;
+            if (avail < need)
+                return RANS_STREAM_NEED_INPUT;
+
+            size_t len;
+            if (dec->coder == RANS_BLOCK_CODER_BYTE)
+                len = RansStreamInitStates<RansByteCoder>(dec, p, need);
+            else
+                len = RansStreamInitStates<Rans64Coder>(dec, p, need);
+            if (len != need)
+                return RANS_STREAM_ERROR;
+            dec->in_pos += need;
+            dec->payload_left -= need;
+            dec->phase = RANS_STREAM_DEC_SYMBOLS;
+            break;
+        }
+
+        case RANS_STREAM_DEC_SYMBOLS: {
+            uint32_t before = dec->raw_done;
+            bool ok;
+            if (dec->coder == RANS_BLOCK_CODER_BYTE)
+                ok = RansStreamDecodeSymbols<RansByteCoder>(dec, dec->dsyms.byte);
+            else
+                ok = RansStreamDecodeSymbols<Rans64Coder>(dec, dec->dsyms.w64);
+            if (!ok)
+                return RANS_STREAM_ERROR;
+            if (dec->raw_done == dec->raw_size)
+                dec->phase = RANS_STREAM_DEC_PADDING;
+            else if (dec->raw_done == before)
+                return RANS_STREAM_NEED_INPUT;
+            break;
+        }
+
+        case RANS_STREAM_DEC_PADDING:
+            if (dec->payload_left > 3)
+                return RANS_STREAM_ERROR;
+            if (avail < dec->payload_left)
+                return RANS_STREAM_NEED_INPUT;
+            dec->in_pos += dec->payload_left;
+            dec->payload_left = 0;
+            dec->phase = RANS_STREAM_DEC_FRAME;
+            break;
+
+        case RANS_STREAM_DEC_END:
+            return avail ? RANS_STREAM_ERROR : RANS_STREAM_END;
+
+        default:
+            return RANS_STREAM_ERROR;
+        }
+    }
+}
+
+// Sets up a push decoder. Frames that decode to more than "max_frame"
+// bytes are rejected, which bounds the decoder's memory use (use the
+// encoder's block size, or 0 for no limit).
+static inline void RansStreamDecoderInit(RansStreamDecoder* dec, uint32_t max_frame, RansStreamSink* sink, void* user)
+{
+    dec->phase = RANS_STREAM_DEC_HEADER;
+    dec->coder = 0;
+    dec->scale_bits = 0;
+    dec->max_frame = max_frame ? max_frame : 0xffffffffu;
+    dec->sink = sink;
+    dec->user = user;
+    dec->in.clear();
+    dec->in_pos = 0;
+    dec->raw_size = 0;
+    dec->raw_done = 0;
+    dec->payload_left = 0;
+}
+
+// Adds "size" bytes of compressed data and decodes as much as possible.
+// Returns RANS_STREAM_NEED_INPUT if it wants more data, RANS_STREAM_END
+// once the whole stream has been decoded, or RANS_STREAM_ERROR (which is
+// sticky).
+static inline int RansStreamDecoderPush(RansStreamDecoder* dec, uint8_t const* data, size_t size)
+{
+    if (dec->phase == RANS_STREAM_DEC_ERROR)
+        return RANS_STREAM_ERROR;
+
+    // drop what's been consumed, then append the new data
+    dec->in.erase(dec->in.begin(), dec->in.begin() + dec->in_pos);
+    dec->in_pos = 0;
+    dec->in.insert(dec->in.end(), data, data + size);
+
+    int result = RansStreamDecoderRun(dec);
+    if (result == RANS_STREAM_ERROR)
+        dec->phase = RANS_STREAM_DEC_ERROR;
+    return result;
+}
+
+// Decodes a complete stream in memory, sending the decoded data to "sink"
+// one frame at a time. Frames that decode to more than "max_frame" bytes
+// are rejected, as in RansStreamDecoderInit (0 for no limit). Returns
+// false if the stream is invalid or truncated, or the sink fails. Never
+// reads past the end of "in".
+static inline bool RansStreamDecompress(uint8_t const* in, size_t in_size, uint32_t max_frame, RansStreamSink* sink, void* user)
+{
+    if (in_size < RANS_STREAM_HEADER_SIZE || RansGet32(in) != RANS_STREAM_MAGIC)
+        return false;
+
+    uint32_t coder = in[4];
+    uint32_t scale_bits = in[5];
+    if (coder > RANS_BLOCK_CODER_64 || scale_bits < 8 || scale_bits > 15 || in[6] != RANS_BLOCK_INTERLEAVE)
+        return false;
+
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> cum2sym;
+    size_t pos = RANS_STREAM_HEADER_SIZE;
+    for (;;) {
+        if (in_size - pos < RANS_STREAM_FRAME_HEADER_SIZE)
+            return false;
+
+        uint32_t raw_size = RansGet32(in + pos + 0);
+        uint32_t payload_size = RansGet32(in + pos + 4);
+        pos += RANS_STREAM_FRAME_HEADER_SIZE;
+        if (!raw_size)
+            return payload_size == 0;
+        if ((payload_size & 3) != 0 || payload_size > in_size - pos)
+            return false;
+        if (max_frame && raw_size > max_frame)
+            return false;
+
+        if (out.size() < raw_size)
+            out.resize(raw_size);
+
+        bool ok;
+        if (coder == RANS_BLOCK_CODER_BYTE)
+            ok = RansBlockDecodeStream<RansByteCoder>(out.data(), raw_size, in + pos, payload_size, 0, scale_bits, &cum2sym);
+        else
+            ok = RansBlockDecodeStream<Rans64Coder>(out.data(), raw_size, in + pos, payload_size, 0, scale_bits, &cum2sym);
+        if (!ok || !sink(user, out.data(), raw_size))
+            return false;
+
+        pos += payload_size;
+    }
+}
+
+#endif // RANS_STREAM_HEADER
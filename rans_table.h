@@ -0,0 +1,314 @@
+// Compact frequency tables for rANS - public domain
+//
+// Storing a normalized frequency table as 256 x u16 costs 512 bytes, which
+// is a lot when the data it describes is only a few KB. This header has a
+// small bit-packed codec for those tables instead. It exploits the usual
+// properties of real tables:
+//
+// - Present symbols tend to come in runs (letters, digits, ...), so the set
+//   of present symbols is stored as alternating run lengths of present and
+//   absent symbols.
+// - Frequencies are stored as a bit length plus mantissa. Neighboring
+//   symbols tend to have similar magnitudes, so the bit lengths are coded
+//   as deltas to the previous one.
+// - The frequencies sum to 1 << scale_bits, so the last present symbol's
+//   frequency is implied.
+//
+// All numbers are Elias gamma codes. Typical order-0 tables for text come
+// out at around 100 bytes; the worst case is RANS_TABLE_MAX_SIZE.
+//
+// Bit stream layout (LSB first):
+//
+//   1 bit      is symbol 0 present?
+//   gamma[]    alternating run lengths (present/absent/...) covering all
+//              256 symbols
+//   per present symbol except the last:
+//     gamma    zigzag(nbits - prev_nbits) + 1, with nbits = floor(log2(freq))
+//              and prev_nbits starting at 0
+//     nbits    low bits of freq (the top bit is implied)
+//
+// The decoder has a fast path that sets up decoder tables directly while
+// parsing (RansTableDecode), without materializing the frequencies first.
+
+#ifndef RANS_TABLE_HEADER
+#define RANS_TABLE_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Upper bound on the size of an encoded table in bytes.
+#define RANS_TABLE_MAX_SIZE 1024
+
+// --------------------------------------------------------------------------
+
+// Bit IO. The writer needs room for RANS_TABLE_MAX_SIZE bytes; the reader
+// is bounds-checked and sets "overrun" if it runs out of input.
+
+typedef struct {
+    uint8_t* ptr;
+    uint64_t bits;
+    uint32_t count;
+} RansTableBitWriter;
+
+typedef struct {
+    uint8_t const* ptr;
+    uint8_t const* end;
+    uint64_t bits;
+    uint32_t count;
+    bool overrun;
+} RansTableBitReader;
+
+static inline uint32_t RansTableCtz64(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (uint32_t) index;
+#else
+    return (uint32_t) __builtin_ctzll(x);
+#endif
+}
+
+static inline uint32_t RansTableLog2(uint32_t x)
+{
+    uint32_t n = 0;
+    while (x >>= 1)
+        n++;
+    return n;
+}
+
+// Writes the low "nbits" (at most 32) bits of "value".
+static inline void RansTablePutBits(RansTableBitWriter* w, uint32_t value, uint32_t nbits)
+{
+    w->bits |= (uint64_t) value << w->count;
+    w->count += nbits;
+    while (w->count >= 8) {
+        *w->ptr++ = (uint8_t) w->bits;
+        w->bits >>= 8;
+        w->count -= 8;
+    }
+}
+
+// Writes "value" >= 1 as Elias gamma code: n zeros, a one, then the low n
+// bits of value, where n = floor(log2(value)).
+static inline void RansTablePutGamma(RansTableBitWriter* w, uint32_t value)
+{
+    uint32_t n = RansTableLog2(value);
+    RansTablePutBits(w, 1u << n, n + 1);
+    RansTablePutBits(w, value & ((1u << n) - 1), n);
+}
+
+// Flushes the remaining bits; returns a pointer past the last byte written.
+static inline uint8_t* RansTableFlushBits(RansTableBitWriter* w)
+{
+    if (w->count)
+        *w->ptr++ = (uint8_t) w->bits;
+    return w->ptr;
+}
+
+static inline void RansTableRefill(RansTableBitReader* r)
+{
+    while (r->count <= 56 && r->ptr < r->end) {
+        r->bits |= (uint64_t) *r->ptr++ << r->count;
+        r->count += 8;
+    }
+}
+
+// Reads "nbits" (at most 32) bits.
+static inline uint32_t RansTableGetBits(RansTableBitReader* r, uint32_t nbits)
+{
+    RansTableRefill(r);
+    if (r->count < nbits) {
+        r->overrun = true;
+        return 0;
+    }
+
+    uint32_t value = (uint32_t) (r->bits & ((1ull << nbits) - 1));
+    r->bits >>= nbits;
+    r->count -= nbits;
+    return value;
+}
+
+// Reads an Elias gamma code (values up to 2^24).
+static inline uint32_t RansTableGetGamma(RansTableBitReader* r)
+{
+    RansTableRefill(r);
+    if (!r->bits) { // no terminating one in sight; either overrun or garbage
+        r->overrun = true;
+        return 0;
+    }
+
+    uint32_t n = RansTableCtz64(r->bits);
+    if (n > 24) {
+        r->overrun = true;
+        return 0;
+    }
+    r->bits >>= n + 1;
+    r->count -= n + 1;
+    return (1u << n) | RansTableGetBits(r, n);
+}
+
+// --------------------------------------------------------------------------
+
+// Encodes "freqs" (which have to sum to 1 << scale_bits, with scale_bits
+// <= 16) to "out", which needs room for RANS_TABLE_MAX_SIZE bytes.
+// Returns the number of bytes written.
+static inline size_t RansTableWrite(uint8_t* out, uint32_t const freqs[256], uint32_t scale_bits)
+{
+    (void) scale_bits;
+
+    RansTableBitWriter w;
+    w.ptr = out;
+    w.bits = 0;
+    w.count = 0;
+
+    // present symbols
+    bool present = freqs[0] != 0;
+    int last = -1;
+    RansTablePutBits(&w, present, 1);
+    for (int s=0; s < 256; ) {
+        int run = 0;
+        while (s + run < 256 && (freqs[s + run] != 0) == present)
+            run++;
+        RansTablePutGamma(&w, run);
+        s += run;
+        if (present)
+            last = s - 1;
+        present = !present;
+    }
+
+    // frequencies
+    int32_t prev_nbits = 0;
+    for (int s=0; s < last; s++) {
+        if (!freqs[s])
+            continue;
+
+        int32_t nbits = RansTableLog2(freqs[s]);
+        int32_t delta = nbits - prev_nbits;
+        RansTablePutGamma(&w, (((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31)) + 1);
+        RansTablePutBits(&w, freqs[s] & ((1u << nbits) - 1), nbits);
+        prev_nbits = nbits;
+    }
+
+    return RansTableFlushBits(&w) - out;
+}
+
+// Decodes a table from "in" (with "in_size" bytes available) and calls
+// visit(sym, start, freq) for every present symbol, in increasing order of
+// sym (and hence start). Absent symbols are not visited. Returns the
+// number of bytes consumed, or 0 if the table is invalid or truncated.
+//
+// This is the fast path: set up decoder symbols and slot tables straight
+// from "visit" (see RansTableReadDec et al. below).
+template<typename Visit>
+static inline size_t RansTableDecode(uint8_t const* in, size_t in_size, uint32_t scale_bits, Visit const& visit)
+{
+    if (scale_bits > 16)
+        return 0;
+
+    RansTableBitReader r;
+    r.ptr = in;
+    r.end = in + in_size;
+    r.bits = 0;
+    r.count = 0;
+    r.overrun = false;
+
+    // present symbols, as a bitmap
+    uint32_t mask[8] = { 0 };
+    uint32_t present = RansTableGetBits(&r, 1);
+    int last = -1;
+    for (uint32_t s=0; s < 256; ) {
+        uint32_t run = RansTableGetGamma(&r);
+        if (r.overrun || run > 256 - s)
+            return 0;
+        if (present) {
+            for (uint32_t i=s; i < s + run; i++)
+                mask[i >> 5] |= 1u << (i & 31);
+            last = (int) (s + run - 1);
+        }
+        s += run;
+        present ^= 1;
+    }
+    if (last < 0)
+        return 0;
+
+    // frequencies
+    uint32_t total = 1u << scale_bits;
+    uint32_t cum = 0;
+    int32_t nbits = 0;
+    for (int s=0; s < last; s++) {
+        if (!(mask[s >> 5] & (1u << (s & 31))))
+            continue;
+
+        uint32_t zz = RansTableGetGamma(&r) - 1;
+        nbits += (int32_t) (zz >> 1) ^ -(int32_t) (zz & 1);
+        if (r.overrun || nbits < 0 || nbits >= (int32_t) scale_bits)
+            return 0;
+
+        uint32_t freq = (1u << nbits) | RansTableGetBits(&r, nbits);
+        if (r.overrun || freq >= total - cum) // need to leave at least 1 for the last symbol
+            return 0;
+
+        visit(s, cum, freq);
+        cum += freq;
+    }
+    visit(last, cum, total - cum);
+
+    // bytes consumed = bytes fetched minus whole bytes still in the buffer
+    return (size_t) (r.ptr - in) - (r.count >> 3);
+}
+
+// Decodes a table into "freqs" (absent symbols get 0). Returns the number
+// of bytes consumed, or 0 on error.
+static inline size_t RansTableRead(uint32_t freqs[256], uint8_t const* in, size_t in_size, uint32_t scale_bits)
+{
+    for (int s=0; s < 256; s++)
+        freqs[s] = 0;
+
+    return RansTableDecode(in, in_size, scale_bits, [freqs](int s, uint32_t, uint32_t freq) {
+        freqs[s] = freq;
+    });
+}
+
+// Decoder table setup for the individual coders; these are only available
+// if the corresponding coder header was included first. Decoder symbols
+// for absent symbols are left alone.
+
+#ifdef RANS_BYTE_HEADER
+// Sets up rans_byte.h decoder symbols and the slot->symbol map "cum2sym"
+// (1 << scale_bits entries).
+static inline size_t RansTableReadDec(RansDecSymbol dsyms[256], uint8_t* cum2sym, uint8_t const* in, size_t in_size, uint32_t scale_bits)
+{
+    return RansTableDecode(in, in_size, scale_bits, [dsyms, cum2sym](int s, uint32_t start, uint32_t freq) {
+        RansDecSymbolInit(&dsyms[s], start, freq);
+        memset(cum2sym + start, s, freq);
+    });
+}
+#endif
+
+#ifdef RANS64_HEADER
+static inline size_t RansTableReadDec64(Rans64DecSymbol dsyms[256], uint8_t* cum2sym, uint8_t const* in, size_t in_size, uint32_t scale_bits)
+{
+    return RansTableDecode(in, in_size, scale_bits, [dsyms, cum2sym](int s, uint32_t start, uint32_t freq) {
+        Rans64DecSymbolInit(&dsyms[s], start, freq);
+        memset(cum2sym + start, s, freq);
+    });
+}
+#endif
+
+#ifdef RANS_WORD_SSE41_HEADER
+// The table has to use RANS_WORD_SCALE_BITS.
+static inline size_t RansTableReadWordTables(RansWordTables* tab, uint8_t const* in, size_t in_size)
+{
+    return RansTableDecode(in, in_size, RANS_WORD_SCALE_BITS, [tab](int s, uint32_t start, uint32_t freq) {
+        RansWordTablesInitSymbol(tab, (uint8_t) s, start, freq);
+    });
+}
+#endif
+
+#endif // RANS_TABLE_HEADER
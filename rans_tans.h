@@ -0,0 +1,367 @@
+// Table-driven tANS (FSE-style) encoder/decoder - public domain
+//
+// rANS and tANS are two ways of running the same ANS state machine: rANS
+// computes the next state arithmetically from freq and cum_freq, tANS
+// looks it up in a table that has one entry per state. This header is
+// here so the two can be compared head to head on the same data, with the
+// same normalized frequencies (SymbolStats at scale_bits), interleaved
+// the same way as rans_interleave.h.
+//
+// The state is x in [L, 2L) with L = 1 << table_log (table_log is the
+// scale_bits of the frequencies, RANS_TANS_MIN_TABLE_LOG to
+// RANS_TANS_MAX_TABLE_LOG). Symbol s owns freqs[s] of the L states,
+// spread over the table with the usual FSE step so that every symbol's
+// states are evenly distributed (RansTansSpread). Encoding s with state x
+// shifts out nb bits so that x >> nb lands in [freq, 2*freq), and looks up
+// the new state for that; decoding reverses it. The renormalization is in
+// bits, not bytes or words, so every symbol reads or writes some number
+// of bits (possibly zero) from a shared bit stream.
+//
+// The tables:
+//
+// - Encoder (RansTansEncTable): per symbol, the same two values FSE uses
+//   (delta_nb_bits, from which nb is one add and shift; delta_find_state,
+//   the offset into the state table), and the state table itself
+//   (2 bytes per state).
+// - Decoder (RansTansDecEntry): per state, symbol, nb and the base of the
+//   next state; 4 bytes per state. At table_log=12 that's 16k, as big as
+//   the fused rANS slots (rans_byte.h), and a decode step is a load, a
+//   bit fetch and an add - no multiply.
+//
+// Usage, from normalized stats:
+//
+//   RansTansEncTableInit(enc, stats.freqs, scale_bits);
+//   RansTansDecTableInit(dec, stats.freqs, scale_bits);   // dec: 1 << scale_bits entries
+//   ptr = RansTansEncode<N>(out_end, in, in_size, enc);
+//   RansTansDecode<N>(out, in_size, ptr, dec, scale_bits);
+//
+// Symbol i goes to state i % N, like in main.cpp and rans_interleave.h;
+// all states share one bit stream. The encoder works backwards from
+// "out_end" like the rANS encoders and writes the final states last, so
+// the decoder can read forwards.
+//
+// Bit stream layout (LSB first, in decoding order): zero padding to a
+// byte boundary, a 1 bit, the N final encoder states (x - L, table_log
+// bits each, state 0 first), then the bits of the symbols.
+//
+// NOTE: the bit IO does unaligned 8-byte loads and stores, and assumes a
+// little-endian machine. The encoder stores up to 8 bytes below the
+// current write position (the buffer needs that much room before the
+// stream start), and the decoder reads up to 16 bytes past the end of the
+// stream. Pad the buffers.
+//
+// Needs to be compiled as C++.
+
+#ifndef RANS_TANS_HEADER
+#define RANS_TANS_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef assert
+#define RansTansAssert assert
+#else
+#define RansTansAssert(x)
+#endif
+
+// Supported table_log range. The encoder flushes and the decoder refills
+// once per 4 symbols, which needs 4*RANS_TANS_MAX_TABLE_LOG+7 <= 63.
+#define RANS_TANS_MIN_TABLE_LOG     5
+#define RANS_TANS_MAX_TABLE_LOG     14
+
+// Encoder symbol.
+typedef struct {
+    int32_t delta_find_state;   // cum_freq - freq
+    uint32_t delta_nb_bits;     // (max_bits << 16) - (freq << max_bits)
+} RansTansEncSymbol;
+
+typedef struct {
+    RansTansEncSymbol syms[256];
+    uint16_t states[1 << RANS_TANS_MAX_TABLE_LOG];  // x in [L, 2L), by symbol and sub-state
+    uint32_t table_log;
+} RansTansEncTable;
+
+// Decoder table entry, one per state.
+typedef struct {
+    uint16_t new_state;         // next state (minus L) is new_state + nb bits read
+    uint8_t sym;
+    uint8_t nb;
+} RansTansDecEntry;
+
+// Bit IO. The writer collects bits in "bits" (the newest in the low bits)
+// and writes whole bytes backwards; the reader consumes them LSB first.
+
+typedef struct {
+    uint8_t* ptr;
+    uint64_t bits;
+    uint32_t count;
+} RansTansBitWriter;
+
+typedef struct {
+    uint8_t const* ptr;
+    uint64_t bits;
+    uint32_t count;
+} RansTansBitReader;
+
+static inline uint32_t RansTansLog2(uint32_t x)
+{
+    uint32_t n = 0;
+    while (x >>= 1)
+        n++;
+    return n;
+}
+
+static inline uint32_t RansTansCtz64(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (uint32_t) index;
+#else
+    return (uint32_t) __builtin_ctzll(x);
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+// Spreads the symbols over the L = 1 << table_log states, FSE style:
+// stepping through the table with a step that's coprime with L (it's
+// odd) and visits every position once. "freqs" (256 of them) must sum to L.
+static inline void RansTansSpread(uint8_t* spread, uint32_t const* freqs, uint32_t table_log)
+{
+    uint32_t size = 1u << table_log;
+    uint32_t mask = size - 1;
+    uint32_t step = (size >> 1) + (size >> 3) + 3;
+    uint32_t pos = 0;
+
+    for (int s=0; s < 256; s++) {
+        for (uint32_t i=0; i < freqs[s]; i++) {
+            spread[pos] = (uint8_t) s;
+            pos = (pos + step) & mask;
+        }
+    }
+    RansTansAssert(pos == 0); // back at the start iff the freqs sum to L
+}
+
+// Initializes the encoder tables from frequencies normalized to
+// 1 << table_log.
+static inline void RansTansEncTableInit(RansTansEncTable* t, uint32_t const* freqs, uint32_t table_log)
+{
+    RansTansAssert(table_log >= RANS_TANS_MIN_TABLE_LOG && table_log <= RANS_TANS_MAX_TABLE_LOG);
+    uint32_t size = 1u << table_log;
+    uint8_t spread[1 << RANS_TANS_MAX_TABLE_LOG];
+    uint32_t cum[256];
+
+    RansTansSpread(spread, freqs, table_log);
+    t->table_log = table_log;
+
+    uint32_t total = 0;
+    for (int s=0; s < 256; s++) {
+        uint32_t freq = freqs[s];
+        RansTansEncSymbol* sym = &t->syms[s];
+        cum[s] = total;
+
+        // x >> nb needs to land in [freq, 2*freq). For x in [L, 2L), that's
+        // either max_bits or max_bits-1 bits, depending on whether x is
+        // above freq << max_bits; the add carries into the high half
+        // exactly when it is.
+        uint32_t max_bits = (freq > 1) ? table_log - RansTansLog2(freq - 1) : table_log;
+        sym->delta_nb_bits = (max_bits << 16) - (freq << max_bits);
+        sym->delta_find_state = (int32_t) total - (int32_t) freq;
+        total += freq;
+    }
+    RansTansAssert(total == size);
+
+    // state table, by symbol, in the order the spread visits the states
+    for (uint32_t i=0; i < size; i++)
+        t->states[cum[spread[i]]++] = (uint16_t) (size + i);
+}
+
+// Initializes the decoder table (1 << table_log entries) from the same
+// frequencies as the encoder.
+static inline void RansTansDecTableInit(RansTansDecEntry* table, uint32_t const* freqs, uint32_t table_log)
+{
+    RansTansAssert(table_log >= RANS_TANS_MIN_TABLE_LOG && table_log <= RANS_TANS_MAX_TABLE_LOG);
+    uint32_t size = 1u << table_log;
+    uint8_t spread[1 << RANS_TANS_MAX_TABLE_LOG];
+    uint32_t next[256];
+
+    RansTansSpread(spread, freqs, table_log);
+    for (int s=0; s < 256; s++)
+        next[s] = freqs[s];
+
+    // The k-th state of a symbol (in spread order) is where the encoder
+    // goes from x >> nb = freq+k; decoding it gets that value back, so
+    // x = ((freq+k) << nb) + (the nb bits), with nb such that x lands in
+    // [L, 2L) again.
+    for (uint32_t i=0; i < size; i++) {
+        uint8_t s = spread[i];
+        uint32_t x = next[s]++;
+        uint32_t nb = table_log - RansTansLog2(x);
+        table[i].sym = s;
+        table[i].nb = (uint8_t) nb;
+        table[i].new_state = (uint16_t) ((x << nb) - size);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+// Encoder
+
+static inline void RansTansWriterInit(RansTansBitWriter* w, uint8_t* out_end)
+{
+    w->ptr = out_end;
+    w->bits = 0;
+    w->count = 0;
+}
+
+static inline void RansTansPutBits(RansTansBitWriter* w, uint32_t value, uint32_t nb)
+{
+    w->bits = (w->bits << nb) | value;
+    w->count += nb;
+}
+
+// Writes all complete bytes. There's room for 63 bits, so this needs to be
+// called at least every 4 symbols.
+static inline void RansTansFlush(RansTansBitWriter* w)
+{
+    // The oldest bits go at the highest address, so left-align them and
+    // store the whole word below ptr (the bits above "count" are stale and
+    // get shifted out; the two-step shift is so count=0 works).
+    uint64_t v = (w->bits << 1) << (63 - w->count);
+    memcpy(w->ptr - 8, &v, 8);
+    w->ptr -= w->count >> 3;
+    w->count &= 7;
+}
+
+// Encodes symbol "s" with state "x". Doesn't flush.
+static inline void RansTansEncPut(uint32_t* x, RansTansBitWriter* w, RansTansEncTable const* t, uint32_t s)
+{
+    RansTansEncSymbol const* sym = &t->syms[s];
+    uint32_t nb = (*x + sym->delta_nb_bits) >> 16;
+    RansTansPutBits(w, *x & ((1u << nb) - 1), nb);
+    *x = t->states[(*x >> nb) + sym->delta_find_state];
+}
+
+// Encodes "in_size" bytes with N interleaved states, backwards from
+// "out_end". Returns the start of the stream.
+template<int N>
+static inline uint8_t* RansTansEncode(uint8_t* out_end, uint8_t const* in, size_t in_size, RansTansEncTable const* t)
+{
+    // Symbols go in blocks of at least 4 (and a multiple of N), with a
+    // flush every 4 symbols.
+    enum { B = N * ((4 + N - 1) / N) };
+    uint32_t table_log = t->table_log;
+    uint32_t x[N];
+    for (int j=0; j < N; j++)
+        x[j] = 1u << table_log;
+
+    RansTansBitWriter w;
+    RansTansWriterInit(&w, out_end);
+
+    size_t full = in_size - (in_size % B);
+    for (size_t i=in_size; i > full; i--) { // NB: working in reverse!
+        RansTansEncPut(&x[(i - 1) % N], &w, t, in[i - 1]);
+        RansTansFlush(&w);
+    }
+    for (size_t i=full; i > 0; i -= B) {
+        for (int j=B-1; j >= 0; j--) {
+            RansTansEncPut(&x[j % N], &w, t, in[i - B + j]);
+            if (((B - 1 - j) & 3) == 3 || j == 0)
+                RansTansFlush(&w);
+        }
+    }
+
+    // final states (state 0 last, so the decoder gets it first), the
+    // marker bit, and padding to a byte boundary
+    for (int j=N-1; j >= 0; j--) {
+        RansTansPutBits(&w, x[j] - (1u << table_log), table_log);
+        RansTansFlush(&w);
+    }
+    RansTansPutBits(&w, 1, 1);
+    RansTansPutBits(&w, 0, (8 - w.count) & 7);
+    RansTansFlush(&w);
+
+    return w.ptr;
+}
+
+// Decoder
+
+// Branchless refill: afterwards there are at least 56 bits in the buffer.
+static inline void RansTansRefill(RansTansBitReader* r)
+{
+    uint64_t next;
+    memcpy(&next, r->ptr, 8);
+    r->bits |= next << r->count;
+    r->ptr += (63 - r->count) >> 3;
+    r->count |= 56;
+}
+
+static inline uint32_t RansTansGetBits(RansTansBitReader* r, uint32_t nb)
+{
+    uint32_t value = (uint32_t) r->bits & ((1u << nb) - 1);
+    r->bits >>= nb;
+    r->count -= nb;
+    return value;
+}
+
+// Starts reading the stream at "ptr": skips the padding and marker.
+static inline void RansTansReaderInit(RansTansBitReader* r, uint8_t const* ptr)
+{
+    r->ptr = ptr;
+    r->bits = 0;
+    r->count = 0;
+    RansTansRefill(r);
+
+    uint32_t skip = RansTansCtz64(r->bits) + 1;
+    r->bits >>= skip;
+    r->count -= skip;
+}
+
+// Decodes one symbol with state "x" (minus L). Doesn't refill.
+static inline uint8_t RansTansDecGet(uint32_t* x, RansTansBitReader* r, RansTansDecEntry const* table)
+{
+    RansTansDecEntry e = table[*x];
+    *x = e.new_state + RansTansGetBits(r, e.nb);
+    return e.sym;
+}
+
+// Decodes "out_size" bytes written by RansTansEncode<N>. Returns the end
+// of the stream (i.e. the encoder's "out_end", for a valid stream).
+template<int N>
+static inline uint8_t const* RansTansDecode(uint8_t* out, size_t out_size, uint8_t const* ptr, RansTansDecEntry const* table, uint32_t table_log)
+{
+    enum { B = N * ((4 + N - 1) / N) };
+    RansTansBitReader r;
+    RansTansReaderInit(&r, ptr);
+
+    uint32_t x[N];
+    for (int j=0; j < N; j++) {
+        RansTansRefill(&r);
+        x[j] = RansTansGetBits(&r, table_log);
+    }
+
+    size_t full = out_size - (out_size % B);
+    for (size_t i=0; i < full; i += B) {
+        for (int j=0; j < B; j++) {
+            if ((j & 3) == 0)
+                RansTansRefill(&r);
+            out[i + j] = RansTansDecGet(&x[j % N], &r, table);
+        }
+    }
+    for (size_t i=full; i < out_size; i++) {
+        RansTansRefill(&r);
+        out[i] = RansTansDecGet(&x[i % N], &r, table);
+    }
+
+    // everything up to the end of the stream is consumed now
+    RansTansAssert(r.count % 8 == 0);
+    return r.ptr - (r.count >> 3);
+}
+
+#endif // RANS_TANS_HEADER
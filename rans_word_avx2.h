@@ -0,0 +1,722 @@
+// Word-aligned AVX2 rANS encoder/decoder - public domain
+//
+// This is an 8-way interleaved version of the SIMD coder in
+// rans_word_sse41.h. It uses the exact same stream format (and the same
+// RansWordTables/RansWordEncSymbol) as the two-register SSE 4.1 loops in
+// main_simd.cpp, but keeps all 8 states in a single 256-bit register and
+// does its decoder table lookups using AVX2 gathers.
+//
+// Unlike rans_byte.h, this file needs to be compiled as C++.
+
+#ifndef RANS_WORD_AVX2_HEADER
+#define RANS_WORD_AVX2_HEADER
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "rans_word_sse41.h"
+
+// --------------------------------------------------------------------------
+
+typedef union {
+    __m256i simd;
+    uint32_t lane[8];
+} RansAvx2Dec;
+
+// Initializes an 8-way AVX2 rANS decoder.
+static inline void RansAvx2DecInit(RansAvx2Dec* r, uint16_t** pptr)
+{
+    r->simd = _mm256_loadu_si256((const __m256i*)*pptr);
+    *pptr += 2*8;
+}
+
+// Decodes eight symbols in parallel using the given tables.
+// Symbol i (decoded from lane i) ends up in byte i of the result.
+static inline uint64_t RansAvx2DecSym(RansAvx2Dec* r, RansWordTables const* tab)
+{
+    __m256i x = r->simd;
+    __m256i slots = _mm256_and_si256(x, _mm256_set1_epi32(RANS_WORD_M - 1));
+
+    // gather freq_bias
+    __m256i freq_bias = _mm256_i32gather_epi32((const int*)tab->slots, slots, 4);
+
+    // gather symbols. There's no byte gather, so we do 32-bit loads ending
+    // at the symbol we want (which then lands in the top byte). For the
+    // first few slots, this reads the end of "slots", which is fine since
+    // it's in the same struct.
+    __m256i syms = _mm256_i32gather_epi32((const int*)(tab->slot2sym - 3), slots, 1);
+
+    // s, x = D(x)
+    __m256i xscaled = _mm256_srli_epi32(x, RANS_WORD_SCALE_BITS);
+    __m256i freq = _mm256_and_si256(freq_bias, _mm256_set1_epi32(0xffff));
+    __m256i bias = _mm256_srli_epi32(freq_bias, 16);
+    r->simd = _mm256_add_epi32(_mm256_mullo_epi32(xscaled, freq), bias);
+
+    // pack the top bytes of all lanes together
+    __m256i packed = _mm256_shuffle_epi8(syms, _mm256_setr_epi8(
+        3,7,11,15, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1,
+        3,7,11,15, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1));
+    packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0,4, 0,0, 0,0, 0,0));
+    return (uint64_t) _mm_cvtsi128_si64(_mm256_castsi256_si128(packed));
+}
+
+// Renormalize after decoding eight symbols.
+static inline void RansAvx2DecRenorm(RansAvx2Dec* r, uint16_t** pptr)
+{
+    // For every mask of lanes that need renormalization, the index of the
+    // input word that goes into each lane. Lanes that don't take a word
+    // are don't-cares since they get blended out anyway.
+    static ALIGNSPEC(int8_t const, perms[256][8], 8) = {
+#define _ -1 // for readability
+        { _,_,_,_, _,_,_,_ }, // 00000000
+        { 0,_,_,_, _,_,_,_ }, // 00000001
+        { _,0,_,_, _,_,_,_ }, // 00000010
+        { 0,1,_,_, _,_,_,_ }, // 00000011
+        { _,_,0,_, _,_,_,_ }, // 00000100
+        { 0,_,1,_, _,_,_,_ }, // 00000101
+        { _,0,1,_, _,_,_,_ }, // 00000110
+        { 0,1,2,_, _,_,_,_ }, // 00000111
+        { _,_,_,0, _,_,_,_ }, // 00001000
+        { 0,_,_,1, _,_,_,_ }, // 00001001
+        { _,0,_,1, _,_,_,_ }, // 00001010
+        { 0,1,_,2, _,_,_,_ }, // 00001011
+        { _,_,0,1, _,_,_,_ }, // 00001100
+        { 0,_,1,2, _,_,_,_ }, // 00001101
+        { _,0,1,2, _,_,_,_ }, // 00001110
+        { 0,1,2,3, _,_,_,_ }, // 00001111
+        { _,_,_,_, 0,_,_,_ }, // 00010000
+        { 0,_,_,_, 1,_,_,_ }, // 00010001
+        { _,0,_,_, 1,_,_,_ }, // 00010010
+        { 0,1,_,_, 2,_,_,_ }, // 00010011
+        { _,_,0,_, 1,_,_,_ }, // 00010100
+        { 0,_,1,_, 2,_,_,_ }, // 00010101
+        { _,0,1,_, 2,_,_,_ }, // 00010110
+        { 0,1,2,_, 3,_,_,_ }, // 00010111
+        { _,_,_,0, 1,_,_,_ }, // 00011000
+        { 0,_,_,1, 2,_,_,_ }, // 00011001
+        { _,0,_,1, 2,_,_,_ }, // 00011010
+        { 0,1,_,2, 3,_,_,_ }, // 00011011
+        { _,_,0,1, 2,_,_,_ }, // 00011100
+        { 0,_,1,2, 3,_,_,_ }, // 00011101
+        { _,0,1,2, 3,_,_,_ }, // 00011110
+        { 0,1,2,3, 4,_,_,_ }, // 00011111
+        { _,_,_,_, _,0,_,_ }, // 00100000
+        { 0,_,_,_, _,1,_,_ }, // 00100001
+        { _,0,_,_, _,1,_,_ }, // 00100010
+        { 0,1,_,_, _,2,_,_ }, // 00100011
+        { _,_,0,_, _,1,_,_ }, // 00100100
+        { 0,_,1,_, _,2,_,_ }, // 00100101
+        { _,0,1,_, _,2,_,_ }, // 00100110
+        { 0,1,2,_, _,3,_,_ }, // 00100111
+        { _,_,_,0, _,1,_,_ }, // 00101000
+        { 0,_,_,1, _,2,_,_ }, // 00101001
+        { _,0,_,1, _,2,_,_ }, // 00101010
+        { 0,1,_,2, _,3,_,_ }, // 00101011
+        { _,_,0,1, _,2,_,_ }, // 00101100
+        { 0,_,1,2, _,3,_,_ }, // 00101101
+        { _,0,1,2, _,3,_,_ }, // 00101110
+        { 0,1,2,3, _,4,_,_ }, // 00101111
+        { _,_,_,_, 0,1,_,_ }, // 00110000
+        { 0,_,_,_, 1,2,_,_ }, // 00110001
+        { _,0,_,_, 1,2,_,_ }, // 00110010
+        { 0,1,_,_, 2,3,_,_ }, // 00110011
+        { _,_,0,_, 1,2,_,_ }, // 00110100
+        { 0,_,1,_, 2,3,_,_ }, // 00110101
+        { _,0,1,_, 2,3,_,_ }, // 00110110
+        { 0,1,2,_, 3,4,_,_ }, // 00110111
+        { _,_,_,0, 1,2,_,_ }, // 00111000
+        { 0,_,_,1, 2,3,_,_ }, // 00111001
+        { _,0,_,1, 2,3,_,_ }, // 00111010
+        { 0,1,_,2, 3,4,_,_ }, // 00111011
+        { _,_,0,1, 2,3,_,_ }, // 00111100
+        { 0,_,1,2, 3,4,_,_ }, // 00111101
+        { _,0,1,2, 3,4,_,_ }, // 00111110
+        { 0,1,2,3, 4,5,_,_ }, // 00111111
+        { _,_,_,_, _,_,0,_ }, // 01000000
+        { 0,_,_,_, _,_,1,_ }, // 01000001
+        { _,0,_,_, _,_,1,_ }, // 01000010
+        { 0,1,_,_, _,_,2,_ }, // 01000011
+        { _,_,0,_, _,_,1,_ }, // 01000100
+        { 0,_,1,_, _,_,2,_ }, // 01000101
+        { _,0,1,_, _,_,2,_ }, // 01000110
+        { 0,1,2,_, _,_,3,_ }, // 01000111
+        { _,_,_,0, _,_,1,_ }, // 01001000
+        { 0,_,_,1, _,_,2,_ }, // 01001001
+        { _,0,_,1, _,_,2,_ }, // 01001010
+        { 0,1,_,2, _,_,3,_ }, // 01001011
+        { _,_,0,1, _,_,2,_ }, // 01001100
+        { 0,_,1,2, _,_,3,_ }, // 01001101
+        { _,0,1,2, _,_,3,_ }, // 01001110
+        { 0,1,2,3, _,_,4,_ }, // 01001111
+        { _,_,_,_, 0,_,1,_ }, // 01010000
+        { 0,_,_,_, 1,_,2,_ }, // 01010001
+        { _,0,_,_, 1,_,2,_ }, // 01010010
+        { 0,1,_,_, 2,_,3,_ }, // 01010011
+        { _,_,0,_, 1,_,2,_ }, // 01010100
+        { 0,_,1,_, 2,_,3,_ }, // 01010101
+        { _,0,1,_, 2,_,3,_ }, // 01010110
+        { 0,1,2,_, 3,_,4,_ }, // 01010111
+        { _,_,_,0, 1,_,2,_ }, // 01011000
+        { 0,_,_,1, 2,_,3,_ }, // 01011001
+        { _,0,_,1, 2,_,3,_ }, // 01011010
+        { 0,1,_,2, 3,_,4,_ }, // 01011011
+        { _,_,0,1, 2,_,3,_ }, // 01011100
+        { 0,_,1,2, 3,_,4,_ }, // 01011101
+        { _,0,1,2, 3,_,4,_ }, // 01011110
+        { 0,1,2,3, 4,_,5,_ }, // 01011111
+        { _,_,_,_, _,0,1,_ }, // 01100000
+        { 0,_,_,_, _,1,2,_ }, // 01100001
+        { _,0,_,_, _,1,2,_ }, // 01100010
+        { 0,1,_,_, _,2,3,_ }, // 01100011
+        { _,_,0,_, _,1,2,_ }, // 01100100
+        { 0,_,1,_, _,2,3,_ }, // 01100101
+        { _,0,1,_, _,2,3,_ }, // 01100110
+        { 0,1,2,_, _,3,4,_ }, // 01100111
+        { _,_,_,0, _,1,2,_ }, // 01101000
+        { 0,_,_,1, _,2,3,_ }, // 01101001
+        { _,0,_,1, _,2,3,_ }, // 01101010
+        { 0,1,_,2, _,3,4,_ }, // 01101011
+        { _,_,0,1, _,2,3,_ }, // 01101100
+        { 0,_,1,2, _,3,4,_ }, // 01101101
+        { _,0,1,2, _,3,4,_ }, // 01101110
+        { 0,1,2,3, _,4,5,_ }, // 01101111
+        { _,_,_,_, 0,1,2,_ }, // 01110000
+        { 0,_,_,_, 1,2,3,_ }, // 01110001
+        { _,0,_,_, 1,2,3,_ }, // 01110010
+        { 0,1,_,_, 2,3,4,_ }, // 01110011
+        { _,_,0,_, 1,2,3,_ }, // 01110100
+        { 0,_,1,_, 2,3,4,_ }, // 01110101
+        { _,0,1,_, 2,3,4,_ }, // 01110110
+        { 0,1,2,_, 3,4,5,_ }, // 01110111
+        { _,_,_,0, 1,2,3,_ }, // 01111000
+        { 0,_,_,1, 2,3,4,_ }, // 01111001
+        { _,0,_,1, 2,3,4,_ }, // 01111010
+        { 0,1,_,2, 3,4,5,_ }, // 01111011
+        { _,_,0,1, 2,3,4,_ }, // 01111100
+        { 0,_,1,2, 3,4,5,_ }, // 01111101
+        { _,0,1,2, 3,4,5,_ }, // 01111110
+        { 0,1,2,3, 4,5,6,_ }, // 01111111
+        { _,_,_,_, _,_,_,0 }, // 10000000
+        { 0,_,_,_, _,_,_,1 }, // 10000001
+        { _,0,_,_, _,_,_,1 }, // 10000010
+        { 0,1,_,_, _,_,_,2 }, // 10000011
+        { _,_,0,_, _,_,_,1 }, // 10000100
+        { 0,_,1,_, _,_,_,2 }, // 10000101
+        { _,0,1,_, _,_,_,2 }, // 10000110
+        { 0,1,2,_, _,_,_,3 }, // 10000111
+        { _,_,_,0, _,_,_,1 }, // 10001000
+        { 0,_,_,1, _,_,_,2 }, // 10001001
+        { _,0,_,1, _,_,_,2 }, // 10001010
+        { 0,1,_,2, _,_,_,3 }, // 10001011
+        { _,_,0,1, _,_,_,2 }, // 10001100
+        { 0,_,1,2, _,_,_,3 }, // 10001101
+        { _,0,1,2, _,_,_,3 }, // 10001110
+        { 0,1,2,3, _,_,_,4 }, // 10001111
+        { _,_,_,_, 0,_,_,1 }, // 10010000
+        { 0,_,_,_, 1,_,_,2 }, // 10010001
+        { _,0,_,_, 1,_,_,2 }, // 10010010
+        { 0,1,_,_, 2,_,_,3 }, // 10010011
+        { _,_,0,_, 1,_,_,2 }, // 10010100
+        { 0,_,1,_, 2,_,_,3 }, // 10010101
+        { _,0,1,_, 2,_,_,3 }, // 10010110
+        { 0,1,2,_, 3,_,_,4 }, // 10010111
+        { _,_,_,0, 1,_,_,2 }, // 10011000
+        { 0,_,_,1, 2,_,_,3 }, // 10011001
+        { _,0,_,1, 2,_,_,3 }, // 10011010
+        { 0,1,_,2, 3,_,_,4 }, // 10011011
+        { _,_,0,1, 2,_,_,3 }, // 10011100
+        { 0,_,1,2, 3,_,_,4 }, // 10011101
+        { _,0,1,2, 3,_,_,4 }, // 10011110
+        { 0,1,2,3, 4,_,_,5 }, // 10011111
+        { _,_,_,_, _,0,_,1 }, // 10100000
+        { 0,_,_,_, _,1,_,2 }, // 10100001
+        { _,0,_,_, _,1,_,2 }, // 10100010
+        { 0,1,_,_, _,2,_,3 }, // 10100011
+        { _,_,0,_, _,1,_,2 }, // 10100100
+        { 0,_,1,_, _,2,_,3 }, // 10100101
+        { _,0,1,_, _,2,_,3 }, // 10100110
+        { 0,1,2,_, _,3,_,4 }, // 10100111
+        { _,_,_,0, _,1,_,2 }, // 10101000
+        { 0,_,_,1, _,2,_,3 }, // 10101001
+        { _,0,_,1, _,2,_,3 }, // 10101010
+        { 0,1,_,2, _,3,_,4 }, // 10101011
+        { _,_,0,1, _,2,_,3 }, // 10101100
+        { 0,_,1,2, _,3,_,4 }, // 10101101
+        { _,0,1,2, _,3,_,4 }, // 10101110
+        { 0,1,2,3, _,4,_,5 }, // 10101111
+        { _,_,_,_, 0,1,_,2 }, // 10110000
+        { 0,_,_,_, 1,2,_,3 }, // 10110001
+        { _,0,_,_, 1,2,_,3 }, // 10110010
+        { 0,1,_,_, 2,3,_,4 }, // 10110011
+        { _,_,0,_, 1,2,_,3 }, // 10110100
+        { 0,_,1,_, 2,3,_,4 }, // 10110101
+        { _,0,1,_, 2,3,_,4 }, // 10110110
+        { 0,1,2,_, 3,4,_,5 }, // 10110111
+        { _,_,_,0, 1,2,_,3 }, // 10111000
+        { 0,_,_,1, 2,3,_,4 }, // 10111001
+        { _,0,_,1, 2,3,_,4 }, // 10111010
+        { 0,1,_,2, 3,4,_,5 }, // 10111011
+        { _,_,0,1, 2,3,_,4 }, // 10111100
+        { 0,_,1,2, 3,4,_,5 }, // 10111101
+        { _,0,1,2, 3,4,_,5 }, // 10111110
+        { 0,1,2,3, 4,5,_,6 }, // 10111111
+        { _,_,_,_, _,_,0,1 }, // 11000000
+        { 0,_,_,_, _,_,1,2 }, // 11000001
+        { _,0,_,_, _,_,1,2 }, // 11000010
+        { 0,1,_,_, _,_,2,3 }, // 11000011
+        { _,_,0,_, _,_,1,2 }, // 11000100
+        { 0,_,1,_, _,_,2,3 }, // 11000101
+        { _,0,1,_, _,_,2,3 }, // 11000110
+        { 0,1,2,_, _,_,3,4 }, // 11000111
+        { _,_,_,0, _,_,1,2 }, // 11001000
+        { 0,_,_,1, _,_,2,3 }, // 11001001
+        { _,0,_,1, _,_,2,3 }, // 11001010
+        { 0,1,_,2, _,_,3,4 }, // 11001011
+        { _,_,0,1, _,_,2,3 }, // 11001100
+        { 0,_,1,2, _,_,3,4 }, // 11001101
+        { _,0,1,2, _,_,3,4 }, // 11001110
+        { 0,1,2,3, _,_,4,5 }, // 11001111
+        { _,_,_,_, 0,_,1,2 }, // 11010000
+        { 0,_,_,_, 1,_,2,3 }, // 11010001
+        { _,0,_,_, 1,_,2,3 }, // 11010010
+        { 0,1,_,_, 2,_,3,4 }, // 11010011
+        { _,_,0,_, 1,_,2,3 }, // 11010100
+        { 0,_,1,_, 2,_,3,4 }, // 11010101
+        { _,0,1,_, 2,_,3,4 }, // 11010110
+        { 0,1,2,_, 3,_,4,5 }, // 11010111
+        { _,_,_,0, 1,_,2,3 }, // 11011000
+        { 0,_,_,1, 2,_,3,4 }, // 11011001
+        { _,0,_,1, 2,_,3,4 }, // 11011010
+        { 0,1,_,2, 3,_,4,5 }, // 11011011
+        { _,_,0,1, 2,_,3,4 }, // 11011100
+        { 0,_,1,2, 3,_,4,5 }, // 11011101
+        { _,0,1,2, 3,_,4,5 }, // 11011110
+        { 0,1,2,3, 4,_,5,6 }, // 11011111
+        { _,_,_,_, _,0,1,2 }, // 11100000
+        { 0,_,_,_, _,1,2,3 }, // 11100001
+        { _,0,_,_, _,1,2,3 }, // 11100010
+        { 0,1,_,_, _,2,3,4 }, // 11100011
+        { _,_,0,_, _,1,2,3 }, // 11100100
+        { 0,_,1,_, _,2,3,4 }, // 11100101
+        { _,0,1,_, _,2,3,4 }, // 11100110
+        { 0,1,2,_, _,3,4,5 }, // 11100111
+        { _,_,_,0, _,1,2,3 }, // 11101000
+        { 0,_,_,1, _,2,3,4 }, // 11101001
+        { _,0,_,1, _,2,3,4 }, // 11101010
+        { 0,1,_,2, _,3,4,5 }, // 11101011
+        { _,_,0,1, _,2,3,4 }, // 11101100
+        { 0,_,1,2, _,3,4,5 }, // 11101101
+        { _,0,1,2, _,3,4,5 }, // 11101110
+        { 0,1,2,3, _,4,5,6 }, // 11101111
+        { _,_,_,_, 0,1,2,3 }, // 11110000
+        { 0,_,_,_, 1,2,3,4 }, // 11110001
+        { _,0,_,_, 1,2,3,4 }, // 11110010
+        { 0,1,_,_, 2,3,4,5 }, // 11110011
+        { _,_,0,_, 1,2,3,4 }, // 11110100
+        { 0,_,1,_, 2,3,4,5 }, // 11110101
+        { _,0,1,_, 2,3,4,5 }, // 11110110
+        { 0,1,2,_, 3,4,5,6 }, // 11110111
+        { _,_,_,0, 1,2,3,4 }, // 11111000
+        { 0,_,_,1, 2,3,4,5 }, // 11111001
+        { _,0,_,1, 2,3,4,5 }, // 11111010
+        { 0,1,_,2, 3,4,5,6 }, // 11111011
+        { _,_,0,1, 2,3,4,5 }, // 11111100
+        { 0,_,1,2, 3,4,5,6 }, // 11111101
+        { _,0,1,2, 3,4,5,6 }, // 11111110
+        { 0,1,2,3, 4,5,6,7 }, // 11111111
+#undef _
+    };
+
+    __m256i x = r->simd;
+
+    // NOTE: unsigned compare via the same bias trick as RansSimdDecRenorm.
+    __m256i x_biased = _mm256_xor_si256(x, _mm256_set1_epi32((int) 0x80000000));
+    __m256i greater = _mm256_cmpgt_epi32(_mm256_set1_epi32(RANS_WORD_L - 0x80000000), x_biased);
+    unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(greater));
+
+    // NOTE: this will read up to 16 bytes past the end of the input buffer;
+    // the same caveats as for RansSimdDecRenorm apply.
+    __m256i memvals = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)*pptr));
+    __m256i xshifted = _mm256_slli_epi32(x, 16);
+    __m256i perm = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)perms[mask]));
+    __m256i newx = _mm256_or_si256(xshifted, _mm256_permutevar8x32_epi32(memvals, perm));
+    r->simd = _mm256_blendv_epi8(x, newx, greater);
+    *pptr += _mm_popcnt_u32(mask);
+}
+
+// Checked decoding; see the notes on RansSimdDecRenormChecked.
+
+// Like RansAvx2DecInit. Fails if there aren't 16 words left or a state is
+// out of range.
+static inline bool RansAvx2DecInitChecked(RansAvx2Dec* r, uint16_t** pptr, uint16_t const* end)
+{
+    if (end - *pptr < 2*8)
+        return false;
+
+    RansAvx2DecInit(r, pptr);
+    __m256i x_biased = _mm256_xor_si256(r->simd, _mm256_set1_epi32((int) 0x80000000));
+    __m256i small = _mm256_cmpgt_epi32(_mm256_set1_epi32(RANS_WORD_L - 0x80000000), x_biased);
+    return _mm256_movemask_ps(_mm256_castsi256_ps(small)) == 0;
+}
+
+// Like RansAvx2DecRenorm. Fails if it would have to read past "end".
+static inline bool RansAvx2DecRenormChecked(RansAvx2Dec* r, uint16_t** pptr, uint16_t const* end)
+{
+    size_t avail = end - *pptr;
+    if (avail >= 8) {
+        RansAvx2DecRenorm(r, pptr);
+        return true;
+    }
+
+    // near the end: renormalize from a zero-padded copy
+    uint16_t tail[8] = { 0 };
+    memcpy(tail, *pptr, avail * sizeof(uint16_t));
+    uint16_t* ptr = tail;
+    RansAvx2Dec x = *r;
+    RansAvx2DecRenorm(&x, &ptr);
+    if ((size_t) (ptr - tail) > avail)
+        return false;
+
+    *r = x;
+    *pptr += ptr - tail;
+    return true;
+}
+
+// Returns whether all lanes are back to the encoder's initial state.
+static inline bool RansAvx2DecIsFinal(RansAvx2Dec const* r)
+{
+    __m256i eq = _mm256_cmpeq_epi32(r->simd, _mm256_set1_epi32(RANS_WORD_L));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(eq)) == 0xff;
+}
+
+// --------------------------------------------------------------------------
+
+typedef union {
+    __m256i simd;
+    uint32_t lane[8];
+} RansAvx2Enc;
+
+// Initializes an 8-way AVX2 rANS encoder.
+static inline void RansAvx2EncInit(RansAvx2Enc* r)
+{
+    r->simd = _mm256_set1_epi32(RANS_WORD_L);
+}
+
+// Encodes eight symbols in parallel; symbol i (in byte i of "s") goes
+// into lane i. See RansSimdEncPut for details.
+static inline void RansAvx2EncPut(RansAvx2Enc* r, uint16_t** pptr, RansWordEncSymbol const* syms, uint64_t s)
+{
+    // For every mask of lanes that emit a word, which lane goes into
+    // each of the 8 output words. The words are packed towards the end.
+    static ALIGNSPEC(int8_t const, perms[256][8], 8) = {
+#define _ -1 // for readability
+        { _,_,_,_, _,_,_,_ }, // 00000000
+        { _,_,_,_, _,_,_,0 }, // 00000001
+        { _,_,_,_, _,_,_,1 }, // 00000010
+        { _,_,_,_, _,_,0,1 }, // 00000011
+        { _,_,_,_, _,_,_,2 }, // 00000100
+        { _,_,_,_, _,_,0,2 }, // 00000101
+        { _,_,_,_, _,_,1,2 }, // 00000110
+        { _,_,_,_, _,0,1,2 }, // 00000111
+        { _,_,_,_, _,_,_,3 }, // 00001000
+        { _,_,_,_, _,_,0,3 }, // 00001001
+        { _,_,_,_, _,_,1,3 }, // 00001010
+        { _,_,_,_, _,0,1,3 }, // 00001011
+        { _,_,_,_, _,_,2,3 }, // 00001100
+        { _,_,_,_, _,0,2,3 }, // 00001101
+        { _,_,_,_, _,1,2,3 }, // 00001110
+        { _,_,_,_, 0,1,2,3 }, // 00001111
+        { _,_,_,_, _,_,_,4 }, // 00010000
+        { _,_,_,_, _,_,0,4 }, // 00010001
+        { _,_,_,_, _,_,1,4 }, // 00010010
+        { _,_,_,_, _,0,1,4 }, // 00010011
+        { _,_,_,_, _,_,2,4 }, // 00010100
+        { _,_,_,_, _,0,2,4 }, // 00010101
+        { _,_,_,_, _,1,2,4 }, // 00010110
+        { _,_,_,_, 0,1,2,4 }, // 00010111
+        { _,_,_,_, _,_,3,4 }, // 00011000
+        { _,_,_,_, _,0,3,4 }, // 00011001
+        { _,_,_,_, _,1,3,4 }, // 00011010
+        { _,_,_,_, 0,1,3,4 }, // 00011011
+        { _,_,_,_, _,2,3,4 }, // 00011100
+        { _,_,_,_, 0,2,3,4 }, // 00011101
+        { _,_,_,_, 1,2,3,4 }, // 00011110
+        { _,_,_,0, 1,2,3,4 }, // 00011111
+        { _,_,_,_, _,_,_,5 }, // 00100000
+        { _,_,_,_, _,_,0,5 }, // 00100001
+        { _,_,_,_, _,_,1,5 }, // 00100010
+        { _,_,_,_, _,0,1,5 }, // 00100011
+        { _,_,_,_, _,_,2,5 }, // 00100100
+        { _,_,_,_, _,0,2,5 }, // 00100101
+        { _,_,_,_, _,1,2,5 }, // 00100110
+        { _,_,_,_, 0,1,2,5 }, // 00100111
+        { _,_,_,_, _,_,3,5 }, // 00101000
+        { _,_,_,_, _,0,3,5 }, // 00101001
+        { _,_,_,_, _,1,3,5 }, // 00101010
+        { _,_,_,_, 0,1,3,5 }, // 00101011
+        { _,_,_,_, _,2,3,5 }, // 00101100
+        { _,_,_,_, 0,2,3,5 }, // 00101101
+        { _,_,_,_, 1,2,3,5 }, // 00101110
+        { _,_,_,0, 1,2,3,5 }, // 00101111
+        { _,_,_,_, _,_,4,5 }, // 00110000
+        { _,_,_,_, _,0,4,5 }, // 00110001
+        { _,_,_,_, _,1,4,5 }, // 00110010
+        { _,_,_,_, 0,1,4,5 }, // 00110011
+        { _,_,_,_, _,2,4,5 }, // 00110100
+        { _,_,_,_, 0,2,4,5 }, // 00110101
+        { _,_,_,_, 1,2,4,5 }, // 00110110
+        { _,_,_,0, 1,2,4,5 }, // 00110111
+        { _,_,_,_, _,3,4,5 }, // 00111000
+        { _,_,_,_, 0,3,4,5 }, // 00111001
+        { _,_,_,_, 1,3,4,5 }, // 00111010
+        { _,_,_,0, 1,3,4,5 }, // 00111011
+        { _,_,_,_, 2,3,4,5 }, // 00111100
+        { _,_,_,0, 2,3,4,5 }, // 00111101
+        { _,_,_,1, 2,3,4,5 }, // 00111110
+        { _,_,0,1, 2,3,4,5 }, // 00111111
+        { _,_,_,_, _,_,_,6 }, // 01000000
+        { _,_,_,_, _,_,0,6 }, // 01000001
+        { _,_,_,_, _,_,1,6 }, // 01000010
+        { _,_,_,_, _,0,1,6 }, // 01000011
+        { _,_,_,_, _,_,2,6 }, // 01000100
+        { _,_,_,_, _,0,2,6 }, // 01000101
+        { _,_,_,_, _,1,2,6 }, // 01000110
+        { _,_,_,_, 0,1,2,6 }, // 01000111
+        { _,_,_,_, _,_,3,6 }, // 01001000
+        { _,_,_,_, _,0,3,6 }, // 01001001
+        { _,_,_,_, _,1,3,6 }, // 01001010
+        { _,_,_,_, 0,1,3,6 }, // 01001011
+        { _,_,_,_, _,2,3,6 }, // 01001100
+        { _,_,_,_, 0,2,3,6 }, // 01001101
+        { _,_,_,_, 1,2,3,6 }, // 01001110
+        { _,_,_,0, 1,2,3,6 }, // 01001111
+        { _,_,_,_, _,_,4,6 }, // 01010000
+        { _,_,_,_, _,0,4,6 }, // 01010001
+        { _,_,_,_, _,1,4,6 }, // 01010010
+        { _,_,_,_, 0,1,4,6 }, // 01010011
+        { _,_,_,_, _,2,4,6 }, // 01010100
+        { _,_,_,_, 0,2,4,6 }, // 01010101
+        { _,_,_,_, 1,2,4,6 }, // 01010110
+        { _,_,_,0, 1,2,4,6 }, // 01010111
+        { _,_,_,_, _,3,4,6 }, // 01011000
+        { _,_,_,_, 0,3,4,6 }, // 01011001
+        { _,_,_,_, 1,3,4,6 }, // 01011010
+        { _,_,_,0, 1,3,4,6 }, // 01011011
+        { _,_,_,_, 2,3,4,6 }, // 01011100
+        { _,_,_,0, 2,3,4,6 }, // 01011101
+        { _,_,_,1, 2,3,4,6 }, // 01011110
+        { _,_,0,1, 2,3,4,6 }, // 01011111
+        { _,_,_,_, _,_,5,6 }, // 01100000
+        { _,_,_,_, _,0,5,6 }, // 01100001
+        { _,_,_,_, _,1,5,6 }, // 01100010
+        { _,_,_,_, 0,1,5,6 }, // 01100011
+        { _,_,_,_, _,2,5,6 }, // 01100100
+        { _,_,_,_, 0,2,5,6 }, // 01100101
+        { _,_,_,_, 1,2,5,6 }, // 01100110
+        { _,_,_,0, 1,2,5,6 }, // 01100111
+        { _,_,_,_, _,3,5,6 }, // 01101000
+        { _,_,_,_, 0,3,5,6 }, // 01101001
+        { _,_,_,_, 1,3,5,6 }, // 01101010
+        { _,_,_,0, 1,3,5,6 }, // 01101011
+        { _,_,_,_, 2,3,5,6 }, // 01101100
+        { _,_,_,0, 2,3,5,6 }, // 01101101
+        { _,_,_,1, 2,3,5,6 }, // 01101110
+        { _,_,0,1, 2,3,5,6 }, // 01101111
+        { _,_,_,_, _,4,5,6 }, // 01110000
+        { _,_,_,_, 0,4,5,6 }, // 01110001
+        { _,_,_,_, 1,4,5,6 }, // 01110010
+        { _,_,_,0, 1,4,5,6 }, // 01110011
+        { _,_,_,_, 2,4,5,6 }, // 01110100
+        { _,_,_,0, 2,4,5,6 }, // 01110101
+        { _,_,_,1, 2,4,5,6 }, // 01110110
+        { _,_,0,1, 2,4,5,6 }, // 01110111
+        { _,_,_,_, 3,4,5,6 }, // 01111000
+        { _,_,_,0, 3,4,5,6 }, // 01111001
+        { _,_,_,1, 3,4,5,6 }, // 01111010
+        { _,_,0,1, 3,4,5,6 }, // 01111011
+        { _,_,_,2, 3,4,5,6 }, // 01111100
+        { _,_,0,2, 3,4,5,6 }, // 01111101
+        { _,_,1,2, 3,4,5,6 }, // 01111110
+        { _,0,1,2, 3,4,5,6 }, // 01111111
+        { _,_,_,_, _,_,_,7 }, // 10000000
+        { _,_,_,_, _,_,0,7 }, // 10000001
+        { _,_,_,_, _,_,1,7 }, // 10000010
+        { _,_,_,_, _,0,1,7 }, // 10000011
+        { _,_,_,_, _,_,2,7 }, // 10000100
+        { _,_,_,_, _,0,2,7 }, // 10000101
+        { _,_,_,_, _,1,2,7 }, // 10000110
+        { _,_,_,_, 0,1,2,7 }, // 10000111
+        { _,_,_,_, _,_,3,7 }, // 10001000
+        { _,_,_,_, _,0,3,7 }, // 10001001
+        { _,_,_,_, _,1,3,7 }, // 10001010
+        { _,_,_,_, 0,1,3,7 }, // 10001011
+        { _,_,_,_, _,2,3,7 }, // 10001100
+        { _,_,_,_, 0,2,3,7 }, // 10001101
+        { _,_,_,_, 1,2,3,7 }, // 10001110
+        { _,_,_,0, 1,2,3,7 }, // 10001111
+        { _,_,_,_, _,_,4,7 }, // 10010000
+        { _,_,_,_, _,0,4,7 }, // 10010001
+        { _,_,_,_, _,1,4,7 }, // 10010010
+        { _,_,_,_, 0,1,4,7 }, // 10010011
+        { _,_,_,_, _,2,4,7 }, // 10010100
+        { _,_,_,_, 0,2,4,7 }, // 10010101
+        { _,_,_,_, 1,2,4,7 }, // 10010110
+        { _,_,_,0, 1,2,4,7 }, // 10010111
+        { _,_,_,_, _,3,4,7 }, // 10011000
+        { _,_,_,_, 0,3,4,7 }, // 10011001
+        { _,_,_,_, 1,3,4,7 }, // 10011010
+        { _,_,_,0, 1,3,4,7 }, // 10011011
+        { _,_,_,_, 2,3,4,7 }, // 10011100
+        { _,_,_,0, 2,3,4,7 }, // 10011101
+        { _,_,_,1, 2,3,4,7 }, // 10011110
+        { _,_,0,1, 2,3,4,7 }, // 10011111
+        { _,_,_,_, _,_,5,7 }, // 10100000
+        { _,_,_,_, _,0,5,7 }, // 10100001
+        { _,_,_,_, _,1,5,7 }, // 10100010
+        { _,_,_,_, 0,1,5,7 }, // 10100011
+        { _,_,_,_, _,2,5,7 }, // 10100100
+        { _,_,_,_, 0,2,5,7 }, // 10100101
+        { _,_,_,_, 1,2,5,7 }, // 10100110
+        { _,_,_,0, 1,2,5,7 }, // 10100111
+        { _,_,_,_, _,3,5,7 }, // 10101000
+        { _,_,_,_, 0,3,5,7 }, // 10101001
+        { _,_,_,_, 1,3,5,7 }, // 10101010
+        { _,_,_,0, 1,3,5,7 }, // 10101011
+        { _,_,_,_, 2,3,5,7 }, // 10101100
+        { _,_,_,0, 2,3,5,7 }, // 10101101
+        { _,_,_,1, 2,3,5,7 }, // 10101110
+        { _,_,0,1, 2,3,5,7 }, // 10101111
+        { _,_,_,_, _,4,5,7 }, // 10110000
+        { _,_,_,_, 0,4,5,7 }, // 10110001
+        { _,_,_,_, 1,4,5,7 }, // 10110010
+        { _,_,_,0, 1,4,5,7 }, // 10110011
+        { _,_,_,_, 2,4,5,7 }, // 10110100
+        { _,_,_,0, 2,4,5,7 }, // 10110101
+        { _,_,_,1, 2,4,5,7 }, // 10110110
+        { _,_,0,1, 2,4,5,7 }, // 10110111
+        { _,_,_,_, 3,4,5,7 }, // 10111000
+        { _,_,_,0, 3,4,5,7 }, // 10111001
+        { _,_,_,1, 3,4,5,7 }, // 10111010
+        { _,_,0,1, 3,4,5,7 }, // 10111011
+        { _,_,_,2, 3,4,5,7 }, // 10111100
+        { _,_,0,2, 3,4,5,7 }, // 10111101
+        { _,_,1,2, 3,4,5,7 }, // 10111110
+        { _,0,1,2, 3,4,5,7 }, // 10111111
+        { _,_,_,_, _,_,6,7 }, // 11000000
+        { _,_,_,_, _,0,6,7 }, // 11000001
+        { _,_,_,_, _,1,6,7 }, // 11000010
+        { _,_,_,_, 0,1,6,7 }, // 11000011
+        { _,_,_,_, _,2,6,7 }, // 11000100
+        { _,_,_,_, 0,2,6,7 }, // 11000101
+        { _,_,_,_, 1,2,6,7 }, // 11000110
+        { _,_,_,0, 1,2,6,7 }, // 11000111
+        { _,_,_,_, _,3,6,7 }, // 11001000
+        { _,_,_,_, 0,3,6,7 }, // 11001001
+        { _,_,_,_, 1,3,6,7 }, // 11001010
+        { _,_,_,0, 1,3,6,7 }, // 11001011
+        { _,_,_,_, 2,3,6,7 }, // 11001100
+        { _,_,_,0, 2,3,6,7 }, // 11001101
+        { _,_,_,1, 2,3,6,7 }, // 11001110
+        { _,_,0,1, 2,3,6,7 }, // 11001111
+        { _,_,_,_, _,4,6,7 }, // 11010000
+        { _,_,_,_, 0,4,6,7 }, // 11010001
+        { _,_,_,_, 1,4,6,7 }, // 11010010
+        { _,_,_,0, 1,4,6,7 }, // 11010011
+        { _,_,_,_, 2,4,6,7 }, // 11010100
+        { _,_,_,0, 2,4,6,7 }, // 11010101
+        { _,_,_,1, 2,4,6,7 }, // 11010110
+        { _,_,0,1, 2,4,6,7 }, // 11010111
+        { _,_,_,_, 3,4,6,7 }, // 11011000
+        { _,_,_,0, 3,4,6,7 }, // 11011001
+        { _,_,_,1, 3,4,6,7 }, // 11011010
+        { _,_,0,1, 3,4,6,7 }, // 11011011
+        { _,_,_,2, 3,4,6,7 }, // 11011100
+        { _,_,0,2, 3,4,6,7 }, // 11011101
+        { _,_,1,2, 3,4,6,7 }, // 11011110
+        { _,0,1,2, 3,4,6,7 }, // 11011111
+        { _,_,_,_, _,5,6,7 }, // 11100000
+        { _,_,_,_, 0,5,6,7 }, // 11100001
+        { _,_,_,_, 1,5,6,7 }, // 11100010
+        { _,_,_,0, 1,5,6,7 }, // 11100011
+        { _,_,_,_, 2,5,6,7 }, // 11100100
+        { _,_,_,0, 2,5,6,7 }, // 11100101
+        { _,_,_,1, 2,5,6,7 }, // 11100110
+        { _,_,0,1, 2,5,6,7 }, // 11100111
+        { _,_,_,_, 3,5,6,7 }, // 11101000
+        { _,_,_,0, 3,5,6,7 }, // 11101001
+        { _,_,_,1, 3,5,6,7 }, // 11101010
+        { _,_,0,1, 3,5,6,7 }, // 11101011
+        { _,_,_,2, 3,5,6,7 }, // 11101100
+        { _,_,0,2, 3,5,6,7 }, // 11101101
+        { _,_,1,2, 3,5,6,7 }, // 11101110
+        { _,0,1,2, 3,5,6,7 }, // 11101111
+        { _,_,_,_, 4,5,6,7 }, // 11110000
+        { _,_,_,0, 4,5,6,7 }, // 11110001
+        { _,_,_,1, 4,5,6,7 }, // 11110010
+        { _,_,0,1, 4,5,6,7 }, // 11110011
+        { _,_,_,2, 4,5,6,7 }, // 11110100
+        { _,_,0,2, 4,5,6,7 }, // 11110101
+        { _,_,1,2, 4,5,6,7 }, // 11110110
+        { _,0,1,2, 4,5,6,7 }, // 11110111
+        { _,_,_,3, 4,5,6,7 }, // 11111000
+        { _,_,0,3, 4,5,6,7 }, // 11111001
+        { _,_,1,3, 4,5,6,7 }, // 11111010
+        { _,0,1,3, 4,5,6,7 }, // 11111011
+        { _,_,2,3, 4,5,6,7 }, // 11111100
+        { _,0,2,3, 4,5,6,7 }, // 11111101
+        { _,1,2,3, 4,5,6,7 }, // 11111110
+        { 0,1,2,3, 4,5,6,7 }, // 11111111
+#undef _
+    };
+
+    // load symbol descriptions (lanes i and i+4 share a register) and
+    // transpose them within 128-bit halves
+    __m256i e0 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&syms[(s >>  0) & 0xff])), _mm_loadu_si128((const __m128i*)&syms[(s >> 32) & 0xff]), 1);
+    __m256i e1 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&syms[(s >>  8) & 0xff])), _mm_loadu_si128((const __m128i*)&syms[(s >> 40) & 0xff]), 1);
+    __m256i e2 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&syms[(s >> 16) & 0xff])), _mm_loadu_si128((const __m128i*)&syms[(s >> 48) & 0xff]), 1);
+    __m256i e3 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&syms[(s >> 24) & 0xff])), _mm_loadu_si128((const __m128i*)&syms[(s >> 56) & 0xff]), 1);
+    __m256i t0 = _mm256_unpacklo_epi32(e0, e1);
+    __m256i t1 = _mm256_unpacklo_epi32(e2, e3);
+    __m256i t2 = _mm256_unpackhi_epi32(e0, e1);
+    __m256i t3 = _mm256_unpackhi_epi32(e2, e3);
+    __m256i x_max = _mm256_unpacklo_epi64(t0, t1);
+    __m256i rcp_freq = _mm256_unpackhi_epi64(t0, t1);
+    __m256i freq = _mm256_unpacklo_epi64(t2, t3);
+    __m256i start = _mm256_unpackhi_epi64(t2, t3);
+
+    // renormalize
+    // NOTE: like RansSimdEncPut, this stores 16 bytes right below the
+    // current position, of which only the last popcnt(mask)*2 are valid.
+    __m256i x = r->simd;
+    __m256i greater = _mm256_cmpeq_epi32(_mm256_max_epu32(x, x_max), x); // x >= x_max (unsigned)
+    unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(greater));
+    __m256i perm = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)perms[mask]));
+    __m256i words = _mm256_and_si256(_mm256_permutevar8x32_epi32(x, perm), _mm256_set1_epi32(0xffff));
+    words = _mm256_permute4x64_epi64(_mm256_packus_epi32(words, words), 0x08);
+    _mm_storeu_si128((__m128i*)(*pptr - 8), _mm256_castsi256_si128(words));
+    *pptr -= _mm_popcnt_u32(mask);
+    x = _mm256_blendv_epi8(x, _mm256_srli_epi32(x, 16), greater);
+
+    // q = mul_hi(x, rcp_freq)
+    __m256i q_even = _mm256_srli_epi64(_mm256_mul_epu32(x, rcp_freq), 32);
+    __m256i q_odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), _mm256_srli_epi64(rcp_freq, 32));
+    __m256i q = _mm256_blend_epi32(q_even, q_odd, 0xaa);
+
+    // r = x - q*freq, then fix up if q was one too small
+    __m256i rem = _mm256_sub_epi32(x, _mm256_mullo_epi32(q, freq));
+    __m256i fix = _mm256_cmpgt_epi32(rem, _mm256_sub_epi32(freq, _mm256_set1_epi32(1)));
+    q = _mm256_sub_epi32(q, fix);
+    rem = _mm256_sub_epi32(rem, _mm256_and_si256(fix, freq));
+
+    // x = C(s,x)
+    r->simd = _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(q, RANS_WORD_SCALE_BITS), rem), start);
+}
+
+// Flushes an 8-way AVX2 rANS encoder.
+static inline void RansAvx2EncFlush(RansAvx2Enc* r, uint16_t** pptr)
+{
+    *pptr -= 2*8;
+    _mm256_storeu_si256((__m256i*)*pptr, r->simd);
+}
+
+#endif // RANS_WORD_AVX2_HEADER
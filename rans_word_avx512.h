@@ -0,0 +1,172 @@
+// Word-aligned AVX-512 rANS encoder/decoder - public domain
+//
+// This is a 16-way interleaved version of the SIMD coder in
+// rans_word_sse41.h, with all 16 states in a single 512-bit register.
+// It uses the same RansWordTables/RansWordEncSymbol and the same
+// word-interleaving rules, just with 16 streams instead of 8 (stream i
+// goes into lane i; see main_simd.cpp for the matching scalar encoder).
+//
+// Instead of the pshufb tables used by the SSE 4.1 and AVX2 versions,
+// renormalization uses AVX-512 expand (decoder) and compress (encoder)
+// with the lane masks directly. Needs AVX-512 F, BW and VL.
+//
+// Unlike rans_byte.h, this file needs to be compiled as C++.
+
+#ifndef RANS_WORD_AVX512_HEADER
+#define RANS_WORD_AVX512_HEADER
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "rans_word_sse41.h"
+
+// --------------------------------------------------------------------------
+
+typedef union {
+    __m512i simd;
+    uint32_t lane[16];
+} RansAvx512Dec;
+
+typedef union {
+    __m512i simd;
+    uint32_t lane[16];
+} RansAvx512Enc;
+
+// Initializes a 16-way AVX-512 rANS decoder.
+static inline void RansAvx512DecInit(RansAvx512Dec* r, uint16_t** pptr)
+{
+    r->simd = _mm512_loadu_si512((const void*)*pptr);
+    *pptr += 2*16;
+}
+
+// Decodes sixteen symbols in parallel using the given tables.
+// Symbol i (decoded from lane i) ends up in byte i of the result.
+static inline __m128i RansAvx512DecSym(RansAvx512Dec* r, RansWordTables const* tab)
+{
+    __m512i x = r->simd;
+    __m512i slots = _mm512_and_si512(x, _mm512_set1_epi32(RANS_WORD_M - 1));
+
+    // gather freq_bias and symbols (see RansAvx2DecSym for the latter)
+    __m512i freq_bias = _mm512_i32gather_epi32(slots, (const void*)tab->slots, 4);
+    __m512i syms = _mm512_i32gather_epi32(slots, (const void*)(tab->slot2sym - 3), 1);
+
+    // s, x = D(x)
+    __m512i xscaled = _mm512_srli_epi32(x, RANS_WORD_SCALE_BITS);
+    __m512i freq = _mm512_and_si512(freq_bias, _mm512_set1_epi32(0xffff));
+    __m512i bias = _mm512_srli_epi32(freq_bias, 16);
+    r->simd = _mm512_add_epi32(_mm512_mullo_epi32(xscaled, freq), bias);
+
+    return _mm512_cvtepi32_epi8(_mm512_srli_epi32(syms, 24));
+}
+
+// Renormalize after decoding sixteen symbols.
+static inline void RansAvx512DecRenorm(RansAvx512Dec* r, uint16_t** pptr)
+{
+    __m512i x = r->simd;
+    __mmask16 mask = _mm512_cmplt_epu32_mask(x, _mm512_set1_epi32(RANS_WORD_L));
+
+    // Zero-extend the next 16 words, then expand the first popcnt(mask)
+    // of them into the lanes that need a new word.
+    // (A 16-bit expand would save the zero-extension, but needs VBMI2.)
+    // NOTE: this will read up to 32 bytes past the end of the input buffer;
+    // the same caveats as for RansSimdDecRenorm apply.
+    __m512i memvals = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)*pptr));
+    __m512i newbits = _mm512_maskz_expand_epi32(mask, memvals);
+    r->simd = _mm512_mask_or_epi32(x, mask, _mm512_slli_epi32(x, 16), newbits);
+    *pptr += _mm_popcnt_u32(mask);
+}
+
+// Checked decoding; see the notes on RansSimdDecRenormChecked.
+
+// Like RansAvx512DecInit. Fails if there aren't 32 words left or a state
+// is out of range.
+static inline bool RansAvx512DecInitChecked(RansAvx512Dec* r, uint16_t** pptr, uint16_t const* end)
+{
+    if (end - *pptr < 2*16)
+        return false;
+
+    RansAvx512DecInit(r, pptr);
+    return _mm512_cmplt_epu32_mask(r->simd, _mm512_set1_epi32(RANS_WORD_L)) == 0;
+}
+
+// Like RansAvx512DecRenorm. Fails if it would have to read past "end".
+static inline bool RansAvx512DecRenormChecked(RansAvx512Dec* r, uint16_t** pptr, uint16_t const* end)
+{
+    size_t avail = end - *pptr;
+    if (avail >= 16) {
+        RansAvx512DecRenorm(r, pptr);
+        return true;
+    }
+
+    // Near the end, a masked load does the job: lanes that need a word
+    // come first in memory order, so loading just the words we have is
+    // enough, and if that's fewer than needed, the stream is truncated.
+    __m512i x = r->simd;
+    __mmask16 mask = _mm512_cmplt_epu32_mask(x, _mm512_set1_epi32(RANS_WORD_L));
+    uint32_t count = _mm_popcnt_u32(mask);
+    if (count > avail)
+        return false;
+
+    __m256i words = _mm256_maskz_loadu_epi16((__mmask16) ((1u << count) - 1), *pptr);
+    __m512i newbits = _mm512_maskz_expand_epi32(mask, _mm512_cvtepu16_epi32(words));
+    r->simd = _mm512_mask_or_epi32(x, mask, _mm512_slli_epi32(x, 16), newbits);
+    *pptr += count;
+    return true;
+}
+
+// Returns whether all lanes are back to the encoder's initial state.
+static inline bool RansAvx512DecIsFinal(RansAvx512Dec const* r)
+{
+    return _mm512_cmpeq_epu32_mask(r->simd, _mm512_set1_epi32(RANS_WORD_L)) == 0xffff;
+}
+
+// Initializes a 16-way AVX-512 rANS encoder.
+static inline void RansAvx512EncInit(RansAvx512Enc* r)
+{
+    r->simd = _mm512_set1_epi32(RANS_WORD_L);
+}
+
+// Encodes sixteen symbols in parallel; symbol i (in byte i of "s") goes
+// into lane i. See RansSimdEncPut for details.
+static inline void RansAvx512EncPut(RansAvx512Enc* r, uint16_t** pptr, RansWordEncSymbol const* syms, __m128i s)
+{
+    // gather symbol descriptions; RansWordEncSymbol is 4 dwords
+    __m512i idx = _mm512_slli_epi32(_mm512_cvtepu8_epi32(s), 2);
+    __m512i x_max = _mm512_i32gather_epi32(idx, (const void*)&syms->x_max, 4);
+    __m512i rcp_freq = _mm512_i32gather_epi32(idx, (const void*)&syms->rcp_freq, 4);
+    __m512i freq = _mm512_i32gather_epi32(idx, (const void*)&syms->freq, 4);
+    __m512i start = _mm512_i32gather_epi32(idx, (const void*)&syms->start, 4);
+
+    // renormalize: compress the low words of the lanes that emit one,
+    // in lane order, and store them right below the current position.
+    __m512i x = r->simd;
+    __mmask16 mask = _mm512_cmpge_epu32_mask(x, x_max);
+    unsigned int count = _mm_popcnt_u32(mask);
+    __m256i words = _mm512_cvtepi32_epi16(_mm512_maskz_compress_epi32(mask, x));
+    *pptr -= count;
+    _mm256_mask_storeu_epi16((void*)*pptr, (__mmask16) ((1u << count) - 1), words);
+    x = _mm512_mask_srli_epi32(x, mask, x, 16);
+
+    // q = mul_hi(x, rcp_freq)
+    __m512i q_even = _mm512_srli_epi64(_mm512_mul_epu32(x, rcp_freq), 32);
+    __m512i q_odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), _mm512_srli_epi64(rcp_freq, 32));
+    __m512i q = _mm512_mask_blend_epi32(0xaaaa, q_even, q_odd);
+
+    // r = x - q*freq, then fix up if q was one too small
+    __m512i rem = _mm512_sub_epi32(x, _mm512_mullo_epi32(q, freq));
+    __mmask16 fix = _mm512_cmpge_epu32_mask(rem, freq);
+    q = _mm512_mask_add_epi32(q, fix, q, _mm512_set1_epi32(1));
+    rem = _mm512_mask_sub_epi32(rem, fix, rem, freq);
+
+    // x = C(s,x)
+    r->simd = _mm512_add_epi32(_mm512_add_epi32(_mm512_slli_epi32(q, RANS_WORD_SCALE_BITS), rem), start);
+}
+
+// Flushes a 16-way AVX-512 rANS encoder.
+static inline void RansAvx512EncFlush(RansAvx512Enc* r, uint16_t** pptr)
+{
+    *pptr -= 2*16;
+    _mm512_storeu_si512((void*)*pptr, r->simd);
+}
+
+#endif // RANS_WORD_AVX512_HEADER
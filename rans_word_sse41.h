@@ -1,15 +1,18 @@
 // Word-aligned SSE 4.1 rANS encoder/decoder - public domain - Fabian 'ryg' Giesen
 //
-// This implementation has a regular rANS encoder and a 4-way interleaved SIMD
-// decoder. Like rans_byte.h, it's intended to illustrate the idea, not to
+// This implementation has a regular rANS encoder and 4-way interleaved SIMD
+// encoders and decoders. Like rans_byte.h, it's intended to illustrate the idea, not to
 // be used as a drop-in arithmetic coder.
 
 #ifndef RANS_WORD_SSE41_HEADER
 #define RANS_WORD_SSE41_HEADER
 
 #include <stdint.h>
+#include <string.h>
 #include <smmintrin.h>
 
+#include "rans_instrument.h"
+
 // READ ME FIRST:
 //
 // The intention in this version is to demonstrate a design where the decoder
@@ -71,6 +74,27 @@ static inline void RansWordTablesInitSymbol(RansWordTables* tab, uint8_t sym, ui
     }
 }
 
+// Builds the whole table for the normalized frequencies "freqs" (which
+// must sum to RANS_WORD_M). Same result as calling RansWordTablesInitSymbol
+// for every symbol, but constexpr, so static distributions can be baked
+// in at compile time (see rans_static.h).
+template<int NumSyms>
+static constexpr RansWordTables RansWordTablesMake(uint32_t const (&freqs)[NumSyms])
+{
+    RansWordTables tab = {};
+    uint32_t start = 0;
+    for (int s=0; s < NumSyms; s++) {
+        for (uint32_t i=0; i < freqs[s]; i++) {
+            // u32 is the first member, so that's the one that gets
+            // initialized: freq in the low half, bias in the high half.
+            tab.slots[start + i] = RansWordSlot { freqs[s] | (i << 16) };
+            tab.slot2sym[start + i] = (uint8_t) s;
+        }
+        start += freqs[s];
+    }
+    return tab;
+}
+
 // Initialize a rANS encoder
 static inline RansWordEnc RansWordEncInit()
 {
@@ -82,6 +106,8 @@ static inline void RansWordEncPut(RansWordEnc* r, uint16_t** pptr, uint32_t star
 {
     // renormalize
     uint32_t x = *r;
+    RANS_COUNT(RansCountEnc(&RansGetCounters()->word, RansCountCost(freq, RANS_WORD_SCALE_BITS),
+        x >= ((RANS_WORD_L >> RANS_WORD_SCALE_BITS) << 16) * freq));
     if (x >= ((RANS_WORD_L >> RANS_WORD_SCALE_BITS) << 16) * freq) {
         *pptr -= 1;
         **pptr = (uint16_t) (x & 0xffff);
@@ -134,6 +160,7 @@ static inline uint8_t RansWordDecSym(RansWordDec* r, RansWordTables const* tab)
 static inline void RansWordDecRenorm(RansWordDec* r, uint16_t** pptr)
 {
     uint32_t x = *r;
+    RANS_COUNT(RansCountDec(&RansGetCounters()->word, x < RANS_WORD_L));
     if (x < RANS_WORD_L) {
         *r = (x << 16) | **pptr;
         *pptr += 1;
@@ -217,13 +244,225 @@ static inline void RansSimdDecRenorm(RansSimdDec* r, uint16_t** pptr)
 
     // NOTE: this will read slightly past the end of the input buffer.
     // In practice, either pad the input buffer by 8 bytes at the end,
-    // or switch to the non-SIMD version once you get close to the end.
+    // or use RansSimdDecRenormChecked once you get close to the end.
     __m128i memvals = _mm_loadl_epi64((const __m128i*)*pptr);
     __m128i xshifted = _mm_slli_epi32(x, 16);
     __m128i shufmask = _mm_load_si128((const __m128i*)shuffles[mask]);
     __m128i newx = _mm_or_si128(xshifted, _mm_shuffle_epi8(memvals, shufmask));
     r->simd = _mm_blendv_epi8(x, newx, greater);
     *pptr += numbits[mask];
+    RANS_COUNT(RansCountSimdDec(&RansGetCounters()->word, numbits[mask]));
+}
+
+// --------------------------------------------------------------------------
+
+// Checked decoding, for untrusted input. These take an "end" pointer
+// (exclusive) and never read at or past it; they return false if the
+// stream is truncated or plainly corrupt.
+//
+// Same reasoning as in rans_byte.h: decoding never increases a state, so
+// if all states start out >= RANS_WORD_L, every lane reads at most one
+// word per symbol, even for corrupt data. RansSimdDecRenorm is safe as
+// long as there are 4 words left (it loads 8 bytes); the checked version
+// below only does extra work when that's not the case. After the last
+// symbol (and its renorm), every state is back to RANS_WORD_L.
+
+// Like RansWordDecInit. Fails if there aren't 2 words left or the state
+// is out of range.
+static inline bool RansWordDecInitChecked(RansWordDec* r, uint16_t** pptr, uint16_t const* end)
+{
+    if (end - *pptr < 2)
+        return false;
+
+    RansWordDecInit(r, pptr);
+    return *r >= RANS_WORD_L;
+}
+
+// Like RansWordDecRenorm. Fails if it would have to read past "end".
+static inline bool RansWordDecRenormChecked(RansWordDec* r, uint16_t** pptr, uint16_t const* end)
+{
+    if (*r < RANS_WORD_L && *pptr == end)
+        return false;
+    RansWordDecRenorm(r, pptr);
+    return true;
+}
+
+// Like RansSimdDecInit, with the same checks as RansWordDecInitChecked.
+static inline bool RansSimdDecInitChecked(RansSimdDec* r, uint16_t** pptr, uint16_t const* end)
+{
+    if (end - *pptr < 2*4)
+        return false;
+
+    RansSimdDecInit(r, pptr);
+    __m128i x_biased = _mm_xor_si128(r->simd, _mm_set1_epi32((int) 0x80000000));
+    __m128i small = _mm_cmpgt_epi32(_mm_set1_epi32(RANS_WORD_L - 0x80000000), x_biased);
+    return _mm_movemask_ps(_mm_castsi128_ps(small)) == 0;
+}
+
+// Like RansSimdDecRenorm. Fails if it would have to read past "end".
+static inline bool RansSimdDecRenormChecked(RansSimdDec* r, uint16_t** pptr, uint16_t const* end)
+{
+    size_t avail = end - *pptr;
+    if (avail >= 4) {
+        RansSimdDecRenorm(r, pptr);
+        return true;
+    }
+
+    // near the end: renormalize from a zero-padded copy
+    uint16_t tail[4] = { 0 };
+    memcpy(tail, *pptr, avail * sizeof(uint16_t));
+    uint16_t* ptr = tail;
+    RansSimdDec x = *r;
+    RansSimdDecRenorm(&x, &ptr);
+    if ((size_t) (ptr - tail) > avail)
+        return false;
+
+    *r = x;
+    *pptr += ptr - tail;
+    return true;
+}
+
+// Returns whether all lanes are back to the encoder's initial state.
+static inline bool RansSimdDecIsFinal(RansSimdDec const* r)
+{
+    __m128i eq = _mm_cmpeq_epi32(r->simd, _mm_set1_epi32(RANS_WORD_L));
+    return _mm_movemask_ps(_mm_castsi128_ps(eq)) == 0xf;
+}
+
+// --------------------------------------------------------------------------
+
+// SIMD encoder. This produces the exact same bitstream as running
+// RansWordEncPut on the four lanes in reverse order (lane 3 first, lane 0
+// last), but uses reciprocals instead of divides.
+
+// Encoder symbol description. This is 16 bytes so all four fields can be
+// fetched with a single load per lane and then transposed.
+struct RansWordEncSymbol {
+    uint32_t x_max;     // (Exclusive) upper bound of pre-normalization interval
+    uint32_t rcp_freq;  // Fixed-point reciprocal frequency
+    uint32_t freq;      // Symbol frequency
+    uint32_t start;     // Start of range
+};
+
+typedef union {
+    __m128i simd;
+    uint32_t lane[4];
+} RansSimdEnc;
+
+// Returns an encoder symbol for start "start" and frequency "freq". This
+// is constexpr, so tables for fixed distributions can be built at compile
+// time (see rans_static.h).
+static constexpr RansWordEncSymbol RansWordEncSymbolMake(uint32_t start, uint32_t freq)
+{
+    // x_max is the same (wrapping) value as computed in RansWordEncPut.
+    //
+    // Unlike rans_byte.h, our states use all 32 bits, so there's no exact
+    // 32-bit reciprocal. We use rcp_freq = floor((2^32-1)/freq) instead,
+    // which gives an estimate for the quotient q'=mul_hi(x, rcp_freq) with
+    //   x/freq - x/2^32 <= q' <= x/freq.
+    // Since x < x_max <= 2^32 after renormalization, q' is either the
+    // correct quotient or off by one; the encoder checks the remainder
+    // and fixes it up. (freq=0 symbols can't be encoded.)
+    return RansWordEncSymbol {
+        ((RANS_WORD_L >> RANS_WORD_SCALE_BITS) << 16) * freq,   // x_max
+        freq ? 0xffffffffu / freq : 0,                          // rcp_freq
+        freq,
+        start
+    };
+}
+
+// Initializes an encoder symbol to start "start" and frequency "freq"
+static inline void RansWordEncSymbolInit(RansWordEncSymbol* s, uint32_t start, uint32_t freq)
+{
+    *s = RansWordEncSymbolMake(start, freq);
+}
+
+// Initializes a SIMD rANS encoder.
+static inline void RansSimdEncInit(RansSimdEnc* r)
+{
+    r->simd = _mm_set1_epi32(RANS_WORD_L);
+}
+
+// Encodes four symbols in parallel; symbol i (in byte i of "s") goes
+// into lane i.
+static inline void RansSimdEncPut(RansSimdEnc* r, uint16_t** pptr, RansWordEncSymbol const* syms, uint32_t s)
+{
+    // For every mask of lanes that emit a word, the shuffle that moves
+    // their low 16 bits, in lane order, to the *end* of the low 8 bytes.
+    static ALIGNSPEC(int8_t const, shuffles[16][16], 16) = {
+#define _ -1 // for readability
+        { _,_,_,_, _,_,_,_, _,_,_,_, _,_,_,_ }, // 0000
+        { _,_,_,_, _,_,0,1, _,_,_,_, _,_,_,_ }, // 0001
+        { _,_,_,_, _,_,4,5, _,_,_,_, _,_,_,_ }, // 0010
+        { _,_,_,_, 0,1,4,5, _,_,_,_, _,_,_,_ }, // 0011
+        { _,_,_,_, _,_,8,9, _,_,_,_, _,_,_,_ }, // 0100
+        { _,_,_,_, 0,1,8,9, _,_,_,_, _,_,_,_ }, // 0101
+        { _,_,_,_, 4,5,8,9, _,_,_,_, _,_,_,_ }, // 0110
+        { _,_,0,1, 4,5,8,9, _,_,_,_, _,_,_,_ }, // 0111
+        { _,_,_,_, _,_,12,13, _,_,_,_, _,_,_,_ }, // 1000
+        { _,_,_,_, 0,1,12,13, _,_,_,_, _,_,_,_ }, // 1001
+        { _,_,_,_, 4,5,12,13, _,_,_,_, _,_,_,_ }, // 1010
+        { _,_,0,1, 4,5,12,13, _,_,_,_, _,_,_,_ }, // 1011
+        { _,_,_,_, 8,9,12,13, _,_,_,_, _,_,_,_ }, // 1100
+        { _,_,0,1, 8,9,12,13, _,_,_,_, _,_,_,_ }, // 1101
+        { _,_,4,5, 8,9,12,13, _,_,_,_, _,_,_,_ }, // 1110
+        { 0,1,4,5, 8,9,12,13, _,_,_,_, _,_,_,_ }, // 1111
+#undef _
+    };
+    static uint8_t const numbits[16] = {
+        0,1,1,2, 1,2,2,3, 1,2,2,3, 2,3,3,4
+    };
+
+    // load symbol descriptions and transpose them
+    __m128i e0 = _mm_loadu_si128((const __m128i*)&syms[(s >>  0) & 0xff]);
+    __m128i e1 = _mm_loadu_si128((const __m128i*)&syms[(s >>  8) & 0xff]);
+    __m128i e2 = _mm_loadu_si128((const __m128i*)&syms[(s >> 16) & 0xff]);
+    __m128i e3 = _mm_loadu_si128((const __m128i*)&syms[(s >> 24) & 0xff]);
+    __m128i t0 = _mm_unpacklo_epi32(e0, e1);
+    __m128i t1 = _mm_unpacklo_epi32(e2, e3);
+    __m128i t2 = _mm_unpackhi_epi32(e0, e1);
+    __m128i t3 = _mm_unpackhi_epi32(e2, e3);
+    __m128i x_max = _mm_unpacklo_epi64(t0, t1);
+    __m128i rcp_freq = _mm_unpackhi_epi64(t0, t1);
+    __m128i freq = _mm_unpacklo_epi64(t2, t3);
+    __m128i start = _mm_unpackhi_epi64(t2, t3);
+
+    // renormalize
+    // NOTE: this always stores 8 bytes right below the current position,
+    // only the last numbits[mask]*2 of which are valid. The rest is below
+    // the new write pointer and gets overwritten later (at the latest, by
+    // RansSimdEncFlush).
+    __m128i x = r->simd;
+    __m128i greater = _mm_cmpeq_epi32(_mm_max_epu32(x, x_max), x); // x >= x_max (unsigned)
+    unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(greater));
+    __m128i shufmask = _mm_load_si128((const __m128i*)shuffles[mask]);
+    _mm_storel_epi64((__m128i*)(*pptr - 4), _mm_shuffle_epi8(x, shufmask));
+    *pptr -= numbits[mask];
+    x = _mm_blendv_epi8(x, _mm_srli_epi32(x, 16), greater);
+    RANS_COUNT(RansCountSimdEnc(&RansGetCounters()->word, numbits[mask]));
+    RANS_COUNT(for (int i=0; i < 4; i++)
+        RansCountEncCost(&RansGetCounters()->word, RansCountCost(syms[(s >> (i*8)) & 0xff].freq, RANS_WORD_SCALE_BITS)));
+
+    // q = mul_hi(x, rcp_freq)
+    __m128i q_even = _mm_srli_epi64(_mm_mul_epu32(x, rcp_freq), 32);
+    __m128i q_odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), _mm_srli_epi64(rcp_freq, 32));
+    __m128i q = _mm_blend_epi16(q_even, q_odd, 0xcc);
+
+    // r = x - q*freq, then fix up if q was one too small
+    __m128i rem = _mm_sub_epi32(x, _mm_mullo_epi32(q, freq));
+    __m128i fix = _mm_cmpgt_epi32(rem, _mm_sub_epi32(freq, _mm_set1_epi32(1)));
+    q = _mm_sub_epi32(q, fix);
+    rem = _mm_sub_epi32(rem, _mm_and_si128(fix, freq));
+
+    // x = C(s,x)
+    r->simd = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(q, RANS_WORD_SCALE_BITS), rem), start);
+}
+
+// Flushes a SIMD rANS encoder. Same as RansWordEncFlush on lanes 3, 2, 1, 0.
+static inline void RansSimdEncFlush(RansSimdEnc* r, uint16_t** pptr)
+{
+    *pptr -= 2*4;
+    _mm_storeu_si128((__m128i*)*pptr, r->simd);
 }
 
 #endif // RANS_WORD_SSE41_HEADER